@@ -1,6 +1,7 @@
 #!/bin/sh
 #../src/objanalyze.cc
 ../src/objcompress.cc
+../src/objbench.cc
 ../src/testing/all_codepoints.cc
 ../src/testing/good_codepoints.cc
 ../src/testing/hex_sanity.cc
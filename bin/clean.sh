@@ -1,6 +1,7 @@
 #!/bin/sh
 # rm -f objanalyze
 rm -f objcompress
+rm -f objbench
 rm -f all_codepoints
 rm -f good_codepoints
 rm -f hex_sanity
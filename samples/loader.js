@@ -17,7 +17,14 @@
 //       }
 //     ],
 //     ...
-//   }
+//   },
+//   instances: [
+//     { name: 'object name', material: 'material_name',
+//       url: 'url', mesh: #, group: #,
+//       offset: [#, #, #], rotation: [#, #, #, #], scale: #
+//     },
+//     ...
+//   ]
 // }
 var MODELS = {};
 
@@ -178,6 +185,212 @@ function accumulateNormal(i0, i1, i2, attribsOutFixed, crosses) {
   crosses[3*i2 + 2] += p0z;
 }
 
+// Mirrors VertexTriangles in predict.h: the triangles incident on
+// each vertex, in triangle order.
+function VertexTriangles_(indices, numVerts) {
+  var numIndices = indices.length;
+  var starts = new Uint32Array(numVerts + 1);
+  for (var i = 0; i < numIndices; i++) {
+    starts[indices[i] + 1]++;
+  }
+  for (var i = 0; i < numVerts; i++) {
+    starts[i + 1] += starts[i];
+  }
+  var fill = new Uint32Array(starts.subarray(0, numVerts));
+  var triangles = new Uint32Array(numIndices);
+  for (var i = 0; i < numIndices; i++) {
+    triangles[fill[indices[i]]++] = (i / 3) | 0;
+  }
+  this.indices = indices;
+  this.starts = starts;
+  this.triangles = triangles;
+  // Outputs of rotate.
+  this.v1 = 0;
+  this.v2 = 0;
+}
+
+// Sets v1 and v2 so that vertex -> v1 -> v2 is the triangle at i.
+VertexTriangles_.prototype.rotate = function(i, vertex) {
+  var indices = this.indices;
+  var t = 3*this.triangles[i];
+  var k = indices[t] === vertex ? 0 : (indices[t + 1] === vertex ? 1 : 2);
+  this.v1 = indices[t + (k + 1) % 3];
+  this.v2 = indices[t + (k + 2) % 3];
+};
+
+// Returns the third vertex of the first triangle with the edge
+// v0 -> v1 whose third vertex is less than limit, or -1.
+VertexTriangles_.prototype.findOpposite = function(v0, v1, limit) {
+  for (var i = this.starts[v0]; i < this.starts[v0 + 1]; i++) {
+    this.rotate(i, v0);
+    if (this.v1 === v1 && this.v2 < limit) {
+      return this.v2;
+    }
+  }
+  return -1;
+};
+
+// Mirrors MultiParallelogramPredictor in predict.h.
+function predictParallelogram_(topology, attribs, vertex, column, numColumns,
+                               predicted) {
+  var sums = [0, 0, 0];
+  var count = 0;
+  var end = topology.starts[vertex + 1];
+  for (var i = topology.starts[vertex]; i < end; i++) {
+    topology.rotate(i, vertex);
+    var a = topology.v1;
+    var b = topology.v2;
+    if (a >= vertex || b >= vertex) continue;
+    var c = topology.findOpposite(b, a, vertex);
+    if (c < 0) continue;
+    for (var j = 0; j < numColumns; j++) {
+      sums[j] += attribs[8*a + column + j] + attribs[8*b + column + j] -
+        attribs[8*c + column + j];
+    }
+    count++;
+  }
+  if (count) {
+    for (var j = 0; j < numColumns; j++) {
+      predicted[j] = Math.min(Math.max((sums[j] / count) | 0, 0), 0xFFFF);
+    }
+    return;
+  }
+  for (var i = topology.starts[vertex]; i < end; i++) {
+    topology.rotate(i, vertex);
+    var neighbors = [topology.v1, topology.v2];
+    for (var k = 0; k < 2; k++) {
+      if (neighbors[k] >= vertex) continue;
+      for (var j = 0; j < numColumns; j++) {
+        sums[j] += attribs[8*neighbors[k] + column + j];
+      }
+      count++;
+    }
+  }
+  for (var j = 0; j < numColumns; j++) {
+    if (count) {
+      predicted[j] = (sums[j] / count) | 0;
+    } else {
+      predicted[j] = vertex ? attribs[8*(vertex - 1) + column + j] : 0;
+    }
+  }
+}
+
+// Mirrors UvStretchPredictor in predict.h. The arithmetic must stay
+// in the same order, so that the rounding matches.
+function predictStretch_(topology, attribs, vertex, column, numColumns,
+                         predicted) {
+  var sumU = 0;
+  var sumV = 0;
+  var count = 0;
+  var pv = 8*vertex;
+  var ab = [0, 0, 0];
+  var av = [0, 0, 0];
+  var end = topology.starts[vertex + 1];
+  for (var i = topology.starts[vertex]; i < end; i++) {
+    topology.rotate(i, vertex);
+    var a = topology.v1;
+    var b = topology.v2;
+    if (a >= vertex || b >= vertex) continue;
+    var pa = 8*a;
+    var pb = 8*b;
+    var abLength2 = 0;
+    var dot = 0;
+    for (var j = 0; j < 3; j++) {
+      ab[j] = attribs[pb + j] - attribs[pa + j];
+      av[j] = attribs[pv + j] - attribs[pa + j];
+      abLength2 += ab[j] * ab[j];
+      dot += ab[j] * av[j];
+    }
+    if (abLength2 === 0) continue;
+    var s = dot / abLength2;
+    var perpLength2 = 0;
+    for (var j = 0; j < 3; j++) {
+      var perp = av[j] - s * ab[j];
+      perpLength2 += perp * perp;
+    }
+    var t = Math.sqrt(perpLength2 / abLength2);
+    var uA = attribs[pa + column];
+    var vA = attribs[pa + column + 1];
+    var uAB = attribs[pb + column] - uA;
+    var vAB = attribs[pb + column + 1] - vA;
+    var side = 1;
+    var c = topology.findOpposite(b, a, vertex);
+    if (c >= 0) {
+      var pc = 8*c;
+      var cross = uAB * (attribs[pc + column + 1] - vA) -
+        vAB * (attribs[pc + column] - uA);
+      if (cross > 0) side = -1;
+    }
+    sumU += uA + s * uAB - side * t * vAB;
+    sumV += vA + s * vAB + side * t * uAB;
+    count++;
+  }
+  if (!count) {
+    predictParallelogram_(topology, attribs, vertex, column, numColumns,
+                          predicted);
+    return;
+  }
+  predicted[0] = Math.min(Math.max(Math.floor(sumU / count + 0.5), 0), 0xFFFF);
+  predicted[1] = Math.min(Math.max(Math.floor(sumV / count + 0.5), 0), 0xFFFF);
+}
+
+var PREDICTORS_ = {
+  parallelogram: predictParallelogram_,
+  stretch: predictStretch_
+};
+
+// Decodes the attributes that are predicted after traversal, as named
+// by meshParams.predictors: [positions, texcoords]. Mirrors
+// EdgeCachingDecompressor::End in decompress.h.
+function decodePredicted_(str, deltaStart, numVerts, predictors,
+                          indicesOut, attribsOutFixed, attribsOut,
+                          decodeOffsets, decodeScales) {
+  var topology = new VertexTriangles_(indicesOut, numVerts);
+  var columns = [[0, 3], [3, 2]];
+  var predicted = [0, 0, 0];
+  for (var p = 0; p < 2; p++) {
+    var predict = PREDICTORS_[predictors[p]];
+    if (!predict) continue;  // "traversal".
+    var column = columns[p][0];
+    var numColumns = columns[p][1];
+    for (var i = 0; i < numVerts; i++) {
+      predict(topology, attribsOutFixed, i, column, numColumns, predicted);
+      for (var j = 0; j < numColumns; j++) {
+        var code = str.charCodeAt(deltaStart + numVerts*(column + j) + i);
+        var value = (predicted[j] + ((code >> 1) ^ (-(code & 1)))) & 0xFFFF;
+        attribsOutFixed[8*i + column + j] = value;
+        attribsOut[8*i + column + j] =
+          decodeScales[column + j] * (value + decodeOffsets[column + j]);
+      }
+    }
+  }
+}
+
+// Normals are predicted from face cross products, so this waits for
+// any predicted positions.
+function decodeNormals_(str, deltaStart, numVerts, indicesOut,
+                        attribsOutFixed, attribsOut) {
+  var crosses = new Int32Array(3*numVerts);
+  for (var i = 0; i < indicesOut.length; i += 3) {
+    accumulateNormal(indicesOut[i], indicesOut[i + 1], indicesOut[i + 2],
+                     attribsOutFixed, crosses);
+  }
+  for (var i = 0; i < numVerts; i++) {
+    var nx = crosses[3*i + 0];
+    var ny = crosses[3*i + 1];
+    var nz = crosses[3*i + 2];
+    var norm = 511.0 / Math.sqrt(nx*nx + ny*ny + nz*nz);
+
+    var cx = str.charCodeAt(deltaStart + 5*numVerts + i);
+    var cy = str.charCodeAt(deltaStart + 6*numVerts + i);
+    var cz = str.charCodeAt(deltaStart + 7*numVerts + i);
+
+    attribsOut[8*i + 5] = norm*nx + ((cx >> 1) ^ (-(cx & 1)));
+    attribsOut[8*i + 6] = norm*ny + ((cy >> 1) ^ (-(cy & 1)));
+    attribsOut[8*i + 7] = norm*nz + ((cz >> 1) ^ (-(cz & 1)));
+  }
+}
+
 function decompressMesh2(str, meshParams, decodeParams, callback) {
   var MAX_BACKREF = 96;
   // Extract conversion parameters from attribArrays.
@@ -190,7 +403,6 @@ function decompressMesh2(str, meshParams, decodeParams, callback) {
   var codeLength = meshParams.codeRange[1];
   var numIndices = 3*meshParams.codeRange[2];
   var indicesOut = new Uint16Array(numIndices);
-  var crosses = new Int32Array(3*numVerts);
   var lastAttrib = new Uint16Array(stride);
   var attribsOutFixed = new Uint16Array(stride * numVerts);
   var attribsOut = new Float32Array(stride * numVerts);
@@ -242,7 +454,6 @@ function decompressMesh2(str, meshParams, decodeParams, callback) {
       } else {
         copyAttrib(stride, attribsOutFixed, lastAttrib, index);
       }
-      accumulateNormal(i0, i1, index, attribsOutFixed, crosses);
     } else {
       // Simple
       var index0 = highest - (code - max_backref);
@@ -278,23 +489,370 @@ function decompressMesh2(str, meshParams, decodeParams, callback) {
       } else {
         copyAttrib(stride, attribsOutFixed, lastAttrib, index2);
       }
-      accumulateNormal(index0, index1, index2, attribsOutFixed, crosses);
     }
   }
+  if (meshParams.predictors) {
+    decodePredicted_(str, deltaStart, numVerts, meshParams.predictors,
+                     indicesOut, attribsOutFixed, attribsOut,
+                     decodeOffsets, decodeScales);
+  }
+  decodeNormals_(str, deltaStart, numVerts, indicesOut, attribsOutFixed,
+                 attribsOut);
+  callback(attribsOut, indicesOut, undefined, meshParams);
+}
+
+// Mirrors EdgeLru in compress.h: a move-to-front cache of unmatched
+// edges. Each edge is stored as (v0, v1, opposite vertex).
+var LRU_MAX_SIZE = 96;
+
+function EdgeLru_() {
+  this.edges = new Uint16Array(3*(LRU_MAX_SIZE + 3));
+  this.size = 0;
+}
+
+EdgeLru_.prototype.remove_ = function(v0, v1) {
+  var edges = this.edges;
+  for (var i = 0; i < 3*this.size; i += 3) {
+    if (edges[i] === v0 && edges[i + 1] === v1) {
+      this.size--;
+      edges.set(edges.subarray(i + 3, 3*this.size + 3), i);
+      return true;
+    }
+  }
+  return false;
+};
+
+EdgeLru_.prototype.update = function(triangle) {
+  var unmatched = [];
+  for (var i = 0; i < 3; i++) {
+    var v0 = triangle[i];
+    var v1 = triangle[(i + 1) % 3];
+    if (!this.remove_(v1, v0)) {
+      unmatched.push(v0, v1, triangle[(i + 2) % 3]);
+    }
+  }
+  var numUnmatched = unmatched.length / 3;
+  var newSize = Math.min(this.size + numUnmatched, LRU_MAX_SIZE);
+  var edges = this.edges;
+  edges.set(edges.subarray(0, 3*(newSize - numUnmatched)), 3*numUnmatched);
+  for (var i = 0; i < numUnmatched; i++) {
+    var from = 3*(numUnmatched - 1 - i);
+    edges[3*i + 0] = unmatched[from + 0];
+    edges[3*i + 1] = unmatched[from + 1];
+    edges[3*i + 2] = unmatched[from + 2];
+  }
+  this.size = newSize;
+};
+
+// Like decompressMesh2, but edge matches are positions in an EdgeLru_
+// instead of backrefs. See EdgeCachingCompressor::CompressWithLRU.
+function decompressMesh3(str, meshParams, decodeParams, callback) {
+  // Extract conversion parameters from attribArrays.
+  var stride = decodeParams.decodeScales.length;
+  var decodeOffsets = decodeParams.decodeOffsets;
+  var decodeScales = decodeParams.decodeScales;
+  var deltaStart = meshParams.attribRange[0];
+  var numVerts = meshParams.attribRange[1];
+  var codeStart = meshParams.lruCodeRange[0];
+  var numIndices = 3*meshParams.lruCodeRange[2];
+  var indicesOut = new Uint16Array(numIndices);
+  var lastAttrib = new Uint16Array(stride);
+  var attribsOutFixed = new Uint16Array(stride * numVerts);
+  var attribsOut = new Float32Array(stride * numVerts);
+  var edgeLru = new EdgeLru_();
+  var highest = 0;
+  for (var i = 0; i < numIndices; i += 3) {
+    var code = str.charCodeAt(codeStart++);
+    var triangle = indicesOut.subarray(i, i + 3);
+    if (code < edgeLru.size) {
+      // Parallelogram
+      var i0 = edgeLru.edges[3*code + 1];
+      var i1 = edgeLru.edges[3*code + 0];
+      var i2 = edgeLru.edges[3*code + 2];
+      triangle[0] = i0;
+      triangle[1] = i1;
+      code = str.charCodeAt(codeStart++);
+      var index = highest - code;
+      triangle[2] = index;
+      if (code === 0) {
+        for (var j = 0; j < 5; j++) {
+          var deltaCode = str.charCodeAt(deltaStart + numVerts*j + highest);
+          var prediction = ((deltaCode >> 1) ^ (-(deltaCode & 1))) +
+            attribsOutFixed[stride*i0 + j] +
+            attribsOutFixed[stride*i1 + j] -
+            attribsOutFixed[stride*i2 + j];
+          lastAttrib[j] = prediction;
+          attribsOutFixed[stride*highest + j] = prediction;
+          attribsOut[stride*highest + j] =
+            decodeScales[j] * (prediction + decodeOffsets[j]);
+        }
+        highest++;
+      } else {
+        copyAttrib(stride, attribsOutFixed, lastAttrib, index);
+      }
+    } else {
+      // Simple
+      var index0 = highest - (code - edgeLru.size);
+      triangle[0] = index0;
+      if (code === edgeLru.size) {
+        decodeAttrib2(str, stride, decodeOffsets, decodeScales, deltaStart,
+                      numVerts, attribsOut, attribsOutFixed, lastAttrib,
+                      highest++);
+      } else {
+        copyAttrib(stride, attribsOutFixed, lastAttrib, index0);
+      }
+      code = str.charCodeAt(codeStart++);
+      var index1 = highest - code;
+      triangle[1] = index1;
+      if (code === 0) {
+        decodeAttrib2(str, stride, decodeOffsets, decodeScales, deltaStart,
+                      numVerts, attribsOut, attribsOutFixed, lastAttrib,
+                      highest++);
+      } else {
+        copyAttrib(stride, attribsOutFixed, lastAttrib, index1);
+      }
+      code = str.charCodeAt(codeStart++);
+      var index2 = highest - code;
+      triangle[2] = index2;
+      if (code === 0) {
+        for (var j = 0; j < 5; j++) {
+          lastAttrib[j] = (attribsOutFixed[stride*index0 + j] +
+                           attribsOutFixed[stride*index1 + j]) / 2;
+        }
+        decodeAttrib2(str, stride, decodeOffsets, decodeScales, deltaStart,
+                      numVerts, attribsOut, attribsOutFixed, lastAttrib,
+                      highest++);
+      } else {
+        copyAttrib(stride, attribsOutFixed, lastAttrib, index2);
+      }
+    }
+    edgeLru.update(triangle);
+  }
+  if (meshParams.predictors) {
+    decodePredicted_(str, deltaStart, numVerts, meshParams.predictors,
+                     indicesOut, attribsOutFixed, attribsOut,
+                     decodeOffsets, decodeScales);
+  }
+  decodeNormals_(str, deltaStart, numVerts, indicesOut, attribsOutFixed,
+                 attribsOut);
+  callback(attribsOut, indicesOut, undefined, meshParams);
+}
+
+// Mirrors GateBoundary in edgebreaker.h. Each gate is stored as
+// (v0, v1, opposite vertex), and is live until it is skipped, decoded
+// across or closed.
+function GateBoundary_(numVerts) {
+  this.gates = [];
+  this.live = [];
+  this.outgoing = [];
+  this.incoming = [];
   for (var i = 0; i < numVerts; i++) {
-    var nx = crosses[3*i + 0];
-    var ny = crosses[3*i + 1];
-    var nz = crosses[3*i + 2];
-    var norm = 511.0 / Math.sqrt(nx*nx + ny*ny + nz*nz);
+    this.outgoing.push([]);
+    this.incoming.push([]);
+  }
+  this.stack = [];
+}
 
-    var cx = str.charCodeAt(deltaStart + 5*numVerts + i);
-    var cy = str.charCodeAt(deltaStart + 6*numVerts + i);
-    var cz = str.charCodeAt(deltaStart + 7*numVerts + i);
+GateBoundary_.prototype.pop = function() {
+  var stack = this.stack;
+  while (stack.length) {
+    var gate = stack.pop();
+    if (this.live[gate]) return gate;
+  }
+  return -1;
+};
+
+GateBoundary_.prototype.next = function(gate) {
+  var outgoing = this.outgoing[this.gates[3*gate + 1]];
+  for (var i = outgoing.length - 1; i >= 0; i--) {
+    if (outgoing[i] !== gate) return this.gates[3*outgoing[i] + 1];
+  }
+  return -1;
+};
+
+GateBoundary_.prototype.previous = function(gate) {
+  var incoming = this.incoming[this.gates[3*gate]];
+  for (var i = incoming.length - 1; i >= 0; i--) {
+    if (incoming[i] !== gate) return this.gates[3*incoming[i]];
+  }
+  return -1;
+};
+
+GateBoundary_.prototype.addSeed = function(triangle) {
+  var first = this.live.length;
+  for (var i = 0; i < 3; i++) {
+    this.newGate_(triangle[i], triangle[(i + 1) % 3], triangle[(i + 2) % 3]);
+  }
+  for (var i = 0; i < 3; i++) {
+    this.close_(first + i);
+  }
+  for (var i = 0; i < 3; i++) {
+    if (this.live[first + i]) this.stack.push(first + i);
+  }
+};
 
-    attribsOut[stride*i + 5] = norm*nx + ((cx >> 1) ^ (-(cx & 1)));
-    attribsOut[stride*i + 6] = norm*ny + ((cy >> 1) ^ (-(cy & 1)));
-    attribsOut[stride*i + 7] = norm*nz + ((cz >> 1) ^ (-(cz & 1)));
+GateBoundary_.prototype.skip = function(gate) {
+  this.kill_(gate);
+};
+
+GateBoundary_.prototype.advance = function(gate, vertex) {
+  var v0 = this.gates[3*gate];
+  var v1 = this.gates[3*gate + 1];
+  this.kill_(gate);
+  var left = this.newGate_(v0, vertex, v1);
+  var right = this.newGate_(vertex, v1, v0);
+  this.close_(left);
+  this.close_(right);
+  if (this.live[left]) this.stack.push(left);
+  if (this.live[right]) this.stack.push(right);
+};
+
+GateBoundary_.prototype.newGate_ = function(v0, v1, opposite) {
+  var gate = this.live.length;
+  this.gates.push(v0, v1, opposite);
+  this.live.push(true);
+  this.outgoing[v0].push(gate);
+  this.incoming[v1].push(gate);
+  return gate;
+};
+
+GateBoundary_.prototype.kill_ = function(gate) {
+  this.live[gate] = false;
+  var outgoing = this.outgoing[this.gates[3*gate]];
+  outgoing.splice(outgoing.indexOf(gate), 1);
+  var incoming = this.incoming[this.gates[3*gate + 1]];
+  incoming.splice(incoming.indexOf(gate), 1);
+};
+
+GateBoundary_.prototype.close_ = function(gate) {
+  if (!this.live[gate]) return;
+  var v0 = this.gates[3*gate];
+  var outgoing = this.outgoing[this.gates[3*gate + 1]];
+  for (var i = 0; i < outgoing.length; i++) {
+    var twin = outgoing[i];
+    if (twin !== gate && this.gates[3*twin + 1] === v0) {
+      this.kill_(gate);
+      this.kill_(twin);
+      return;
+    }
   }
+};
+
+var GATE_NEW_VERTEX = 0;
+var GATE_NEXT = 1;
+var GATE_PREVIOUS = 2;
+var GATE_SPLIT = 3;
+var GATE_SKIP = 4;
+
+// Decodes the connectivity coded by
+// EdgeCachingCompressor::EncodeWithEdgebreaker. Gate symbols are
+// packed three to a code, with index codes in between as needed.
+function decompressMesh4(str, meshParams, decodeParams, callback) {
+  // Extract conversion parameters from attribArrays.
+  var stride = decodeParams.decodeScales.length;
+  var decodeOffsets = decodeParams.decodeOffsets;
+  var decodeScales = decodeParams.decodeScales;
+  var deltaStart = meshParams.attribRange[0];
+  var numVerts = meshParams.attribRange[1];
+  var codeStart = meshParams.edgebreakerCodeRange[0];
+  var numIndices = 3*meshParams.edgebreakerCodeRange[2];
+  var indicesOut = new Uint16Array(numIndices);
+  var lastAttrib = new Uint16Array(stride);
+  var attribsOutFixed = new Uint16Array(stride * numVerts);
+  var attribsOut = new Float32Array(stride * numVerts);
+  var gates = new GateBoundary_(numVerts);
+  var packed = 0;
+  var numPacked = 0;
+  var highest = 0;
+  for (var i = 0; i < numIndices; i += 3) {
+    var triangle = indicesOut.subarray(i, i + 3);
+    var gate;
+    var symbol;
+    while ((gate = gates.pop()) >= 0) {
+      if (numPacked === 0) {
+        packed = str.charCodeAt(codeStart++);
+        numPacked = 3;
+      }
+      symbol = packed % 5;
+      packed = (packed / 5) | 0;
+      numPacked--;
+      if (symbol !== GATE_SKIP) break;
+      gates.skip(gate);
+    }
+    if (gate < 0) {
+      // Seed, as the simple case of decompressMesh2.
+      var code = str.charCodeAt(codeStart++);
+      var index0 = highest - code;
+      triangle[0] = index0;
+      if (code === 0) {
+        decodeAttrib2(str, stride, decodeOffsets, decodeScales, deltaStart,
+                      numVerts, attribsOut, attribsOutFixed, lastAttrib,
+                      highest++);
+      } else {
+        copyAttrib(stride, attribsOutFixed, lastAttrib, index0);
+      }
+      code = str.charCodeAt(codeStart++);
+      var index1 = highest - code;
+      triangle[1] = index1;
+      if (code === 0) {
+        decodeAttrib2(str, stride, decodeOffsets, decodeScales, deltaStart,
+                      numVerts, attribsOut, attribsOutFixed, lastAttrib,
+                      highest++);
+      } else {
+        copyAttrib(stride, attribsOutFixed, lastAttrib, index1);
+      }
+      code = str.charCodeAt(codeStart++);
+      var index2 = highest - code;
+      triangle[2] = index2;
+      if (code === 0) {
+        for (var j = 0; j < 5; j++) {
+          lastAttrib[j] = (attribsOutFixed[stride*index0 + j] +
+                           attribsOutFixed[stride*index1 + j]) / 2;
+        }
+        decodeAttrib2(str, stride, decodeOffsets, decodeScales, deltaStart,
+                      numVerts, attribsOut, attribsOutFixed, lastAttrib,
+                      highest++);
+      } else {
+        copyAttrib(stride, attribsOutFixed, lastAttrib, index2);
+      }
+      gates.addSeed(triangle);
+      continue;
+    }
+    var i0 = gates.gates[3*gate + 1];
+    var i1 = gates.gates[3*gate];
+    triangle[0] = i0;
+    triangle[1] = i1;
+    if (symbol === GATE_NEW_VERTEX) {
+      // Parallelogram
+      var i2 = gates.gates[3*gate + 2];
+      for (var j = 0; j < 5; j++) {
+        var deltaCode = str.charCodeAt(deltaStart + numVerts*j + highest);
+        var prediction = ((deltaCode >> 1) ^ (-(deltaCode & 1))) +
+          attribsOutFixed[stride*i0 + j] +
+          attribsOutFixed[stride*i1 + j] -
+          attribsOutFixed[stride*i2 + j];
+        lastAttrib[j] = prediction;
+        attribsOutFixed[stride*highest + j] = prediction;
+        attribsOut[stride*highest + j] =
+          decodeScales[j] * (prediction + decodeOffsets[j]);
+      }
+      triangle[2] = highest++;
+    } else if (symbol === GATE_NEXT) {
+      triangle[2] = gates.next(gate);
+    } else if (symbol === GATE_PREVIOUS) {
+      triangle[2] = gates.previous(gate);
+    } else {
+      triangle[2] = highest - 1 - str.charCodeAt(codeStart++);
+    }
+    gates.advance(gate, triangle[2]);
+  }
+  if (meshParams.predictors) {
+    decodePredicted_(str, deltaStart, numVerts, meshParams.predictors,
+                     indicesOut, attribsOutFixed, attribsOut,
+                     decodeOffsets, decodeScales);
+  }
+  decodeNormals_(str, deltaStart, numVerts, indicesOut, attribsOutFixed,
+                 attribsOut);
   callback(attribsOut, indicesOut, undefined, meshParams);
 }
 
@@ -309,6 +867,20 @@ function downloadMesh(path, meshEntry, decodeParams, callback) {
         if (req.responseText.length < meshEnd) break;
 
         decompressMesh(req.responseText, meshParams, decodeParams, callback);
+      } else if (meshParams.lruCodeRange) {
+        var lruCodeRange = meshParams.lruCodeRange;
+        var meshEnd = lruCodeRange[0] + lruCodeRange[1];
+
+        if (req.responseText.length < meshEnd) break;
+
+        decompressMesh3(req.responseText, meshParams, decodeParams, callback);
+      } else if (meshParams.edgebreakerCodeRange) {
+        var edgebreakerCodeRange = meshParams.edgebreakerCodeRange;
+        var meshEnd = edgebreakerCodeRange[0] + edgebreakerCodeRange[1];
+
+        if (req.responseText.length < meshEnd) break;
+
+        decompressMesh4(req.responseText, meshParams, decodeParams, callback);
       } else {
         var codeRange = meshParams.codeRange;
         var meshEnd = codeRange[0] + codeRange[1];
@@ -335,9 +907,88 @@ function downloadMeshes(path, meshUrlMap, decodeParams, callback) {
   }
 }
 
+// Rotates the 3 floats at v[i] by the unit quaternion q, as
+// (x, y, z, w).
+function rotateByQuaternion_(q, v, i) {
+  var x = v[i], y = v[i + 1], z = v[i + 2];
+  var tx = 2 * (q[1]*z - q[2]*y);
+  var ty = 2 * (q[2]*x - q[0]*z);
+  var tz = 2 * (q[0]*y - q[1]*x);
+  v[i] = x + q[3]*tx + q[1]*tz - q[2]*ty;
+  v[i + 1] = y + q[3]*ty + q[2]*tx - q[0]*tz;
+  v[i + 2] = z + q[3]*tz + q[0]*ty - q[1]*tx;
+}
+
+// Copies group instance.group of a decoded mesh into a mesh of its
+// own, moved to where the instance is drawn: positions p become
+// scale * rotation(p) + offset, and normals are rotated.
+function decompressInstance_(attribs, indices, meshParams, stride,
+                             instance, callback) {
+  var start = 0;
+  for (var i = 0; i < instance.group; i++) {
+    start += meshParams.lengths[i];
+  }
+  var length = meshParams.lengths[instance.group];
+  // Vertices are renumbered in order of first use.
+  var renumbered = {};
+  var vertices = [];
+  var indicesOut = new Uint16Array(length);
+  for (var i = 0; i < length; i++) {
+    var index = indices[start + i];
+    if (!(index in renumbered)) {
+      renumbered[index] = vertices.length;
+      vertices.push(index);
+    }
+    indicesOut[i] = renumbered[index];
+  }
+  var attribsOut = new Float32Array(stride * vertices.length);
+  for (var i = 0; i < vertices.length; i++) {
+    var vertex = vertices[i];
+    attribsOut.set(attribs.subarray(stride*vertex, stride*(vertex + 1)),
+                   stride*i);
+  }
+  var rotation = instance.rotation;
+  var scale = instance.scale || 1;
+  var offset = instance.offset;
+  for (var i = 0; i < attribsOut.length; i += stride) {
+    if (rotation) {
+      rotateByQuaternion_(rotation, attribsOut, i);
+      rotateByQuaternion_(rotation, attribsOut, i + 5);
+    }
+    for (var j = 0; j < 3; j++) {
+      attribsOut[i + j] = scale * attribsOut[i + j] + offset[j];
+    }
+  }
+  callback(attribsOut, indicesOut, undefined, {
+    material: instance.material,
+    names: [instance.name],
+    lengths: [length]
+  });
+}
+
+// Wraps callback so that each of a model's instances (written by
+// objcompress --dedup) is also passed to it, once the mesh it is
+// drawn from is decoded.
+function instancingCallback_(model, callback) {
+  var instances = model.instances;
+  if (!instances) return callback;
+  var stride = model.decodeParams.decodeScales.length;
+  return function(attribs, indices, bboxen, meshParams) {
+    callback(attribs, indices, bboxen, meshParams);
+    for (var i = 0; i < instances.length; i++) {
+      var instance = instances[i];
+      if (model.urls[instance.url][instance.mesh] === meshParams) {
+        decompressInstance_(attribs, indices, meshParams, stride,
+                            instance, callback);
+      }
+    }
+  };
+}
+
 function downloadModel(path, model, callback) {
   var model = MODELS[model];
-  downloadMeshes(path, model.urls, model.decodeParams, callback);
+  downloadMeshes(path, model.urls, model.decodeParams,
+                 instancingCallback_(model, callback));
 }
 
 function downloadModelJson(jsonUrl, decodeParams, callback) {
@@ -346,3 +997,61 @@ function downloadModelJson(jsonUrl, decodeParams, callback) {
                    loaded.urls, decodeParams, callback);
   });
 }
+
+// Returns the urls of the coarsest level of detail in a model
+// manifest ("lods", written by obj2utf8x --lod) whose error, in
+// model units, is at most maxError. Levels are listed coarsest
+// first. Without one, this is the full resolution "urls".
+function chooseLodUrls(model, maxError) {
+  var lods = model.lods || [];
+  for (var i = 0; i < lods.length; i++) {
+    if (lods[i].error <= maxError) return lods[i].urls;
+  }
+  return model.urls;
+}
+
+function downloadModelLodJson(jsonUrl, decodeParams, maxError, callback) {
+  getJsonRequest(jsonUrl, function(loaded) {
+    downloadMeshes(jsonUrl.substr(0,jsonUrl.lastIndexOf("/")+1),
+                   chooseLodUrls(loaded, maxError), decodeParams, callback);
+  });
+}
+
+// Parses a file written by obj2utf8x --gpu (see gpu.h) from an
+// ArrayBuffer, without copying. Each mesh has typed-array views that
+// go straight to bufferData: vertices are 16 bytes, with positions as
+// 3 SHORTs at 0, normals at 8 (one INT_2_10_10_10_REV, or 2 normalized
+// SHORTs if normalFormat is 1, octahedral) and texcoords as 2
+// UNSIGNED_SHORTs at 12, normalized unless texcoordFormat is 1.
+function parseGpuMeshes(arrayBuffer) {
+  var header = new DataView(arrayBuffer);
+  var magic = String.fromCharCode(header.getUint8(0), header.getUint8(1),
+                                  header.getUint8(2), header.getUint8(3));
+  if (magic !== "WGLG" || header.getUint32(4, true) !== 1) return null;
+  var numMeshes = header.getUint32(8, true);
+  var decodeOffsets = [];
+  var decodeScales = [];
+  for (var i = 0; i < 3; i++) {
+    decodeOffsets.push(header.getFloat32(32 + 4*i, true));
+    decodeScales.push(header.getFloat32(44 + 4*i, true));
+  }
+  var meshes = [];
+  for (var i = 0; i < numMeshes; i++) {
+    var record = 64 + 16*i;
+    var vertexOffset = header.getUint32(record, true);
+    var numVerts = header.getUint32(record + 4, true);
+    meshes.push({
+      vertices: new Uint8Array(arrayBuffer, vertexOffset, 16*numVerts),
+      numVerts: numVerts,
+      indices: new Uint16Array(arrayBuffer, header.getUint32(record + 8, true),
+                               header.getUint32(record + 12, true))
+    });
+  }
+  return {
+    normalFormat: header.getUint32(12, true),
+    texcoordFormat: header.getUint32(60, true),
+    decodeOffsets: decodeOffsets,
+    decodeScales: decodeScales,
+    meshes: meshes
+  };
+}
@@ -0,0 +1,258 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_ASYNC_SINK_H_
+#define WEBGL_LOADER_ASYNC_SINK_H_
+
+// Tools that include this must be built with -pthread.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "base.h"
+#include "stream.h"
+
+namespace webgl_loader {
+
+enum AsyncFileFlags {
+  // Bypass the page cache, where the file system allows it. Files
+  // that can't be opened that way are written normally.
+  ASYNC_FILE_DIRECT = 1,
+  // Don't report success from |Close| until the data is on disk.
+  ASYNC_FILE_SYNC = 2
+};
+
+// Offsets and lengths of O_DIRECT writes must be multiples of this.
+const size_t kDirectAlignment = 4096;
+
+// Writes a file on its own thread, so that whoever fills it doesn't
+// wait on the disk or network. Filled blocks go around a ring of
+// |num_blocks|: the writer takes them in order, and hands each back
+// once it is written. Two counting semaphores say how many are
+// waiting to be written and how many are free, so neither side takes
+// a lock, and neither makes a system call unless it has to wait for
+// the other.
+class AsyncFileSink : public BufferedSink {
+ public:
+  explicit AsyncFileSink(size_t block_size = 1 << 20, size_t num_blocks = 4)
+      : fd_(-1),
+        direct_(false),
+        sync_(false),
+        error_(0),
+        slots_(num_blocks),
+        next_fill_(0),
+        length_(0) {
+    CHECK(num_blocks >= 2);
+    for (size_t i = 0; i < slots_.size(); ++i) {
+      slots_[i].data = NULL;
+      slots_[i].capacity = 0;
+      Resize(&slots_[i], RoundUp(block_size), 0);
+    }
+  }
+
+  virtual ~AsyncFileSink() {
+    Close();
+    for (size_t i = 0; i < slots_.size(); ++i) {
+      free(slots_[i].data);
+    }
+  }
+
+  // Starts writing |path|, truncating it, with |flags| from
+  // |AsyncFileFlags|. Must not already be open.
+  bool Open(const char* path, int flags) {
+    CHECK(fd_ < 0);
+    const int mode = O_WRONLY | O_CREAT | O_TRUNC;
+    direct_ = false;
+#ifdef O_DIRECT
+    if (flags & ASYNC_FILE_DIRECT) {
+      fd_ = open(path, mode | O_DIRECT, 0666);
+      direct_ = fd_ >= 0;
+    }
+#endif
+    if (fd_ < 0) fd_ = open(path, mode, 0666);
+    if (fd_ < 0) return false;
+    sync_ = (flags & ASYNC_FILE_SYNC) != 0;
+    error_ = 0;
+    next_fill_ = 0;
+    length_ = 0;
+    CHECK(0 == sem_init(&filled_, 0, 0));
+    CHECK(0 == sem_init(&free_, 0, slots_.size() - 1));
+    Slot& slot = slots_[0];
+    cursor_ = slot.data;
+    limit_ = slot.data + slot.capacity;
+    CHECK(0 == pthread_create(&writer_, NULL, &AsyncFileSink::Run, this));
+    return true;
+  }
+
+  bool is_open() const {
+    return fd_ >= 0;
+  }
+
+  // Whether O_DIRECT was used for the open file.
+  bool direct() const {
+    return direct_;
+  }
+
+  // The errno of the first thing that failed, or 0.
+  int error() const {
+    return error_;
+  }
+
+  // Writes what is left, waits for the writer, and closes the file.
+  // Returns whether everything was written, which is true if it was
+  // never opened.
+  bool Close() {
+    if (fd_ < 0) return true;
+    // O_DIRECT can only write whole pages, so the last is padded out
+    // and the file cut back after.
+    const size_t length = cursor_ - slots_[next_fill_].data;
+    if (direct_ && length % kDirectAlignment) {
+      const size_t padded = RoundUp(length);
+      memset(cursor_, 0, padded - length);
+      cursor_ += padded - length;
+    }
+    length_ += length;
+    Send(cursor_ - slots_[next_fill_].data, false);
+    Send(0, true);
+    CHECK(0 == pthread_join(writer_, NULL));
+    sem_destroy(&filled_);
+    sem_destroy(&free_);
+    if (direct_ && !error_ && 0 != ftruncate(fd_, length_)) error_ = errno;
+    if (sync_ && !error_ && 0 != fdatasync(fd_)) error_ = errno;
+    if (0 != close(fd_) && !error_) error_ = errno;
+    fd_ = -1;
+    cursor_ = limit_ = NULL;
+    return !error_;
+  }
+
+ protected:
+  // Sends the filled block, or only its whole pages for O_DIRECT, in
+  // which case the rest starts the next one.
+  virtual void MakeRoom(size_t n) {
+    CHECK(fd_ >= 0);
+    char* const start = slots_[next_fill_].data;
+    const size_t length = cursor_ - start;
+    const size_t sent = direct_ ?
+        length - length % kDirectAlignment : length;
+    if (sent == 0) {
+      if (length + n > slots_[next_fill_].capacity) {
+        Slot& slot = slots_[next_fill_];
+        Resize(&slot, RoundUp(length + n), length);
+        cursor_ = slot.data + length;
+        limit_ = slot.data + slot.capacity;
+      }
+      return;
+    }
+    char tail[kDirectAlignment];
+    const size_t tail_length = length - sent;
+    memcpy(tail, start + sent, tail_length);
+    length_ += sent;
+    Send(sent, false);
+    Slot& slot = slots_[next_fill_];
+    if (tail_length + n > slot.capacity) {
+      Resize(&slot, RoundUp(tail_length + n), 0);
+    }
+    memcpy(slot.data, tail, tail_length);
+    cursor_ = slot.data + tail_length;
+    limit_ = slot.data + slot.capacity;
+  }
+
+ private:
+  struct Slot {
+    char* data;
+    size_t capacity;
+    size_t length;  // Of the bytes to write.
+    bool last;  // Tells the writer to stop.
+  };
+
+  static size_t RoundUp(size_t n) {
+    return (n + kDirectAlignment - 1) & ~(kDirectAlignment - 1);
+  }
+
+  // Replaces |slot|'s block, which must not be in flight, with one of
+  // |capacity| bytes, aligned for O_DIRECT, keeping its first |keep|.
+  static void Resize(Slot* slot, size_t capacity, size_t keep) {
+    void* data = NULL;
+    CHECK(0 == posix_memalign(&data, kDirectAlignment, capacity));
+    if (keep != 0) memcpy(data, slot->data, keep);
+    free(slot->data);
+    slot->data = static_cast<char*>(data);
+    slot->capacity = capacity;
+  }
+
+  // Hands the block being filled to the writer, and waits for the
+  // next to be free.
+  void Send(size_t length, bool last) {
+    Slot& slot = slots_[next_fill_];
+    slot.length = length;
+    slot.last = last;
+    CHECK(0 == sem_post(&filled_));
+    next_fill_ = (next_fill_ + 1) % slots_.size();
+    if (!last) {
+      while (0 != sem_wait(&free_)) CHECK(errno == EINTR);
+    }
+  }
+
+  static void* Run(void* self) {
+    static_cast<AsyncFileSink*>(self)->Write();
+    return NULL;
+  }
+
+  // The writer thread. After a failed write it keeps taking blocks,
+  // so that the other side never waits forever, but drops them.
+  void Write() {
+    size_t next_write = 0;
+    for (;;) {
+      while (0 != sem_wait(&filled_)) CHECK(errno == EINTR);
+      const Slot& slot = slots_[next_write];
+      if (slot.last) return;
+      const char* data = slot.data;
+      size_t remaining = slot.length;
+      while (remaining != 0 && !error_) {
+        const ssize_t written = write(fd_, data, remaining);
+        if (written < 0) {
+          if (errno != EINTR) error_ = errno;
+          continue;
+        }
+        data += written;
+        remaining -= written;
+      }
+      CHECK(0 == sem_post(&free_));
+      next_write = (next_write + 1) % slots_.size();
+    }
+  }
+
+  int fd_;
+  bool direct_;
+  bool sync_;
+  int error_;  // Written by the writer, read once it is joined.
+  std::vector<Slot> slots_;
+  size_t next_fill_;  // The slot [|cursor_|, |limit_|) is in.
+  size_t length_;  // Of the file, not counting padding.
+  pthread_t writer_;
+  sem_t filled_;  // Slots sent and not yet taken by the writer.
+  sem_t free_;  // Slots written, not counting the one being filled.
+};
+
+}  // namespace webgl_loader
+
+#endif  // WEBGL_LOADER_ASYNC_SINK_H_
@@ -28,6 +28,7 @@ typedef unsigned char uint8;
 typedef unsigned short uint16;
 typedef short int16;
 typedef unsigned int uint32;
+typedef unsigned long long uint64;
 
 // printf format strings for size_t.
 #ifdef _WIN32
@@ -163,6 +164,16 @@ uint16 Quantize(float f, float in_min, float in_scale, uint16 out_max) {
   return static_cast<uint16>(out_max * ((f-in_min) / in_scale));
 }
 
+// Maps small signed residuals to small unsigned codes:
+// 0, -1, 1, -2, ... -> 0, 1, 2, 3, ...
+uint16 ZigZag(int16 word) {
+  return (word >> 15) ^ (word << 1);
+}
+
+int UnZigZag(uint16 code) {
+  return (code >> 1) ^ -(code & 1);
+}
+
 // TODO: Visual Studio calls this someting different.
 #ifdef putc_unlocked
 # define PutChar putc_unlocked
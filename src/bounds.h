@@ -18,6 +18,7 @@
 #include <stdio.h>
 
 #include "base.h"
+#include "json.h"
 
 namespace webgl_loader {
 
@@ -98,17 +99,13 @@ struct BoundsParams {
     return ret;
   }
 
-  void DumpJson(FILE* out = stdout) {
-    // TODO: use JsonSink.
-    fputs("{\n", out);
-    fprintf(out, "    \"decodeOffsets\": [%d,%d,%d,%d,%d,%d,%d,%d],\n",
-            decodeOffsets[0], decodeOffsets[1], decodeOffsets[2],
-            decodeOffsets[3], decodeOffsets[4], decodeOffsets[5],
-            decodeOffsets[6], decodeOffsets[7]);
-    fprintf(out, "    \"decodeScales\": [%f,%f,%f,%f,%f,%f,%f,%f]\n",
-            decodeScales[0], decodeScales[1], decodeScales[2], decodeScales[3],
-            decodeScales[4], decodeScales[5], decodeScales[6], decodeScales[7]);
-    fputs("  }", out);
+  void DumpJson(JsonSink* json) const {
+    json->BeginObject();
+    json->PutString("decodeOffsets");
+    json->PutIntArray(decodeOffsets, 8);
+    json->PutString("decodeScales");
+    json->PutFloatArray(decodeScales, 8);
+    json->End();
   }
 
   float mins[8];
@@ -0,0 +1,433 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_BUILD_CACHE_H_
+#define WEBGL_LOADER_BUILD_CACHE_H_
+
+// A local store of what a tool built for each model, so that a model
+// whose inputs haven't changed is read back rather than built again.
+//
+// Each entry is a directory named for its key, a |Hash64| of every
+// input: the OBJ, the MTL files it names, and the tool's parameters.
+// It holds the model's JS, as "model.js", and the output files the JS
+// names, with the same content names (see hash_sink.h). A hit links
+// those back into the current directory, so it costs a hash of the
+// inputs and a few stats and links. Tools whose outputs keep one name
+// and are rewritten in place, as obj2utf8x's are, copy them instead,
+// and keep their JSON manifest as the JS. The JS file's mtime is when
+// the entry was last used, and |BuildCache::Collect| removes the least
+// recently used entries to keep the store under a size.
+//
+// Entries are written to a temporary directory and renamed into
+// place, and renamed out of it again before they are removed, so
+// several threads or processes can share a store. One removed while
+// another is reading it is a miss.
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "base.h"
+#include "hash_sink.h"
+#include "inflate.h"
+#include "stream.h"
+
+namespace webgl_loader {
+
+// Adds |length| bytes of |data| to |hash|, after their length, so that
+// one run of them can't be mistaken for another.
+void HashBytes(const char* data, size_t length, Hash64* hash) {
+  const uint64 length64 = length;
+  hash->Update(reinterpret_cast<const char*>(&length64), sizeof(length64));
+  hash->Update(data, length);
+}
+
+void HashString(const std::string& str, Hash64* hash) {
+  HashBytes(str.data(), str.size(), hash);
+}
+
+// Adds what |part| has hashed to |hash|.
+void HashDigest(const Hash64& part, Hash64* hash) {
+  const uint64 digest = part.Digest();
+  hash->Update(reinterpret_cast<const char*>(&digest), sizeof(digest));
+}
+
+// Adds the contents of the file at |path| to |hash|. Returns false,
+// having added nothing, if it couldn't be read.
+bool HashFile(const char* path, Hash64* hash) {
+  FILE* fp = fopen(path, "rb");
+  if (!fp) return false;
+  Hash64 file_hash;
+  char buf[64 * 1024];
+  size_t length;
+  while ((length = fread(buf, 1, sizeof(buf), fp)) != 0) {
+    file_hash.Update(buf, length);
+  }
+  const bool ok = !ferror(fp);
+  fclose(fp);
+  if (ok) HashDigest(file_hash, hash);
+  return ok;
+}
+
+// Adds the OBJ read from |obj_input| to |hash|, as it reads once
+// inflated, so that gzipping it doesn't change the hash, and each MTL
+// file its mtllib lines name, looked for where |WavefrontObjFile|
+// looks. An MTL file that is missing is hashed as such. Returns false
+// if |obj_input| couldn't be read.
+bool HashObjInputs(BufferedInput* obj_input, Hash64* hash) {
+  InflatingInput inflated(obj_input);
+  BufferedInput* input = LooksGzipped(obj_input) ?
+      static_cast<BufferedInput*>(&inflated) : obj_input;
+  std::vector<std::string> mtllibs;
+  std::vector<char> line;
+  Hash64 obj_hash;
+  while (GetLine(input, &line)) {
+    obj_hash.Update(&line[0], line.size() - 1);
+    char* stripped = StripLeadingWhitespace(&line[0]);
+    if (0 == strncmp(stripped, "mtllib", 6)) {
+      TerminateAtNewlineOrComment(stripped);
+      mtllibs.push_back(StripLeadingWhitespace(stripped + 6));
+    }
+  }
+  if (kEndOfFile != input->error()) return false;
+  HashDigest(obj_hash, hash);
+  for (size_t i = 0; i < mtllibs.size(); ++i) {
+    HashString(mtllibs[i], hash);
+    if (!HashFile(mtllibs[i].c_str(), hash)) {
+      HashString("missing", hash);
+    }
+  }
+  return true;
+}
+
+// As above, for the OBJ at |path|.
+bool HashObjInputs(const char* path, Hash64* hash) {
+  FILE* fp = fopen(path, "rb");
+  if (!fp) return false;
+  std::vector<char> buf(64 * 1024);
+  BufferedInputStream input(fp, &buf[0], buf.size());
+  const bool ok = HashObjInputs(&input, hash);
+  fclose(fp);
+  return ok;
+}
+
+// Of the running tool, for keys, so that a rebuilt one starts afresh:
+// its binary, found through /proc, or else at |argv0|.
+uint64 ToolHash(const char* argv0) {
+  Hash64 hash;
+  if (!HashFile("/proc/self/exe", &hash)) {
+    HashFile(argv0, &hash);
+  }
+  return hash.Digest();
+}
+
+// Copies the file at |from| to |to|, through a temporary file, so that
+// |to| appears complete or not at all.
+bool CopyFile(const std::string& from, const std::string& to) {
+  FILE* in = fopen(from.c_str(), "rb");
+  if (!in) return false;
+  std::string temp_path = to + ".XXXXXX";
+  const int fd = mkstemp(&temp_path[0]);
+  FILE* out = fd >= 0 ? fdopen(fd, "wb") : NULL;
+  if (fd >= 0 && out == NULL) {
+    close(fd);
+    unlink(temp_path.c_str());
+  }
+  bool ok = out != NULL;
+  char buf[64 * 1024];
+  size_t length;
+  while (ok && (length = fread(buf, 1, sizeof(buf), in)) != 0) {
+    ok = length == fwrite(buf, 1, length, out);
+  }
+  ok = ok && !ferror(in);
+  fclose(in);
+  if (out != NULL) {
+    ok = (0 == fclose(out)) && ok;
+    ok = ok && 0 == rename(temp_path.c_str(), to.c_str());
+    if (!ok) unlink(temp_path.c_str());
+  }
+  return ok;
+}
+
+// Makes the file at |from| also appear at |to|, unless something is
+// already there: a hard link where it can be, or a copy.
+bool LinkOrCopy(const std::string& from, const std::string& to) {
+  if (0 == link(from.c_str(), to.c_str()) || errno == EEXIST) return true;
+  return CopyFile(from, to);
+}
+
+// Adds the names in the directory at |path|, but "." and "..", to
+// |names|. Returns false if it couldn't be read.
+bool ListDir(const std::string& path, std::vector<std::string>* names) {
+  DIR* dir = opendir(path.c_str());
+  if (!dir) return false;
+  while (const struct dirent* entry = readdir(dir)) {
+    if (0 == strcmp(entry->d_name, ".") ||
+        0 == strcmp(entry->d_name, "..")) {
+      continue;
+    }
+    names->push_back(entry->d_name);
+  }
+  closedir(dir);
+  return true;
+}
+
+// Removes the directory at |path| and the files in it.
+void RemoveDir(const std::string& path) {
+  std::vector<std::string> names;
+  ListDir(path, &names);
+  for (size_t i = 0; i < names.size(); ++i) {
+    unlink((path + "/" + names[i]).c_str());
+  }
+  rmdir(path.c_str());
+}
+
+struct BuildCacheStats {
+  BuildCacheStats()
+      : num_entries(0),
+        num_bytes(0),
+        num_evicted(0),
+        num_evicted_bytes(0) {
+  }
+
+  // Left after |Collect|.
+  size_t num_entries;
+  uint64 num_bytes;
+  // Removed by it.
+  size_t num_evicted;
+  uint64 num_evicted_bytes;
+};
+
+class BuildCache {
+ public:
+  // Keeps its entries under |dir|, which is made if it isn't there.
+  explicit BuildCache(const std::string& dir)
+      : dir_(dir),
+        copy_outputs_(false) {
+    mkdir(dir_.c_str(), 0777);
+  }
+
+  // For outputs that aren't named for their contents, and so may be
+  // written over in place: entries then take copies of them rather
+  // than links, and a hit replaces whatever is there.
+  void set_copy_outputs(bool copy_outputs) {
+    copy_outputs_ = copy_outputs;
+  }
+
+  // Whether the store's directory is there to use.
+  bool ok() const {
+    struct stat st;
+    return 0 == stat(dir_.c_str(), &st) && S_ISDIR(st.st_mode);
+  }
+
+  // If there is an entry for |key|, links its output files into the
+  // current directory, where they aren't already, appends its JS to
+  // |js|, marks it used, and returns true.
+  bool Fetch(uint64 key, std::string* js) const {
+    return Fetch(key, "", js);
+  }
+
+  // As above, but puts the output files in |dir|, or the current
+  // directory if it is empty.
+  bool Fetch(uint64 key, const std::string& dir, std::string* js) const {
+    const std::string entry = EntryPath(key);
+    const std::string js_path = entry + "/" + kJsName;
+    std::string contents;
+    if (!ReadFile(js_path.c_str(), &contents)) return false;
+    std::vector<std::string> names;
+    if (!ListDir(entry, &names)) return false;
+    for (size_t i = 0; i < names.size(); ++i) {
+      if (names[i] == kJsName) continue;
+      const std::string from = entry + "/" + names[i];
+      const std::string to = dir.empty() ? names[i] : dir + "/" + names[i];
+      if (!(copy_outputs_ ? CopyFile(from, to) : LinkOrCopy(from, to))) {
+        return false;
+      }
+    }
+    utimes(js_path.c_str(), NULL);
+    js->append(contents);
+    return true;
+  }
+
+  // Adds an entry for |key|, of |js| and the files at |paths|, which
+  // must all have different names. Returns false if it couldn't,
+  // which leaves the store as it was. Another entry for |key| is kept
+  // rather than replaced.
+  bool Store(uint64 key, const std::string& js,
+             const std::vector<std::string>& paths) const {
+    std::string temp_path = dir_ + "/tmp.XXXXXX";
+    if (!mkdtemp(&temp_path[0])) return false;
+    bool ok = WriteFile((temp_path + "/" + kJsName).c_str(), js);
+    for (size_t i = 0; ok && i < paths.size(); ++i) {
+      const std::string to = temp_path + "/" +
+          StripLeadingDir(paths[i].c_str());
+      ok = copy_outputs_ ? CopyFile(paths[i], to) : LinkOrCopy(paths[i], to);
+    }
+    // A directory is only renamed over an empty one, so an entry that
+    // is already there stays.
+    if (ok && 0 != rename(temp_path.c_str(), EntryPath(key).c_str())) {
+      ok = errno == EEXIST || errno == ENOTEMPTY;
+      RemoveDir(temp_path);
+      return ok;
+    }
+    if (!ok) RemoveDir(temp_path);
+    return ok;
+  }
+
+  // Removes the least recently used entries until the rest take up at
+  // most |max_bytes|, and temporary directories left by tools that
+  // stopped more than an hour ago. Sizes are of the files' contents.
+  void Collect(uint64 max_bytes, BuildCacheStats* stats) const {
+    std::vector<std::string> names;
+    if (!ListDir(dir_, &names)) return;
+    std::vector<Entry> entries;
+    uint64 num_bytes = 0;
+    const time_t stale = time(NULL) - 3600;
+    for (size_t i = 0; i < names.size(); ++i) {
+      const std::string path = dir_ + "/" + names[i];
+      struct stat st;
+      if (0 == names[i].compare(0, 4, "tmp.")) {
+        if (0 == stat(path.c_str(), &st) && st.st_mtime < stale) {
+          RemoveDir(path);
+        }
+        continue;
+      }
+      if (names[i].size() != 16 ||
+          0 != stat((path + "/" + kJsName).c_str(), &st)) {
+        continue;
+      }
+      Entry entry;
+      entry.name = names[i];
+      entry.used = st.st_mtime;
+      entry.num_bytes = DirBytes(path);
+      entries.push_back(entry);
+      num_bytes += entry.num_bytes;
+    }
+    // Oldest first; ties by name, so that it doesn't depend on the
+    // order the directory lists them.
+    std::sort(entries.begin(), entries.end());
+    size_t num_evicted = 0;
+    for (; num_evicted < entries.size() && num_bytes > max_bytes;
+         ++num_evicted) {
+      const Entry& entry = entries[num_evicted];
+      Evict(entry.name);
+      num_bytes -= entry.num_bytes;
+      stats->num_evicted_bytes += entry.num_bytes;
+    }
+    stats->num_evicted += num_evicted;
+    stats->num_entries = entries.size() - num_evicted;
+    stats->num_bytes = num_bytes;
+  }
+
+  // Where the entry for |key| is, or would be.
+  std::string EntryPath(uint64 key) const {
+    char hex[17];
+    ToHex(static_cast<uint32>(key >> 32), hex);
+    ToHex(static_cast<uint32>(key), hex + 8);
+    return dir_ + "/" + hex;
+  }
+
+ private:
+  static const char kJsName[];
+
+  struct Entry {
+    std::string name;
+    time_t used;
+    uint64 num_bytes;
+
+    bool operator<(const Entry& that) const {
+      return used != that.used ? used < that.used : name < that.name;
+    }
+  };
+
+  // Renames the entry |name| to a temporary directory, which is atomic,
+  // and then removes it, so that a |Fetch| of it at the same time finds
+  // all of its files or fails, rather than restoring only some.
+  void Evict(const std::string& name) const {
+    std::string temp_path = dir_ + "/tmp.XXXXXX";
+    if (!mkdtemp(&temp_path[0])) return;
+    if (0 == rename((dir_ + "/" + name).c_str(), temp_path.c_str())) {
+      RemoveDir(temp_path);
+    } else {
+      rmdir(temp_path.c_str());
+    }
+  }
+
+  static uint64 DirBytes(const std::string& path) {
+    std::vector<std::string> names;
+    ListDir(path, &names);
+    uint64 num_bytes = 0;
+    for (size_t i = 0; i < names.size(); ++i) {
+      struct stat st;
+      if (0 == stat((path + "/" + names[i]).c_str(), &st)) {
+        num_bytes += st.st_size;
+      }
+    }
+    return num_bytes;
+  }
+
+  static bool ReadFile(const char* path, std::string* contents) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return false;
+    char buf[64 * 1024];
+    size_t length;
+    while ((length = fread(buf, 1, sizeof(buf), fp)) != 0) {
+      contents->append(buf, length);
+    }
+    const bool ok = !ferror(fp);
+    fclose(fp);
+    return ok;
+  }
+
+  static bool WriteFile(const char* path, const std::string& contents) {
+    FILE* fp = fopen(path, "wb");
+    if (!fp) return false;
+    const bool ok =
+        contents.size() == fwrite(contents.data(), 1, contents.size(), fp);
+    return (0 == fclose(fp)) && ok;
+  }
+
+  const std::string dir_;
+  bool copy_outputs_;
+};
+
+const char BuildCache::kJsName[] = "model.js";
+
+// What a tool's --cache did, on STDERR, after collecting it down to
+// |max_bytes|, if that isn't 0.
+void ReportCache(const BuildCache& cache, size_t num_hits,
+                 size_t num_models, uint64 max_bytes) {
+  fprintf(stderr, "Cache: reused " PRIuS " of " PRIuS " models (%.1f%%).\n",
+          num_hits, num_models,
+          num_models ? 100.0 * num_hits / num_models : 0.0);
+  if (max_bytes == 0) return;
+  BuildCacheStats stats;
+  cache.Collect(max_bytes, &stats);
+  fprintf(stderr, "Cache: " PRIuS " entries, %.1f MiB; evicted " PRIuS
+          " least recently used, %.1f MiB.\n", stats.num_entries,
+          stats.num_bytes / 1048576.0, stats.num_evicted,
+          stats.num_evicted_bytes / 1048576.0);
+}
+
+}  // namespace webgl_loader
+
+#endif  // WEBGL_LOADER_BUILD_CACHE_H_
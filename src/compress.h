@@ -17,8 +17,14 @@
 
 #include <math.h>
 
+#include <algorithm>
+
 #include "base.h"
 #include "bounds.h"
+#include "edgebreaker.h"
+#include "entropy.h"
+#include "predict.h"
+#include "simd.h"
 #include "stream.h"
 #include "utf8.h"
 
@@ -38,13 +44,10 @@ void AttribsToQuantizedAttribs(const AttribList& interleaved_attribs,
   }
 }
 
-uint16 ZigZag(int16 word) {
-  return (word >> 15) ^ (word << 1);
-}
-
-void CompressAABBToUtf8(const Bounds& bounds,
-                        const BoundsParams& total_bounds,
-                        ByteSinkInterface* utf8) {
+// Appends the 6 words |CompressAABBToUtf8| writes for |bounds| to
+// |words|: the quantized mins, then the extents.
+void QuantizeAABB(const Bounds& bounds, const BoundsParams& total_bounds,
+                  QuantizedAttribList* words) {
   const int maxPosition = (1 << 14) - 1;  // 16383;
   uint16 mins[3] = { 0 };
   uint16 maxes[3] = { 0 };
@@ -55,10 +58,20 @@ void CompressAABBToUtf8(const Bounds& bounds,
     maxes[i] = Quantize(bounds.maxes[i], total_min, total_scale, maxPosition);
   }
   for (int i = 0; i < 3; ++i) {
-    Uint16ToUtf8(mins[i], utf8);
+    words->push_back(mins[i]);
   }
   for (int i = 0; i < 3; ++i) {
-    Uint16ToUtf8(maxes[i] - mins[i], utf8);
+    words->push_back(maxes[i] - mins[i]);
+  }
+}
+
+void CompressAABBToUtf8(const Bounds& bounds,
+                        const BoundsParams& total_bounds,
+                        ByteSinkInterface* utf8) {
+  QuantizedAttribList words;
+  QuantizeAABB(bounds, total_bounds, &words);
+  for (size_t i = 0; i < words.size(); ++i) {
+    Uint16ToUtf8(words[i], utf8);
   }
 }
 
@@ -69,12 +82,13 @@ void CompressIndicesToUtf8(const OptimizedIndexList& list,
   // mark only ever moves by one at a time. Foruntately, the vertex
   // optimizer does that for us, to optimize for per-transform vertex
   // fetch order.
+  BufferedByteSink buffered(utf8);
   uint16 index_high_water_mark = 0;
   for (size_t i = 0; i < list.size(); ++i) {
     const int index = list[i];
     CHECK(index >= 0);
     CHECK(index <= index_high_water_mark);
-    CHECK(Uint16ToUtf8(index_high_water_mark - index, utf8));
+    CHECK(Uint16ToUtf8(index_high_water_mark - index, &buffered));
     if (index == index_high_water_mark) {
       ++index_high_water_mark;
     }
@@ -83,125 +97,310 @@ void CompressIndicesToUtf8(const OptimizedIndexList& list,
 
 void CompressQuantizedAttribsToUtf8(const QuantizedAttribList& attribs,
                                     ByteSinkInterface* utf8) {
-  for (size_t i = 0; i < 8; ++i) {
-    // Use a transposed representation, and delta compression.
-    uint16 prev = 0;
-    for (size_t j = i; j < attribs.size(); j += 8) {
-      const uint16 word = attribs[j];
-      const uint16 za = ZigZag(static_cast<int16>(word - prev));
-      prev = word;
-      CHECK(Uint16ToUtf8(za, utf8));
-    }
+  // Use a transposed representation, and delta compression.
+  QuantizedAttribList planar(attribs.size());
+  if (!attribs.empty()) {
+    TransposeDeltaZigZag(&attribs[0], attribs.size() / 8, &planar[0]);
+  }
+  if (!planar.empty()) {
+    CHECK(Uint16ArrayToUtf8(&planar[0], planar.size(), utf8));
   }
 }
 
-class EdgeCachingCompressor {
+// A move-to-front cache of directed edges that have not yet been
+// matched by a neighboring triangle. Both |CompressWithLRU| and the
+// decompressor maintain one, and they must update it identically.
+class EdgeLru {
  public:
   // Assuming that the vertex cache optimizer LRU is 32 vertices, we
   // expect ~64 triangles, and ~96 edges.
-  static const size_t kMaxLruSize = 96;
-  static const int kLruSentinel = -1;
+  static const size_t kMaxSize = 96;
+
+  // By convention, |v0| -> |v1| follows the winding of the triangle
+  // that introduced the edge, and |opposite| is its third vertex.
+  struct Edge {
+    uint16 v0, v1, opposite;
+  };
+
+  EdgeLru()
+      : size_(0) {
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  const Edge& operator[](size_t i) const {
+    DCHECK(i < size_);
+    return edges_[i];
+  }
+
+  // Returns the position of the first edge in the cache that matches
+  // an edge of |triangle| with the opposite winding, or |size()| if
+  // there are none. On a match, |triangle| is rotated (preserving
+  // winding) so that the matching edge comes first; that is,
+  // |triangle[0]| == |edge.v1| and |triangle[1]| == |edge.v0|.
+  size_t Find(uint16* triangle) const {
+    const uint16 i0 = triangle[0];
+    const uint16 i1 = triangle[1];
+    const uint16 i2 = triangle[2];
+    for (size_t i = 0; i < size_; ++i) {
+      const Edge& edge = edges_[i];
+      if (edge.v0 == i1 && edge.v1 == i0) {
+        return i;
+      } else if (edge.v0 == i2 && edge.v1 == i1) {
+        triangle[0] = i1;
+        triangle[1] = i2;
+        triangle[2] = i0;
+        return i;
+      } else if (edge.v0 == i0 && edge.v1 == i2) {
+        triangle[0] = i2;
+        triangle[1] = i0;
+        triangle[2] = i1;
+        return i;
+      }
+    }
+    return size_;
+  }
+
+  // If we assume that the mesh is mostly manifold, then each edge is
+  // shared by at most two triangles, so once an edge is matched it
+  // will never be matched again. Remove all matched edges of
+  // |triangle| from the cache, and push the rest to the front. The
+  // edge opposite the first vertex ends up at the front, since that is
+  // where a strip would continue.
+  void Update(const uint16* triangle) {
+    Edge unmatched[3];
+    size_t num_unmatched = 0;
+    for (size_t i = 0; i < 3; ++i) {
+      Edge edge;
+      edge.v0 = triangle[i];
+      edge.v1 = triangle[(i + 1) % 3];
+      edge.opposite = triangle[(i + 2) % 3];
+      if (!Remove(edge.v1, edge.v0)) {
+        unmatched[num_unmatched++] = edge;
+      }
+    }
+    // Shift the cache, discarding whatever falls off the end.
+    size_t new_size = size_ + num_unmatched;
+    if (new_size > kMaxSize) new_size = kMaxSize;
+    memmove(edges_ + num_unmatched, edges_,
+            (new_size - num_unmatched) * sizeof(Edge));
+    for (size_t i = 0; i < num_unmatched; ++i) {
+      edges_[i] = unmatched[num_unmatched - 1 - i];
+    }
+    size_ = new_size;
+  }
+
+  void DumpDebug(FILE* fp = stdout) const {
+    for (size_t i = 0; i < size_; ++i) {
+      fprintf(fp, PRIuS ": %hu %hu (%hu)\n", i,
+              edges_[i].v0, edges_[i].v1, edges_[i].opposite);
+    }
+  }
+
+ private:
+  bool Remove(uint16 v0, uint16 v1) {
+    for (size_t i = 0; i < size_; ++i) {
+      if (edges_[i].v0 == v0 && edges_[i].v1 == v1) {
+        --size_;
+        memmove(edges_ + i, edges_ + i + 1, (size_ - i) * sizeof(Edge));
+        return true;
+      }
+    }
+    return false;
+  }
+
+  size_t size_;
+  // We pad the array by a triangle to simplify edge cases.
+  Edge edges_[kMaxSize + 3];
+};
 
-  EdgeCachingCompressor(const QuantizedAttribList& attribs,
+// How |EdgeCachingCompressor| encodes edge matches. These values are
+// stored in binary meshes.
+enum EdgeCachingMode {
+  EDGE_CACHING_BACKREF = 0,
+  EDGE_CACHING_LRU = 1,
+  EDGE_CACHING_EDGEBREAKER = 2
+};
+
+class EdgeCachingCompressor {
+ public:
+  // How far back |Compress| looks for a matching edge, in indices.
+  static const size_t kMaxLruSize = EdgeLru::kMaxSize;
+
+  EdgeCachingCompressor(QuantizedAttribList& attribs,
                         OptimizedIndexList& indices)
       : attribs_(attribs),
         indices_(indices),
+        mode_(EDGE_CACHING_BACKREF),
+        choose_predictors_(false),
         deltas_(attribs.size()),
         index_high_water_mark_(0),
-        lru_size_(0) {
+        packed_code_(0) {
     memset(last_attrib_, 0, sizeof(last_attrib_));
   }
 
-  // Work in progress. Does not remotely work.
+  void Compress(ByteSinkInterface* utf8) {
+    Encode();
+    EmitUtf8(utf8);
+  }
+
   void CompressWithLRU(ByteSinkInterface* utf8) {
-    size_t match_indices[3];
-    size_t match_winding[3];
-    for (size_t i = 0; i < indices_.size(); i += 3) {
-      const uint16* triangle = &indices_[i];
-      // Try to find edge matches to cheaply encode indices and employ
-      // parallelogram prediction.
-      const size_t num_matches = LruEdge(triangle,
-                                         match_indices, match_winding);
-      switch (num_matches) {
-        case 0: 
-          LruEdgeZero(triangle);
-          // No edges match, so use simple predictor.
-          continue;
-        case 1: 
-          LruEdgeOne(triangle[match_winding[1]], 
-                     triangle[match_winding[2]], match_indices[0]);
-          break;
-        case 2: 
-          LruEdgeTwo(triangle[match_winding[2]], 
-                     match_indices[0], match_indices[1]); 
-          break;
-        case 3: 
-          LruEdgeThree(match_indices[0], match_indices[1], match_indices[2]);
-          break;
-        default:
-          DumpDebug();
-          CHECK(false);
+    EncodeWithLRU();
+    EmitUtf8(utf8);
+  }
+
+  void CompressWithEdgebreaker(ByteSinkInterface* utf8) {
+    EncodeWithEdgebreaker();
+    EmitUtf8(utf8);
+  }
+
+  // Like |Encode|, but matching edges are found in a move-to-front
+  // cache of unmatched edges, and encoded by their position in that
+  // cache. Matched edges are removed, so the cache stays short and
+  // the positions stay small. The stream layout is the same as
+  // |Encode|: |deltas_| followed by |codes_|. For each triangle, the
+  // first code is either:
+  // (1) less than the current cache size, the position of the
+  //     matching edge, followed by a code for the third vertex, or,
+  // (2) otherwise, the high water mark code of the first vertex
+  //     offset by the current cache size, followed by codes for the
+  //     second and third vertices.
+  // See |EdgeCachingDecompressor::DecompressWithLRU|.
+  void EncodeWithLRU() {
+    mode_ = EDGE_CACHING_LRU;
+    PredictNormals();
+    EdgeLru edge_lru;
+    for (size_t triangle_start_index = 0;
+         triangle_start_index < indices_.size(); triangle_start_index += 3) {
+      uint16* triangle = &indices_[triangle_start_index];
+      const size_t lru_size = edge_lru.size();
+      const size_t match = edge_lru.Find(triangle);
+      const size_t first_code = codes_.size();
+      if (match != lru_size) {
+        ParallelogramPredictor(match, edge_lru[match].opposite,
+                               triangle_start_index);
+      } else {
+        SimplePredictor(lru_size, triangle_start_index);
       }
+      SplitCodes(first_code);
+      edge_lru.Update(triangle);
     }
+    if (choose_predictors_) ChoosePredictors();
   }
 
-  // Instead of using an LRU cache of edges, simply scan the history
-  // for matching edges.
-  void Compress(ByteSinkInterface* utf8) {
-    // TODO: do this pre-quantization.
-    // Normal prediction.
+  // Codes connectivity with the |GateSymbol|s in edgebreaker.h
+  // instead of edge matches, so that most triangles cost a few bits
+  // instead of a code and a high water mark code. Triangles are
+  // reordered and vertices renumbered in the order the decoder sees
+  // them, which also rewrites |attribs_|. New vertices across a gate
+  // are parallelogram predicted, and new vertices of seed triangles
+  // are predicted as in |SimplePredictor|. |edge_codes_| has one
+  // |GateSymbol| per step, and |index_codes_| has a code for each
+  // |GATE_SPLIT|, counting back from the newest vertex, and three high
+  // water mark codes per seed. In |codes_|, these are in the order
+  // the decoder reads them, with symbols packed three to a code. See
+  // |EdgeCachingDecompressor::DecompressWithEdgebreaker|.
+  void EncodeWithEdgebreaker() {
+    mode_ = EDGE_CACHING_EDGEBREAKER;
     const size_t num_attribs = attribs_.size() / 8;
-    std::vector<int> crosses(3 * num_attribs);
-    for (size_t i = 0; i < indices_.size(); i += 3) {
-      // Compute face cross products.
-      const uint16 i0 = indices_[i + 0];
-      const uint16 i1 = indices_[i + 1];
-      const uint16 i2 = indices_[i + 2];
-      int e1[3], e2[3], cross[3];
-      e1[0] = attribs_[8*i1 + 0] - attribs_[8*i0 + 0];
-      e1[1] = attribs_[8*i1 + 1] - attribs_[8*i0 + 1];
-      e1[2] = attribs_[8*i1 + 2] - attribs_[8*i0 + 2];
-      e2[0] = attribs_[8*i2 + 0] - attribs_[8*i0 + 0];
-      e2[1] = attribs_[8*i2 + 1] - attribs_[8*i0 + 1];
-      e2[2] = attribs_[8*i2 + 2] - attribs_[8*i0 + 2];
-      cross[0] = e1[1] * e2[2] - e1[2] * e2[1];
-      cross[1] = e1[2] * e2[0] - e1[0] * e2[2];
-      cross[2] = e1[0] * e2[1] - e1[1] * e2[0];
-      // Accumulate face cross product into each vertex.
-      for (size_t j = 0; j < 3; ++j) {
-        crosses[3*i0 + j] += cross[j];
-        crosses[3*i1 + j] += cross[j];
-        crosses[3*i2 + j] += cross[j];
+    const size_t num_tris = indices_.size() / 3;
+    // |new_index_| is -1 until a vertex is seen; |old_index_| is its
+    // inverse.
+    new_index_.assign(num_attribs, -1);
+    old_index_.clear();
+    OptimizedIndexList traversed;
+    traversed.reserve(indices_.size());
+    if (num_tris != 0) {
+      const VertexTriangles topology(&indices_[0], num_tris, num_attribs);
+      std::vector<bool> visited(num_tris, false);
+      GateBoundary gates(num_attribs);
+      size_t next_seed = 0;
+      while (traversed.size() < indices_.size()) {
+        const int gate = gates.Pop();
+        if (gate < 0) {
+          while (visited[next_seed]) ++next_seed;
+          visited[next_seed] = true;
+          const uint16* seed = &indices_[3 * next_seed];
+          EdgebreakerSeed(seed);
+          traversed.insert(traversed.end(), seed, seed + 3);
+          gates.AddSeed(seed);
+          continue;
+        }
+        const GateBoundary::Gate& across = gates[gate];
+        const uint16 a = across.v0;
+        const uint16 b = across.v1;
+        size_t found = num_tris;
+        uint16 c = 0;
+        for (size_t i = topology.begin(b); i != topology.end(b); ++i) {
+          const size_t triangle = (topology.triangle(i) - &indices_[0]) / 3;
+          uint16 v1, v2;
+          VertexTriangles::Rotate(topology.triangle(i), b, &v1, &v2);
+          if (v1 == a && !visited[triangle]) {
+            found = triangle;
+            c = v2;
+            break;
+          }
+        }
+        if (found == num_tris) {
+          // A boundary, or the edge is non-manifold.
+          PutGateSymbol(GATE_SKIP);
+          gates.Skip(gate);
+          continue;
+        }
+        visited[found] = true;
+        if (new_index_[c] < 0) {
+          PutGateSymbol(GATE_NEW_VERTEX);
+          int predicted[5];
+          for (size_t j = 0; j < 5; ++j) {
+            predicted[j] = attribs_[8*a + j] + attribs_[8*b + j] -
+                attribs_[8*across.opposite + j];
+          }
+          EdgebreakerVertex(c, predicted);
+        } else if (c == gates.Next(gate)) {
+          PutGateSymbol(GATE_NEXT);
+        } else if (c == gates.Previous(gate)) {
+          PutGateSymbol(GATE_PREVIOUS);
+        } else {
+          PutGateSymbol(GATE_SPLIT);
+          PutIndexCode(old_index_.size() - 1 - new_index_[c]);
+        }
+        traversed.push_back(b);
+        traversed.push_back(a);
+        traversed.push_back(c);
+        gates.Advance(gate, c);
       }
     }
-    // Compute normal residues.
-    for (size_t idx = 0; idx < num_attribs; ++idx) {
-      float pnx = crosses[3*idx + 0];
-      float pny = crosses[3*idx + 1];
-      float pnz = crosses[3*idx + 2];
-      const float pnorm = 511.0 / sqrt(pnx*pnx + pny*pny + pnz*pnz);
-      pnx *= pnorm;
-      pny *= pnorm;
-      pnz *= pnorm;
-
-      float nx = attribs_[8*idx + 5] - 511;
-      float ny = attribs_[8*idx + 6] - 511;
-      float nz = attribs_[8*idx + 7] - 511;
-      const float norm = 511.0 / sqrt(nx*nx + ny*ny + nz*nz);
-      nx *= norm;
-      ny *= norm;
-      nz *= norm;
-
-      const uint16 dx = ZigZag(nx - pnx);
-      const uint16 dy = ZigZag(ny - pny);
-      const uint16 dz = ZigZag(nz - pnz);
-
-      deltas_[5*num_attribs + idx] = dx;
-      deltas_[6*num_attribs + idx] = dy;
-      deltas_[7*num_attribs + idx] = dz;
+    // Vertices that no triangle uses can't be decoded by any of the
+    // modes, but number them anyway so the renumbering is complete.
+    for (size_t i = 0; i < num_attribs; ++i) {
+      if (new_index_[i] < 0) {
+        new_index_[i] = old_index_.size();
+        old_index_.push_back(i);
+      }
     }
+    QuantizedAttribList renumbered(attribs_.size());
+    for (size_t i = 0; i < num_attribs; ++i) {
+      std::copy(&attribs_[8*old_index_[i]], &attribs_[8*old_index_[i]] + 8,
+                &renumbered[8*i]);
+    }
+    attribs_.swap(renumbered);
+    for (size_t i = 0; i < traversed.size(); ++i) {
+      indices_[i] = new_index_[traversed[i]];
+    }
+    PredictNormals();
+    if (choose_predictors_) ChoosePredictors();
+  }
+
+  // Instead of using an LRU cache of edges, simply scan the history
+  // for matching edges.
+  void Encode() {
+    mode_ = EDGE_CACHING_BACKREF;
+    PredictNormals();
     for (size_t triangle_start_index = 0; 
          triangle_start_index < indices_.size(); triangle_start_index += 3) {
+      const size_t first_code = codes_.size();
       const uint16 i0 = indices_[triangle_start_index + 0];
       const uint16 i1 = indices_[triangle_start_index + 1];
       const uint16 i2 = indices_[triangle_start_index + 2];
@@ -210,8 +409,10 @@ class EdgeCachingCompressor {
       // |max_backref| should be configurable and communicated.
       const uint16 max_backref = triangle_start_index < kMaxLruSize ?
           triangle_start_index : kMaxLruSize;
-      // Scan the index list for matching edges.
-      uint16 backref = 0;
+      // Scan the index list for matching edges. A |backref| of 0 is
+      // the triangle itself, which only "matches" if it is degenerate,
+      // and the decoder doesn't know its vertices yet.
+      uint16 backref = 3;
       for (; backref < max_backref; backref += 3) {
         const size_t candidate_start_index = triangle_start_index - backref;
         const uint16 j0 = indices_[candidate_start_index + 0];
@@ -270,19 +471,73 @@ class EdgeCachingCompressor {
           break;
         }
       }
-      if (backref == max_backref) {
+      if (backref >= max_backref) {
         SimplePredictor(max_backref, triangle_start_index);
       }
+      SplitCodes(first_code);
     }
-    // Emit as UTF-8.
-    for (size_t i = 0; i < deltas_.size(); ++i) {
-      if (!Uint16ToUtf8(deltas_[i], utf8)) {
-        // TODO: bounds-dependent texcoords are still busted :(
-        Uint16ToUtf8(0, utf8);
+    if (choose_predictors_) ChoosePredictors();
+  }
+
+  void EmitUtf8(ByteSinkInterface* utf8) const {
+    BufferedByteSink buffered(utf8);
+    if (!deltas_.empty() &&
+        !Uint16ArrayToUtf8(&deltas_[0], deltas_.size(), &buffered)) {
+      for (size_t i = 0; i < deltas_.size(); ++i) {
+        if (!Uint16ToUtf8(deltas_[i], &buffered)) {
+          // TODO: bounds-dependent texcoords are still busted :(
+          Uint16ToUtf8(0, &buffered);
+        }
+      }
+    }
+    if (!codes_.empty()) {
+      CHECK(Uint16ArrayToUtf8(&codes_[0], codes_.size(), &buffered));
+    }
+  }
+
+  // Binary meshes are for clients that don't need to go through
+  // XHR.responseText, so they can use an entropy coder instead of
+  // UTF-8. They begin with varints for the |EdgeCachingMode|, the
+  // position and texcoord |AttribPredictor|s, the number of
+  // vertices, triangles, edge codes and index codes, followed by a
+  // range coded payload of: the 8 columns of |deltas_|, the edge
+  // codes, then the index codes. Each column and each kind of code
+  // has its own adaptive model, and |GateSymbol|s are modeled in the
+  // context of the symbol before, since C tends to be followed by R
+  // and so on. Unlike UTF-8, any uint16 value can be coded. See
+  // |DecompressBinaryMesh|.
+  void EmitBinary(ByteSinkInterface* sink) const {
+    const size_t num_attribs = attribs_.size() / 8;
+    PutVarint(mode_, sink);
+    PutVarint(predictors_.positions, sink);
+    PutVarint(predictors_.texcoords, sink);
+    PutVarint(num_attribs, sink);
+    PutVarint(indices_.size() / 3, sink);
+    PutVarint(edge_codes_.size(), sink);
+    PutVarint(index_codes_.size(), sink);
+    RangeEncoder encoder(sink);
+    for (size_t j = 0; j < 8; ++j) {
+      AdaptiveUint16Model model;
+      for (size_t i = 0; i < num_attribs; ++i) {
+        model.Encode(deltas_[num_attribs*j + i], &encoder);
       }
     }
-    for (size_t i = 0; i < codes_.size(); ++i) {
-      CHECK(Uint16ToUtf8(codes_[i], utf8));
+    EncodeCodes(&encoder);
+    encoder.Flush();
+  }
+
+  // The connectivity part of |EmitBinary|, which is also useful for
+  // measuring it alone.
+  void EncodeCodes(RangeEncoder* encoder) const {
+    AdaptiveUint16Model edge_models[NUM_GATE_SYMBOLS];
+    size_t context = 0;
+    for (size_t i = 0; i < edge_codes_.size(); ++i) {
+      edge_models[context].Encode(edge_codes_[i], encoder);
+      if (mode_ == EDGE_CACHING_EDGEBREAKER) context = edge_codes_[i];
+    }
+    AdaptiveUint16Model index_model;
+    for (size_t i = 0; i < index_codes_.size(); ++i) {
+      index_model.Encode(index_codes_[i], encoder);
     }
   }
 
@@ -290,13 +545,154 @@ class EdgeCachingCompressor {
 
   const OptimizedIndexList& codes() const { return codes_; }
 
-  void DumpDebug(FILE* fp = stdout) {
-    for (size_t i = 0; i < lru_size_; ++i) {
-      fprintf(fp, PRIuS ": %d\n", i, edge_lru_[i]);
-    }
+  // |codes_|, split into the first code of each triangle and the rest.
+  const OptimizedIndexList& edge_codes() const { return edge_codes_; }
+
+  const OptimizedIndexList& index_codes() const { return index_codes_; }
+
+  // After encoding, the predictors that |deltas_| were computed with.
+  // These need to be in the manifest, unless |IsTraversal()|.
+  const AttribPredictors& predictors() const { return predictors_; }
+
+  // If set, |Encode| and |EncodeWithLRU| try each of the predictors
+  // in predict.h, and keep whichever gives the lowest residual entropy
+  // for positions and texcoords. Off by default, since loaders that
+  // predate |predictors()| would decode the result as traversal deltas.
+  void set_choose_predictors(bool choose_predictors) {
+    choose_predictors_ = choose_predictors;
   }
 
  private:
+  // Replaces the traversal residuals of positions and texcoords with
+  // those of a post pass predictor, where that reduces their entropy.
+  // |indices_| must be in their final winding order.
+  void ChoosePredictors() {
+    const size_t num_attribs = attribs_.size() / 8;
+    predictors_ = AttribPredictors();
+    if (indices_.empty()) return;
+    const VertexTriangles topology(&indices_[0], indices_.size() / 3,
+                                   num_attribs);
+    QuantizedAttribList candidate(deltas_.size());
+    const AttribPredictor position_candidates[] = {
+      PREDICTOR_PARALLELOGRAM
+    };
+    const AttribPredictor texcoord_candidates[] = {
+      PREDICTOR_PARALLELOGRAM, PREDICTOR_STRETCH
+    };
+    predictors_.positions = ChoosePredictor(
+        topology, position_candidates, 1, 0, 3, &candidate);
+    predictors_.texcoords = ChoosePredictor(
+        topology, texcoord_candidates, 2, 3, 2, &candidate);
+  }
+
+  // Returns the best of |PREDICTOR_TRAVERSAL| and |candidates| for
+  // columns [|column|, |column| + |num_columns|), and updates
+  // |deltas_| to match. |scratch| is the size of |deltas_|.
+  AttribPredictor ChoosePredictor(const VertexTriangles& topology,
+                                  const AttribPredictor* candidates,
+                                  size_t num_candidates,
+                                  size_t column, size_t num_columns,
+                                  QuantizedAttribList* scratch) {
+    const size_t num_attribs = attribs_.size() / 8;
+    AttribPredictor best = PREDICTOR_TRAVERSAL;
+    double best_bits = ResidualEntropy(&deltas_[0], num_attribs,
+                                       column, num_columns);
+    for (size_t i = 0; i < num_candidates; ++i) {
+      EncodeResiduals(*GetPredictor(candidates[i]), topology, attribs_,
+                      column, num_columns, &scratch->at(0));
+      const double bits = ResidualEntropy(&scratch->at(0), num_attribs,
+                                          column, num_columns);
+      if (bits < best_bits && Utf8Encodable(*scratch, column, num_columns)) {
+        best = candidates[i];
+        best_bits = bits;
+      }
+    }
+    if (best != PREDICTOR_TRAVERSAL) {
+      EncodeResiduals(*GetPredictor(best), topology, attribs_,
+                      column, num_columns, &deltas_[0]);
+    }
+    return best;
+  }
+
+  // A predictor that is badly wrong for some vertex could produce
+  // residuals that |EmitUtf8| can't represent. Codes past
+  // |kUtf8SurrogatePairStart| are shifted on the wire, and
+  // String.charCodeAt would return the shifted value, so those are
+  // ruled out as well.
+  bool Utf8Encodable(const QuantizedAttribList& deltas,
+                     size_t column, size_t num_columns) const {
+    const size_t num_attribs = attribs_.size() / 8;
+    for (size_t i = num_attribs * column;
+         i < num_attribs * (column + num_columns); ++i) {
+      if (deltas[i] >= kUtf8SurrogatePairStart) return false;
+    }
+    return true;
+  }
+
+  // TODO: do this pre-quantization.
+  // Normal prediction.
+  void PredictNormals() {
+    const size_t num_attribs = attribs_.size() / 8;
+    std::vector<int> crosses(3 * num_attribs);
+    for (size_t i = 0; i < indices_.size(); i += 3) {
+      // Compute face cross products.
+      const uint16 i0 = indices_[i + 0];
+      const uint16 i1 = indices_[i + 1];
+      const uint16 i2 = indices_[i + 2];
+      int e1[3], e2[3], cross[3];
+      e1[0] = attribs_[8*i1 + 0] - attribs_[8*i0 + 0];
+      e1[1] = attribs_[8*i1 + 1] - attribs_[8*i0 + 1];
+      e1[2] = attribs_[8*i1 + 2] - attribs_[8*i0 + 2];
+      e2[0] = attribs_[8*i2 + 0] - attribs_[8*i0 + 0];
+      e2[1] = attribs_[8*i2 + 1] - attribs_[8*i0 + 1];
+      e2[2] = attribs_[8*i2 + 2] - attribs_[8*i0 + 2];
+      cross[0] = e1[1] * e2[2] - e1[2] * e2[1];
+      cross[1] = e1[2] * e2[0] - e1[0] * e2[2];
+      cross[2] = e1[0] * e2[1] - e1[1] * e2[0];
+      // Accumulate face cross product into each vertex.
+      for (size_t j = 0; j < 3; ++j) {
+        crosses[3*i0 + j] += cross[j];
+        crosses[3*i1 + j] += cross[j];
+        crosses[3*i2 + j] += cross[j];
+      }
+    }
+    // Compute normal residues.
+    for (size_t idx = 0; idx < num_attribs; ++idx) {
+      float pnx = crosses[3*idx + 0];
+      float pny = crosses[3*idx + 1];
+      float pnz = crosses[3*idx + 2];
+      const float pnorm = 511.0 / sqrt(pnx*pnx + pny*pny + pnz*pnz);
+      pnx *= pnorm;
+      pny *= pnorm;
+      pnz *= pnorm;
+
+      float nx = attribs_[8*idx + 5] - 511;
+      float ny = attribs_[8*idx + 6] - 511;
+      float nz = attribs_[8*idx + 7] - 511;
+      const float norm = 511.0 / sqrt(nx*nx + ny*ny + nz*nz);
+      nx *= norm;
+      ny *= norm;
+      nz *= norm;
+
+      const uint16 dx = ZigZag(nx - pnx);
+      const uint16 dy = ZigZag(ny - pny);
+      const uint16 dz = ZigZag(nz - pnz);
+
+      deltas_[5*num_attribs + idx] = dx;
+      deltas_[6*num_attribs + idx] = dy;
+      deltas_[7*num_attribs + idx] = dz;
+    }
+  }
+
+  // The first code of each triangle identifies an edge match (or
+  // not), and the codes that follow it are high water mark codes, so
+  // they have rather different statistics.
+  void SplitCodes(size_t first_code) {
+    edge_codes_.push_back(codes_[first_code]);
+    index_codes_.insert(index_codes_.end(),
+                        codes_.begin() + first_code + 1, codes_.end());
+  }
+
   // The simple predictor is slightly (maybe 5%) more effective than
   // |CompressQuantizedAttribsToUtf8|. Instead of delta encoding in
   // attribute order, we use the last referenced attribute as the
@@ -360,6 +756,62 @@ class EdgeCachingCompressor {
     }
   }
 
+  // Mirrors |EdgeCachingDecompressor::NextSymbol|.
+  void PutGateSymbol(GateSymbol symbol) {
+    const size_t position = edge_codes_.size() % 3;
+    edge_codes_.push_back(symbol);
+    if (position == 0) {
+      packed_code_ = codes_.size();
+      codes_.push_back(symbol);
+    } else {
+      codes_[packed_code_] += symbol * (position == 1 ? NUM_GATE_SYMBOLS :
+                                        NUM_GATE_SYMBOLS * NUM_GATE_SYMBOLS);
+    }
+  }
+
+  void PutIndexCode(uint16 code) {
+    codes_.push_back(code);
+    index_codes_.push_back(code);
+  }
+
+  // Numbers |index| as the next vertex, and encodes its attributes
+  // against |predicted| in their new place in |deltas_|.
+  void EdgebreakerVertex(uint16 index, const int* predicted) {
+    const size_t num_attribs = attribs_.size() / 8;
+    new_index_[index] = old_index_.size();
+    old_index_.push_back(index);
+    for (size_t j = 0; j < 5; ++j) {
+      deltas_[num_attribs*j + new_index_[index]] =
+          ZigZag(attribs_[8*index + j] - predicted[j]);
+    }
+    UpdateLastAttrib(index);
+  }
+
+  // Like |SimplePredictor|, but with the high water mark codes of
+  // the renumbered vertices.
+  void EdgebreakerSeed(const uint16* triangle) {
+    for (size_t i = 0; i < 3; ++i) {
+      const uint16 index = triangle[i];
+      if (new_index_[index] >= 0) {
+        PutIndexCode(old_index_.size() - new_index_[index]);
+        UpdateLastAttrib(index);
+        continue;
+      }
+      PutIndexCode(0);
+      int predicted[5];
+      for (size_t j = 0; j < 5; ++j) {
+        if (i < 2) {
+          predicted[j] = last_attrib_[j];
+        } else {
+          int average = attribs_[8*triangle[0] + j];
+          average += attribs_[8*triangle[1] + j];
+          predicted[j] = average / 2;
+        }
+      }
+      EdgebreakerVertex(index, predicted);
+    }
+  }
+
   // Returns |true| if |index_high_water_mark_| is incremented, otherwise
   // returns |false| and automatically updates |last_attrib_|. 
   bool HighWaterMark(uint16 index, uint16 start_code = 0) {
@@ -379,135 +831,14 @@ class EdgeCachingCompressor {
     }
   }
 
-  // Find edge matches of |triangle| referenced in |edge_lru_|
-  // |match_indices| stores where the matches occur in |edge_lru_|
-  // |match_winding| stores where the matches occur in |triangle|
-  size_t LruEdge(const uint16* triangle,
-                 size_t* match_indices,
-                 size_t* match_winding) {
-    const uint16 i0 = triangle[0];
-    const uint16 i1 = triangle[1];
-    const uint16 i2 = triangle[2];
-    // The primary thing is to find the first matching edge, if
-    // any. If we assume that our mesh is mostly manifold, then each
-    // edge is shared by at most two triangles (with the indices in
-    // opposite order), so we actually want to eventually remove all
-    // matching edges. However, this means we have to continue
-    // scanning the array to find all matching edges, not just the
-    // first. The edges that don't match will then pushed to the
-    // front.
-    size_t num_matches = 0;
-    for (size_t i = 0; i < lru_size_ && num_matches < 3; ++i) {
-      const int edge_index = edge_lru_[i];
-      // |winding| is a tricky detail used to dereference the edge to
-      // yield |e0| and |e1|, since we must handle the edge that wraps
-      // the last and first vertex. For now, just implement this in a
-      // straightforward way using a switch, but since this code would
-      // actually also need to run in the decompressor, we must
-      // optimize it.
-      const int winding = edge_index % 3;
-      uint16 e0, e1;
-      switch (winding) {
-        case 0:
-          e0 = indices_[edge_index + 1];
-          e1 = indices_[edge_index + 2];
-          break;
-        case 1:
-          e0 = indices_[edge_index + 2];
-          e1 = indices_[edge_index];
-          break;
-        case 2:
-          e0 = indices_[edge_index];
-          e1 = indices_[edge_index + 1];
-          break;
-        default:
-          DumpDebug();
-          CHECK(false);
-      }
-
-      // Check each edge of the input triangle against |e0| and
-      // |e1|. Note that we reverse the winding of the input triangle.
-      // TODO: does this properly handle degenerate input?
-      if (e0 == i1 && e1 == i0) {
-        match_winding[num_matches] = 2;
-        match_indices[++num_matches] = i;
-      } else if (e0 == i2 && e1 == i1) {
-        match_winding[num_matches] = 0;
-        match_indices[++num_matches] = i;
-      } else if (e0 == i0 && e1 == i2) {
-        match_winding[num_matches] = 1;
-        match_indices[++num_matches] = i;
-      }
-    }
-    switch (num_matches) {
-      case 1:
-        match_winding[1] = (match_winding[0] + 1) % 3;  // Fall through.
-      case 2:
-        match_winding[2] = 3 - match_winding[1] - match_winding[0];
-      default: ;  // Do nothing.
-    }
-    return num_matches;
-  }
-
-  // If no edges were found in |triangle|, then simply push the edges
-  // onto |edge_lru_|.
-  void LruEdgeZero(const uint16* triangle) {
-    // Shift |edge_lru_| by three elements. Note that the |edge_lru_|
-    // array has at least three extra elements to make this simple.
-    lru_size_ += 3;
-    if (lru_size_ > kMaxLruSize) lru_size_ = kMaxLruSize;
-    memmove(edge_lru_ + 3, edge_lru_, lru_size_ * sizeof(int));
-    // Push |triangle| to front of |edge_lru_|
-    edge_lru_[0] = triangle[0];
-    edge_lru_[1] = triangle[1];
-    edge_lru_[2] = triangle[2];
-  }
-
-  // Remove one edge and add two.
-  void LruEdgeOne(size_t i0, size_t i1, size_t match_index) {
-    CHECK(match_index < lru_size_);
-    // Shift |edge_lru_| by one element, starting with |match_index| + 1.
-    memmove(edge_lru_ + match_index + 2, edge_lru_ + match_index + 1,
-            (lru_size_ - match_index) * sizeof(int));
-    // Shift |edge_lru_| by two elements until reaching |match_index|.
-    memmove(edge_lru_ + 2, edge_lru_, match_index * sizeof(int));
-    edge_lru_[0] = i0;
-    edge_lru_[1] = i1;
-  }
-
-  // Remove two edges and add one.
-  void LruEdgeTwo(int i0, size_t match_index0, size_t match_index1) {
-    CHECK(match_index0 < lru_size_);
-    CHECK(match_index1 < lru_size_);
-
-    // memmove 1
-    // memmove 2
-    edge_lru_[0] = i0;
-  }
-
-  // All edges were found, so just remove them from |edge_lru_|.
-  void LruEdgeThree(size_t match_index0, 
-                    size_t match_index1, 
-                    size_t match_index2) {
-    const size_t shift_two = match_index1 - 1;
-    for (size_t i = match_index0; i < shift_two; ++i) {
-      edge_lru_[i] = edge_lru_[i + 1];
-    }
-    const size_t shift_three = match_index2 - 2;
-    for (size_t i = shift_two; i < shift_three; ++i) {
-      edge_lru_[i] = edge_lru_[i + 2];
-    }
-    lru_size_ -= 3;
-    for (size_t i = shift_three; i < lru_size_; ++i) {
-      edge_lru_[i] = edge_lru_[i + 3];
-    }
-  }
-
-  // |attribs_| and |indices_| is the input mesh.
-  const QuantizedAttribList& attribs_;
-  // |indices_| are non-const because |Compress| may update triangle
-  // winding order.
+  // |attribs_| and |indices_| is the input mesh. They are non-const
+  // because |Compress| may update triangle winding order, and
+  // |EncodeWithEdgebreaker| renumbers everything.
+  QuantizedAttribList& attribs_;
   OptimizedIndexList& indices_;
+  EdgeCachingMode mode_;
+  bool choose_predictors_;
+  AttribPredictors predictors_;
   // |deltas_| contains the compressed attributes. They can be
   // compressed in one of two ways:
   // (1) with parallelogram prediction, compared with the predicted vertex,
@@ -520,18 +851,20 @@ class EdgeCachingCompressor {
   // edge match; that is, the first edge of the next triangle matches
   // a recently-seen edge.
   OptimizedIndexList codes_; 
+  OptimizedIndexList edge_codes_;
+  OptimizedIndexList index_codes_;
   // |index_high_water_mark_| is used as it is in |CompressIndicesToUtf8|.
   uint16 index_high_water_mark_;
   // |last_attrib_referenced_| is the index of the last referenced
   // attribute. This is used to delta encode attributes when no edge match
   // is found.
   uint16 last_attrib_[8];
-  size_t lru_size_;
-  // |edge_lru_| contains the LRU lits of edge references. It stores
-  // indices to the input |indices_|. By convention, an edge points to
-  // the vertex opposite the edge in question. We pad the array by a
-  // triangle to simplify edge cases.
-  int edge_lru_[kMaxLruSize + 3];
+  // For |EncodeWithEdgebreaker|: the position in |codes_| of the code
+  // that the next two |GateSymbol|s are packed into, and the vertex
+  // renumbering, by old and by new index.
+  size_t packed_code_;
+  std::vector<int> new_index_;
+  std::vector<uint16> old_index_;
 };
 
 }  // namespace webgl_loader
@@ -0,0 +1,625 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_CONVERT_H_
+#define WEBGL_LOADER_CONVERT_H_
+
+// obj2utf8x's pipeline, from a parsed OBJ to mesh files and their
+// manifest, for tools that convert many models in one process. Tools
+// that include this must be built with -pthread.
+
+#include <errno.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "async_sink.h"
+#include "bounds.h"
+#include "build_cache.h"
+#include "compress.h"
+#include "decompress.h"
+#include "gpu.h"
+#include "hash_sink.h"
+#include "manifest.h"
+#include "mesh.h"
+#include "optimize.h"
+#include "simplify.h"
+#include "stream.h"
+#include "thread.h"
+#include "weld.h"
+
+namespace webgl_loader {
+
+// By |EdgeCachingMode|.
+const MeshFormat kCodeRangeFormats[] = {
+  MESH_FORMAT_CODE_RANGE,
+  MESH_FORMAT_LRU_CODE_RANGE,
+  MESH_FORMAT_EDGEBREAKER_CODE_RANGE
+};
+
+// How to convert a model; obj2utf8x's flags, by default off.
+struct ConvertOptions {
+  ConvertOptions()
+      : mode(EDGE_CACHING_BACKREF),
+        use_binary(false),
+        use_predictors(false),
+        weld(false),
+        use_gpu(false),
+        gpu_normals(GPU_NORMALS_INT_2_10_10_10),
+        file_flags(0),
+        print_stats(false),
+        print_hash(false),
+        verify(false),
+        num_threads(1),
+        cache(NULL),
+        tool_hash(0) {
+    weld_tolerances.position = 0;
+    weld_tolerances.texcoord = 0;
+    weld_tolerances.normal = 0;
+  }
+
+  EdgeCachingMode mode;
+  bool use_binary;
+  bool use_predictors;
+  bool weld;
+  WeldTolerances weld_tolerances;
+  bool use_gpu;
+  GpuNormalFormat gpu_normals;
+  int file_flags;  // From AsyncFileFlags.
+  bool print_stats;
+  bool print_hash;
+  bool verify;
+  std::vector<double> lod_ratios;  // Decreasing; empty for no LODs.
+  int num_threads;  // To simplify batches on.
+  BuildCache* cache;  // For --cache, or NULL.
+  // Of this tool, for cache keys, so that a rebuilt one starts afresh.
+  uint64 tool_hash;
+};
+
+// A material batch, at some level of detail.
+struct Batch {
+  const std::string* material;
+  DrawMesh draw_mesh;
+  std::vector<size_t> group_offsets;
+};
+
+// What was written to a mesh file, for --verify.
+struct WrittenMeshes {
+  std::vector<MeshEntry> entries;
+  // Rotated by the compressor to match |entries|.
+  WebGLMeshList meshes;
+};
+
+// Quantizes, optimizes and compresses |batch| to |sink|, starting at
+// |*offset|, and adds its manifest entries to |written|.
+void WriteBatch(const ConvertOptions& options,
+                const BoundsParams& bounds_params,
+                const Batch& batch, ByteSinkInterface* sink,
+                size_t* offset, WrittenMeshes* written) {
+  const DrawMesh& draw_mesh = batch.draw_mesh;
+  QuantizedAttribList quantized_attribs;
+  AttribsToQuantizedAttribs(draw_mesh.attribs, bounds_params,
+                            &quantized_attribs);
+  // Welding goes by quantized attribs, so that it sees the vertices
+  // as the decoder will.
+  std::vector<int> remap;
+  size_t num_welded = 0, num_dropped = 0;
+  if (options.weld) {
+    num_welded = FindWeldedVertices(quantized_attribs,
+                                    options.weld_tolerances, &remap);
+  }
+  IndexList welded_indices;
+  VertexOptimizer vertex_optimizer(quantized_attribs);
+  const std::vector<size_t>& group_offsets = batch.group_offsets;
+  WebGLMeshList webgl_meshes;
+  for (size_t i = 0; i < group_offsets.size(); ++i) {
+    const size_t here = group_offsets[i];
+    size_t length = (i + 1 < group_offsets.size()) ?
+        group_offsets[i + 1] - here : draw_mesh.indices.size() - here;
+    CHECK(length % 3 == 0);
+    if (length == 0) continue;
+    const int* indices = &draw_mesh.indices[here];
+    if (options.weld) {
+      const size_t start = welded_indices.size();
+      num_dropped += RemapTriangles(remap, indices, length, &welded_indices);
+      length = welded_indices.size() - start;
+      if (length == 0) continue;
+      indices = &welded_indices[start];
+    }
+    vertex_optimizer.AddTriangles(indices, length, &webgl_meshes);
+  }
+  if (options.weld) {
+    fprintf(stderr, "%s: welded " PRIuS " of " PRIuS " vertices, dropping "
+            PRIuS " triangles.\n", batch.material->c_str(), num_welded,
+            quantized_attribs.size() / 8, num_dropped);
+  }
+
+  std::vector<MeshEntry> entries(webgl_meshes.size());
+  for (size_t i = 0; i < webgl_meshes.size(); ++i) {
+    const size_t num_attribs = webgl_meshes[i].attribs.size();
+    const size_t num_indices = webgl_meshes[i].indices.size();
+    CHECK(num_attribs % 8 == 0);
+    CHECK(num_indices % 3 == 0);
+    if (options.use_gpu) {
+      // Written all at once by |WriteMeshFile|, which needs every mesh
+      // for the header.
+      MeshEntry& entry = entries[i];
+      entry.format = MESH_FORMAT_GPU_BUFFERS;
+      entry.material = *batch.material;
+      entry.num_verts = num_attribs / 8;
+      entry.num_tris = num_indices / 3;
+      entry.code_start = written->meshes.size() + i;
+      continue;
+    }
+    EdgeCachingCompressor compressor(webgl_meshes[i].attribs,
+                                     webgl_meshes[i].indices);
+    compressor.set_choose_predictors(options.use_predictors);
+    switch (options.mode) {
+      case EDGE_CACHING_LRU:
+        compressor.EncodeWithLRU();
+        break;
+      case EDGE_CACHING_EDGEBREAKER:
+        compressor.EncodeWithEdgebreaker();
+        break;
+      default:
+        compressor.Encode();
+    }
+    MeshEntry& entry = entries[i];
+    entry.material = *batch.material;
+    entry.num_tris = num_indices / 3;
+    entry.predictors = compressor.predictors();
+    if (options.use_binary) {
+      // Binary meshes are byte ranges, and are self-describing.
+      std::string binary;
+      StringSink binary_sink(&binary);
+      compressor.EmitBinary(&binary_sink);
+      sink->PutN(binary.data(), binary.size());
+      entry.format = MESH_FORMAT_BINARY_RANGE;
+      entry.code_start = *offset;
+      entry.code_length = binary.size();
+    } else {
+      compressor.EmitUtf8(sink);
+      entry.format = kCodeRangeFormats[options.mode];
+      entry.attrib_start = *offset;
+      entry.num_verts = num_attribs / 8;
+      entry.code_start = *offset + num_attribs;
+      entry.code_length = compressor.codes().size();
+    }
+    *offset = entry.End();
+  }
+  written->entries.insert(written->entries.end(),
+                          entries.begin(), entries.end());
+  written->meshes.insert(written->meshes.end(),
+                         webgl_meshes.begin(), webgl_meshes.end());
+}
+
+// For --stats: how big |path| is, and how far an order-0 entropy
+// coder could shrink it, from the byte counts in |histo|.
+void PrintStats(const char* path, const size_t* histo) {
+  size_t total = 0;
+  for (size_t i = 0; i < 256; ++i) {
+    total += histo[i];
+  }
+  double bits = 0.0;
+  size_t num_used = 0;
+  for (size_t i = 0; i < 256; ++i) {
+    if (histo[i] == 0) continue;
+    ++num_used;
+    bits += histo[i] * log(static_cast<double>(total) / histo[i]) / log(2.0);
+  }
+  fprintf(stderr, "%s: " PRIuS " bytes, " PRIuS " distinct, order-0 entropy "
+          "%.3f bits/byte (" PRIuS " bytes).\n", path, total, num_used,
+          total ? bits / total : 0.0, static_cast<size_t>(bits / 8));
+}
+
+// "path: what went wrong", for |errno_value|.
+std::string FileError(const char* path, int errno_value) {
+  return std::string(path) + ": " + strerror(errno_value);
+}
+
+// Writes |batches| to |path|, and adds its "urls" entry to |urls|.
+// The encoders write each byte once, and a |FanOutSink| hands it to
+// the file and to whatever --stats and --hash need. Returns false,
+// with |error| set, if |path| couldn't be written.
+bool WriteMeshFile(const ConvertOptions& options,
+                   const BoundsParams& bounds_params,
+                   const std::vector<Batch>& batches, const char* path,
+                   std::vector<ManifestUrl>* urls, WrittenMeshes* written,
+                   std::string* error) {
+  // Written on another thread while the next batch is compressed.
+  AsyncFileSink utf8_out;
+  if (!utf8_out.Open(path, options.file_flags)) {
+    *error = FileError(path, errno);
+    return false;
+  }
+  FanOutSink utf8_sink;
+  // The hash is taken in the file's own blocks, rather than a copy.
+  HashingSink hashing_sink(&utf8_out);
+  utf8_sink.AddBranch(options.print_hash ?
+                      static_cast<BufferedSink*>(&hashing_sink) :
+                      &utf8_out);
+  NullSink null_sink;
+  ByteHistogramSink histogram_sink(&null_sink);
+  BufferedByteSink stats_sink(&histogram_sink);
+  if (options.print_stats) utf8_sink.AddBranch(&stats_sink);
+  size_t offset = 0;
+  for (size_t i = 0; i < batches.size(); ++i) {
+    WriteBatch(options, bounds_params, batches[i], &utf8_sink, &offset,
+               written);
+  }
+  urls->push_back(ManifestUrl());
+  ManifestUrl& url = urls->back();
+  url.path = path;
+  url.meshes.resize(written->entries.size());
+  for (size_t i = 0; i < written->entries.size(); ++i) {
+    url.meshes[i].entry = written->entries[i];
+  }
+  if (options.use_gpu) {
+    if (WriteGpuMeshes(bounds_params, options.gpu_normals,
+                       written->meshes, &utf8_sink) !=
+        GPU_TEXCOORDS_UNORM16) {
+      fprintf(stderr, "%s: texcoords wrap, so they are not normalized.\n",
+              path);
+    }
+  }
+  utf8_sink.Flush();
+  if (options.print_hash) {
+    char hex[17];
+    const uint64 hash = hashing_sink.Digest();
+    ToHex(static_cast<uint32>(hash >> 32), hex);
+    ToHex(static_cast<uint32>(hash), hex + 8);
+    fprintf(stderr, "%s: hash %s\n", path, hex);
+  }
+  if (options.print_stats) PrintStats(path, histogram_sink.histo());
+  if (!utf8_out.Close()) {
+    *error = FileError(path, utf8_out.error());
+    return false;
+  }
+  return true;
+}
+
+// Maps |path|, as a client would, and checks it against |written|.
+bool VerifyGpuFile(const char* path, const WrittenMeshes& written) {
+  GpuMeshFile file;
+  size_t num_mismatches = 0;
+  if (!file.Map(path) || file.num_meshes() != written.meshes.size()) {
+    num_mismatches = written.meshes.size();
+  } else {
+    DecodedMesh mesh;
+    for (size_t i = 0; i < file.num_meshes(); ++i) {
+      file.Unpack(i, &mesh);
+      if (!MatchesDecodedMesh(written.meshes[i], MESH_FORMAT_GPU_BUFFERS,
+                              mesh)) {
+        ++num_mismatches;
+      }
+    }
+  }
+  fprintf(stderr, "%s: verified " PRIuS " of " PRIuS " meshes, "
+          PRIuS " mismatched.\n", path, file.num_meshes(),
+          written.meshes.size(), num_mismatches);
+  return num_mismatches == 0;
+}
+
+// Decodes |path|, and checks it against |written|.
+bool VerifyMeshFile(const BoundsParams& bounds_params,
+                    const char* path, const WrittenMeshes& written) {
+  if (!written.entries.empty() &&
+      written.entries[0].format == MESH_FORMAT_GPU_BUFFERS) {
+    return VerifyGpuFile(path, written);
+  }
+  FILE* fp = fopen(path, "rb");
+  if (fp == NULL) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return false;
+  }
+  MeshVerifier verifier(&written.meshes);
+  MeshStreamDecoder decoder(bounds_params, written.entries, &verifier);
+  const bool finished = DecodeMeshFile(fp, &decoder);
+  fclose(fp);
+  fprintf(stderr, "%s: verified " PRIuS " of " PRIuS " meshes, "
+          PRIuS " mismatched.\n", path, verifier.num_meshes(),
+          written.meshes.size(), verifier.num_mismatches());
+  return finished && verifier.num_mismatches() == 0;
+}
+
+// Parses a list like "0.5,0.25,0.06" into |ratios|.
+bool ParseLodRatios(const char* list, std::vector<double>* ratios) {
+  while (*list) {
+    char* end = NULL;
+    const double ratio = strtod(list, &end);
+    if (end == list || ratio <= 0.0 || ratio >= 1.0) return false;
+    if (!ratios->empty() && ratio >= ratios->back()) return false;
+    ratios->push_back(ratio);
+    list = end;
+    if (*list == ',') ++list;
+  }
+  return !ratios->empty();
+}
+
+// Parses a list like "2,1,4" into |tolerances| for positions,
+// texcoords and normals.
+bool ParseWeldTolerances(const char* list, WeldTolerances* tolerances) {
+  uint16* const fields[3] = {
+    &tolerances->position, &tolerances->texcoord, &tolerances->normal
+  };
+  for (size_t i = 0; i < 3; ++i) {
+    char* end = NULL;
+    const long tolerance = strtol(list, &end, 10);
+    if (end == list || tolerance < 0 || tolerance > 1023) return false;
+    *fields[i] = static_cast<uint16>(tolerance);
+    list = end;
+    if (*list != (i < 2 ? ',' : '\0')) return false;
+    ++list;
+  }
+  return true;
+}
+
+// Parses "2_10_10_10" or "octahedral" into |format|.
+bool ParseGpuNormalFormat(const char* name, GpuNormalFormat* format) {
+  if (0 == strcmp(name, "2_10_10_10")) {
+    *format = GPU_NORMALS_INT_2_10_10_10;
+  } else if (0 == strcmp(name, "octahedral")) {
+    *format = GPU_NORMALS_OCTAHEDRAL;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Parses the flag in |argv|[0], and its value in |argv|[1] if it
+// takes one, into |options|. Returns how many of the |argc| arguments
+// it used: 0 if |argv|[0] isn't a conversion flag, or its value is
+// bad.
+int ParseConvertFlag(int argc, const char* const* argv,
+                     ConvertOptions* options) {
+  const char* flag = argv[0];
+  if (0 == strcmp(flag, "--lru")) {
+    options->mode = EDGE_CACHING_LRU;
+  } else if (0 == strcmp(flag, "--edgebreaker")) {
+    options->mode = EDGE_CACHING_EDGEBREAKER;
+  } else if (0 == strcmp(flag, "--binary")) {
+    options->use_binary = true;
+  } else if (0 == strcmp(flag, "--verify")) {
+    options->verify = true;
+  } else if (0 == strcmp(flag, "--direct")) {
+    options->file_flags |= ASYNC_FILE_DIRECT;
+  } else if (0 == strcmp(flag, "--sync")) {
+    options->file_flags |= ASYNC_FILE_SYNC;
+  } else if (0 == strcmp(flag, "--stats")) {
+    options->print_stats = true;
+  } else if (0 == strcmp(flag, "--hash")) {
+    options->print_hash = true;
+  } else if (0 == strcmp(flag, "--predictors")) {
+    options->use_predictors = true;
+  } else if (argc < 2) {
+    return 0;
+  } else if (0 == strcmp(flag, "--lod")) {
+    std::vector<double> ratios;
+    if (!ParseLodRatios(argv[1], &ratios)) return 0;
+    options->lod_ratios.swap(ratios);
+    return 2;
+  } else if (0 == strcmp(flag, "--gpu")) {
+    if (!ParseGpuNormalFormat(argv[1], &options->gpu_normals)) return 0;
+    options->use_gpu = true;
+    return 2;
+  } else if (0 == strcmp(flag, "--weld")) {
+    if (!ParseWeldTolerances(argv[1], &options->weld_tolerances)) return 0;
+    options->weld = true;
+    return 2;
+  } else {
+    return 0;
+  }
+  return 1;
+}
+
+// "out.utf8" -> "out.lod1.utf8", or "out" -> "out.lod1".
+std::string LodPath(const char* path, size_t level) {
+  const char* dot = strrchr(StripLeadingDir(path), '.');
+  const size_t split = dot ? dot - path : strlen(path);
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".lod" PRIuS, level);
+  const std::string full(path);
+  return full.substr(0, split) + suffix + full.substr(split);
+}
+
+// The LOD chains of all the batches, built in parallel.
+struct LodChains {
+  const std::vector<Batch>* batches;
+  const std::vector<double>* ratios;
+  std::vector<std::vector<LodLevel> > levels;
+};
+
+void BuildBatchLodChain(void* arg, size_t i) {
+  LodChains* chains = static_cast<LodChains*>(arg);
+  const Batch& batch = (*chains->batches)[i];
+  BuildLodChain(batch.draw_mesh, batch.group_offsets, *chains->ratios,
+                &chains->levels[i]);
+}
+
+// Compresses |obj| to |out_path|, and its levels of detail to
+// |LodPath|s beside it, and describes them all in |manifest|, as
+// obj2utf8x does. With |options.verify|, |verified| says whether each
+// file decodes as it was written; otherwise it is true. Returns false,
+// with |error| set, if a file couldn't be written. Progress and
+// --stats go to STDERR.
+bool ConvertObj(const ConvertOptions& options, const WavefrontObjFile& obj,
+                const char* out_path, Manifest* manifest, bool* verified,
+                std::string* error) {
+  const MaterialList& materials = obj.materials();
+  manifest->materials.resize(materials.size());
+  for (size_t i = 0; i < materials.size(); ++i) {
+    ManifestMaterial& material = manifest->materials[i];
+    material.name = materials[i].name;
+    for (size_t j = 0; j < 3; ++j) {
+      material.Kd[j] = Quantize(materials[i].Kd[j], 0, 1, 255);
+    }
+    material.map_Kd = materials[i].map_Kd;
+  }
+
+  const MaterialBatches& material_batches = obj.material_batches();
+
+  // Pass 1: compute bounds.
+  Bounds bounds;
+  bounds.Clear();
+  std::vector<Batch> batches;
+  for (MaterialBatches::const_iterator iter = material_batches.begin();
+       iter != material_batches.end(); ++iter) {
+    const DrawBatch& draw_batch = iter->second;
+    bounds.Enclose(draw_batch.draw_mesh().attribs);
+    if (draw_batch.draw_mesh().indices.empty()) continue;
+    batches.push_back(Batch());
+    Batch& batch = batches.back();
+    batch.material = &iter->first;
+    batch.draw_mesh = draw_batch.draw_mesh();
+    const std::vector<GroupStart>& group_starts = draw_batch.group_starts();
+    for (size_t i = 0; i < group_starts.size(); ++i) {
+      batch.group_offsets.push_back(group_starts[i].offset);
+    }
+  }
+  BoundsParams bounds_params = BoundsParams::FromBounds(bounds);
+  memcpy(manifest->decode_offsets, bounds_params.decodeOffsets,
+         sizeof(manifest->decode_offsets));
+  memcpy(manifest->decode_scales, bounds_params.decodeScales,
+         sizeof(manifest->decode_scales));
+  // Pass 2: quantize, optimize, compress, report.
+  WrittenMeshes written;
+  if (!WriteMeshFile(options, bounds_params, batches, out_path,
+                     &manifest->urls, &written, error)) {
+    return false;
+  }
+  *verified = !options.verify ||
+      VerifyMeshFile(bounds_params, out_path, written);
+
+  // Pass 3: simplify each batch, and write each level of detail to
+  // its own file, coarsest first in the manifest, so that a loader
+  // can start with the coarsest one it will accept.
+  const std::vector<double>& lod_ratios = options.lod_ratios;
+  if (!lod_ratios.empty()) {
+    LodChains chains;
+    chains.batches = &batches;
+    chains.ratios = &lod_ratios;
+    chains.levels.resize(batches.size());
+    ParallelFor(batches.size(), &BuildBatchLodChain, &chains,
+                options.num_threads);
+    for (size_t level = lod_ratios.size(); level-- != 0; ) {
+      std::vector<Batch> lod_batches;
+      double lod_error = 0.0;
+      for (size_t i = 0; i < batches.size(); ++i) {
+        const LodLevel& lod = chains.levels[i][level];
+        lod_error = std::max(lod_error, lod.error);
+        if (lod.indices.empty()) continue;
+        lod_batches.push_back(Batch());
+        Batch& batch = lod_batches.back();
+        batch.material = batches[i].material;
+        batch.draw_mesh.attribs = batches[i].draw_mesh.attribs;
+        batch.draw_mesh.indices = lod.indices;
+        batch.group_offsets = lod.group_offsets;
+      }
+      const std::string path = LodPath(out_path, level + 1);
+      manifest->lods.push_back(ManifestLod());
+      ManifestLod& lod = manifest->lods.back();
+      lod.error = lod_error;
+      WrittenMeshes lod_written;
+      if (!WriteMeshFile(options, bounds_params, lod_batches, path.c_str(),
+                         &lod.urls, &lod_written, error)) {
+        return false;
+      }
+      if (options.verify) {
+        *verified &= VerifyMeshFile(bounds_params, path.c_str(),
+                                    lod_written);
+      }
+    }
+  }
+  return true;
+}
+
+// The paths of the mesh files in |manifest|: its "urls", then those of
+// each of its "lods".
+void ManifestPaths(const Manifest& manifest,
+                   std::vector<std::string>* paths) {
+  for (size_t i = 0; i < manifest.urls.size(); ++i) {
+    paths->push_back(manifest.urls[i].path);
+  }
+  for (size_t i = 0; i < manifest.lods.size(); ++i) {
+    const std::vector<ManifestUrl>& urls = manifest.lods[i].urls;
+    for (size_t j = 0; j < urls.size(); ++j) {
+      paths->push_back(urls[j].path);
+    }
+  }
+}
+
+// The key in |options.cache| for converting the OBJ whose |inputs| are
+// hashed (see |HashObjInputs|) to |out_path|, which the manifest
+// names. Of the options, it covers those that change the output.
+uint64 ConvertKey(const ConvertOptions& options, const Hash64& inputs,
+                  const char* out_path) {
+  Hash64 hash;
+  HashBytes(reinterpret_cast<const char*>(&options.tool_hash),
+            sizeof(options.tool_hash), &hash);
+  const uint32 flags[] = {
+    static_cast<uint32>(options.mode),
+    options.use_binary,
+    options.use_predictors,
+    options.weld,
+    options.weld_tolerances.position,
+    options.weld_tolerances.texcoord,
+    options.weld_tolerances.normal,
+    options.use_gpu,
+    static_cast<uint32>(options.gpu_normals)
+  };
+  HashBytes(reinterpret_cast<const char*>(flags), sizeof(flags), &hash);
+  const std::vector<double>& lod_ratios = options.lod_ratios;
+  HashBytes(lod_ratios.empty() ? NULL :
+            reinterpret_cast<const char*>(&lod_ratios[0]),
+            lod_ratios.size() * sizeof(lod_ratios[0]), &hash);
+  HashString(out_path, &hash);
+  HashDigest(inputs, &hash);
+  return hash.Digest();
+}
+
+// If |options.cache| has an entry for |key|, puts its files back beside
+// |out_path|, reads its manifest into |manifest|, and returns true.
+bool FetchConverted(const ConvertOptions& options, uint64 key,
+                    const char* out_path, Manifest* manifest) {
+  const char* name = StripLeadingDir(out_path);
+  const std::string dir(out_path, name - out_path);
+  std::string json;
+  if (!options.cache->Fetch(key, dir, &json)) return false;
+  BufferedInput input(json.data(), json.size());
+  JsonReader reader(&input);
+  JsonManifestReader manifest_reader(&reader);
+  if (manifest_reader.Read(manifest)) return true;
+  *manifest = Manifest();
+  return false;
+}
+
+// Adds an entry for |key| to |options.cache|, of |manifest| and the
+// files it names. Returns false if it couldn't.
+bool StoreConverted(const ConvertOptions& options, uint64 key,
+                    const Manifest& manifest) {
+  std::string json;
+  {
+    BufferedStringSink sink(&json);
+    JsonSink json_sink(&sink);
+    WriteJsonManifest(manifest, &json_sink);
+  }
+  std::vector<std::string> paths;
+  ManifestPaths(manifest, &paths);
+  return options.cache->Store(key, json, paths);
+}
+
+}  // namespace webgl_loader
+
+#endif  // WEBGL_LOADER_CONVERT_H_
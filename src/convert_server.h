@@ -0,0 +1,697 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_CONVERT_SERVER_H_
+#define WEBGL_LOADER_CONVERT_SERVER_H_
+
+// A resident obj2utf8x, for services that convert models on demand:
+// jobs come over a Unix domain socket, and run on a few threads of one
+// long-lived process, rather than each paying for a process of its
+// own, with cold caches and a fresh heap.
+//
+// Each connection carries one job. Every message is a varint length,
+// as in stream.h, and then that many bytes. The client sends a JSON
+// header:
+//
+//   {"args": ["--lru", "--lod", "0.5"], "input": "in.obj",
+//    "out": "out.utf8"}
+//
+// where "args" are obj2utf8x's conversion flags, on top of those the
+// server was started with. Without "input", the OBJ itself, perhaps
+// gzipped, follows as a second message. The server replies with one
+// message:
+//
+//   {"ok": true, "verified": true, "cached": false, "manifest": {...},
+//    "files": ["out.utf8", "out.lod1.utf8"],
+//    "seconds": {"queued": 0.0001, "parse": 0.02, "convert": 0.1,
+//                "total": 0.12}}
+//
+// or {"ok": false, "error": "why"}, where the error is "busy" if too
+// many jobs were already waiting. Relative paths, including those of
+// MTL files, are from the server's working directory. With a build
+// cache (see build_cache.h), a job whose inputs and options haven't
+// changed is "cached": its files are copied from there, and it isn't
+// parsed, converted or verified again.
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "base.h"
+#include "convert.h"
+#include "inflate.h"
+#include "json.h"
+#include "json_reader.h"
+#include "manifest.h"
+#include "mesh.h"
+#include "stream.h"
+#include "thread.h"
+#include "timer.h"
+
+namespace webgl_loader {
+
+// Writes all of [|data|, |data| + |length|) to the socket |fd|. A peer
+// that has gone away is an error, rather than a SIGPIPE.
+bool SendFully(int fd, const char* data, size_t length) {
+  while (length != 0) {
+    const ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR) continue;
+    if (sent <= 0) return false;
+    data += sent;
+    length -= sent;
+  }
+  return true;
+}
+
+// Reads exactly |length| bytes from the socket |fd| to |data|.
+bool RecvFully(int fd, char* data, size_t length) {
+  while (length != 0) {
+    const ssize_t received = recv(fd, data, length, 0);
+    if (received < 0 && errno == EINTR) continue;
+    if (received <= 0) return false;
+    data += received;
+    length -= received;
+  }
+  return true;
+}
+
+bool SendMessage(int fd, const std::string& message) {
+  CHECK(message.size() <= 0xFFFFFFFFu);
+  char length[5];
+  return SendFully(fd, length,
+                   PutVarint(static_cast<uint32>(message.size()), length) -
+                   length) &&
+      SendFully(fd, message.data(), message.size());
+}
+
+// Fails if the message is longer than |max_length|.
+bool RecvMessage(int fd, size_t max_length, std::string* message) {
+  char length[5];
+  uint32 value;
+  for (size_t i = 0; i < sizeof(length); ++i) {
+    if (!RecvFully(fd, length + i, 1)) return false;
+    if (GetVarint(length, length + i + 1, &value)) {
+      if (value > max_length) return false;
+      message->resize(value);
+      return value == 0 || RecvFully(fd, &(*message)[0], value);
+    }
+  }
+  return false;
+}
+
+// Sets |address| to the socket at |path|, if it fits.
+bool UnixAddress(const char* path, struct sockaddr_un* address) {
+  memset(address, 0, sizeof(*address));
+  address->sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address->sun_path)) return false;
+  strcpy(address->sun_path, path);
+  return true;
+}
+
+// Returns a socket connected to |path|, or -1 with errno set.
+int ConnectUnix(const char* path) {
+  struct sockaddr_un address;
+  if (!UnixAddress(path, &address)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  if (0 != connect(fd, reinterpret_cast<struct sockaddr*>(&address),
+                   sizeof(address))) {
+    const int connect_errno = errno;
+    close(fd);
+    errno = connect_errno;
+    return -1;
+  }
+  return fd;
+}
+
+// Returns a socket listening at |path|, replacing what is there, or -1
+// with errno set.
+int ListenUnix(const char* path, int backlog) {
+  struct sockaddr_un address;
+  if (!UnixAddress(path, &address)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  unlink(path);
+  if (0 != bind(fd, reinterpret_cast<struct sockaddr*>(&address),
+                sizeof(address)) ||
+      0 != listen(fd, backlog)) {
+    const int listen_errno = errno;
+    close(fd);
+    errno = listen_errno;
+    return -1;
+  }
+  return fd;
+}
+
+// A job, as the client sends it. Either |input| or |data| is the OBJ.
+struct ConvertJob {
+  std::vector<std::string> args;
+  std::string input;
+  std::string data;
+  std::string out;
+};
+
+void WriteJobHeader(const ConvertJob& job, std::string* header) {
+  BufferedStringSink sink(header);
+  JsonSink json(&sink);
+  json.BeginObject();
+  json.PutString("args");
+  json.BeginArray();
+  for (size_t i = 0; i < job.args.size(); ++i) {
+    json.PutString(job.args[i].c_str());
+  }
+  json.End();
+  if (!job.input.empty()) {
+    json.PutString("input");
+    json.PutString(job.input.c_str());
+  }
+  json.PutString("out");
+  json.PutString(job.out.c_str());
+  json.EndAll();
+  sink.Flush();
+}
+
+// Reads what |WriteJobHeader| writes. Keys it doesn't know are
+// skipped.
+bool ReadJobHeader(const std::string& header, ConvertJob* job) {
+  BufferedInput input(header.data(), header.size());
+  JsonReader reader(&input);
+  if (JSON_BEGIN_OBJECT != reader.Next()) return false;
+  while (JSON_KEY == reader.Next()) {
+    if (reader.Equals("args")) {
+      if (JSON_BEGIN_ARRAY != reader.Next()) return false;
+      while (JSON_STRING == reader.Next()) {
+        job->args.push_back(std::string(reader.text(), reader.length()));
+      }
+      if (JSON_END_ARRAY != reader.token()) return false;
+    } else if (reader.Equals("input") || reader.Equals("out")) {
+      std::string* value = reader.Equals("input") ? &job->input : &job->out;
+      if (JSON_STRING != reader.Next()) return false;
+      value->assign(reader.text(), reader.length());
+    } else if (!reader.Skip()) {
+      return false;
+    }
+  }
+  return JSON_END_OBJECT == reader.token();
+}
+
+// Sends |job| to the server at |socket_path|, and waits for its reply
+// in |response|. Returns false, with errno set, if the server couldn't
+// be reached or hung up; a job that failed still gets a response.
+bool RunConvertJob(const char* socket_path, const ConvertJob& job,
+                   std::string* response) {
+  const int fd = ConnectUnix(socket_path);
+  if (fd < 0) return false;
+  std::string header;
+  WriteJobHeader(job, &header);
+  // A server that is busy may hang up before reading it all, so its
+  // reply is read either way.
+  if (SendMessage(fd, header) && job.input.empty()) {
+    SendMessage(fd, job.data);
+  }
+  const bool ok = RecvMessage(fd, 0xFFFFFFFFu, response);
+  close(fd);
+  return ok;
+}
+
+bool ReadFileToString(const char* path, std::string* contents) {
+  FILE* fp = fopen(path, "rb");
+  if (fp == NULL) return false;
+  char buf[64 * 1024];
+  size_t length;
+  while ((length = fread(buf, 1, sizeof(buf), fp)) != 0) {
+    contents->append(buf, length);
+  }
+  const bool ok = !ferror(fp);
+  fclose(fp);
+  return ok;
+}
+
+// How long each step of a job took, in seconds.
+struct JobSeconds {
+  JobSeconds()
+      : queued(0), parse(0), convert(0), total(0) {
+  }
+
+  double queued;  // From being accepted to a thread taking it.
+  double parse;  // Reading and parsing the OBJ, or fetching it cached.
+  double convert;
+  double total;  // From being accepted to the reply.
+};
+
+// What the server replied, for clients.
+struct ConvertReply {
+  ConvertReply()
+      : ok(false), verified(false), cached(false) {
+  }
+
+  bool ok;
+  bool verified;
+  bool cached;
+  std::string error;
+  Manifest manifest;
+  std::vector<std::string> files;
+  JobSeconds seconds;
+};
+
+// Reads a reply from |RunConvertJob|. Keys it doesn't know are
+// skipped.
+bool ReadConvertReply(const std::string& response, ConvertReply* reply) {
+  BufferedInput input(response.data(), response.size());
+  JsonReader reader(&input);
+  if (JSON_BEGIN_OBJECT != reader.Next()) return false;
+  while (JSON_KEY == reader.Next()) {
+    bool ok = true;
+    if (reader.Equals("ok") || reader.Equals("verified") ||
+        reader.Equals("cached")) {
+      bool* value = reader.Equals("ok") ? &reply->ok :
+          reader.Equals("verified") ? &reply->verified : &reply->cached;
+      ok = JSON_BOOL == reader.Next();
+      *value = reader.boolean();
+    } else if (reader.Equals("error")) {
+      ok = JSON_STRING == reader.Next();
+      reply->error.assign(reader.text(), reader.length());
+    } else if (reader.Equals("manifest")) {
+      JsonManifestReader manifest_reader(&reader);
+      ok = manifest_reader.Read(&reply->manifest);
+    } else if (reader.Equals("files")) {
+      ok = JSON_BEGIN_ARRAY == reader.Next();
+      while (ok && JSON_STRING == reader.Next()) {
+        reply->files.push_back(std::string(reader.text(), reader.length()));
+      }
+      ok = ok && JSON_END_ARRAY == reader.token();
+    } else if (reader.Equals("seconds")) {
+      ok = JSON_BEGIN_OBJECT == reader.Next();
+      while (ok && JSON_KEY == reader.Next()) {
+        JobSeconds& seconds = reply->seconds;
+        double* value = reader.Equals("queued") ? &seconds.queued :
+            reader.Equals("parse") ? &seconds.parse :
+            reader.Equals("convert") ? &seconds.convert :
+            reader.Equals("total") ? &seconds.total : NULL;
+        if (value == NULL) {
+          ok = reader.Skip();
+        } else {
+          ok = JSON_NUMBER == reader.Next();
+          *value = reader.number();
+        }
+      }
+      ok = ok && JSON_END_OBJECT == reader.token();
+    } else {
+      ok = reader.Skip();
+    }
+    if (!ok) return false;
+  }
+  return JSON_END_OBJECT == reader.token();
+}
+
+struct ConvertServerStats {
+  ConvertServerStats()
+      : num_jobs(0), num_failed(0), num_busy(0), num_cached(0) {
+  }
+
+  size_t num_jobs;  // Run, including those that failed.
+  size_t num_failed;
+  size_t num_busy;  // Turned away.
+  size_t num_cached;  // Taken from the build cache.
+};
+
+// Accepts connections on one thread, and runs their jobs on others,
+// each with a single thread of its own, so that jobs scale with
+// clients rather than with the batches in each model.
+class ConvertServer {
+ public:
+  // Jobs start from |options|. |num_threads| run at once, and up to
+  // |max_queued| more wait for them; past that, jobs are turned away as
+  // busy, so that a burst gets quick answers rather than slow ones.
+  ConvertServer(const ConvertOptions& options, int num_threads,
+                size_t max_queued)
+      : options_(options),
+        max_pending_(num_threads + max_queued),
+        listen_fd_(-1),
+        workers_(num_threads),
+        stopping_(false),
+        next_id_(0),
+        num_pending_(0) {
+    options_.num_threads = 1;
+    CHECK(0 == pthread_mutex_init(&mutex_, NULL));
+    CHECK(0 == pthread_cond_init(&ready_, NULL));
+  }
+
+  ~ConvertServer() {
+    Stop();
+    pthread_cond_destroy(&ready_);
+    pthread_mutex_destroy(&mutex_);
+  }
+
+  // Listens at |path|, replacing what is there, and starts the
+  // threads. Returns false, with errno set, if it can't listen.
+  bool Start(const char* path) {
+    CHECK(listen_fd_ < 0);
+    listen_fd_ = ListenUnix(path, 64);
+    if (listen_fd_ < 0) return false;
+    path_ = path;
+    stopping_ = false;
+    CHECK(0 == pthread_create(&acceptor_, NULL, &ConvertServer::Accept,
+                              this));
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      CHECK(0 == pthread_create(&workers_[i], NULL, &ConvertServer::Work,
+                                this));
+    }
+    return true;
+  }
+
+  // Waits for the acceptor, which only returns after |Stop| or if
+  // the socket fails.
+  void Wait() {
+    if (listen_fd_ >= 0) pthread_join(acceptor_, NULL);
+  }
+
+  // Stops taking jobs, finishes the ones already taken, and removes the
+  // socket.
+  void Stop() {
+    if (listen_fd_ < 0) return;
+    {
+      MutexLock lock(&mutex_);
+      stopping_ = true;
+      pthread_cond_broadcast(&ready_);
+    }
+    // Wakes the acceptor, which then sees |stopping_|.
+    const int fd = ConnectUnix(path_.c_str());
+    if (fd >= 0) close(fd);
+    pthread_join(acceptor_, NULL);
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      CHECK(0 == pthread_join(workers_[i], NULL));
+    }
+    close(listen_fd_);
+    unlink(path_.c_str());
+    listen_fd_ = -1;
+  }
+
+  ConvertServerStats stats() {
+    MutexLock lock(&mutex_);
+    return stats_;
+  }
+
+ private:
+  struct Job {
+    int fd;
+    size_t id;
+    double accepted;  // |Timer::Now|.
+  };
+
+  // Largest job header and OBJ a client may send.
+  static const size_t kMaxHeaderBytes = 64 * 1024;
+  static const size_t kMaxInputBytes = 1 << 30;
+  // How long a client may take to send its job.
+  static const int kRecvTimeoutSeconds = 60;
+
+  static void* Accept(void* self) {
+    static_cast<ConvertServer*>(self)->AcceptLoop();
+    return NULL;
+  }
+
+  static void* Work(void* self) {
+    static_cast<ConvertServer*>(self)->WorkLoop();
+    return NULL;
+  }
+
+  void AcceptLoop() {
+    for (;;) {
+      Job job;
+      job.fd = accept(listen_fd_, NULL, NULL);
+      job.accepted = Timer::Now();
+      if (job.fd < 0) {
+        const int accept_errno = errno;
+        if (accept_errno == EINTR || accept_errno == ECONNABORTED) continue;
+        fprintf(stderr, "%s: accept: %s\n", path_.c_str(),
+                strerror(accept_errno));
+        if (accept_errno == EMFILE || accept_errno == ENFILE ||
+            accept_errno == ENOBUFS || accept_errno == ENOMEM) {
+          // Out of something that finishing jobs gives back.
+          usleep(10000);
+          continue;
+        }
+        return;
+      }
+      struct timeval timeout = { kRecvTimeoutSeconds, 0 };
+      setsockopt(job.fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+      bool busy = false;
+      {
+        MutexLock lock(&mutex_);
+        if (stopping_) {
+          close(job.fd);
+          return;
+        }
+        job.id = next_id_++;
+        if (num_pending_ == max_pending_) {
+          busy = true;
+          ++stats_.num_busy;
+        } else {
+          ++num_pending_;
+          queue_.push_back(job);
+          pthread_cond_signal(&ready_);
+        }
+      }
+      if (busy) {
+        std::string response;
+        WriteError("busy", &response);
+        SendMessage(job.fd, response);
+        close(job.fd);
+      }
+    }
+  }
+
+  void WorkLoop() {
+    for (;;) {
+      Job job;
+      {
+        MutexLock lock(&mutex_);
+        while (queue_.empty() && !stopping_) {
+          pthread_cond_wait(&ready_, &mutex_);
+        }
+        if (queue_.empty()) return;
+        job = queue_.front();
+        queue_.pop_front();
+      }
+      bool cached = false;
+      const bool ok = RunJob(job, &cached);
+      close(job.fd);
+      MutexLock lock(&mutex_);
+      --num_pending_;
+      ++stats_.num_jobs;
+      if (!ok) ++stats_.num_failed;
+      if (cached) ++stats_.num_cached;
+    }
+  }
+
+  // Runs |job|, replies, and logs how it went to STDERR. Sets |cached|
+  // if it was taken from the build cache.
+  bool RunJob(const Job& job, bool* cached) {
+    JobSeconds seconds;
+    seconds.queued = Timer::Now() - job.accepted;
+    ConvertJob request;
+    Manifest manifest;
+    bool verified = false;
+    std::string error;
+    const bool ok = Convert(job.fd, &request, &manifest, &verified, cached,
+                            &seconds, &error);
+    std::vector<std::string> files;
+    std::string response;
+    if (ok) {
+      ManifestPaths(manifest, &files);
+      seconds.total = Timer::Now() - job.accepted;
+      WriteResponse(manifest, verified, *cached, files, seconds, &response);
+    } else {
+      WriteError(error.c_str(), &response);
+    }
+    SendMessage(job.fd, response);
+    seconds.total = Timer::Now() - job.accepted;
+    if (ok) {
+      fprintf(stderr, "job " PRIuS ": %s: " PRIuS " files%s in %.1f ms "
+              "(queued %.1f, parse %.1f, convert %.1f).\n", job.id,
+              request.out.c_str(), files.size(),
+              *cached ? " from cache" : verified ? "" : ", not verified",
+              1e3 * seconds.total,
+              1e3 * seconds.queued, 1e3 * seconds.parse,
+              1e3 * seconds.convert);
+    } else {
+      fprintf(stderr, "job " PRIuS ": %s\n", job.id, error.c_str());
+    }
+    return ok;
+  }
+
+  // Reads the job from |fd| into |request|, and converts it, or takes
+  // it from the build cache and sets |cached|. Returns false, with
+  // |error| set, if it can't be.
+  bool Convert(int fd, ConvertJob* request, Manifest* manifest,
+               bool* verified, bool* cached, JobSeconds* seconds,
+               std::string* error) {
+    std::string header;
+    if (!RecvMessage(fd, kMaxHeaderBytes, &header) ||
+        !ReadJobHeader(header, request)) {
+      *error = "bad job header";
+      return false;
+    }
+    if (request->out.empty()) {
+      *error = "no out path";
+      return false;
+    }
+    ConvertOptions options = options_;
+    std::vector<const char*> args;
+    for (size_t i = 0; i < request->args.size(); ++i) {
+      args.push_back(request->args[i].c_str());
+    }
+    for (size_t i = 0; i < args.size(); ) {
+      const int num_args = ParseConvertFlag(args.size() - i, &args[i],
+                                            &options);
+      if (num_args == 0) {
+        *error = std::string("bad flag: ") + args[i];
+        return false;
+      }
+      i += num_args;
+    }
+    Timer timer;
+    std::string& data = request->data;
+    if (request->input.empty()) {
+      if (!RecvMessage(fd, kMaxInputBytes, &data)) {
+        *error = "bad job input";
+        return false;
+      }
+    } else if (!ReadFileToString(request->input.c_str(), &data)) {
+      *error = FileError(request->input.c_str(), errno);
+      return false;
+    }
+    const std::string& name = request->input.empty() ? "input" :
+        request->input;
+    const char* out_path = request->out.c_str();
+    uint64 key = 0;
+    if (options.cache != NULL) {
+      Hash64 inputs;
+      BufferedInput hash_input(data.data(), data.size());
+      if (!HashObjInputs(&hash_input, &inputs)) {
+        *error = name + ": unreadable or corrupt input";
+        return false;
+      }
+      key = ConvertKey(options, inputs, out_path);
+      if (FetchConverted(options, key, out_path, manifest)) {
+        *verified = true;
+        *cached = true;
+        seconds->parse = timer.ElapsedSeconds();
+        return true;
+      }
+    }
+    BufferedInput input(data.data(), data.size());
+    std::string parse_error;
+    WavefrontObjFile obj(&input, name, &parse_error);
+    // The OBJ is parsed, so its text can go.
+    std::string().swap(data);
+    if (!parse_error.empty()) {
+      *error = name + ": " + parse_error;
+      return false;
+    }
+    seconds->parse = timer.ElapsedSeconds();
+    timer.Reset();
+    if (!ConvertObj(options, obj, out_path, manifest, verified, error)) {
+      return false;
+    }
+    seconds->convert = timer.ElapsedSeconds();
+    // One that didn't verify is converted again next time.
+    if (options.cache != NULL && *verified &&
+        !StoreConverted(options, key, *manifest)) {
+      fprintf(stderr, "WARNING: %s couldn't be cached: %s\n", out_path,
+              strerror(errno));
+    }
+    return true;
+  }
+
+  static void WriteResponse(const Manifest& manifest, bool verified,
+                            bool cached,
+                            const std::vector<std::string>& files,
+                            const JobSeconds& seconds,
+                            std::string* response) {
+    BufferedStringSink sink(response);
+    JsonSink json(&sink);
+    json.BeginObject();
+    json.PutString("ok");
+    json.PutBool(true);
+    json.PutString("verified");
+    json.PutBool(verified);
+    json.PutString("cached");
+    json.PutBool(cached);
+    json.PutString("manifest");
+    WriteJsonManifest(manifest, &json);
+    json.PutString("files");
+    json.BeginArray();
+    for (size_t i = 0; i < files.size(); ++i) {
+      json.PutString(files[i].c_str());
+    }
+    json.End();
+    json.PutString("seconds");
+    json.BeginObject();
+    json.PutString("queued");
+    json.PutFloat(seconds.queued);
+    json.PutString("parse");
+    json.PutFloat(seconds.parse);
+    json.PutString("convert");
+    json.PutFloat(seconds.convert);
+    json.PutString("total");
+    json.PutFloat(seconds.total);
+    json.EndAll();
+    sink.Flush();
+  }
+
+  static void WriteError(const char* error, std::string* response) {
+    BufferedStringSink sink(response);
+    JsonSink json(&sink);
+    json.BeginObject();
+    json.PutString("ok");
+    json.PutBool(false);
+    json.PutString("error");
+    json.PutString(error);
+    json.EndAll();
+    sink.Flush();
+  }
+
+  ConvertOptions options_;
+  const size_t max_pending_;
+  std::string path_;
+  int listen_fd_;
+  pthread_t acceptor_;
+  std::vector<pthread_t> workers_;
+  pthread_mutex_t mutex_;
+  pthread_cond_t ready_;  // Signalled with |mutex_|.
+  // Guarded by |mutex_|.
+  bool stopping_;
+  size_t next_id_;
+  size_t num_pending_;  // Queued or running.
+  std::deque<Job> queue_;
+  ConvertServerStats stats_;
+};
+
+}  // namespace webgl_loader
+
+#endif  // WEBGL_LOADER_CONVERT_SERVER_H_
@@ -0,0 +1,860 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_DECOMPRESS_H_
+#define WEBGL_LOADER_DECOMPRESS_H_
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "base.h"
+#include "bounds.h"
+#include "compress.h"
+#include "edgebreaker.h"
+#include "entropy.h"
+#include "predict.h"
+#include "stream.h"
+#include "utf8.h"
+
+namespace webgl_loader {
+
+// Reference decoders for the formats written by compress.h. These
+// mirror the JavaScript decoders in samples/loader.js, and are meant
+// for verifying and benchmarking the compressors natively.
+
+// A decoded mesh, as it would be passed to the loader.js callback.
+struct DecodedMesh {
+  // Interleaved 8-wide attributes, before |decodeOffsets| and
+  // |decodeScales| are applied. Predicted normals are not stored
+  // here, since they are only reconstructed approximately.
+  QuantizedAttribList fixed_attribs;
+  // Interleaved 8-wide attributes, as floats.
+  AttribList attribs;
+  OptimizedIndexList indices;
+  // For each group, the center and then the radius of its bounding
+  // box, as in |decompressAABBs_|. Empty if there are none.
+  AttribList bboxes;
+};
+
+// Decodes |CompressQuantizedAttribsToUtf8| followed by
+// |CompressIndicesToUtf8|. Mirrors |decompressMesh| in loader.js.
+bool DecompressSimpleMesh(const BoundsParams& params,
+                          const uint16* attrib_codes, size_t num_verts,
+                          const uint16* index_codes, size_t num_tris,
+                          DecodedMesh* mesh) {
+  mesh->fixed_attribs.resize(8 * num_verts);
+  mesh->attribs.assign(8 * num_verts, 0.f);
+  mesh->indices.resize(3 * num_tris);
+  for (size_t j = 0; j < 8; ++j) {
+    const float decode_scale = params.decodeScales[j];
+    const int decode_offset = params.decodeOffsets[j];
+    uint16 prev = 0;
+    for (size_t i = 0; i < num_verts; ++i) {
+      prev += UnZigZag(attrib_codes[num_verts*j + i]);
+      mesh->fixed_attribs[8*i + j] = prev;
+      // Like loader.js, ignore attributes that are never scaled.
+      if (decode_scale) {
+        mesh->attribs[8*i + j] = decode_scale * (prev + decode_offset);
+      }
+    }
+  }
+  size_t highest = 0;
+  for (size_t i = 0; i < 3 * num_tris; ++i) {
+    const uint16 code = index_codes[i];
+    if (code > highest) return false;
+    mesh->indices[i] = highest - code;
+    if (code == 0) {
+      if (highest == num_verts) return false;
+      ++highest;
+    }
+  }
+  return true;
+}
+
+// Decodes |num_bboxes| consecutive |CompressAABBToUtf8| outputs.
+// Mirrors |decompressAABBs_| in loader.js.
+void DecompressAABBs(const BoundsParams& params,
+                     const uint16* codes, size_t num_bboxes,
+                     AttribList* bboxes) {
+  bboxes->resize(6 * num_bboxes);
+  for (size_t i = 0; i < num_bboxes; ++i) {
+    const uint16* code = &codes[6*i];
+    float* bbox = &bboxes->at(6*i);
+    for (size_t j = 0; j < 3; ++j) {
+      const int min = code[j] + params.decodeOffsets[j];
+      const int radius = (code[3 + j] + 1) >> 1;
+      bbox[j] = params.decodeScales[j] * (min + radius);
+      bbox[3 + j] = params.decodeScales[j] * radius;
+    }
+  }
+}
+
+// Decodes the |deltas_| and |codes_| streams of an
+// |EdgeCachingCompressor|. The stream layouts are described with
+// |EdgeCachingCompressor::Encode| and |EncodeWithLRU|. Methods return
+// |false| if the streams are malformed.
+class EdgeCachingDecompressor {
+ public:
+  // |deltas| has 8 * |num_verts| entries, and |codes| has |num_codes|
+  // entries. Both are unowned.
+  EdgeCachingDecompressor(const BoundsParams& params,
+                          const uint16* deltas, size_t num_verts,
+                          const uint16* codes, size_t num_codes,
+                          size_t num_tris)
+      : params_(params),
+        deltas_(deltas),
+        num_verts_(num_verts),
+        num_tris_(num_tris),
+        split_codes_(false),
+        highest_(0),
+        num_packed_(0),
+        mesh_(NULL) {
+    codes_[EDGE_CODE] = codes;
+    num_codes_[EDGE_CODE] = num_codes;
+    codes_[INDEX_CODE] = NULL;
+    num_codes_[INDEX_CODE] = 0;
+  }
+
+  // Like above, but the codes are split into |edge_codes| and
+  // |index_codes|, as in binary meshes. Except for
+  // |EDGE_CACHING_EDGEBREAKER|, there is one edge code per triangle.
+  EdgeCachingDecompressor(const BoundsParams& params,
+                          const uint16* deltas, size_t num_verts,
+                          size_t num_tris,
+                          const uint16* edge_codes, size_t num_edge_codes,
+                          const uint16* index_codes, size_t num_index_codes)
+      : params_(params),
+        deltas_(deltas),
+        num_verts_(num_verts),
+        num_tris_(num_tris),
+        split_codes_(true),
+        highest_(0),
+        num_packed_(0),
+        mesh_(NULL) {
+    codes_[EDGE_CODE] = edge_codes;
+    num_codes_[EDGE_CODE] = num_edge_codes;
+    codes_[INDEX_CODE] = index_codes;
+    num_codes_[INDEX_CODE] = num_index_codes;
+  }
+
+  // The predictors the compressor chose, from the manifest or binary
+  // mesh header.
+  void set_predictors(const AttribPredictors& predictors) {
+    predictors_ = predictors;
+  }
+
+  bool Decompress(EdgeCachingMode mode, DecodedMesh* mesh) {
+    switch (mode) {
+      case EDGE_CACHING_BACKREF:
+        return Decompress(mesh);
+      case EDGE_CACHING_LRU:
+        return DecompressWithLRU(mesh);
+      case EDGE_CACHING_EDGEBREAKER:
+        return DecompressWithEdgebreaker(mesh);
+      default:
+        return false;
+    }
+  }
+
+  // Mirrors |decompressMesh2| in loader.js.
+  bool Decompress(DecodedMesh* mesh) {
+    Begin(mesh);
+    for (size_t i = 0; i < 3*num_tris_; i += 3) {
+      uint16* triangle = &mesh_->indices[i];
+      const size_t max_backref = i < EdgeCachingCompressor::kMaxLruSize ?
+          i : EdgeCachingCompressor::kMaxLruSize;
+      uint16 code;
+      if (!NextCode(EDGE_CODE, &code)) return false;
+      if (code < max_backref) {
+        // Codes 0-2 would refer back to this triangle itself.
+        if (code < 3) return false;
+        const size_t winding = code % 3;
+        const uint16* backref = &mesh_->indices[i - (code - winding)];
+        uint16 opposite;
+        switch (winding) {
+          case 0:
+            triangle[0] = backref[2];
+            triangle[1] = backref[1];
+            opposite = backref[0];
+            break;
+          case 1:
+            triangle[0] = backref[0];
+            triangle[1] = backref[2];
+            opposite = backref[1];
+            break;
+          default:
+            triangle[0] = backref[1];
+            triangle[1] = backref[0];
+            opposite = backref[2];
+            break;
+        }
+        if (!ParallelogramVertex(triangle, opposite)) return false;
+      } else if (!SimpleTriangle(code - max_backref, triangle)) {
+        return false;
+      }
+    }
+    return End();
+  }
+
+  // Mirrors |decompressMesh3| in loader.js.
+  bool DecompressWithLRU(DecodedMesh* mesh) {
+    Begin(mesh);
+    EdgeLru edge_lru;
+    for (size_t i = 0; i < num_tris_; ++i) {
+      uint16* triangle = &mesh_->indices[3*i];
+      const size_t lru_size = edge_lru.size();
+      uint16 code;
+      if (!NextCode(EDGE_CODE, &code)) return false;
+      if (code < lru_size) {
+        const EdgeLru::Edge& edge = edge_lru[code];
+        triangle[0] = edge.v1;
+        triangle[1] = edge.v0;
+        if (!ParallelogramVertex(triangle, edge.opposite)) return false;
+      } else if (!SimpleTriangle(code - lru_size, triangle)) {
+        return false;
+      }
+      edge_lru.Update(triangle);
+    }
+    return End();
+  }
+
+  // Mirrors |decompressMesh4| in loader.js.
+  bool DecompressWithEdgebreaker(DecodedMesh* mesh) {
+    Begin(mesh);
+    GateBoundary gates(num_verts_);
+    for (size_t i = 0; i < num_tris_; ++i) {
+      uint16* triangle = &mesh_->indices[3*i];
+      int gate;
+      uint16 symbol = GATE_SKIP;
+      while ((gate = gates.Pop()) >= 0) {
+        if (!NextSymbol(&symbol)) return false;
+        if (symbol != GATE_SKIP) break;
+        gates.Skip(gate);
+      }
+      if (gate < 0) {
+        uint16 code;
+        if (!NextCode(INDEX_CODE, &code) || !SimpleTriangle(code, triangle)) {
+          return false;
+        }
+        gates.AddSeed(triangle);
+        continue;
+      }
+      const GateBoundary::Gate& across = gates[gate];
+      triangle[0] = across.v1;
+      triangle[1] = across.v0;
+      uint16 code;
+      int vertex;
+      switch (symbol) {
+        case GATE_NEW_VERTEX:
+          if (highest_ == num_verts_) return false;
+          triangle[2] = highest_;
+          PredictVertex(triangle, across.opposite);
+          break;
+        case GATE_NEXT:
+        case GATE_PREVIOUS:
+          vertex = symbol == GATE_NEXT ? gates.Next(gate) :
+              gates.Previous(gate);
+          if (vertex < 0) return false;
+          triangle[2] = vertex;
+          break;
+        case GATE_SPLIT:
+          if (!NextCode(INDEX_CODE, &code) || code >= highest_) return false;
+          triangle[2] = highest_ - 1 - code;
+          break;
+        default:
+          return false;
+      }
+      gates.Advance(gate, triangle[2]);
+    }
+    return End();
+  }
+
+ private:
+  void Begin(DecodedMesh* mesh) {
+    mesh_ = mesh;
+    mesh_->fixed_attribs.assign(8 * num_verts_, 0);
+    mesh_->attribs.assign(8 * num_verts_, 0.f);
+    mesh_->indices.assign(3 * num_tris_, 0);
+    crosses_.assign(3 * num_verts_, 0);
+    memset(last_attrib_, 0, sizeof(last_attrib_));
+    code_pos_[EDGE_CODE] = 0;
+    code_pos_[INDEX_CODE] = 0;
+    highest_ = 0;
+    num_packed_ = 0;
+  }
+
+  // Run the post pass predictors, if any, then reconstruct normals
+  // from the face cross products and the normal residues, like
+  // loader.js.
+  bool End() {
+    if (highest_ != num_verts_ ||
+        code_pos_[EDGE_CODE] != num_codes_[EDGE_CODE] ||
+        code_pos_[INDEX_CODE] != num_codes_[INDEX_CODE]) {
+      return false;
+    }
+    if (!predictors_.IsValid()) return false;
+    if (!predictors_.IsTraversal() && num_tris_ != 0) {
+      const VertexTriangles topology(&mesh_->indices[0], num_tris_,
+                                     num_verts_);
+      // Positions first, since texcoords may be predicted from them.
+      DecodePredicted(topology, predictors_.positions, 0, 3);
+      DecodePredicted(topology, predictors_.texcoords, 3, 2);
+    }
+    for (size_t i = 0; i < 3 * num_tris_; i += 3) {
+      AccumulateNormal(&mesh_->indices[i]);
+    }
+    for (size_t i = 0; i < num_verts_; ++i) {
+      const float nx = crosses_[3*i + 0];
+      const float ny = crosses_[3*i + 1];
+      const float nz = crosses_[3*i + 2];
+      const float norm = 511.0 / sqrt(nx*nx + ny*ny + nz*nz);
+      for (size_t j = 0; j < 3; ++j) {
+        const float n = crosses_[3*i + j];
+        const uint16 code = deltas_[(5 + j)*num_verts_ + i];
+        mesh_->attribs[8*i + 5 + j] = norm*n + UnZigZag(code);
+      }
+    }
+    return true;
+  }
+
+  void DecodePredicted(const VertexTriangles& topology,
+                       AttribPredictor predictor,
+                       size_t column, size_t num_columns) {
+    if (predictor == PREDICTOR_TRAVERSAL) return;
+    DecodeResiduals(*GetPredictor(predictor), topology, deltas_, num_verts_,
+                    column, num_columns, &mesh_->fixed_attribs[0]);
+    for (size_t i = 0; i < num_verts_; ++i) {
+      for (size_t j = column; j < column + num_columns; ++j) {
+        SetAttrib(i, j, Fixed(i, j));
+      }
+    }
+  }
+
+  enum CodeKind {
+    EDGE_CODE = 0,
+    INDEX_CODE = 1
+  };
+
+  bool NextCode(CodeKind kind, uint16* code) {
+    // Unless the codes are split, they are all in the first stream.
+    const size_t stream = split_codes_ ? kind : EDGE_CODE;
+    if (code_pos_[stream] == num_codes_[stream]) return false;
+    *code = codes_[stream][code_pos_[stream]++];
+    return true;
+  }
+
+  // Unless the codes are split, |GateSymbol|s are packed three to a
+  // code, as by |EdgeCachingCompressor::PutGateSymbol|.
+  bool NextSymbol(uint16* symbol) {
+    if (split_codes_) {
+      return NextCode(EDGE_CODE, symbol) && *symbol < NUM_GATE_SYMBOLS;
+    }
+    if (num_packed_ == 0) {
+      if (!NextCode(EDGE_CODE, &packed_) ||
+          packed_ >= kNumPackedGateCodes) {
+        return false;
+      }
+      num_packed_ = 3;
+    }
+    *symbol = packed_ % NUM_GATE_SYMBOLS;
+    packed_ /= NUM_GATE_SYMBOLS;
+    --num_packed_;
+    return true;
+  }
+
+  // Decode a high water mark code to an index, decoding the
+  // attributes of new vertices relative to |last_attrib_|.
+  bool DecodeIndex(uint16 code, uint16* index) {
+    if (code > highest_) return false;
+    *index = highest_ - code;
+    if (code == 0) {
+      if (highest_ == num_verts_) return false;
+      DecodeDeltaAttrib(highest_++);
+    } else {
+      CopyLastAttrib(*index);
+    }
+    return true;
+  }
+
+  // Mirrors |EdgeCachingCompressor::SimplePredictor|.
+  bool SimpleTriangle(uint16 first_code, uint16* triangle) {
+    uint16 code;
+    if (!DecodeIndex(first_code, &triangle[0])) return false;
+    if (!NextCode(INDEX_CODE, &code) || !DecodeIndex(code, &triangle[1])) {
+      return false;
+    }
+    if (!NextCode(INDEX_CODE, &code) || code > highest_) return false;
+    if (code == 0) {
+      for (size_t j = 0; j < 5; ++j) {
+        int average = Fixed(triangle[0], j);
+        average += Fixed(triangle[1], j);
+        last_attrib_[j] = average / 2;
+      }
+    }
+    return DecodeIndex(code, &triangle[2]);
+  }
+
+  // Mirrors |EdgeCachingCompressor::ParallelogramPredictor|, where
+  // |triangle[0]| and |triangle[1]| are already known.
+  bool ParallelogramVertex(uint16* triangle, uint16 opposite) {
+    uint16 code;
+    if (!NextCode(INDEX_CODE, &code) || code > highest_) return false;
+    triangle[2] = highest_ - code;
+    if (code != 0) {
+      CopyLastAttrib(triangle[2]);
+      return true;
+    }
+    if (highest_ == num_verts_) return false;
+    PredictVertex(triangle, opposite);
+    return true;
+  }
+
+  // Decodes |triangle[2]|, which is the new vertex |highest_|.
+  void PredictVertex(const uint16* triangle, uint16 opposite) {
+    for (size_t j = 0; j < 5; ++j) {
+      const uint16 prediction = UnZigZag(Delta(highest_, j)) +
+          Fixed(triangle[0], j) + Fixed(triangle[1], j) - Fixed(opposite, j);
+      last_attrib_[j] = prediction;
+      SetAttrib(highest_, j, prediction);
+    }
+    ++highest_;
+  }
+
+  void DecodeDeltaAttrib(uint16 index) {
+    for (size_t j = 0; j < 5; ++j) {
+      last_attrib_[j] += UnZigZag(Delta(index, j));
+      SetAttrib(index, j, last_attrib_[j]);
+    }
+  }
+
+  void CopyLastAttrib(uint16 index) {
+    for (size_t j = 0; j < 8; ++j) {
+      last_attrib_[j] = Fixed(index, j);
+    }
+  }
+
+  void AccumulateNormal(const uint16* triangle) {
+    const uint16 i0 = triangle[0];
+    const uint16 i1 = triangle[1];
+    const uint16 i2 = triangle[2];
+    int e1[3], e2[3];
+    for (size_t j = 0; j < 3; ++j) {
+      e1[j] = Fixed(i1, j) - Fixed(i0, j);
+      e2[j] = Fixed(i2, j) - Fixed(i0, j);
+    }
+    const int cross[3] = {
+      e1[1] * e2[2] - e1[2] * e2[1],
+      e1[2] * e2[0] - e1[0] * e2[2],
+      e1[0] * e2[1] - e1[1] * e2[0]
+    };
+    for (size_t j = 0; j < 3; ++j) {
+      crosses_[3*i0 + j] += cross[j];
+      crosses_[3*i1 + j] += cross[j];
+      crosses_[3*i2 + j] += cross[j];
+    }
+  }
+
+  uint16 Delta(size_t index, size_t j) const {
+    return deltas_[num_verts_*j + index];
+  }
+
+  uint16 Fixed(size_t index, size_t j) const {
+    return mesh_->fixed_attribs[8*index + j];
+  }
+
+  void SetAttrib(size_t index, size_t j, uint16 value) {
+    mesh_->fixed_attribs[8*index + j] = value;
+    mesh_->attribs[8*index + j] =
+        params_.decodeScales[j] * (value + params_.decodeOffsets[j]);
+  }
+
+  const BoundsParams& params_;
+  const uint16* deltas_;  // unowned.
+  size_t num_verts_;
+  size_t num_tris_;
+  bool split_codes_;
+  const uint16* codes_[2];  // unowned.
+  size_t num_codes_[2];
+  size_t code_pos_[2];
+  // |highest_| is the high water mark, as in |CompressIndicesToUtf8|.
+  uint16 highest_;
+  // Unread |GateSymbol|s of the last packed code.
+  uint16 packed_;
+  size_t num_packed_;
+  uint16 last_attrib_[8];
+  AttribPredictors predictors_;
+  std::vector<int> crosses_;
+  DecodedMesh* mesh_;  // unowned.
+};
+
+// Decodes a mesh written by |EdgeCachingCompressor::EmitBinary| from
+// the start of [|data|, |data| + |length|). If |consumed| is not NULL,
+// it is set to the length of the binary mesh.
+bool DecompressBinaryMesh(const char* data, size_t length,
+                          const BoundsParams& params, DecodedMesh* mesh,
+                          size_t* consumed = NULL) {
+  const char* const end = data + length;
+  uint32 mode, positions, texcoords, num_verts, num_tris;
+  uint32 num_edge_codes, num_index_codes;
+  const char* cursor = GetVarint(data, end, &mode);
+  if (cursor) cursor = GetVarint(cursor, end, &positions);
+  if (cursor) cursor = GetVarint(cursor, end, &texcoords);
+  if (cursor) cursor = GetVarint(cursor, end, &num_verts);
+  if (cursor) cursor = GetVarint(cursor, end, &num_tris);
+  if (cursor) cursor = GetVarint(cursor, end, &num_edge_codes);
+  if (cursor) cursor = GetVarint(cursor, end, &num_index_codes);
+  // Each triangle has at most 3 index codes, and each gate at most
+  // one edge code, so 4 per triangle. Indices are 16 bits.
+  if (!cursor || num_verts > 0x10000 ||
+      num_edge_codes > 4 * static_cast<size_t>(num_tris) ||
+      num_index_codes > 3 * static_cast<size_t>(num_tris) ||
+      positions >= NUM_PREDICTORS || texcoords >= NUM_PREDICTORS) {
+    return false;
+  }
+  AttribPredictors predictors;
+  predictors.positions = static_cast<AttribPredictor>(positions);
+  predictors.texcoords = static_cast<AttribPredictor>(texcoords);
+  // Once its probabilities saturate, the model spends about 0.11 bits
+  // on a zero, so this bounds the allocations below for corrupt input.
+  const size_t num_values = 8 * static_cast<size_t>(num_verts) +
+      num_edge_codes + num_index_codes;
+  if (num_values > 128 * static_cast<size_t>(end - cursor) + 1024) {
+    return false;
+  }
+
+  RangeDecoder decoder(cursor, end - cursor);
+  std::vector<uint16> deltas(8 * num_verts);
+  for (size_t j = 0; j < 8; ++j) {
+    AdaptiveUint16Model model;
+    for (size_t i = 0; i < num_verts; ++i) {
+      deltas[num_verts*j + i] = model.Decode(&decoder);
+    }
+  }
+  std::vector<uint16> edge_codes(num_edge_codes);
+  AdaptiveUint16Model edge_models[NUM_GATE_SYMBOLS];
+  size_t context = 0;
+  for (size_t i = 0; i < num_edge_codes; ++i) {
+    edge_codes[i] = edge_models[context].Decode(&decoder);
+    if (mode == EDGE_CACHING_EDGEBREAKER) {
+      context = std::min<size_t>(edge_codes[i], NUM_GATE_SYMBOLS - 1);
+    }
+  }
+  std::vector<uint16> index_codes(num_index_codes);
+  AdaptiveUint16Model index_model;
+  for (size_t i = 0; i < num_index_codes; ++i) {
+    index_codes[i] = index_model.Decode(&decoder);
+  }
+  if (decoder.overrun()) return false;
+  if (consumed) {
+    *consumed = decoder.cursor() - data;
+  }
+  // Avoid taking the address of empty vectors.
+  const uint16 kEmpty = 0;
+  EdgeCachingDecompressor decompressor(
+      params,
+      deltas.empty() ? &kEmpty : &deltas[0], num_verts, num_tris,
+      edge_codes.empty() ? &kEmpty : &edge_codes[0], num_edge_codes,
+      index_codes.empty() ? &kEmpty : &index_codes[0], num_index_codes);
+  decompressor.set_predictors(predictors);
+  return decompressor.Decompress(static_cast<EdgeCachingMode>(mode), mesh);
+}
+
+// The range entries of a mesh manifest, one per mesh. Each kind of
+// range is decoded by a different function in loader.js.
+enum MeshFormat {
+  MESH_FORMAT_INDEX_RANGE,     // |decompressMesh|, from objcompress.
+  MESH_FORMAT_CODE_RANGE,      // |decompressMesh2|, from obj2utf8x.
+  MESH_FORMAT_LRU_CODE_RANGE,  // |decompressMesh3|, from obj2utf8x --lru.
+  MESH_FORMAT_BINARY_RANGE,    // |DecompressBinaryMesh|.
+  // |decompressMesh4|, from obj2utf8x --edgebreaker.
+  MESH_FORMAT_EDGEBREAKER_CODE_RANGE,
+  // |GpuMeshFile| in gpu.h, from obj2utf8x --gpu. Not streamed.
+  MESH_FORMAT_GPU_BUFFERS
+};
+
+EdgeCachingMode EdgeCachingModeOf(MeshFormat format) {
+  switch (format) {
+    case MESH_FORMAT_LRU_CODE_RANGE: return EDGE_CACHING_LRU;
+    case MESH_FORMAT_EDGEBREAKER_CODE_RANGE: return EDGE_CACHING_EDGEBREAKER;
+    default: return EDGE_CACHING_BACKREF;
+  }
+}
+
+// Offsets are in UTF-16 code units (that is, decoded uint16s) for the
+// UTF-8 formats, and in bytes for binary meshes, as in the manifest.
+struct MeshEntry {
+  MeshEntry()
+      : format(MESH_FORMAT_INDEX_RANGE),
+        attrib_start(0), num_verts(0),
+        code_start(0), code_length(0), num_tris(0),
+        bboxes_start(0), num_bboxes(0) {
+  }
+
+  // The offset just past the last code of the mesh. The mesh can be
+  // decoded once this much input is available.
+  size_t End() const {
+    size_t end = code_start + code_length;
+    if (format != MESH_FORMAT_BINARY_RANGE) {
+      end = std::max(end, attrib_start + 8 * num_verts);
+    }
+    if (num_bboxes != 0) {
+      end = std::max(end, bboxes_start + 6 * num_bboxes);
+    }
+    return end;
+  }
+
+  MeshFormat format;
+  std::string material;
+  // "attribRange": [|attrib_start|, |num_verts|]. Unused for binary.
+  size_t attrib_start;
+  size_t num_verts;
+  // "indexRange": [|code_start|, |num_tris|], where |code_length| is
+  // 3 * |num_tris|, or
+  // "codeRange": [|code_start|, |code_length|, |num_tris|], or the
+  // same for "lruCodeRange" and "edgebreakerCodeRange", or
+  // "binaryRange": [|code_start|, |code_length|].
+  size_t code_start;
+  size_t code_length;
+  size_t num_tris;
+  // "bboxes": |bboxes_start|, with one bbox per group name. Only
+  // used by the index range format.
+  size_t bboxes_start;
+  size_t num_bboxes;
+  // "predictors": [positions, texcoords], by |kPredictorNames|. Only
+  // for the code range formats.
+  AttribPredictors predictors;
+};
+
+// Receives meshes from |MeshStreamDecoder| as they are decoded, like
+// the loader.js callback.
+class MeshSinkInterface {
+ public:
+  virtual ~MeshSinkInterface() { }
+
+  virtual void PutMesh(const MeshEntry& entry, const DecodedMesh& mesh) = 0;
+};
+
+// Decodes meshes from input that arrives incrementally, like the
+// loader.js |onprogress| handler: each mesh is passed to |sink| as
+// soon as its range is complete, in manifest order.
+class MeshStreamDecoder {
+ public:
+  // |entries| must all be binary, or all UTF-8. |sink| is unowned.
+  MeshStreamDecoder(const BoundsParams& params,
+                    const std::vector<MeshEntry>& entries,
+                    MeshSinkInterface* sink)
+      : params_(params),
+        entries_(entries),
+        sink_(sink),
+        binary_(!entries.empty() &&
+                entries[0].format == MESH_FORMAT_BINARY_RANGE),
+        next_entry_(0),
+        error_(false) {
+    for (size_t i = 0; i < entries_.size(); ++i) {
+      CHECK(binary_ == (entries_[i].format == MESH_FORMAT_BINARY_RANGE));
+    }
+  }
+
+  // Returns |false| if the input or manifest is malformed, after which
+  // no more meshes are decoded.
+  bool Push(const char* data, size_t length) {
+    if (error_) return false;
+    size_t available;
+    if (binary_) {
+      bytes_.append(data, length);
+      available = bytes_.size();
+    } else {
+      if (!utf8_decoder_.Decode(data, length, &words_)) return Fail();
+      available = words_.size();
+    }
+    while (next_entry_ < entries_.size() &&
+           entries_[next_entry_].End() <= available) {
+      const MeshEntry& entry = entries_[next_entry_];
+      if (!DecodeEntry(entry)) return Fail();
+      sink_->PutMesh(entry, mesh_);
+      ++next_entry_;
+    }
+    return true;
+  }
+
+  // |true| if every mesh in the manifest was decoded.
+  bool Finish() const {
+    return !error_ && next_entry_ == entries_.size() &&
+        (binary_ || utf8_decoder_.at_boundary());
+  }
+
+  size_t num_decoded() const {
+    return next_entry_;
+  }
+
+ private:
+  bool DecodeEntry(const MeshEntry& entry) {
+    mesh_.bboxes.clear();
+    if (entry.format == MESH_FORMAT_BINARY_RANGE) {
+      return DecompressBinaryMesh(&bytes_[entry.code_start], entry.code_length,
+                                  params_, &mesh_);
+    }
+    const uint16* const deltas = &words_[entry.attrib_start];
+    const uint16* const codes = &words_[entry.code_start];
+    switch (entry.format) {
+      case MESH_FORMAT_INDEX_RANGE:
+        if (entry.code_length != 3 * entry.num_tris) return false;
+        if (!DecompressSimpleMesh(params_, deltas, entry.num_verts,
+                                  codes, entry.num_tris, &mesh_)) {
+          return false;
+        }
+        if (entry.num_bboxes != 0) {
+          DecompressAABBs(params_, &words_[entry.bboxes_start],
+                          entry.num_bboxes, &mesh_.bboxes);
+        }
+        return true;
+      case MESH_FORMAT_CODE_RANGE:
+      case MESH_FORMAT_LRU_CODE_RANGE:
+      case MESH_FORMAT_EDGEBREAKER_CODE_RANGE: {
+        EdgeCachingDecompressor decompressor(params_,
+                                             deltas, entry.num_verts,
+                                             codes, entry.code_length,
+                                             entry.num_tris);
+        decompressor.set_predictors(entry.predictors);
+        return decompressor.Decompress(EdgeCachingModeOf(entry.format),
+                                       &mesh_);
+      }
+      default:
+        return false;
+    }
+  }
+
+  bool Fail() {
+    error_ = true;
+    return false;
+  }
+
+  const BoundsParams params_;
+  const std::vector<MeshEntry> entries_;
+  MeshSinkInterface* sink_;  // unowned.
+  const bool binary_;
+  size_t next_entry_;
+  bool error_;
+  // Like XHR.responseText, all the input so far.
+  Utf8Decoder utf8_decoder_;
+  std::vector<uint16> words_;
+  std::string bytes_;
+  // Reused between meshes.
+  DecodedMesh mesh_;
+};
+
+// Returns |true| if |decoded| is |expected|, as encoded by one of the
+// compressors. The edge caching formats reconstruct normals from face
+// cross products, so those are only expected to be close.
+bool MatchesDecodedMesh(const WebGLMesh& expected, MeshFormat format,
+                        const DecodedMesh& decoded) {
+  if (expected.indices != decoded.indices ||
+      expected.attribs.size() != decoded.fixed_attribs.size()) {
+    return false;
+  }
+  if (format == MESH_FORMAT_INDEX_RANGE) {
+    return expected.attribs == decoded.fixed_attribs;
+  }
+  for (size_t i = 0; i < expected.attribs.size(); i += 8) {
+    for (size_t j = 0; j < 5; ++j) {
+      if (expected.attribs[i + j] != decoded.fixed_attribs[i + j]) {
+        return false;
+      }
+    }
+    float n[3], norm = 0;
+    for (size_t j = 0; j < 3; ++j) {
+      n[j] = expected.attribs[i + 5 + j] - 511.f;
+      norm += n[j] * n[j];
+    }
+    norm = 511.f / sqrt(norm);
+    for (size_t j = 0; j < 3; ++j) {
+      if (!(fabs(norm * n[j] - decoded.attribs[i + 5 + j]) < 2.f)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Checks each decoded mesh against the mesh that was compressed, for
+// the compressors' --verify modes.
+class MeshVerifier : public MeshSinkInterface {
+ public:
+  // |expected| is unowned, and has one mesh per manifest entry.
+  explicit MeshVerifier(const WebGLMeshList* expected)
+      : expected_(expected),
+        expected_bboxes_(NULL),
+        num_meshes_(0),
+        num_mismatches_(0) {
+  }
+
+  // Also checks each mesh's bboxes against |bboxes|, which is unowned
+  // and has the |QuantizeAABB| words of each mesh's bboxes, decoded
+  // with |params|. Otherwise, only their number is checked.
+  void set_expected_bboxes(const BoundsParams& params,
+                           const std::vector<QuantizedAttribList>* bboxes) {
+    params_ = params;
+    expected_bboxes_ = bboxes;
+  }
+
+  virtual void PutMesh(const MeshEntry& entry, const DecodedMesh& mesh) {
+    if (num_meshes_ >= expected_->size() ||
+        !MatchesDecodedMesh(expected_->at(num_meshes_), entry.format, mesh) ||
+        mesh.bboxes.size() != 6 * entry.num_bboxes ||
+        !MatchesBBoxes(mesh.bboxes)) {
+      ++num_mismatches_;
+    }
+    ++num_meshes_;
+  }
+
+  size_t num_meshes() const { return num_meshes_; }
+  size_t num_mismatches() const { return num_mismatches_; }
+
+ private:
+  bool MatchesBBoxes(const AttribList& bboxes) const {
+    if (expected_bboxes_ == NULL) return true;
+    if (num_meshes_ >= expected_bboxes_->size()) return false;
+    const QuantizedAttribList& words = expected_bboxes_->at(num_meshes_);
+    if (words.size() != bboxes.size()) return false;
+    if (words.empty()) return true;
+    AttribList expected;
+    DecompressAABBs(params_, &words[0], words.size() / 6, &expected);
+    return expected == bboxes;
+  }
+
+  const WebGLMeshList* expected_;  // unowned.
+  BoundsParams params_;
+  const std::vector<QuantizedAttribList>* expected_bboxes_;  // unowned.
+  size_t num_meshes_;
+  size_t num_mismatches_;
+};
+
+// Reads |fp| to the end in network-sized pieces, pushing each to
+// |decoder|. Returns |decoder->Finish()|.
+bool DecodeMeshFile(FILE* fp, MeshStreamDecoder* decoder) {
+  char buf[64 * 1024];
+  size_t num_read;
+  while ((num_read = fread(buf, 1, sizeof(buf), fp)) != 0) {
+    if (!decoder->Push(buf, num_read)) return false;
+  }
+  return decoder->Finish();
+}
+
+}  // namespace webgl_loader
+
+#endif  // WEBGL_LOADER_DECOMPRESS_H_
@@ -0,0 +1,194 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_EDGEBREAKER_H_
+#define WEBGL_LOADER_EDGEBREAKER_H_
+
+#include <algorithm>
+#include <vector>
+
+#include "base.h"
+
+namespace webgl_loader {
+
+// An Edgebreaker-style connectivity coder grows a region of decoded
+// triangles one triangle at a time. Its boundary is made of "gates":
+// directed edges of decoded triangles whose other side has not been
+// decoded yet. Each step takes a gate a -> b, and one symbol says
+// where the third vertex c of the triangle (b, a, c) across it is:
+//   C: a new vertex, the next in vertex order,
+//   R: the end of the gate that starts at b,
+//   L: the start of the gate that ends at a,
+//   S: any other vertex, given explicitly by an index code,
+//   X: there is no triangle across the gate, so it is dropped.
+// On a manifold mesh, almost every step is C, R or L, and C steps
+// introduce vertices in the order a parallelogram can predict them.
+//
+// Unlike Edgebreaker proper, the boundary is not kept as ordered
+// loops, and the decoder is never told how they split or merge.
+// Instead, gates are looked up by vertex, and whenever a new gate
+// meets a gate running the other way, both are closed. That handles
+// holes, handles and non-manifold edges and vertices (with S and X
+// symbols) at some cost in compression, and means that any triangle
+// list can be coded. When no gates are left, the next triangle is a
+// seed, whose vertices are coded with high water mark codes.
+//
+// |GateBoundary| is that shared state. The encoder and decoder make
+// the same calls in the same order, so they agree on it exactly.
+
+enum GateSymbol {
+  GATE_NEW_VERTEX = 0,  // C
+  GATE_NEXT = 1,        // R
+  GATE_PREVIOUS = 2,    // L
+  GATE_SPLIT = 3,       // S
+  GATE_SKIP = 4,        // X
+  NUM_GATE_SYMBOLS
+};
+
+// In UTF-8, three symbols are packed into one code, as
+// s0 + 5*s1 + 25*s2, which is always a single byte.
+const uint16 kNumPackedGateCodes =
+    NUM_GATE_SYMBOLS * NUM_GATE_SYMBOLS * NUM_GATE_SYMBOLS;
+
+class GateBoundary {
+ public:
+  struct Gate {
+    uint16 v0;
+    uint16 v1;
+    // The third vertex of the decoded triangle, for parallelogram
+    // prediction of a new vertex across the gate.
+    uint16 opposite;
+    bool live;
+  };
+
+  explicit GateBoundary(size_t num_verts)
+      : outgoing_(num_verts),
+        incoming_(num_verts) {
+  }
+
+  const Gate& operator[](int gate) const {
+    return gates_[gate];
+  }
+
+  // Returns the next gate to decode across, or -1 if there are none,
+  // in which case the next triangle is a seed.
+  int Pop() {
+    while (!stack_.empty()) {
+      const int gate = stack_.back();
+      stack_.pop_back();
+      if (gates_[gate].live) return gate;
+    }
+    return -1;
+  }
+
+  // The vertex for |GATE_NEXT| across |gate|, or -1 if there is none.
+  int Next(int gate) const {
+    const std::vector<int>& outgoing = outgoing_[gates_[gate].v1];
+    for (size_t i = outgoing.size(); i-- != 0; ) {
+      if (outgoing[i] != gate) return gates_[outgoing[i]].v1;
+    }
+    return -1;
+  }
+
+  // The vertex for |GATE_PREVIOUS| across |gate|, or -1.
+  int Previous(int gate) const {
+    const std::vector<int>& incoming = incoming_[gates_[gate].v0];
+    for (size_t i = incoming.size(); i-- != 0; ) {
+      if (incoming[i] != gate) return gates_[incoming[i]].v0;
+    }
+    return -1;
+  }
+
+  // Starts a new region with |triangle|.
+  void AddSeed(const uint16* triangle) {
+    const int first = static_cast<int>(gates_.size());
+    for (size_t i = 0; i < 3; ++i) {
+      NewGate(triangle[i], triangle[(i + 1) % 3], triangle[(i + 2) % 3]);
+    }
+    for (int i = 0; i < 3; ++i) {
+      Close(first + i);
+    }
+    for (int i = 0; i < 3; ++i) {
+      if (gates_[first + i].live) stack_.push_back(first + i);
+    }
+  }
+
+  // For |GATE_SKIP|.
+  void Skip(int gate) {
+    Kill(gate);
+  }
+
+  // Decodes the triangle (|gate|.v1, |gate|.v0, |vertex|), replacing
+  // |gate| with up to two new gates.
+  void Advance(int gate, uint16 vertex) {
+    const Gate old = gates_[gate];
+    Kill(gate);
+    const int left = NewGate(old.v0, vertex, old.v1);
+    const int right = NewGate(vertex, old.v1, old.v0);
+    Close(left);
+    Close(right);
+    // |right| is on top, so the region grows in a spiral like
+    // Edgebreaker's.
+    if (gates_[left].live) stack_.push_back(left);
+    if (gates_[right].live) stack_.push_back(right);
+  }
+
+ private:
+  int NewGate(uint16 v0, uint16 v1, uint16 opposite) {
+    const int gate = static_cast<int>(gates_.size());
+    Gate new_gate = { v0, v1, opposite, true };
+    gates_.push_back(new_gate);
+    outgoing_[v0].push_back(gate);
+    incoming_[v1].push_back(gate);
+    return gate;
+  }
+
+  void Kill(int gate) {
+    gates_[gate].live = false;
+    Erase(gate, &outgoing_[gates_[gate].v0]);
+    Erase(gate, &incoming_[gates_[gate].v1]);
+  }
+
+  static void Erase(int gate, std::vector<int>* gates) {
+    gates->erase(std::find(gates->begin(), gates->end(), gate));
+  }
+
+  // If a live gate runs opposite to |gate|, the triangles on either
+  // side are both decoded, so both gates are closed.
+  void Close(int gate) {
+    const Gate& u = gates_[gate];
+    if (!u.live) return;
+    const std::vector<int>& outgoing = outgoing_[u.v1];
+    for (size_t i = 0; i < outgoing.size(); ++i) {
+      const int twin = outgoing[i];
+      if (twin != gate && gates_[twin].v1 == u.v0) {
+        Kill(gate);
+        Kill(twin);
+        return;
+      }
+    }
+  }
+
+  std::vector<Gate> gates_;
+  // The live gates starting and ending at each vertex, oldest first.
+  std::vector<std::vector<int> > outgoing_;
+  std::vector<std::vector<int> > incoming_;
+  // Gates waiting to be decoded across, including dead ones, which
+  // are discarded when popped.
+  std::vector<int> stack_;
+};
+
+}  // namespace webgl_loader
+
+#endif  // WEBGL_LOADER_EDGEBREAKER_H_
@@ -0,0 +1,274 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_ENTROPY_H_
+#define WEBGL_LOADER_ENTROPY_H_
+
+#include "base.h"
+#include "stream.h"
+
+namespace webgl_loader {
+
+// An adaptive binary range coder, in the style of LZMA's. Each binary
+// decision is coded with an adaptive probability, so there is no need
+// to transmit any tables; the decoder learns the same statistics as
+// it goes.
+
+const int kNumProbBits = 11;
+const uint16 kProbOne = 1 << kNumProbBits;
+const uint16 kProbInit = kProbOne / 2;
+// Larger values adapt more slowly, but more precisely.
+const int kNumAdaptBits = 5;
+const uint32 kRangeTop = 1 << 24;
+
+class RangeEncoder {
+ public:
+  // |sink| is unowned and must not be NULL. Nothing reaches it until
+  // |Flush|.
+  explicit RangeEncoder(ByteSinkInterface* sink)
+      : sink_(sink),
+        low_(0),
+        range_(0xFFFFFFFF),
+        cache_(0),
+        cache_size_(1) {
+  }
+
+  void EncodeBit(uint16* prob, int bit) {
+    const uint32 bound = (range_ >> kNumProbBits) * *prob;
+    if (bit == 0) {
+      range_ = bound;
+      *prob += (kProbOne - *prob) >> kNumAdaptBits;
+    } else {
+      low_ += bound;
+      range_ -= bound;
+      *prob -= *prob >> kNumAdaptBits;
+    }
+    Normalize();
+  }
+
+  // Encode the low |num_bits| of |value| with probability 1/2 each.
+  void EncodeDirectBits(uint32 value, int num_bits) {
+    while (num_bits > 0) {
+      range_ >>= 1;
+      if ((value >> --num_bits) & 1) {
+        low_ += range_;
+      }
+      Normalize();
+    }
+  }
+
+  // Must be called once, after the last bit.
+  void Flush() {
+    for (int i = 0; i < 5; ++i) {
+      ShiftLow();
+    }
+    sink_.Flush();
+  }
+
+ private:
+  void Normalize() {
+    while (range_ < kRangeTop) {
+      range_ <<= 8;
+      ShiftLow();
+    }
+  }
+
+  // Carries are propagated lazily: a run of 0xFF bytes is held back in
+  // |cache_| and |cache_size_| until we know whether it overflows.
+  void ShiftLow() {
+    if (static_cast<uint32>(low_) < 0xFF000000U || (low_ >> 32) != 0) {
+      const uint8 carry = static_cast<uint8>(low_ >> 32);
+      uint8 temp = cache_;
+      do {
+        sink_.Put(static_cast<char>(temp + carry));
+        temp = 0xFF;
+      } while (--cache_size_ != 0);
+      cache_ = static_cast<uint8>(low_ >> 24);
+    }
+    ++cache_size_;
+    low_ = (low_ & 0x00FFFFFF) << 8;
+  }
+
+  BufferedByteSink sink_;
+  unsigned long long low_;
+  uint32 range_;
+  uint8 cache_;
+  unsigned long long cache_size_;
+};
+
+class RangeDecoder {
+ public:
+  // |data| is unowned, and must outlive the decoder.
+  RangeDecoder(const char* data, size_t length)
+      : cursor_(data),
+        end_(data + length),
+        range_(0xFFFFFFFF),
+        code_(0),
+        overrun_(false) {
+    for (int i = 0; i < 5; ++i) {
+      code_ = (code_ << 8) | NextByte();
+    }
+  }
+
+  int DecodeBit(uint16* prob) {
+    const uint32 bound = (range_ >> kNumProbBits) * *prob;
+    int bit;
+    if (code_ < bound) {
+      range_ = bound;
+      *prob += (kProbOne - *prob) >> kNumAdaptBits;
+      bit = 0;
+    } else {
+      code_ -= bound;
+      range_ -= bound;
+      *prob -= *prob >> kNumAdaptBits;
+      bit = 1;
+    }
+    Normalize();
+    return bit;
+  }
+
+  uint32 DecodeDirectBits(int num_bits) {
+    uint32 value = 0;
+    while (num_bits-- > 0) {
+      range_ >>= 1;
+      int bit = 0;
+      if (code_ >= range_) {
+        code_ -= range_;
+        bit = 1;
+      }
+      value = (value << 1) | bit;
+      Normalize();
+    }
+    return value;
+  }
+
+  // |true| if the decoder has read past the end of its input, which
+  // means the input was truncated or corrupt.
+  bool overrun() const {
+    return overrun_;
+  }
+
+  // The position just after the last byte read by the decoder. After
+  // decoding everything, this is the end of the encoded data.
+  const char* cursor() const {
+    return cursor_;
+  }
+
+ private:
+  void Normalize() {
+    if (range_ < kRangeTop) {
+      range_ <<= 8;
+      code_ = (code_ << 8) | NextByte();
+    }
+  }
+
+  uint8 NextByte() {
+    if (cursor_ == end_) {
+      overrun_ = true;
+      return 0;
+    }
+    return static_cast<uint8>(*cursor_++);
+  }
+
+  const char* cursor_;  // unowned.
+  const char* end_;
+  uint32 range_;
+  uint32 code_;
+  bool overrun_;
+};
+
+// An adaptive model for 16-bit values that are usually small, such as
+// ZigZag-coded residuals or high water mark codes. Values are split
+// into a bucket, which is the number of significant bits, and a
+// mantissa. The bucket and the most significant bits of the mantissa
+// are coded with adaptive probabilities. The remaining low bits are
+// nearly uniform, so they are coded directly.
+class AdaptiveUint16Model {
+ public:
+  AdaptiveUint16Model() {
+    for (size_t i = 0; i < kNumBucketProbs; ++i) {
+      bucket_probs_[i] = kProbInit;
+    }
+    for (size_t i = 0; i < kNumBuckets; ++i) {
+      for (size_t j = 0; j < kNumMantissaProbs; ++j) {
+        mantissa_probs_[i][j] = kProbInit;
+      }
+    }
+  }
+
+  void Encode(uint16 value, RangeEncoder* encoder) {
+    int bucket = 0;
+    while (bucket < 16 && (value >> bucket)) ++bucket;
+    EncodeTree(bucket_probs_, kNumBucketBits, bucket, encoder);
+    if (bucket < 2) return;
+    // The leading one bit is implied by the bucket.
+    const int num_bits = bucket - 1;
+    const uint32 mantissa = value - (1U << num_bits);
+    const int num_modeled = num_bits < kNumModeledBits ?
+        num_bits : kNumModeledBits;
+    const int num_direct = num_bits - num_modeled;
+    EncodeTree(mantissa_probs_[bucket], num_modeled,
+               mantissa >> num_direct, encoder);
+    encoder->EncodeDirectBits(mantissa, num_direct);
+  }
+
+  uint16 Decode(RangeDecoder* decoder) {
+    const uint32 bucket = DecodeTree(bucket_probs_, kNumBucketBits, decoder);
+    if (bucket < 2) return bucket;
+    const int num_bits = (bucket > 16 ? 16 : bucket) - 1;
+    const int num_modeled = num_bits < kNumModeledBits ?
+        num_bits : kNumModeledBits;
+    const int num_direct = num_bits - num_modeled;
+    uint32 mantissa = DecodeTree(mantissa_probs_[bucket > 16 ? 16 : bucket],
+                                 num_modeled, decoder);
+    mantissa = (mantissa << num_direct) |
+        decoder->DecodeDirectBits(num_direct);
+    return static_cast<uint16>((1U << num_bits) + mantissa);
+  }
+
+ private:
+  static const int kNumBucketBits = 5;
+  static const size_t kNumBucketProbs = 1 << kNumBucketBits;
+  static const size_t kNumBuckets = 17;
+  static const int kNumModeledBits = 3;
+  static const size_t kNumMantissaProbs = 1 << kNumModeledBits;
+
+  // Bit trees code |num_bits| bits, most significant first, with each
+  // bit using a probability conditioned on the bits before it.
+  static void EncodeTree(uint16* probs, int num_bits, uint32 value,
+                         RangeEncoder* encoder) {
+    uint32 node = 1;
+    while (num_bits-- > 0) {
+      const int bit = (value >> num_bits) & 1;
+      encoder->EncodeBit(&probs[node], bit);
+      node = (node << 1) | bit;
+    }
+  }
+
+  static uint32 DecodeTree(uint16* probs, int num_bits,
+                           RangeDecoder* decoder) {
+    uint32 node = 1;
+    for (int i = 0; i < num_bits; ++i) {
+      node = (node << 1) | decoder->DecodeBit(&probs[node]);
+    }
+    return node - (1U << num_bits);
+  }
+
+  uint16 bucket_probs_[kNumBucketProbs];
+  uint16 mantissa_probs_[kNumBuckets][kNumMantissaProbs];
+};
+
+}  // namespace webgl_loader
+
+#endif  // WEBGL_LOADER_ENTROPY_H_
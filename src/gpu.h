@@ -0,0 +1,453 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_GPU_H_
+#define WEBGL_LOADER_GPU_H_
+
+#include <fcntl.h>
+#include <math.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "base.h"
+#include "bounds.h"
+#include "decompress.h"
+#include "stream.h"
+
+namespace webgl_loader {
+
+// A file of vertex and index buffers that are ready to upload with
+// bufferData as they are, for clients that would rather not decode at
+// all. Everything is little-endian:
+//
+//   header, 64 bytes:
+//      0  "WGLG"
+//      4  uint32 version, 1
+//      8  uint32 number of meshes
+//     12  uint32 |GpuNormalFormat|
+//     16  uint32 vertex stride, 16
+//     20  uint32 position, normal and texcoord offsets in a vertex:
+//         0, 8 and 12
+//     32  float[3] position decode offsets, as in decodeParams
+//     44  float[3] position decode scales
+//     56  uint32 index size, 2
+//     60  uint32 |GpuTexcoordFormat|
+//   then for each mesh, 16 bytes:
+//         uint32 vertex offset in the file, number of vertices,
+//         index offset in the file, number of indices
+//   then for each mesh, its vertices, 16-byte aligned, followed by
+//   its indices.
+//
+// A vertex is:
+//   positions: 3 x GL_SHORT, not normalized, then 2 bytes of padding.
+//     The model position is (p + decode offset) * decode scale, which
+//     fits in a model matrix.
+//   normals: see |GpuNormalFormat|.
+//   texcoords: see |GpuTexcoordFormat|.
+
+enum GpuNormalFormat {
+  // One GL_INT_2_10_10_10_REV, normalized: x, y and z in the low 30
+  // bits, w = 0 above them.
+  GPU_NORMALS_INT_2_10_10_10 = 0,
+  // 2 x GL_SHORT, normalized, as an octahedral map; see
+  // |OctahedralNormal|.
+  GPU_NORMALS_OCTAHEDRAL = 1
+};
+
+enum GpuTexcoordFormat {
+  // 2 x GL_UNSIGNED_SHORT, normalized, when every texcoord is in
+  // [0, 1].
+  GPU_TEXCOORDS_UNORM16 = 0,
+  // 2 x GL_UNSIGNED_SHORT, not normalized, in quanta of 1/1023, as in
+  // decodeParams, for texcoords that wrap.
+  GPU_TEXCOORDS_QUANTIZED = 1
+};
+
+const char kGpuMagic[4] = { 'W', 'G', 'L', 'G' };
+const uint32 kGpuVersion = 1;
+const size_t kGpuHeaderSize = 64;
+const size_t kGpuMeshRecordSize = 16;
+const size_t kGpuVertexStride = 16;
+const size_t kGpuPositionOffset = 0;
+const size_t kGpuNormalOffset = 8;
+const size_t kGpuTexcoordOffset = 12;
+
+inline void PutLittleEndian16(uint16 word, char* out) {
+  out[0] = static_cast<char>(word & 0xFF);
+  out[1] = static_cast<char>(word >> 8);
+}
+
+inline void PutLittleEndian32(uint32 word, char* out) {
+  for (size_t i = 0; i < 4; ++i) {
+    out[i] = static_cast<char>((word >> (8 * i)) & 0xFF);
+  }
+}
+
+inline uint32 GetLittleEndian32(const char* in) {
+  uint32 word = 0;
+  for (size_t i = 0; i < 4; ++i) {
+    word |= static_cast<uint32>(static_cast<unsigned char>(in[i])) << (8 * i);
+  }
+  return word;
+}
+
+inline uint16 GetLittleEndian16(const char* in) {
+  return static_cast<uint16>(static_cast<unsigned char>(in[0]) |
+                             static_cast<unsigned char>(in[1]) << 8);
+}
+
+inline uint32 FloatBits(float f) {
+  uint32 bits;
+  memcpy(&bits, &f, sizeof(bits));
+  return bits;
+}
+
+inline float BitsFloat(uint32 bits) {
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+// Whether the buffers can be used in place on this machine.
+inline bool IsLittleEndian() {
+  const uint16 word = 1;
+  char byte;
+  memcpy(&byte, &word, 1);
+  return byte == 1;
+}
+
+// Maps the unit vector |n| onto the octahedron |x| + |y| + |z| = 1,
+// and unfolds its lower half over the corners of the square.
+void OctahedralNormal(const float* n, float* uv) {
+  const float l1 = fabs(n[0]) + fabs(n[1]) + fabs(n[2]);
+  float u = l1 > 0.f ? n[0] / l1 : 0.f;
+  float v = l1 > 0.f ? n[1] / l1 : 0.f;
+  if (n[2] < 0.f) {
+    const float folded_u = (1.f - fabs(v)) * (u >= 0.f ? 1.f : -1.f);
+    v = (1.f - fabs(u)) * (v >= 0.f ? 1.f : -1.f);
+    u = folded_u;
+  }
+  uv[0] = u;
+  uv[1] = v;
+}
+
+// The inverse of |OctahedralNormal|, normalized.
+void UnpackOctahedralNormal(const float* uv, float* n) {
+  n[0] = uv[0];
+  n[1] = uv[1];
+  n[2] = 1.f - fabs(uv[0]) - fabs(uv[1]);
+  if (n[2] < 0.f) {
+    n[0] = (1.f - fabs(uv[1])) * (uv[0] >= 0.f ? 1.f : -1.f);
+    n[1] = (1.f - fabs(uv[0])) * (uv[1] >= 0.f ? 1.f : -1.f);
+  }
+  const float length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+  for (size_t i = 0; i < 3; ++i) {
+    n[i] /= length;
+  }
+}
+
+inline int RoundToInt(float f) {
+  return static_cast<int>(floor(f + 0.5f));
+}
+
+// Packs the quantized vertex |attribs| into |kGpuVertexStride| bytes
+// at |out|.
+void PackGpuVertex(const uint16* attribs, GpuNormalFormat format,
+                   GpuTexcoordFormat texcoord_format, char* out) {
+  for (size_t i = 0; i < 3; ++i) {
+    PutLittleEndian16(attribs[i], out + kGpuPositionOffset + 2 * i);
+  }
+  PutLittleEndian16(0, out + kGpuPositionOffset + 6);
+  float n[3], length = 0.f;
+  for (size_t i = 0; i < 3; ++i) {
+    n[i] = static_cast<float>(attribs[5 + i]) - 511.f;
+    length += n[i] * n[i];
+  }
+  length = sqrt(length);
+  for (size_t i = 0; i < 3; ++i) {
+    n[i] = length > 0.f ? n[i] / length : 0.f;
+  }
+  if (format == GPU_NORMALS_OCTAHEDRAL) {
+    float uv[2];
+    OctahedralNormal(n, uv);
+    for (size_t i = 0; i < 2; ++i) {
+      const int16 snorm = static_cast<int16>(RoundToInt(32767.f * uv[i]));
+      PutLittleEndian16(static_cast<uint16>(snorm),
+                        out + kGpuNormalOffset + 2 * i);
+    }
+  } else {
+    uint32 packed = 0;
+    for (size_t i = 0; i < 3; ++i) {
+      const int snorm = RoundToInt(511.f * n[i]);
+      packed |= (static_cast<uint32>(snorm) & 0x3FF) << (10 * i);
+    }
+    PutLittleEndian32(packed, out + kGpuNormalOffset);
+  }
+  // Texcoords are quantized to 10 bits over [0, 1], and widened so
+  // that normalizing them gives the same value.
+  for (size_t i = 0; i < 2; ++i) {
+    const uint32 unorm = (texcoord_format == GPU_TEXCOORDS_UNORM16) ?
+        (attribs[3 + i] * 65535u + 511u) / 1023u : attribs[3 + i];
+    PutLittleEndian16(static_cast<uint16>(unorm),
+                      out + kGpuTexcoordOffset + 2 * i);
+  }
+}
+
+inline size_t AlignUp(size_t offset, size_t alignment) {
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+// Writes |meshes| to |sink| in the format above, and returns the
+// texcoord format, which is unorm16 unless some texcoord wraps.
+GpuTexcoordFormat WriteGpuMeshes(const BoundsParams& params,
+                                 GpuNormalFormat format,
+                                 const WebGLMeshList& meshes,
+                                 ByteSinkInterface* sink) {
+  GpuTexcoordFormat texcoord_format = GPU_TEXCOORDS_UNORM16;
+  for (size_t i = 0; i < meshes.size(); ++i) {
+    const QuantizedAttribList& attribs = meshes[i].attribs;
+    for (size_t j = 0; j < attribs.size(); j += 8) {
+      if (attribs[j + 3] > 1023 || attribs[j + 4] > 1023) {
+        texcoord_format = GPU_TEXCOORDS_QUANTIZED;
+      }
+    }
+  }
+  std::string header(kGpuHeaderSize + kGpuMeshRecordSize * meshes.size(),
+                     '\0');
+  char* out = &header[0];
+  memcpy(out, kGpuMagic, sizeof(kGpuMagic));
+  PutLittleEndian32(kGpuVersion, out + 4);
+  PutLittleEndian32(static_cast<uint32>(meshes.size()), out + 8);
+  PutLittleEndian32(format, out + 12);
+  PutLittleEndian32(kGpuVertexStride, out + 16);
+  PutLittleEndian32(kGpuPositionOffset, out + 20);
+  PutLittleEndian32(kGpuNormalOffset, out + 24);
+  PutLittleEndian32(kGpuTexcoordOffset, out + 28);
+  for (size_t i = 0; i < 3; ++i) {
+    PutLittleEndian32(FloatBits(static_cast<float>(params.decodeOffsets[i])),
+                      out + 32 + 4 * i);
+    PutLittleEndian32(FloatBits(params.decodeScales[i]), out + 44 + 4 * i);
+  }
+  PutLittleEndian32(sizeof(uint16), out + 56);
+  PutLittleEndian32(texcoord_format, out + 60);
+  size_t offset = header.size();
+  for (size_t i = 0; i < meshes.size(); ++i) {
+    char* record = out + kGpuHeaderSize + kGpuMeshRecordSize * i;
+    const size_t num_verts = meshes[i].attribs.size() / 8;
+    const size_t num_indices = meshes[i].indices.size();
+    offset = AlignUp(offset, kGpuVertexStride);
+    PutLittleEndian32(static_cast<uint32>(offset), record);
+    PutLittleEndian32(static_cast<uint32>(num_verts), record + 4);
+    offset += kGpuVertexStride * num_verts;
+    PutLittleEndian32(static_cast<uint32>(offset), record + 8);
+    PutLittleEndian32(static_cast<uint32>(num_indices), record + 12);
+    offset += sizeof(uint16) * num_indices;
+  }
+  sink->PutN(header.data(), header.size());
+  size_t written = header.size();
+  std::string buffer;
+  for (size_t i = 0; i < meshes.size(); ++i) {
+    const WebGLMesh& mesh = meshes[i];
+    const size_t num_verts = mesh.attribs.size() / 8;
+    const size_t start = AlignUp(written, kGpuVertexStride);
+    buffer.assign(start - written + kGpuVertexStride * num_verts +
+                  sizeof(uint16) * mesh.indices.size(), '\0');
+    char* vertices = &buffer[start - written];
+    for (size_t j = 0; j < num_verts; ++j) {
+      PackGpuVertex(&mesh.attribs[8 * j], format, texcoord_format,
+                    vertices + kGpuVertexStride * j);
+    }
+    char* indices = vertices + kGpuVertexStride * num_verts;
+    for (size_t j = 0; j < mesh.indices.size(); ++j) {
+      PutLittleEndian16(mesh.indices[j], indices + sizeof(uint16) * j);
+    }
+    sink->PutN(buffer.data(), buffer.size());
+    written += buffer.size();
+  }
+  return texcoord_format;
+}
+
+// One mesh of a |GpuMeshFile|, pointing into its bytes.
+struct GpuMeshView {
+  // |kGpuVertexStride| bytes each.
+  const char* vertices;
+  size_t num_verts;
+  // Little-endian uint16s.
+  const char* indices;
+  size_t num_indices;
+};
+
+// Reads a file from |WriteGpuMeshes| in place, from memory or by
+// mapping it, so that a client can hand the views straight to
+// bufferData. Parsing only checks the header and the mesh records.
+// The views are little-endian, so a client on a machine that isn't
+// (see |IsLittleEndian|) has to swap them first.
+class GpuMeshFile {
+ public:
+  GpuMeshFile()
+      : map_(NULL),
+        map_size_(0) {
+  }
+
+  ~GpuMeshFile() {
+    Unmap();
+  }
+
+  // Maps |path| read-only, and parses it.
+  bool Map(const char* path) {
+    Unmap();
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      close(fd);
+      return false;
+    }
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+    map_ = map;
+    map_size_ = st.st_size;
+    return Parse(static_cast<const char*>(map_), map_size_);
+  }
+
+  // Parses the |size| bytes at |data|, which must outlive this.
+  bool Parse(const char* data, size_t size) {
+    meshes_.clear();
+    if (size < kGpuHeaderSize || memcmp(data, kGpuMagic, 4) != 0 ||
+        GetLittleEndian32(data + 4) != kGpuVersion ||
+        GetLittleEndian32(data + 16) != kGpuVertexStride ||
+        GetLittleEndian32(data + 56) != sizeof(uint16)) {
+      return false;
+    }
+    format_ = static_cast<GpuNormalFormat>(GetLittleEndian32(data + 12));
+    texcoord_format_ =
+        static_cast<GpuTexcoordFormat>(GetLittleEndian32(data + 60));
+    if ((format_ != GPU_NORMALS_INT_2_10_10_10 &&
+         format_ != GPU_NORMALS_OCTAHEDRAL) ||
+        (texcoord_format_ != GPU_TEXCOORDS_UNORM16 &&
+         texcoord_format_ != GPU_TEXCOORDS_QUANTIZED)) {
+      return false;
+    }
+    for (size_t i = 0; i < 3; ++i) {
+      decode_offsets_[i] = BitsFloat(GetLittleEndian32(data + 32 + 4 * i));
+      decode_scales_[i] = BitsFloat(GetLittleEndian32(data + 44 + 4 * i));
+    }
+    const size_t num_meshes = GetLittleEndian32(data + 8);
+    if (num_meshes > (size - kGpuHeaderSize) / kGpuMeshRecordSize) {
+      return false;
+    }
+    meshes_.resize(num_meshes);
+    for (size_t i = 0; i < num_meshes; ++i) {
+      const char* record = data + kGpuHeaderSize + kGpuMeshRecordSize * i;
+      const size_t vertex_offset = GetLittleEndian32(record);
+      const size_t num_verts = GetLittleEndian32(record + 4);
+      const size_t index_offset = GetLittleEndian32(record + 8);
+      const size_t num_indices = GetLittleEndian32(record + 12);
+      if (vertex_offset > size ||
+          num_verts > (size - vertex_offset) / kGpuVertexStride ||
+          index_offset > size ||
+          num_indices > (size - index_offset) / sizeof(uint16)) {
+        meshes_.clear();
+        return false;
+      }
+      GpuMeshView& mesh = meshes_[i];
+      mesh.vertices = data + vertex_offset;
+      mesh.num_verts = num_verts;
+      mesh.indices = data + index_offset;
+      mesh.num_indices = num_indices;
+    }
+    return true;
+  }
+
+  GpuNormalFormat normal_format() const { return format_; }
+  GpuTexcoordFormat texcoord_format() const { return texcoord_format_; }
+  const float* decode_offsets() const { return decode_offsets_; }
+  const float* decode_scales() const { return decode_scales_; }
+  size_t num_meshes() const { return meshes_.size(); }
+  const GpuMeshView& mesh(size_t i) const { return meshes_[i]; }
+
+  // Unpacks mesh |i|, for checking. |mesh|->fixed_attribs gets the
+  // quantized positions and texcoords, and |mesh|->attribs gets
+  // normals scaled to 511, like the edge caching decoders.
+  void Unpack(size_t i, DecodedMesh* mesh) const {
+    const GpuMeshView& view = meshes_[i];
+    mesh->fixed_attribs.assign(8 * view.num_verts, 0);
+    mesh->attribs.assign(8 * view.num_verts, 0.f);
+    mesh->indices.resize(view.num_indices);
+    mesh->bboxes.clear();
+    for (size_t j = 0; j < view.num_verts; ++j) {
+      const char* vertex = view.vertices + kGpuVertexStride * j;
+      uint16* fixed = &mesh->fixed_attribs[8 * j];
+      float* n = &mesh->attribs[8 * j + 5];
+      for (size_t k = 0; k < 3; ++k) {
+        fixed[k] = GetLittleEndian16(vertex + kGpuPositionOffset + 2 * k);
+      }
+      for (size_t k = 0; k < 2; ++k) {
+        const uint32 texcoord =
+            GetLittleEndian16(vertex + kGpuTexcoordOffset + 2 * k);
+        fixed[3 + k] = (texcoord_format_ == GPU_TEXCOORDS_UNORM16) ?
+            static_cast<uint16>((texcoord * 1023u + 32767u) / 65535u) :
+            static_cast<uint16>(texcoord);
+      }
+      if (format_ == GPU_NORMALS_OCTAHEDRAL) {
+        float uv[2];
+        for (size_t k = 0; k < 2; ++k) {
+          const int16 snorm = static_cast<int16>(
+              GetLittleEndian16(vertex + kGpuNormalOffset + 2 * k));
+          uv[k] = std::max(-1.f, snorm / 32767.f);
+        }
+        UnpackOctahedralNormal(uv, n);
+      } else {
+        const uint32 packed = GetLittleEndian32(vertex + kGpuNormalOffset);
+        for (size_t k = 0; k < 3; ++k) {
+          int snorm = (packed >> (10 * k)) & 0x3FF;
+          if (snorm >= 512) snorm -= 1024;
+          n[k] = std::max(-1.f, snorm / 511.f);
+        }
+      }
+      for (size_t k = 0; k < 3; ++k) {
+        n[k] *= 511.f;
+      }
+    }
+    for (size_t j = 0; j < view.num_indices; ++j) {
+      mesh->indices[j] = GetLittleEndian16(view.indices + sizeof(uint16) * j);
+    }
+  }
+
+ private:
+  void Unmap() {
+    if (map_ != NULL) munmap(map_, map_size_);
+    map_ = NULL;
+    map_size_ = 0;
+  }
+
+  void* map_;
+  size_t map_size_;
+  GpuNormalFormat format_;
+  GpuTexcoordFormat texcoord_format_;
+  float decode_offsets_[3];
+  float decode_scales_[3];
+  std::vector<GpuMeshView> meshes_;
+};
+
+}  // namespace webgl_loader
+
+#endif  // WEBGL_LOADER_GPU_H_
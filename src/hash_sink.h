@@ -0,0 +1,274 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_HASH_SINK_H_
+#define WEBGL_LOADER_HASH_SINK_H_
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "base.h"
+#include "stream.h"
+
+namespace webgl_loader {
+
+// Yann Collet's xxHash64, fed a piece at a time. Four independent
+// lanes each take 8 bytes of every 32, so it runs several times as
+// fast as |SimpleHash|'s byte at a time. Words are read in host
+// order, so hashes only agree between little-endian machines.
+class Hash64 {
+ public:
+  explicit Hash64(uint64 seed = 0) {
+    Reset(seed);
+  }
+
+  void Reset(uint64 seed = 0) {
+    seed_ = seed;
+    lanes_[0] = seed + kPrime1 + kPrime2;
+    lanes_[1] = seed + kPrime2;
+    lanes_[2] = seed;
+    lanes_[3] = seed - kPrime1;
+    stripe_length_ = 0;
+    total_length_ = 0;
+  }
+
+  void Update(const char* data, size_t length) {
+    total_length_ += length;
+    if (stripe_length_ != 0) {
+      const size_t fill = std::min(length, kStripeSize - stripe_length_);
+      memcpy(stripe_ + stripe_length_, data, fill);
+      stripe_length_ += fill;
+      data += fill;
+      length -= fill;
+      if (stripe_length_ < kStripeSize) return;
+      Stripe(stripe_);
+      stripe_length_ = 0;
+    }
+    const char* const end = data + length - length % kStripeSize;
+    uint64 v0 = lanes_[0], v1 = lanes_[1], v2 = lanes_[2], v3 = lanes_[3];
+    for (; data != end; data += kStripeSize) {
+      v0 = Round(v0, Load64(data));
+      v1 = Round(v1, Load64(data + 8));
+      v2 = Round(v2, Load64(data + 16));
+      v3 = Round(v3, Load64(data + 24));
+    }
+    lanes_[0] = v0;
+    lanes_[1] = v1;
+    lanes_[2] = v2;
+    lanes_[3] = v3;
+    stripe_length_ = length % kStripeSize;
+    memcpy(stripe_, data, stripe_length_);
+  }
+
+  // Of everything since |Reset|. Doesn't change the state, so more
+  // can be added after.
+  uint64 Digest() const {
+    uint64 hash;
+    if (total_length_ >= kStripeSize) {
+      hash = Rotate(lanes_[0], 1) + Rotate(lanes_[1], 7) +
+          Rotate(lanes_[2], 12) + Rotate(lanes_[3], 18);
+      for (size_t i = 0; i < 4; ++i) {
+        hash = (hash ^ Round(0, lanes_[i])) * kPrime1 + kPrime4;
+      }
+    } else {
+      hash = seed_ + kPrime5;
+    }
+    hash += total_length_;
+    const char* p = stripe_;
+    const char* const end = stripe_ + stripe_length_;
+    for (; p + 8 <= end; p += 8) {
+      hash ^= Round(0, Load64(p));
+      hash = Rotate(hash, 27) * kPrime1 + kPrime4;
+    }
+    if (p + 4 <= end) {
+      uint32 word;
+      memcpy(&word, p, sizeof(word));
+      hash ^= word * kPrime1;
+      hash = Rotate(hash, 23) * kPrime2 + kPrime3;
+      p += 4;
+    }
+    for (; p != end; ++p) {
+      hash ^= static_cast<uint8>(*p) * kPrime5;
+      hash = Rotate(hash, 11) * kPrime1;
+    }
+    hash ^= hash >> 33;
+    hash *= kPrime2;
+    hash ^= hash >> 29;
+    hash *= kPrime3;
+    hash ^= hash >> 32;
+    return hash;
+  }
+
+ private:
+  static const uint64 kPrime1 = 11400714785074694791ULL;
+  static const uint64 kPrime2 = 14029467366897019727ULL;
+  static const uint64 kPrime3 = 1609587929392839161ULL;
+  static const uint64 kPrime4 = 9650029242287828579ULL;
+  static const uint64 kPrime5 = 2870177450012600261ULL;
+  static const size_t kStripeSize = 32;
+
+  static uint64 Rotate(uint64 x, int bits) {
+    return (x << bits) | (x >> (64 - bits));
+  }
+
+  static uint64 Load64(const char* p) {
+    uint64 word;
+    memcpy(&word, p, sizeof(word));
+    return word;
+  }
+
+  static uint64 Round(uint64 lane, uint64 word) {
+    return Rotate(lane + word * kPrime2, 31) * kPrime1;
+  }
+
+  void Stripe(const char* data) {
+    for (size_t i = 0; i < 4; ++i) {
+      lanes_[i] = Round(lanes_[i], Load64(data + 8 * i));
+    }
+  }
+
+  uint64 seed_;
+  uint64 lanes_[4];
+  char stripe_[kStripeSize];  // A partial stripe, left for later.
+  size_t stripe_length_;
+  uint64 total_length_;
+};
+
+// At most this much is written to a |HashingSink| before it is
+// hashed, so that it is still in cache.
+const size_t kHashWindow = 64 * 1024;
+
+// Hashes everything written to |sink| on the way through. Producers
+// write straight into |sink|'s own room, and the bytes are hashed
+// where they lie, so nothing is copied twice. Nothing else may write
+// to |sink| while this is, until |Flush|.
+class HashingSink : public BufferedSink {
+ public:
+  // |sink| is unowned and must not be NULL.
+  explicit HashingSink(BufferedSink* sink)
+      : sink_(sink),
+        start_(NULL) {
+  }
+
+  virtual ~HashingSink() {
+    Flush();
+  }
+
+  // Flushes, and returns the hash of everything written since
+  // construction or |Reset|.
+  uint64 Digest() {
+    Flush();
+    return hash_.Digest();
+  }
+
+  void Reset() {
+    Flush();
+    hash_.Reset();
+  }
+
+ protected:
+  // Hashes and commits what was written, and reserves up to
+  // |kHashWindow| more of |sink_|, or |n| if that is more.
+  virtual void MakeRoom(size_t n) {
+    if (start_ != NULL) {
+      hash_.Update(start_, cursor_ - start_);
+      sink_->Commit(cursor_);
+    }
+    if (n == 0) {
+      start_ = cursor_ = limit_ = NULL;
+      return;
+    }
+    start_ = cursor_ = sink_->Reserve(n);
+    limit_ = cursor_ + std::min(sink_->room(), std::max(n, kHashWindow));
+  }
+
+ private:
+  BufferedSink* sink_;  // unowned.
+  char* start_;  // Of what has yet to be hashed.
+  Hash64 hash_;
+};
+
+// Whether the files at |path_a| and |path_b| hold the same bytes.
+bool SameContents(const char* path_a, const char* path_b) {
+  struct stat stat_a, stat_b;
+  if (0 != stat(path_a, &stat_a) || 0 != stat(path_b, &stat_b) ||
+      stat_a.st_size != stat_b.st_size) {
+    return false;
+  }
+  FILE* fp_a = fopen(path_a, "rb");
+  FILE* fp_b = fopen(path_b, "rb");
+  bool same = fp_a != NULL && fp_b != NULL;
+  char buf_a[4096], buf_b[4096];
+  while (same) {
+    const size_t length = fread(buf_a, 1, sizeof(buf_a), fp_a);
+    same = length == fread(buf_b, 1, sizeof(buf_b), fp_b) &&
+        0 == memcmp(buf_a, buf_b, length);
+    if (length < sizeof(buf_a)) break;
+  }
+  if (fp_a != NULL) fclose(fp_a);
+  if (fp_b != NULL) fclose(fp_b);
+  return same;
+}
+
+// Moves the finished file at |temp_path| to a name made from |hash|,
+// its contents' |Hash64|, and |suffix|: "<16 hex digits>.<suffix>".
+// The name appears all at once, complete. If a file already has that
+// name and the same contents, it is kept and |temp_path| removed; if
+// its contents differ, "-1", "-2", ... are tried after the digits
+// until one is free or the same. The name is returned in |name|.
+// Returns false, with errno set, if the file couldn't be moved.
+bool RenameToContentName(const std::string& temp_path, uint64 hash,
+                         const std::string& suffix, std::string* name) {
+  char hex[17];
+  ToHex(static_cast<uint32>(hash >> 32), hex);
+  ToHex(static_cast<uint32>(hash), hex + 8);
+  for (int collisions = 0; ; ++collisions) {
+    *name = hex;
+    if (collisions != 0) {
+      char buf[16];
+      snprintf(buf, sizeof(buf), "-%d", collisions);
+      *name += buf;
+    }
+    *name += "." + suffix;
+    // Unlike rename, link won't replace a file that is already there.
+    // Where there are no hard links, rename if nothing is.
+    if (0 == link(temp_path.c_str(), name->c_str())) {
+      return 0 == unlink(temp_path.c_str());
+    }
+    if (errno != EEXIST) {
+      struct stat unused;
+      if (0 == stat(name->c_str(), &unused)) {
+        errno = EEXIST;
+      } else if (errno == ENOENT) {
+        return 0 == rename(temp_path.c_str(), name->c_str());
+      } else {
+        return false;
+      }
+    }
+    if (SameContents(temp_path.c_str(), name->c_str())) {
+      return 0 == unlink(temp_path.c_str());
+    }
+    fprintf(stderr, "WARNING: %s has different contents with the same "
+            "hash\n", name->c_str());
+  }
+}
+
+}  // namespace webgl_loader
+
+#endif  // WEBGL_LOADER_HASH_SINK_H_
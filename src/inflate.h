@@ -0,0 +1,641 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_INFLATE_H_
+#define WEBGL_LOADER_INFLATE_H_
+
+// Streaming gzip and zlib (RFC 1950-1952) decompression, as a
+// |BufferedInput| over another one. third_party/nothings/stb_image.c
+// has an inflater, but it needs the whole compressed input in memory
+// and grows its output to fit all of it, so this one is written to
+// stop whenever its output buffer is full, and pull its input a
+// buffer at a time. The Huffman decoding follows stb_image: a 9-bit
+// table for short codes, and a canonical walk for the rest.
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "base.h"
+#include "stream.h"
+
+namespace webgl_loader {
+
+// How far back a deflate match can reach.
+const size_t kInflateWindowSize = 32 * 1024;
+
+// Whether |input| starts with the gzip magic number. Doesn't consume
+// anything.
+bool LooksGzipped(BufferedInput* input) {
+  while (input->cursor == input->end()) {
+    if (kNoError != input->Refill()) return false;
+  }
+  return input->end() - input->cursor >= 2 &&
+      static_cast<uint8>(input->cursor[0]) == 0x1F &&
+      static_cast<uint8>(input->cursor[1]) == 0x8B;
+}
+
+// A canonical Huffman code, as deflate describes them by the length
+// of each symbol's code.
+class HuffmanDecoder {
+ public:
+  static const int kMaxBits = 15;
+  static const int kFastBits = 9;
+
+  // Returns false if |lengths| is over-subscribed. Codes that are
+  // incomplete are allowed; deflate uses them for a single distance.
+  bool Init(const uint8* lengths, size_t num_symbols) {
+    memset(counts_, 0, sizeof(counts_));
+    memset(fast_, 0, sizeof(fast_));
+    for (size_t i = 0; i < num_symbols; ++i) {
+      ++counts_[lengths[i]];
+    }
+    counts_[0] = 0;
+    int left = 1;
+    uint16 offsets[kMaxBits + 1];
+    uint16 next_code[kMaxBits + 1];
+    offsets[1] = 0;
+    next_code[1] = 0;
+    for (int len = 1; len <= kMaxBits; ++len) {
+      left = 2 * left - counts_[len];
+      if (left < 0) return false;
+      if (len < kMaxBits) {
+        offsets[len + 1] = offsets[len] + counts_[len];
+        next_code[len + 1] = (next_code[len] + counts_[len]) << 1;
+      }
+    }
+    for (size_t i = 0; i < num_symbols; ++i) {
+      const int len = lengths[i];
+      if (len == 0) continue;
+      symbols_[offsets[len]++] = static_cast<uint16>(i);
+      if (len > kFastBits) {
+        ++next_code[len];
+        continue;
+      }
+      // Codes are sent from their high bit, and read from the low.
+      int reversed = 0;
+      for (int code = next_code[len]++, k = 0; k < len; ++k, code >>= 1) {
+        reversed = (reversed << 1) | (code & 1);
+      }
+      const uint16 entry = static_cast<uint16>((len << 9) | i);
+      for (int k = reversed; k < (1 << kFastBits); k += 1 << len) {
+        fast_[k] = entry;
+      }
+    }
+    return true;
+  }
+
+  // Decodes a symbol from the low bits of |bits|, and sets |*length|
+  // to the length of its code. Returns -1, with |*length| at least
+  // |num_bits| if it ran out, if there is no such code.
+  int Decode(uint32 bits, int num_bits, int* length) const {
+    const uint16 entry = fast_[bits & ((1 << kFastBits) - 1)];
+    if (entry != 0) {
+      *length = entry >> 9;
+      return entry & 0x1FF;
+    }
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len <= kMaxBits; ++len) {
+      code |= (bits >> (len - 1)) & 1;
+      const int count = counts_[len];
+      if (code - first < count) {
+        *length = len;
+        return symbols_[index + code - first];
+      }
+      index += count;
+      first = (first + count) << 1;
+      code <<= 1;
+    }
+    *length = num_bits;
+    return -1;
+  }
+
+ private:
+  uint16 fast_[1 << kFastBits];  // (length << 9) | symbol, or 0.
+  uint16 counts_[kMaxBits + 1];  // Of codes of each length.
+  uint16 symbols_[288];  // In code order.
+};
+
+// The CRC-32 of each byte, for |Crc32|.
+struct Crc32Table {
+  uint32 crcs[256];
+
+  Crc32Table() {
+    for (uint32 i = 0; i < 256; ++i) {
+      uint32 crc = i;
+      for (int k = 0; k < 8; ++k) {
+        crc = (crc & 1) ? 0xEDB88320u ^ (crc >> 1) : crc >> 1;
+      }
+      crcs[i] = crc;
+    }
+  }
+};
+
+// Continues the gzip CRC-32 |crc| over [|data|, |end|). Start at 0.
+uint32 Crc32(uint32 crc, const char* data, const char* end) {
+  // Built on first use, once, whichever thread gets here first.
+  static const Crc32Table kTable;
+  const uint32* table = kTable.crcs;
+  crc = ~crc;
+  for (; data != end; ++data) {
+    crc = table[(crc ^ static_cast<uint8>(*data)) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+// Continues the zlib Adler-32 |adler| over [|data|, |end|). Start
+// at 1.
+uint32 Adler32(uint32 adler, const char* data, const char* end) {
+  uint32 a = adler & 0xFFFF, b = adler >> 16;
+  while (data != end) {
+    // The most bytes before |b| could overflow.
+    const char* stop = data + std::min<size_t>(end - data, 5552);
+    for (; data != stop; ++data) {
+      a += static_cast<uint8>(*data);
+      b += a;
+    }
+    a %= 65521;
+    b %= 65521;
+  }
+  return (b << 16) | a;
+}
+
+// Inflates gzip or zlib data read from |source|, a buffer at a time.
+// Concatenated gzip members read as one. Memory is bounded by the
+// 32KB deflate window and the output buffer, whatever the input.
+// Input that isn't gzip or zlib, is corrupt, or fails its checksum
+// ends the stream with kCorruptInput; input that ends early does the
+// same, unless |source| failed with kFileError first.
+class InflatingInput : public BufferedInput {
+ public:
+  // |source| is unowned.
+  explicit InflatingInput(BufferedInput* source,
+                          size_t buffer_size = 256 * 1024)
+      : BufferedInput(RefillInflate),
+        source_(source),
+        source_error_(kNoError),
+        bits_(0),
+        num_bits_(0),
+        num_padding_bits_(0),
+        buffer_(kInflateWindowSize + buffer_size),
+        total_out_(0),
+        member_start_out_(0),
+        state_(STATE_HEADER),
+        gzip_(false),
+        first_member_(true),
+        final_block_(false),
+        stored_remaining_(0),
+        copy_length_(0),
+        copy_distance_(0),
+        checksum_(0),
+        checksum_start_(NULL) {
+    cursor = begin_ = end_ = &buffer_[kInflateWindowSize];
+  }
+
+  // Of the inflated data so far.
+  uint64 total_out() const {
+    return total_out_;
+  }
+
+ protected:
+  static ErrorCode RefillInflate(BufferedInput* bi) {
+    return static_cast<InflatingInput*>(bi)->DoRefillInflate();
+  }
+
+ private:
+  enum State {
+    STATE_HEADER,
+    STATE_BLOCK_HEADER,
+    STATE_STORED,
+    STATE_HUFFMAN,
+    STATE_TRAILER,
+    STATE_DONE
+  };
+
+  // Keeps the last window of output before |begin_| for matches to
+  // copy from, and inflates after it.
+  ErrorCode DoRefillInflate() {
+    char* const out_begin = &buffer_[kInflateWindowSize];
+    const size_t keep = std::min<uint64>(total_out_, kInflateWindowSize);
+    memmove(out_begin - keep, end_ - keep, keep);
+    char* out = out_begin;
+    char* const out_end = &buffer_[0] + buffer_.size();
+    checksum_start_ = out;
+    ErrorCode error = kNoError;
+    while (out != out_end && state_ != STATE_DONE && error == kNoError) {
+      error = Step(&out, out_end);
+    }
+    if (error == kNoError) Checksum(out);
+    begin_ = cursor = out_begin;
+    end_ = out;
+    if (error != kNoError) return fail(error);
+    if (state_ == STATE_DONE) {
+      if (out == out_begin) return fail(kEndOfFile);
+      refiller_ = RefillEndOfFile;
+    }
+    return kNoError;
+  }
+
+  // Makes progress from |state_|, writing at most up to |out_end|.
+  ErrorCode Step(char** out, char* out_end) {
+    switch (state_) {
+      case STATE_HEADER:
+        return ReadHeader();
+      case STATE_BLOCK_HEADER:
+        return ReadBlockHeader();
+      case STATE_STORED:
+        return CopyStored(out, out_end);
+      case STATE_HUFFMAN:
+        return InflateHuffman(out, out_end);
+      case STATE_TRAILER:
+        Checksum(*out);
+        return ReadTrailer();
+      default:
+        return kNoError;
+    }
+  }
+
+  // Tops up |bits_| to at least |n| bits, 24 at most. Past the end
+  // of |source_| it adds zeroes, which |Consume| catches if they are
+  // ever used.
+  void Fill(int n) {
+    while (num_bits_ < n) {
+      uint32 byte = 0;
+      if (NextSourceByte(&byte)) {
+        bits_ |= byte << num_bits_;
+      } else {
+        num_padding_bits_ += 8;
+      }
+      num_bits_ += 8;
+    }
+  }
+
+  bool NextSourceByte(uint32* byte) {
+    if (source_error_ != kNoError) return false;
+    while (source_->cursor == source_->end()) {
+      const ErrorCode error = source_->Refill();
+      if (error != kNoError) {
+        source_error_ = error;
+        return false;
+      }
+    }
+    *byte = static_cast<uint8>(*source_->cursor++);
+    return true;
+  }
+
+  bool Consume(int n) {
+    bits_ >>= n;
+    num_bits_ -= n;
+    return num_bits_ >= num_padding_bits_;
+  }
+
+  // Stores the next |n| bits, up to 16, in |*value|. Returns false if
+  // the input ended first.
+  bool GetBits(int n, uint32* value) {
+    Fill(n);
+    *value = bits_ & ((1u << n) - 1);
+    return Consume(n);
+  }
+
+  bool AlignToByte() {
+    return Consume(num_bits_ & 7);
+  }
+
+  // Returns the error for input that is cut short.
+  ErrorCode Truncated() const {
+    return source_error_ == kFileError ? kFileError : kCorruptInput;
+  }
+
+  // Whether there is any input left, for another gzip member.
+  bool MoreInput() {
+    if (num_bits_ > num_padding_bits_) return true;
+    uint32 byte;
+    if (!NextSourceByte(&byte)) return false;
+    --source_->cursor;
+    return true;
+  }
+
+  ErrorCode ReadHeader() {
+    uint32 b0, b1;
+    if (!GetBits(8, &b0) || !GetBits(8, &b1)) return Truncated();
+    if (b0 == 0x1F && b1 == 0x8B) {
+      gzip_ = true;
+      checksum_ = 0;
+      member_start_out_ = total_out_;
+      uint32 method, flags, ignored;
+      if (!GetBits(8, &method) || !GetBits(8, &flags)) return Truncated();
+      if (method != 8) return kCorruptInput;
+      // Modification time, extra flags and OS.
+      for (int i = 0; i < 6; ++i) {
+        if (!GetBits(8, &ignored)) return Truncated();
+      }
+      if (flags & 4) {  // FEXTRA
+        uint32 length;
+        if (!GetBits(16, &length)) return Truncated();
+        for (uint32 i = 0; i < length; ++i) {
+          if (!GetBits(8, &ignored)) return Truncated();
+        }
+      }
+      for (uint32 flag = 8; flag <= 16; flag <<= 1) {  // FNAME, FCOMMENT
+        if (!(flags & flag)) continue;
+        do {
+          if (!GetBits(8, &ignored)) return Truncated();
+        } while (ignored != 0);
+      }
+      if ((flags & 2) && !GetBits(16, &ignored)) {  // FHCRC
+        return Truncated();
+      }
+    } else if (first_member_ && (b0 & 0x0F) == 8 && (b0 >> 4) <= 7 &&
+               (b0 * 256 + b1) % 31 == 0 && !(b1 & 0x20)) {
+      gzip_ = false;
+      checksum_ = 1;
+    } else {
+      return kCorruptInput;
+    }
+    first_member_ = false;
+    state_ = STATE_BLOCK_HEADER;
+    return kNoError;
+  }
+
+  ErrorCode ReadBlockHeader() {
+    uint32 final_block, type;
+    if (!GetBits(1, &final_block) || !GetBits(2, &type)) return Truncated();
+    final_block_ = final_block != 0;
+    switch (type) {
+      case 0: {
+        uint32 length, inverse;
+        if (!AlignToByte() || !GetBits(16, &length) ||
+            !GetBits(16, &inverse)) {
+          return Truncated();
+        }
+        if (length != (inverse ^ 0xFFFF)) return kCorruptInput;
+        stored_remaining_ = length;
+        state_ = STATE_STORED;
+        return kNoError;
+      }
+      case 1:
+        InitFixedCodes();
+        state_ = STATE_HUFFMAN;
+        return kNoError;
+      case 2: {
+        const ErrorCode error = ReadDynamicCodes();
+        if (error == kNoError) state_ = STATE_HUFFMAN;
+        return error;
+      }
+      default:
+        return kCorruptInput;
+    }
+  }
+
+  void InitFixedCodes() {
+    uint8 lengths[288 + 30];
+    memset(lengths, 8, 144);
+    memset(lengths + 144, 9, 256 - 144);
+    memset(lengths + 256, 7, 280 - 256);
+    memset(lengths + 280, 8, 288 - 280);
+    memset(lengths + 288, 5, 30);
+    CHECK(literals_.Init(lengths, 288));
+    CHECK(distances_.Init(lengths + 288, 30));
+  }
+
+  ErrorCode ReadDynamicCodes() {
+    static const uint8 kCodeLengthOrder[19] = {
+      16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+    };
+    uint32 num_literals, num_distances, num_code_lengths;
+    if (!GetBits(5, &num_literals) || !GetBits(5, &num_distances) ||
+        !GetBits(4, &num_code_lengths)) {
+      return Truncated();
+    }
+    num_literals += 257;
+    num_distances += 1;
+    num_code_lengths += 4;
+    if (num_literals > 286 || num_distances > 30) return kCorruptInput;
+    uint8 code_lengths[19] = { 0 };
+    for (uint32 i = 0; i < num_code_lengths; ++i) {
+      uint32 length;
+      if (!GetBits(3, &length)) return Truncated();
+      code_lengths[kCodeLengthOrder[i]] = static_cast<uint8>(length);
+    }
+    HuffmanDecoder code_length_decoder;
+    if (!code_length_decoder.Init(code_lengths, 19)) return kCorruptInput;
+    uint8 lengths[286 + 30];
+    const uint32 num_lengths = num_literals + num_distances;
+    for (uint32 i = 0; i < num_lengths; ) {
+      int symbol;
+      const ErrorCode error = DecodeSymbol(code_length_decoder, &symbol);
+      if (error != kNoError) return error;
+      if (symbol < 16) {
+        lengths[i++] = static_cast<uint8>(symbol);
+        continue;
+      }
+      uint8 repeated = 0;
+      uint32 count;
+      bool ok;
+      if (symbol == 16) {
+        if (i == 0) return kCorruptInput;
+        repeated = lengths[i - 1];
+        ok = GetBits(2, &count);
+        count += 3;
+      } else if (symbol == 17) {
+        ok = GetBits(3, &count);
+        count += 3;
+      } else {
+        ok = GetBits(7, &count);
+        count += 11;
+      }
+      if (!ok) return Truncated();
+      if (i + count > num_lengths) return kCorruptInput;
+      memset(lengths + i, repeated, count);
+      i += count;
+    }
+    if (lengths[256] == 0) return kCorruptInput;
+    if (!literals_.Init(lengths, num_literals) ||
+        !distances_.Init(lengths + num_literals, num_distances)) {
+      return kCorruptInput;
+    }
+    return kNoError;
+  }
+
+  ErrorCode DecodeSymbol(const HuffmanDecoder& decoder, int* symbol) {
+    Fill(HuffmanDecoder::kMaxBits);
+    int length;
+    *symbol = decoder.Decode(bits_, num_bits_, &length);
+    if (!Consume(length)) return Truncated();
+    return *symbol < 0 ? kCorruptInput : kNoError;
+  }
+
+  ErrorCode CopyStored(char** out, char* out_end) {
+    while (stored_remaining_ != 0 && *out != out_end) {
+      if (num_bits_ != 0) {
+        uint32 byte;
+        if (!GetBits(8, &byte)) return Truncated();
+        *(*out)++ = static_cast<char>(byte);
+        ++total_out_;
+        --stored_remaining_;
+        continue;
+      }
+      uint32 byte;
+      if (!NextSourceByte(&byte)) return Truncated();
+      --source_->cursor;
+      const size_t length = std::min<size_t>(
+          std::min<size_t>(stored_remaining_, out_end - *out),
+          source_->end() - source_->cursor);
+      memcpy(*out, source_->cursor, length);
+      source_->cursor += length;
+      *out += length;
+      total_out_ += length;
+      stored_remaining_ -= length;
+    }
+    if (stored_remaining_ == 0) EndBlock();
+    return kNoError;
+  }
+
+  void EndBlock() {
+    state_ = final_block_ ? STATE_TRAILER : STATE_BLOCK_HEADER;
+  }
+
+  ErrorCode InflateHuffman(char** out_ptr, char* out_end) {
+    static const uint16 kLengthBase[29] = {
+      3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51,
+      59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+    };
+    static const uint8 kLengthExtra[29] = {
+      0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4,
+      4, 5, 5, 5, 5, 0
+    };
+    static const uint16 kDistanceBase[30] = {
+      1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385,
+      513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+    };
+    static const uint8 kDistanceExtra[30] = {
+      0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10,
+      10, 11, 11, 12, 12, 13, 13
+    };
+    char* out = *out_ptr;
+    ErrorCode error = kNoError;
+    while (out != out_end) {
+      if (copy_length_ != 0) {
+        // Byte by byte, since a match may overlap itself.
+        const char* from = out - copy_distance_;
+        const size_t length = std::min<size_t>(copy_length_, out_end - out);
+        for (size_t i = 0; i < length; ++i) {
+          out[i] = from[i];
+        }
+        out += length;
+        total_out_ += length;
+        copy_length_ -= length;
+        continue;
+      }
+      int symbol;
+      error = DecodeSymbol(literals_, &symbol);
+      if (error != kNoError) break;
+      if (symbol < 256) {
+        *out++ = static_cast<char>(symbol);
+        ++total_out_;
+        continue;
+      }
+      if (symbol == 256) {
+        EndBlock();
+        break;
+      }
+      symbol -= 257;
+      if (symbol >= 29) {
+        error = kCorruptInput;
+        break;
+      }
+      uint32 extra;
+      if (!GetBits(kLengthExtra[symbol], &extra)) {
+        error = Truncated();
+        break;
+      }
+      copy_length_ = kLengthBase[symbol] + extra;
+      error = DecodeSymbol(distances_, &symbol);
+      if (error != kNoError) break;
+      if (symbol >= 30) {
+        error = kCorruptInput;
+        break;
+      }
+      if (!GetBits(kDistanceExtra[symbol], &extra)) {
+        error = Truncated();
+        break;
+      }
+      copy_distance_ = kDistanceBase[symbol] + extra;
+      if (copy_distance_ > total_out_) {
+        error = kCorruptInput;
+        break;
+      }
+    }
+    *out_ptr = out;
+    return error;
+  }
+
+  // Folds the output since the last call into |checksum_|.
+  void Checksum(char* out) {
+    checksum_ = gzip_ ? Crc32(checksum_, checksum_start_, out) :
+        Adler32(checksum_, checksum_start_, out);
+    checksum_start_ = out;
+  }
+
+  ErrorCode ReadTrailer() {
+    if (!AlignToByte()) return Truncated();
+    uint32 bytes[8];
+    const int num_bytes = gzip_ ? 8 : 4;
+    for (int i = 0; i < num_bytes; ++i) {
+      if (!GetBits(8, &bytes[i])) return Truncated();
+    }
+    if (gzip_) {
+      const uint32 crc = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) |
+          (bytes[3] << 24);
+      const uint32 size = bytes[4] | (bytes[5] << 8) | (bytes[6] << 16) |
+          (bytes[7] << 24);
+      const uint32 member_size =
+          static_cast<uint32>(total_out_ - member_start_out_);
+      if (crc != checksum_ || size != member_size) {
+        return kCorruptInput;
+      }
+    } else {
+      const uint32 adler = (bytes[0] << 24) | (bytes[1] << 16) |
+          (bytes[2] << 8) | bytes[3];
+      if (adler != checksum_) return kCorruptInput;
+    }
+    state_ = (gzip_ && MoreInput()) ? STATE_HEADER : STATE_DONE;
+    return kNoError;
+  }
+
+  BufferedInput* source_;  // unowned.
+  ErrorCode source_error_;  // Once |source_| has ended.
+  uint32 bits_;  // Read from |source_|, and not yet used.
+  int num_bits_;
+  int num_padding_bits_;  // Of |bits_|, added past the end.
+  std::vector<char> buffer_;  // The window, then the output.
+  uint64 total_out_;
+  uint64 member_start_out_;  // |total_out_| when the gzip member began.
+  State state_;
+  bool gzip_;
+  bool first_member_;
+  bool final_block_;
+  HuffmanDecoder literals_;
+  HuffmanDecoder distances_;
+  size_t stored_remaining_;
+  size_t copy_length_;
+  size_t copy_distance_;
+  uint32 checksum_;
+  char* checksum_start_;
+};
+
+}  // namespace webgl_loader
+
+#endif  // WEBGL_LOADER_INFLATE_H_
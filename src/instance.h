@@ -0,0 +1,557 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_INSTANCE_H_
+#define WEBGL_LOADER_INSTANCE_H_
+
+#include <math.h>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "base.h"
+#include "bounds.h"
+#include "thread.h"
+
+namespace webgl_loader {
+
+// Finds groups that repeat the same geometry, so that a copy can be
+// drawn from the original instead of being sent again.
+//
+// Groups are compared after quantization, so "the same" means the
+// same to the decoder. Each group is put in a canonical form first:
+// its vertices are renumbered in order of first use, so where they
+// are in the batch doesn't matter, and its positions are quantized
+// relative to the minimum corner of its bounding box, so a copy that
+// is only translated still matches. Drawing a copy from the original
+// plus the difference of their minimums is then off by at most a
+// couple of quanta.
+
+// A group's geometry, in canonical form.
+struct CanonicalGroup {
+  // Interleaved as |QuantizedAttribList|, with positions relative
+  // to |min|.
+  QuantizedAttribList attribs;
+  // Into |attribs|.
+  IndexList indices;
+  // The vertex each of |attribs| came from.
+  std::vector<int> vertices;
+  // The minimum corner of the group's bounding box.
+  float min[3];
+  uint32 hash;
+
+  bool SameGeometry(const CanonicalGroup& that) const {
+    return hash == that.hash && attribs == that.attribs &&
+        indices == that.indices;
+  }
+};
+
+// Makes |group| from the triangles |indices|[0, |length|) into
+// |attribs|, quantized as |params|.
+void MakeCanonicalGroup(const AttribList& attribs, const BoundsParams& params,
+                        const int* indices, size_t length,
+                        CanonicalGroup* group) {
+  std::vector<int>& vertices = group->vertices;
+  std::map<int, int> renumbered;
+  vertices.clear();
+  group->indices.resize(length);
+  for (size_t i = 0; i < length; ++i) {
+    const std::pair<std::map<int, int>::iterator, bool> inserted =
+        renumbered.insert(std::make_pair(indices[i],
+                                         static_cast<int>(vertices.size())));
+    if (inserted.second) vertices.push_back(indices[i]);
+    group->indices[i] = inserted.first->second;
+  }
+  for (size_t j = 0; j < 3; ++j) {
+    group->min[j] = FLT_MAX;
+    for (size_t i = 0; i < vertices.size(); ++i) {
+      group->min[j] = std::min(group->min[j], attribs[8*vertices[i] + j]);
+    }
+  }
+  group->attribs.resize(8 * vertices.size());
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    const float* vertex = &attribs[8 * vertices[i]];
+    uint16* quantized = &group->attribs[8 * i];
+    for (size_t j = 0; j < 3; ++j) {
+      // Rounded, so that float error in a translated copy doesn't
+      // tip it into the next quantum.
+      quantized[j] = static_cast<uint16>(
+          floor(params.outputMaxes[j] * (vertex[j] - group->min[j]) /
+                params.scales[j] + 0.5f));
+    }
+    for (size_t j = 3; j < 8; ++j) {
+      quantized[j] = Quantize(vertex[j], params.mins[j], params.scales[j],
+                              params.outputMaxes[j]);
+    }
+  }
+  // The hash only needs to be good enough to make full comparisons
+  // rare.
+  group->hash = 0;
+  if (!group->attribs.empty()) {
+    group->hash = SimpleHash(reinterpret_cast<char*>(&group->attribs[0]),
+                             group->attribs.size() * sizeof(uint16));
+  }
+  if (length) {
+    group->hash = SimpleHash(reinterpret_cast<char*>(&group->indices[0]),
+                             length * sizeof(int), group->hash);
+  }
+}
+
+// Where a repeated group is drawn from. Its positions are the
+// source's p, as |scale| * |rotation|(p) + |offset|, and its normals
+// the source's, rotated.
+struct GroupInstance {
+  // The id of the group with the same geometry, or -1 if there is
+  // none.
+  int source;
+  // A unit quaternion, as (x, y, z, w).
+  float rotation[4];
+  float scale;
+  float offset[3];
+
+  bool IsTranslation() const {
+    return rotation[3] == 1.f && scale == 1.f;
+  }
+
+  void SetTranslation(const float* translation) {
+    rotation[0] = rotation[1] = rotation[2] = 0.f;
+    rotation[3] = 1.f;
+    scale = 1.f;
+    offset[0] = translation[0];
+    offset[1] = translation[1];
+    offset[2] = translation[2];
+  }
+};
+
+class DuplicateGroupFinder {
+ public:
+  DuplicateGroupFinder() { }
+
+  // Adds |group| as group |*id|. If an earlier group had the same
+  // geometry, fills in |instance| and returns true; |group| can then
+  // be drawn from that one.
+  bool Add(const CanonicalGroup& group, int* id, GroupInstance* instance) {
+    *id = static_cast<int>(mins_.size() / 3);
+    mins_.insert(mins_.end(), group.min, group.min + 3);
+    typedef std::multimap<uint32, int>::const_iterator Iterator;
+    const std::pair<Iterator, Iterator> range =
+        by_hash_.equal_range(group.hash);
+    for (Iterator iter = range.first; iter != range.second; ++iter) {
+      const int source = iter->second;
+      if (!group.SameGeometry(sources_[source])) continue;
+      instance->source = source_ids_[source];
+      float offset[3];
+      for (size_t j = 0; j < 3; ++j) {
+        offset[j] = group.min[j] - mins_[3*instance->source + j];
+      }
+      instance->SetTranslation(offset);
+      return true;
+    }
+    by_hash_.insert(std::make_pair(group.hash,
+                                   static_cast<int>(sources_.size())));
+    sources_.push_back(group);
+    source_ids_.push_back(*id);
+    return false;
+  }
+
+ private:
+  // Groups that are not copies, and their ids.
+  std::vector<CanonicalGroup> sources_;
+  std::vector<int> source_ids_;
+  // Into |sources_|.
+  std::multimap<uint32, int> by_hash_;
+  // Of every group, by id.
+  std::vector<float> mins_;
+};
+
+// Finds the eigenvalues and eigenvectors of the symmetric |N| x |N|
+// matrix |a| by Jacobi rotations, destroying |a|. Eigenvector k is
+// column k of |vectors|.
+template <int N>
+void SymmetricEigen(double a[N][N], double values[N], double vectors[N][N]) {
+  for (int i = 0; i < N; ++i) {
+    for (int j = 0; j < N; ++j) {
+      vectors[i][j] = (i == j) ? 1.0 : 0.0;
+    }
+  }
+  for (int sweep = 0; sweep < 50; ++sweep) {
+    double diagonal = 0.0, off_diagonal = 0.0;
+    for (int p = 0; p < N; ++p) {
+      diagonal += a[p][p] * a[p][p];
+      for (int q = p + 1; q < N; ++q) {
+        off_diagonal += a[p][q] * a[p][q];
+      }
+    }
+    if (off_diagonal <= 1e-24 * diagonal) break;
+    for (int p = 0; p < N; ++p) {
+      for (int q = p + 1; q < N; ++q) {
+        if (a[p][q] == 0.0) continue;
+        // The rotation of rows and columns p and q that zeroes a[p][q].
+        const double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+        const double t = (theta >= 0.0 ? 1.0 : -1.0) /
+            (fabs(theta) + sqrt(theta * theta + 1.0));
+        const double c = 1.0 / sqrt(t * t + 1.0);
+        const double s = t * c;
+        for (int k = 0; k < N; ++k) {
+          const double kp = a[k][p], kq = a[k][q];
+          a[k][p] = c * kp - s * kq;
+          a[k][q] = s * kp + c * kq;
+        }
+        for (int k = 0; k < N; ++k) {
+          const double pk = a[p][k], qk = a[q][k];
+          a[p][k] = c * pk - s * qk;
+          a[q][k] = s * pk + c * qk;
+        }
+        for (int k = 0; k < N; ++k) {
+          const double kp = vectors[k][p], kq = vectors[k][q];
+          vectors[k][p] = c * kp - s * kq;
+          vectors[k][q] = s * kp + c * kq;
+        }
+      }
+    }
+  }
+  for (int i = 0; i < N; ++i) {
+    values[i] = a[i][i];
+  }
+}
+
+// Rotates |v| by the unit quaternion |q| = (x, y, z, w).
+template <typename T>
+void RotateByQuaternion(const T* q, const T* v, T* out) {
+  // v + 2w (u x v) + 2 u x (u x v), for u = (x, y, z).
+  const T uv[3] = {
+    q[1] * v[2] - q[2] * v[1],
+    q[2] * v[0] - q[0] * v[2],
+    q[0] * v[1] - q[1] * v[0]
+  };
+  const T uuv[3] = {
+    q[1] * uv[2] - q[2] * uv[1],
+    q[2] * uv[0] - q[0] * uv[2],
+    q[0] * uv[1] - q[1] * uv[0]
+  };
+  for (size_t i = 0; i < 3; ++i) {
+    out[i] = v[i] + 2 * (q[3] * uv[i] + uuv[i]);
+  }
+}
+
+// Properties of a group that don't change when it is moved, turned
+// or scaled, for a quick test of whether two groups could be copies.
+struct GroupSignature {
+  static const size_t kNumEdgeBins = 16;
+
+  size_t num_verts;
+  size_t num_tris;
+  // Of the canonical indices.
+  uint32 connectivity;
+  // The variance of the vertices along each principal axis, as a
+  // fraction of the total, smallest first.
+  double spread[3];
+  // Of the edge lengths of each triangle, in bins of 1/8 of the RMS
+  // distance of the vertices from their centroid. The last bin takes
+  // anything longer.
+  size_t edge_histogram[kNumEdgeBins];
+
+  bool Similar(const GroupSignature& that) const {
+    if (num_verts != that.num_verts || num_tris != that.num_tris ||
+        connectivity != that.connectivity) {
+      return false;
+    }
+    for (size_t i = 0; i < 3; ++i) {
+      if (fabs(spread[i] - that.spread[i]) > 1e-2) return false;
+    }
+    // Float error can push an edge into the next bin over.
+    size_t differences = 0;
+    for (size_t i = 0; i < kNumEdgeBins; ++i) {
+      differences += (edge_histogram[i] > that.edge_histogram[i]) ?
+          edge_histogram[i] - that.edge_histogram[i] :
+          that.edge_histogram[i] - edge_histogram[i];
+    }
+    return differences <= 2 + 3 * num_tris / 50;
+  }
+};
+
+// Finds groups that are copies of others, moved, turned or uniformly
+// scaled. Groups are added in order, and then searched in three
+// steps:
+//   1. In parallel, each group is put in canonical form, and given a
+//      |GroupSignature| from the centroid, principal axes and edge
+//      lengths of its vertices.
+//   2. Translated copies are found exactly, by |DuplicateGroupFinder|.
+//   3. The remaining groups are clustered by vertex and triangle
+//      counts and connectivity, and the clusters are searched in
+//      parallel. Each group in a cluster is compared to the earlier
+//      ones that aren't copies, first by signature, and then by
+//      fitting a transform to their vertices and checking that it
+//      holds to within a quantum.
+// Vertices are matched in canonical order, so a copy has to list its
+// triangles the same way as its source does, as the copies a modeler
+// makes do. Mirrored copies are not found.
+class InstanceFinder {
+ public:
+  explicit InstanceFinder(const BoundsParams& params)
+      : params_(params) {
+  }
+
+  // Adds the triangles |indices|[0, |length|) into |attribs| as the
+  // next group. Both must outlive |Find|.
+  void AddGroup(const AttribList& attribs, const int* indices,
+                size_t length) {
+    groups_.resize(groups_.size() + 1);
+    Group& group = groups_.back();
+    group.attribs = &attribs;
+    group.indices = indices;
+    group.length = length;
+  }
+
+  size_t num_groups() const {
+    return groups_.size();
+  }
+
+  // Finds the copies among the groups, on up to |num_threads| threads.
+  void Find(int num_threads) {
+    ParallelFor(groups_.size(), &DescribeGroup, this, num_threads);
+    DuplicateGroupFinder duplicate_finder;
+    ClusterMap clusters;
+    for (size_t i = 0; i < groups_.size(); ++i) {
+      Group& group = groups_[i];
+      int id;
+      if (duplicate_finder.Add(group.canonical, &id, &group.instance) ||
+          group.radius == 0.0) {
+        continue;
+      }
+      const ClusterKey key(
+          std::make_pair(group.signature.num_verts, group.signature.num_tris),
+          group.signature.connectivity);
+      clusters[key].push_back(static_cast<int>(i));
+    }
+    clusters_.clear();
+    for (ClusterMap::iterator iter = clusters.begin();
+         iter != clusters.end(); ++iter) {
+      if (iter->second.size() > 1) clusters_.push_back(iter->second);
+    }
+    ParallelFor(clusters_.size(), &SearchCluster, this, num_threads);
+    // A translated copy of a group that turned out to be a copy itself
+    // is drawn from that one's source instead.
+    for (size_t i = 0; i < groups_.size(); ++i) {
+      GroupInstance& instance = groups_[i].instance;
+      if (instance.source < 0) continue;
+      const GroupInstance& source = groups_[instance.source].instance;
+      if (source.source < 0) continue;
+      float offset[3];
+      for (size_t j = 0; j < 3; ++j) {
+        offset[j] = source.offset[j] + instance.offset[j];
+      }
+      instance = source;
+      for (size_t j = 0; j < 3; ++j) {
+        instance.offset[j] = offset[j];
+      }
+    }
+  }
+
+  // After |Find|.
+  const GroupInstance& instance(int id) const {
+    return groups_[id].instance;
+  }
+
+  const CanonicalGroup& canonical(int id) const {
+    return groups_[id].canonical;
+  }
+
+ private:
+  struct Group {
+    const AttribList* attribs;
+    const int* indices;
+    size_t length;
+    CanonicalGroup canonical;
+    GroupSignature signature;
+    double centroid[3];
+    // The RMS distance of the vertices from |centroid|.
+    double radius;
+    GroupInstance instance;
+  };
+
+  typedef std::pair<std::pair<size_t, size_t>, uint32> ClusterKey;
+  typedef std::map<ClusterKey, std::vector<int> > ClusterMap;
+
+  static void DescribeGroup(void* self, size_t i) {
+    const InstanceFinder* finder = static_cast<InstanceFinder*>(self);
+    Group& group = static_cast<InstanceFinder*>(self)->groups_[i];
+    group.instance.source = -1;
+    MakeCanonicalGroup(*group.attribs, finder->params_, group.indices,
+                       group.length, &group.canonical);
+    const AttribList& attribs = *group.attribs;
+    const std::vector<int>& vertices = group.canonical.vertices;
+    GroupSignature& signature = group.signature;
+    signature.num_verts = vertices.size();
+    signature.num_tris = group.length / 3;
+    signature.connectivity = 0;
+    if (group.length) {
+      IndexList& indices = group.canonical.indices;
+      signature.connectivity = SimpleHash(
+          reinterpret_cast<char*>(&indices[0]), group.length * sizeof(int));
+    }
+    double covariance[3][3] = { { 0.0 } };
+    for (size_t j = 0; j < 3; ++j) {
+      group.centroid[j] = 0.0;
+      for (size_t k = 0; k < vertices.size(); ++k) {
+        group.centroid[j] += attribs[8*vertices[k] + j];
+      }
+      if (!vertices.empty()) group.centroid[j] /= vertices.size();
+    }
+    for (size_t k = 0; k < vertices.size(); ++k) {
+      const float* position = &attribs[8*vertices[k]];
+      for (size_t j = 0; j < 3; ++j) {
+        for (size_t l = 0; l < 3; ++l) {
+          covariance[j][l] += (position[j] - group.centroid[j]) *
+              (position[l] - group.centroid[l]);
+        }
+      }
+    }
+    const double total =
+        covariance[0][0] + covariance[1][1] + covariance[2][2];
+    group.radius = vertices.empty() ? 0.0 : sqrt(total / vertices.size());
+    double axes[3][3];
+    SymmetricEigen<3>(covariance, signature.spread, axes);
+    std::sort(signature.spread, signature.spread + 3);
+    for (size_t j = 0; j < 3; ++j) {
+      signature.spread[j] = total > 0.0 ? signature.spread[j] / total : 0.0;
+    }
+    std::fill(signature.edge_histogram,
+              signature.edge_histogram + GroupSignature::kNumEdgeBins, 0);
+    if (group.radius == 0.0) return;
+    for (size_t k = 0; k < group.length; ++k) {
+      const size_t next = (k % 3 == 2) ? k - 2 : k + 1;
+      const float* a = &attribs[8*group.indices[k]];
+      const float* b = &attribs[8*group.indices[next]];
+      double length = 0.0;
+      for (size_t j = 0; j < 3; ++j) {
+        length += (a[j] - b[j]) * (a[j] - b[j]);
+      }
+      const size_t bin = static_cast<size_t>(8.0 * sqrt(length) / group.radius);
+      ++signature.edge_histogram[
+          std::min(bin, GroupSignature::kNumEdgeBins - 1)];
+    }
+  }
+
+  static void SearchCluster(void* self, size_t i) {
+    InstanceFinder* finder = static_cast<InstanceFinder*>(self);
+    const std::vector<int>& cluster = finder->clusters_[i];
+    std::vector<int> sources;
+    for (size_t j = 0; j < cluster.size(); ++j) {
+      Group& group = finder->groups_[cluster[j]];
+      for (size_t k = 0; k < sources.size(); ++k) {
+        const Group& source = finder->groups_[sources[k]];
+        if (group.signature.Similar(source.signature) &&
+            group.canonical.indices == source.canonical.indices &&
+            finder->FitTransform(source, group, &group.instance)) {
+          group.instance.source = sources[k];
+          break;
+        }
+      }
+      if (group.instance.source < 0) sources.push_back(cluster[j]);
+    }
+  }
+
+  // Fits the transform that takes |from| to |to| into |instance|, and
+  // returns whether it holds for every vertex.
+  bool FitTransform(const Group& from, const Group& to,
+                    GroupInstance* instance) const {
+    const AttribList& from_attribs = *from.attribs;
+    const AttribList& to_attribs = *to.attribs;
+    const std::vector<int>& from_vertices = from.canonical.vertices;
+    const std::vector<int>& to_vertices = to.canonical.vertices;
+    // The rotation is Horn's: the eigenvector of the largest
+    // eigenvalue of a 4 x 4 matrix made from the cross-covariance of
+    // the two groups. The scale is the ratio of their radii.
+    double m[3][3] = { { 0.0 } };
+    for (size_t k = 0; k < from_vertices.size(); ++k) {
+      const float* p = &from_attribs[8*from_vertices[k]];
+      const float* q = &to_attribs[8*to_vertices[k]];
+      for (size_t j = 0; j < 3; ++j) {
+        for (size_t l = 0; l < 3; ++l) {
+          m[j][l] += (p[j] - from.centroid[j]) * (q[l] - to.centroid[l]);
+        }
+      }
+    }
+    double n[4][4] = {
+      { m[0][0] + m[1][1] + m[2][2], m[1][2] - m[2][1],
+        m[2][0] - m[0][2], m[0][1] - m[1][0] },
+      { m[1][2] - m[2][1], m[0][0] - m[1][1] - m[2][2],
+        m[0][1] + m[1][0], m[2][0] + m[0][2] },
+      { m[2][0] - m[0][2], m[0][1] + m[1][0],
+        -m[0][0] + m[1][1] - m[2][2], m[1][2] + m[2][1] },
+      { m[0][1] - m[1][0], m[2][0] + m[0][2],
+        m[1][2] + m[2][1], -m[0][0] - m[1][1] + m[2][2] }
+    };
+    double values[4], vectors[4][4];
+    SymmetricEigen<4>(n, values, vectors);
+    const int largest = static_cast<int>(
+        std::max_element(values, values + 4) - values);
+    // Horn's quaternion is (w, x, y, z).
+    const double rotation[4] = {
+      vectors[1][largest], vectors[2][largest], vectors[3][largest],
+      vectors[0][largest]
+    };
+    const double scale = to.radius / from.radius;
+    double offset[3];
+    RotateByQuaternion(rotation, from.centroid, offset);
+    for (size_t j = 0; j < 3; ++j) {
+      offset[j] = to.centroid[j] - scale * offset[j];
+    }
+    const double position_tolerance =
+        params_.scales[0] / params_.outputMaxes[0];
+    const double normal_tolerance =
+        2.0 * params_.scales[5] / params_.outputMaxes[5];
+    for (size_t k = 0; k < from_vertices.size(); ++k) {
+      const float* p = &from_attribs[8*from_vertices[k]];
+      const float* q = &to_attribs[8*to_vertices[k]];
+      const double position[3] = { p[0], p[1], p[2] };
+      const double normal[3] = { p[5], p[6], p[7] };
+      double moved[3], turned[3];
+      RotateByQuaternion(rotation, position, moved);
+      RotateByQuaternion(rotation, normal, turned);
+      for (size_t j = 0; j < 3; ++j) {
+        if (fabs(scale * moved[j] + offset[j] - q[j]) > position_tolerance ||
+            fabs(turned[j] - q[5 + j]) > normal_tolerance) {
+          return false;
+        }
+      }
+      // Texcoords are quantized the same everywhere.
+      const uint16* from_quantized = &from.canonical.attribs[8*k];
+      const uint16* to_quantized = &to.canonical.attribs[8*k];
+      if (from_quantized[3] != to_quantized[3] ||
+          from_quantized[4] != to_quantized[4]) {
+        return false;
+      }
+    }
+    for (size_t j = 0; j < 4; ++j) {
+      instance->rotation[j] = static_cast<float>(rotation[j]);
+    }
+    instance->scale = static_cast<float>(scale);
+    for (size_t j = 0; j < 3; ++j) {
+      instance->offset[j] = static_cast<float>(offset[j]);
+    }
+    return true;
+  }
+
+  const BoundsParams params_;
+  std::vector<Group> groups_;
+  // Of group ids, for |SearchCluster|.
+  std::vector<std::vector<int> > clusters_;
+};
+
+}  // namespace webgl_loader
+
+#endif  // WEBGL_LOADER_INSTANCE_H_
@@ -16,7 +16,9 @@
 #define WEBGL_LOADER_JSON_H_
 
 #include <float.h>
+#include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <vector>
@@ -26,24 +28,167 @@
 
 namespace webgl_loader {
 
+// Pairs of decimal digits, "00" to "99", so that integers can be
+// formatted two digits per division.
+const char kDecimalPairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233"
+    "34353637383940414243444546474849505152535455565758596061626364656667"
+    "6869707172737475767778798081828384858687888990919293949596979899";
+
+// Writes |value| in decimal to |out|, which must have room for 20
+// digits, and returns just past the last.
+inline char* FormatUint(uint64 value, char* out) {
+  char digits[20];
+  char* first = digits + sizeof(digits);
+  while (value >= 100) {
+    const char* pair = kDecimalPairs + 2 * (value % 100);
+    value /= 100;
+    *--first = pair[1];
+    *--first = pair[0];
+  }
+  if (value >= 10) {
+    *--first = kDecimalPairs[2 * value + 1];
+    *--first = kDecimalPairs[2 * value];
+  } else {
+    *--first = static_cast<char>('0' + value);
+  }
+  const size_t length = digits + sizeof(digits) - first;
+  memcpy(out, first, length);
+  return out + length;
+}
+
+// As |FormatUint|, with room for a sign.
+inline char* FormatInt(long long value, char* out) {
+  if (value >= 0) return FormatUint(value, out);
+  *out++ = '-';
+  // Negated unsigned, so that the most negative value works.
+  return FormatUint(0 - static_cast<uint64>(value), out);
+}
+
+// |x| * 10^|exponent|. Exact for small integers and exponents, and
+// otherwise within a few ulps.
+inline double ScaleByPow10(double x, int exponent) {
+  static const double kPow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+  for (; exponent > 22; exponent -= 22) x *= 1e22;
+  for (; exponent < -22; exponent += 22) x /= 1e22;
+  return exponent >= 0 ? x * kPow10[exponent] : x / kPow10[-exponent];
+}
+
+// Writes the fewest significant digits that read back as |f|, and
+// returns just past the last; |out| needs room for 24 bytes. Numbers
+// are laid out as JavaScript's toString would: fixed point from 1e-6
+// to 1e21, and otherwise like "1.5e-7". JSON has no NaN or infinity,
+// so they are written as null.
+inline char* FormatFloat(float f, char* out) {
+  if (f != f || f > FLT_MAX || f < -FLT_MAX) {
+    memcpy(out, "null", 4);
+    return out + 4;
+  }
+  char* const start = out;
+  if (f < 0 || (f == 0 && 1 / f < 0)) {
+    *out++ = '-';
+  }
+  const double value = fabs(f);
+  if (value == 0) {
+    *out++ = '0';
+    return out;
+  }
+  // Find the shortest |digits| * 10^(|exponent| - |num_digits| + 1)
+  // that rounds to |f|. Floats never need more than 9 digits.
+  int exponent = static_cast<int>(floor(log10(value)));
+  if (ScaleByPow10(1.0, exponent) > value) --exponent;
+  if (ScaleByPow10(1.0, exponent + 1) <= value) ++exponent;
+  uint64 digits = 0;
+  int num_digits = 1;
+  for (; num_digits <= 9; ++num_digits) {
+    const int shift = num_digits - 1 - exponent;
+    digits = static_cast<uint64>(ScaleByPow10(value, shift) + 0.5);
+    if (static_cast<float>(ScaleByPow10(digits, -shift)) == fabsf(f)) break;
+  }
+  if (num_digits > 9) num_digits = 9;
+  // Rounding up may have carried into another digit, as 9.96 to 10.
+  char buf[24];
+  char* const digits_end = FormatUint(digits, buf);
+  if (digits_end - buf > num_digits) ++exponent;
+  num_digits = digits_end - buf;
+  while (num_digits > 1 && buf[num_digits - 1] == '0') --num_digits;
+  if (exponent < -6 || exponent >= 21) {
+    *out++ = buf[0];
+    if (num_digits > 1) {
+      *out++ = '.';
+      memcpy(out, buf + 1, num_digits - 1);
+      out += num_digits - 1;
+    }
+    *out++ = 'e';
+    *out++ = exponent < 0 ? '-' : '+';
+    out = FormatInt(exponent < 0 ? -exponent : exponent, out);
+  } else if (exponent < 0) {
+    *out++ = '0';
+    *out++ = '.';
+    for (int i = -1; i > exponent; --i) *out++ = '0';
+    memcpy(out, buf, num_digits);
+    out += num_digits;
+  } else if (exponent + 1 >= num_digits) {
+    memcpy(out, buf, num_digits);
+    out += num_digits;
+    for (int i = num_digits; i <= exponent; ++i) *out++ = '0';
+  } else {
+    memcpy(out, buf, exponent + 1);
+    out += exponent + 1;
+    *out++ = '.';
+    memcpy(out, buf + exponent + 1, num_digits - exponent - 1);
+    out += num_digits - exponent - 1;
+  }
+  // The search above works in doubles, which can be off by an ulp, so
+  // check that it reads back, and fall back to all 9 digits if not.
+  *out = '\0';
+  if (strtof(start, NULL) != f) {
+    out = start + snprintf(start, 24, "%.9g", f);
+  }
+  return out;
+}
+
 // JsonSink will generate JSON in the ByteSink passed in, but does
 // not actually own the backing data. Performs rudimentary grammar
 // checking. It will automatically add delimiting punctuation and
 // prevent non-String object keys.
-//
-// TODO: Pretty printing.
 class JsonSink {
  public:
-  // |sink| is unowned and should not be NULL.
+  // |sink| is unowned and should not be NULL. Output is buffered, and
+  // reaches |sink| as each top-level value is finished.
   explicit JsonSink(ByteSinkInterface* sink)
-    : sink_(sink) {
+    : owned_sink_(new BufferedByteSink(sink)),
+      sink_(owned_sink_),
+      pretty_depth_(0) {
     state_.reserve(8);
     PushState(JSON_STATE_SIMPLE);
   }
 
+  // |sink| is unowned and should not be NULL. It is up to the caller
+  // to flush it.
+  explicit JsonSink(BufferedSink* sink)
+    : owned_sink_(NULL),
+      sink_(sink),
+      pretty_depth_(0) {
+    state_.reserve(8);
+    PushState(JSON_STATE_SIMPLE);
+  }
+
+  // Puts each element of arrays and objects nested |depth| deep or
+  // less on its own line, indented two spaces a level. Deeper ones,
+  // and the bulk arrays, stay on one line. The default, 0, is all on
+  // one line.
+  void set_pretty_depth(size_t depth) {
+    pretty_depth_ = depth;
+  }
+
   // Automatically close values when JsonSink goes out of scope.
   ~JsonSink() {
     EndAll();
+    delete owned_sink_;
   }
 
   // Methods to put scalar values into the JSON object. Aside from
@@ -52,30 +197,69 @@ class JsonSink {
   void PutNull() {
     OnPutValue();
     PutN("null", 4);
+    OnValueDone();
   }
 
   void PutBool(bool b) {
     OnPutValue();
     PutN(b ? "true" : "false", b ? 4 : 5);
+    OnValueDone();
   }
 
   void PutInt(int i) {
     OnPutValue();
-    char buf[kBufSize];
-    int len = sprintf(buf, "%d", i);
-    CHECK(len > 0 && len < kBufSize);
-    PutN(buf, len);
+    sink_->Commit(FormatInt(i, sink_->Reserve(kBufSize)));
+    OnValueDone();
+  }
+
+  void PutUint(size_t n) {
+    OnPutValue();
+    sink_->Commit(FormatUint(n, sink_->Reserve(kBufSize)));
+    OnValueDone();
   }
 
+  // The shortest decimal that reads back as |f|; see |FormatFloat|.
   void PutFloat(float f) {
     OnPutValue();
-    char buf[kBufSize];
-    int len = sprintf(buf, "%g", f);
-    CHECK(len > 0 && len < kBufSize);
-    PutN(buf, len);
+    sink_->Commit(FormatFloat(f, sink_->Reserve(kBufSize)));
+    OnValueDone();
+  }
+
+  // Whole arrays of numbers, without going through the state machine
+  // for each.
+  void PutIntArray(const int* values, size_t n) {
+    BeginBulkArray();
+    for (size_t i = 0; i < n; ++i) {
+      char* buf = sink_->Reserve(kBufSize);
+      *buf = ',';
+      sink_->Commit(FormatInt(values[i], buf + (i != 0)));
+    }
+    EndBulkArray();
+  }
+
+  void PutUintArray(const size_t* values, size_t n) {
+    BeginBulkArray();
+    for (size_t i = 0; i < n; ++i) {
+      char* buf = sink_->Reserve(kBufSize);
+      *buf = ',';
+      sink_->Commit(FormatUint(values[i], buf + (i != 0)));
+    }
+    EndBulkArray();
+  }
+
+  void PutFloatArray(const float* values, size_t n) {
+    BeginBulkArray();
+    for (size_t i = 0; i < n; ++i) {
+      char* buf = sink_->Reserve(kBufSize);
+      *buf = ',';
+      sink_->Commit(FormatFloat(values[i], buf + (i != 0)));
+    }
+    EndBulkArray();
   }
 
-  // |str| should not be NULL.
+  // |str| should not be NULL, and is UTF-8. Quotes, backslashes and
+  // control characters are escaped, and so are U+2028 and U+2029, so
+  // that the output is also a valid JavaScript literal.
   void PutString(const char* str) {
     // Strings are the only legal value for object keys.
     switch (GetState()) {
@@ -83,15 +267,34 @@ class JsonSink {
       Put(',');  // fall through.
     case JSON_STATE_OBJECT_KEY_FIRST:
       SetState(JSON_STATE_OBJECT_VALUE);
+      NewLine(state_.size() - 1);
       break;
     default:
       UpdateState();
     }
 
-    // TODO: escaping.
     Put('\"');
-    PutN(str, strlen(str));
+    const char* run = str;
+    const char* p = str;
+    for (; *p; ++p) {
+      const uint8 c = static_cast<uint8>(*p);
+      if (c >= 0x20 && c != '\"' && c != '\\' && c != 0xE2) continue;
+      if (c == 0xE2) {
+        // U+2028 and U+2029 are E2 80 A8 and E2 80 A9.
+        if (p[1] != '\x80' || (p[2] != '\xA8' && p[2] != '\xA9')) continue;
+        PutN(run, p - run);
+        PutN(p[2] == '\xA8' ? "\\u2028" : "\\u2029", 6);
+        p += 2;
+        run = p + 1;
+        continue;
+      }
+      PutN(run, p - run);
+      run = p + 1;
+      PutEscaped(c);
+    }
+    PutN(run, p - run);
     Put('\"');
+    OnValueDone();
   }
 
   // Arrays and Objects are recursive JSON values.
@@ -115,17 +318,20 @@ class JsonSink {
       // We haven't provided a value, so emit a null..
       PutNull();  // ...and fall through to the normal case.
     case JSON_STATE_OBJECT_KEY:
+      NewLine(state_.size() - 2);  // fall through.
     case JSON_STATE_OBJECT_KEY_FIRST:
       Put('}');
       break;
-    case JSON_STATE_ARRAY_FIRST:
     case JSON_STATE_ARRAY:
+      NewLine(state_.size() - 2);  // fall through.
+    case JSON_STATE_ARRAY_FIRST:
       Put(']');
       break;
     default: 
       return;  // Do nothing.
     }
     PopState();
+    OnValueDone();
   }
   
   // Close all values. Convenient way to end up with a valid JSON
@@ -135,9 +341,8 @@ class JsonSink {
   }
   
  private:
-  // Conservative estimate of how many bytes to allocate on the stack
-  // as scratch space for int/float to NUL-terminated string.
-  static const int kBufSize = 32;
+  // Room to reserve for a number, and a comma before it.
+  static const size_t kBufSize = 32;
   
   // JsonSink needs to internally maintain some structural state in
   // order to correctly delimit values with the appropriate
@@ -179,9 +384,11 @@ class JsonSink {
       return;
     case JSON_STATE_ARRAY_FIRST:
       SetState(JSON_STATE_ARRAY);
+      NewLine(state_.size() - 1);
       return;
     case JSON_STATE_ARRAY:
       Put(',');
+      NewLine(state_.size() - 1);
       return;
     default:
       return;
@@ -200,6 +407,55 @@ class JsonSink {
     UpdateState();
   }
 
+  // A quote, backslash or control character, escaped.
+  void PutEscaped(uint8 c) {
+    static const char kHexDigits[] = "0123456789abcdef";
+    char escape[6] = { '\\', 'u', '0', '0', '\0', '\0' };
+    switch (c) {
+    case '\"':
+    case '\\': escape[1] = c; break;
+    case '\b': escape[1] = 'b'; break;
+    case '\f': escape[1] = 'f'; break;
+    case '\n': escape[1] = 'n'; break;
+    case '\r': escape[1] = 'r'; break;
+    case '\t': escape[1] = 't'; break;
+    default:
+      escape[4] = kHexDigits[c >> 4];
+      escape[5] = kHexDigits[c & 0xF];
+      PutN(escape, 6);
+      return;
+    }
+    PutN(escape, 2);
+  }
+
+  // For pretty printing: starts a line indented to |depth|, if the
+  // innermost array or object is shallow enough.
+  void NewLine(size_t depth) {
+    if (state_.size() - 1 > pretty_depth_) return;
+    char* buf = sink_->Reserve(1 + 2 * depth);
+    *buf = '\n';
+    memset(buf + 1, ' ', 2 * depth);
+    sink_->Commit(buf + 1 + 2 * depth);
+  }
+
+  void BeginBulkArray() {
+    OnPutValue();
+    Put('[');
+  }
+
+  void EndBulkArray() {
+    Put(']');
+    OnValueDone();
+  }
+
+  // Passes a finished top-level value on to the sink we were given,
+  // if we are buffering for it.
+  void OnValueDone() {
+    if (owned_sink_ != NULL && GetState() == JSON_STATE_SIMPLE) {
+      owned_sink_->Flush();
+    }
+  }
+
   // Convenience forwarding methods for sink_.
   void Put(char c) {
     sink_->Put(c);
@@ -209,8 +465,14 @@ class JsonSink {
     sink_->PutN(str, len);
   }
   
-  ByteSinkInterface* sink_;
+  BufferedByteSink* owned_sink_;
+  BufferedSink* sink_;
   std::vector<State> state_;
+  size_t pretty_depth_;
+
+  // Disallow copy and assignment.
+  JsonSink(const JsonSink&);
+  void operator=(const JsonSink&);
 };
 
 }  // namespace webgl_loader
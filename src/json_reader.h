@@ -0,0 +1,467 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_JSON_READER_H_
+#define WEBGL_LOADER_JSON_READER_H_
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "base.h"
+#include "stream.h"
+
+namespace webgl_loader {
+
+// What |JsonReader::Next| found.
+enum JsonToken {
+  JSON_NULL,
+  JSON_BOOL,
+  JSON_NUMBER,
+  JSON_STRING,
+  JSON_KEY,  // An object key, with its colon.
+  JSON_BEGIN_ARRAY,
+  JSON_END_ARRAY,
+  JSON_BEGIN_OBJECT,
+  JSON_END_OBJECT,
+  JSON_END,  // The top-level value is done.
+  JSON_ERROR
+};
+
+// Pulls one JSON value from a |BufferedInput| a token at a time, the
+// reading counterpart of |JsonSink|. Nothing is allocated after
+// construction: strings without escapes are handed out where they
+// lie in the input's buffer, and others are unescaped into a scratch
+// buffer of fixed size. |Skip| and |SkipRest| pass over arrays and
+// objects without tokenizing them, so that a large manifest can be searched
+// for the parts that matter.
+//
+//   JsonReader reader(&input);
+//   CHECK(JSON_BEGIN_OBJECT == reader.Next());
+//   while (JSON_KEY == reader.Next()) {
+//     if (reader.Equals("urls")) { ... } else reader.Skip();
+//   }
+//
+// Reading stops at the end of the top-level value, so one may be
+// read from the middle of a larger stream.
+class JsonReader {
+ public:
+  // Nesting deeper than this is an error.
+  static const size_t kMaxDepth = 64;
+
+  // |input| is unowned and must not be NULL. Numbers, and strings
+  // that have escapes or are split between buffers, may be at most
+  // |max_token| bytes, after unescaping.
+  explicit JsonReader(BufferedInput* input, size_t max_token = 4096)
+      : input_(input),
+        scratch_(max_token + 1),
+        state_(EXPECT_VALUE),
+        depth_(0),
+        token_(JSON_END),
+        error_(kNoError),
+        text_(NULL),
+        length_(0),
+        number_(0.0) {
+  }
+
+  // Reads the next token. After |JSON_END| or |JSON_ERROR|, returns
+  // the same again.
+  JsonToken Next() {
+    if (state_ == DONE) return token_ = JSON_END;
+    if (state_ == FAILED) return token_ = JSON_ERROR;
+    int c = SkipSpace();
+    if (state_ == EXPECT_FIRST || state_ == EXPECT_NEXT) {
+      const char close = containers_[depth_ - 1];
+      if (c == close) {
+        ++input_->cursor;
+        --depth_;
+        AfterValue();
+        return token_ = close == '}' ? JSON_END_OBJECT : JSON_END_ARRAY;
+      }
+      if (state_ == EXPECT_NEXT) {
+        if (c != ',') return Fail();
+        ++input_->cursor;
+        c = SkipSpace();
+      }
+      if (close == '}') return ReadKey(c);
+    }
+    return ReadValue(c);
+  }
+
+  // Passes over the rest of the current value: after
+  // |JSON_BEGIN_ARRAY| or |JSON_BEGIN_OBJECT|, up to and including its
+  // end, which becomes the current token; after |JSON_KEY|, the whole
+  // value that goes with it. Does nothing after anything else. Only
+  // strings and brackets are looked at on the way, so what is skipped
+  // isn't checked. Returns false on error.
+  bool Skip() {
+    if (token_ == JSON_KEY) {
+      Next();
+    }
+    if (token_ != JSON_BEGIN_ARRAY && token_ != JSON_BEGIN_OBJECT) {
+      return token_ != JSON_ERROR;
+    }
+    return SkipToEnd();
+  }
+
+  // As |Skip|, but passes over the rest of the array or object the
+  // reader is inside, for when what was wanted from it has been found.
+  bool SkipRest() {
+    if (depth_ == 0) return token_ != JSON_ERROR;
+    return SkipToEnd();
+  }
+
+  JsonToken token() const {
+    return token_;
+  }
+
+  // How many arrays and objects the reader is inside.
+  size_t depth() const {
+    return depth_;
+  }
+
+  // |kNoError| unless |Next| returned |JSON_ERROR|; then the input's
+  // error, or |kCorruptInput| if the JSON was malformed or cut short.
+  ErrorCode error() const {
+    return error_;
+  }
+
+  // The contents of a |JSON_STRING| or |JSON_KEY|, unescaped, or the
+  // text of a |JSON_NUMBER|. Not NUL-terminated, and good only until
+  // the next call to |Next| or |Skip|.
+  const char* text() const {
+    return text_;
+  }
+
+  size_t length() const {
+    return length_;
+  }
+
+  // Whether |text| is |str|.
+  bool Equals(const char* str) const {
+    return length_ == strlen(str) && 0 == memcmp(text_, str, length_);
+  }
+
+  // The value of a |JSON_NUMBER|, or of a |JSON_BOOL| as 0 or 1.
+  double number() const {
+    return number_;
+  }
+
+  bool boolean() const {
+    return number_ != 0.0;
+  }
+
+ private:
+  // What |Next| is to read.
+  enum State {
+    EXPECT_VALUE,
+    EXPECT_FIRST,  // The first element or key, or the end.
+    EXPECT_NEXT,  // A comma, or the end.
+    DONE,
+    FAILED
+  };
+
+  // Whether there is anything left to read at the cursor.
+  bool Fill() {
+    return input_->cursor != input_->end() || kNoError == input_->Refill();
+  }
+
+  // The next character that isn't whitespace, left at the cursor, or
+  // -1 at the end of the input.
+  int SkipSpace() {
+    while (Fill()) {
+      const char* p = input_->cursor;
+      const char* const end = input_->end();
+      while (p != end && (*p == ' ' || *p == '\n' || *p == '\r' ||
+                          *p == '\t')) {
+        ++p;
+      }
+      input_->cursor = p;
+      if (p != end) return static_cast<uint8>(*p);
+    }
+    return -1;
+  }
+
+  // The next character, consumed, or -1 at the end of the input.
+  int GetChar() {
+    if (!Fill()) return -1;
+    return static_cast<uint8>(*input_->cursor++);
+  }
+
+  JsonToken Fail() {
+    state_ = FAILED;
+    const ErrorCode input_error = input_->error();
+    error_ = input_error == kNoError || input_error == kEndOfFile ?
+        kCorruptInput : input_error;
+    return token_ = JSON_ERROR;
+  }
+
+  void AfterValue() {
+    state_ = depth_ == 0 ? DONE : EXPECT_NEXT;
+  }
+
+  // Scans for the end of the innermost array or object.
+  bool SkipToEnd() {
+    if (state_ == FAILED) return false;
+    size_t nesting = 1;
+    bool in_string = false;
+    bool escaped = false;
+    while (Fill()) {
+      const char* p = input_->cursor;
+      const char* const end = input_->end();
+      for (; p != end; ++p) {
+        const char c = *p;
+        if (in_string) {
+          if (escaped) {
+            escaped = false;
+          } else if (c == '\\') {
+            escaped = true;
+          } else if (c == '"') {
+            in_string = false;
+          }
+        } else if (c == '"') {
+          in_string = true;
+        } else if (c == '[' || c == '{') {
+          ++nesting;
+        } else if ((c == ']' || c == '}') && 0 == --nesting) {
+          input_->cursor = p + 1;
+          token_ = containers_[--depth_] == '}' ?
+              JSON_END_OBJECT : JSON_END_ARRAY;
+          AfterValue();
+          return true;
+        }
+      }
+      input_->cursor = end;
+    }
+    Fail();
+    return false;
+  }
+
+  JsonToken ReadValue(int c) {
+    switch (c) {
+      case '[':
+      case '{':
+        if (depth_ == kMaxDepth) return Fail();
+        ++input_->cursor;
+        containers_[depth_++] = c == '[' ? ']' : '}';
+        state_ = EXPECT_FIRST;
+        return token_ = c == '[' ? JSON_BEGIN_ARRAY : JSON_BEGIN_OBJECT;
+      case '"':
+        if (!ReadString()) return Fail();
+        token_ = JSON_STRING;
+        break;
+      case 't':
+        if (!ReadLiteral("true", 4)) return Fail();
+        number_ = 1.0;
+        token_ = JSON_BOOL;
+        break;
+      case 'f':
+        if (!ReadLiteral("false", 5)) return Fail();
+        number_ = 0.0;
+        token_ = JSON_BOOL;
+        break;
+      case 'n':
+        if (!ReadLiteral("null", 4)) return Fail();
+        token_ = JSON_NULL;
+        break;
+      default:
+        if (c != '-' && (c < '0' || c > '9')) return Fail();
+        if (!ReadNumber()) return Fail();
+        token_ = JSON_NUMBER;
+        break;
+    }
+    AfterValue();
+    return token_;
+  }
+
+  JsonToken ReadKey(int c) {
+    if (c != '"' || !ReadString() || SkipSpace() != ':') return Fail();
+    ++input_->cursor;
+    state_ = EXPECT_VALUE;
+    return token_ = JSON_KEY;
+  }
+
+  bool ReadLiteral(const char* literal, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+      if (GetChar() != literal[i]) return false;
+    }
+    return true;
+  }
+
+  // Integers of up to 15 digits, which is most of what manifests
+  // hold, are added up as they are read; anything else goes through
+  // strtod.
+  bool ReadNumber() {
+    size_t length = 0;
+    bool integral = true;
+    double value = 0.0;
+    while (Fill()) {
+      const char c = *input_->cursor;
+      if (c >= '0' && c <= '9') {
+        value = 10.0 * value + (c - '0');
+      } else if (c == '.' || c == 'e' || c == 'E' || c == '+' ||
+                 (c == '-' && length != 0)) {
+        integral = false;
+      } else if (c != '-') {
+        break;
+      }
+      if (length + 1 == scratch_.size()) return false;
+      scratch_[length++] = c;
+      ++input_->cursor;
+    }
+    const bool negative = scratch_[0] == '-';
+    const size_t num_digits = length - negative;
+    if (num_digits == 0) return false;
+    text_ = &scratch_[0];
+    length_ = length;
+    if (integral && num_digits <= 15) {
+      number_ = negative ? -value : value;
+      return true;
+    }
+    scratch_[length] = '\0';
+    char* end;
+    number_ = strtod(text_, &end);
+    return end == text_ + length;
+  }
+
+  // Reads the string at the cursor, quotes and all. Where it has no
+  // escapes and lies within the input's buffer, it is left there.
+  bool ReadString() {
+    ++input_->cursor;
+    if (!Fill()) return false;
+    const char* const start = input_->cursor;
+    const char* p = start;
+    const char* const end = input_->end();
+    while (p != end && *p != '"' && *p != '\\' &&
+           static_cast<uint8>(*p) >= 0x20) {
+      ++p;
+    }
+    if (p != end && *p == '"') {
+      text_ = start;
+      length_ = p - start;
+      input_->cursor = p + 1;
+      return true;
+    }
+    // Otherwise, unescape into |scratch_|.
+    size_t length = p - start;
+    if (length >= scratch_.size()) return false;
+    memcpy(&scratch_[0], start, length);
+    input_->cursor = p;
+    for (;;) {
+      int c = GetChar();
+      if (c == '"') break;
+      if (c < 0x20) return false;
+      if (c == '\\') {
+        c = GetChar();
+        switch (c) {
+          case '"': case '\\': case '/': break;
+          case 'b': c = '\b'; break;
+          case 'f': c = '\f'; break;
+          case 'n': c = '\n'; break;
+          case 'r': c = '\r'; break;
+          case 't': c = '\t'; break;
+          case 'u':
+            if (!ReadCodePoint(&length)) return false;
+            continue;
+          default: return false;
+        }
+      }
+      if (length + 1 >= scratch_.size()) return false;
+      scratch_[length++] = static_cast<char>(c);
+    }
+    text_ = &scratch_[0];
+    length_ = length;
+    return true;
+  }
+
+  // Four hex digits, or -1.
+  int ReadHex4() {
+    int value = 0;
+    for (size_t i = 0; i < 4; ++i) {
+      const int c = GetChar();
+      int digit;
+      if (c >= '0' && c <= '9') {
+        digit = c - '0';
+      } else if (c >= 'a' && c <= 'f') {
+        digit = c - 'a' + 10;
+      } else if (c >= 'A' && c <= 'F') {
+        digit = c - 'A' + 10;
+      } else {
+        return -1;
+      }
+      value = 16 * value + digit;
+    }
+    return value;
+  }
+
+  // After "\u": the code point, and the low surrogate of a pair, as
+  // UTF-8 at |*length| in |scratch_|.
+  bool ReadCodePoint(size_t* length) {
+    int code_point = ReadHex4();
+    if (code_point < 0) return false;
+    if (code_point >= 0xD800 && code_point < 0xDC00) {
+      if (GetChar() != '\\' || GetChar() != 'u') return false;
+      const int low = ReadHex4();
+      if (low < 0xDC00 || low >= 0xE000) return false;
+      code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+    } else if (code_point >= 0xDC00 && code_point < 0xE000) {
+      return false;
+    }
+    char utf8[4];
+    size_t n;
+    if (code_point < 0x80) {
+      utf8[0] = static_cast<char>(code_point);
+      n = 1;
+    } else if (code_point < 0x800) {
+      utf8[0] = static_cast<char>(0xC0 | (code_point >> 6));
+      utf8[1] = static_cast<char>(0x80 | (code_point & 0x3F));
+      n = 2;
+    } else if (code_point < 0x10000) {
+      utf8[0] = static_cast<char>(0xE0 | (code_point >> 12));
+      utf8[1] = static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+      utf8[2] = static_cast<char>(0x80 | (code_point & 0x3F));
+      n = 3;
+    } else {
+      utf8[0] = static_cast<char>(0xF0 | (code_point >> 18));
+      utf8[1] = static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+      utf8[2] = static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+      utf8[3] = static_cast<char>(0x80 | (code_point & 0x3F));
+      n = 4;
+    }
+    if (*length + n >= scratch_.size()) return false;
+    memcpy(&scratch_[*length], utf8, n);
+    *length += n;
+    return true;
+  }
+
+  BufferedInput* input_;  // unowned.
+  std::vector<char> scratch_;
+  State state_;
+  char containers_[kMaxDepth];  // The closing bracket of each.
+  size_t depth_;
+  JsonToken token_;
+  ErrorCode error_;
+  const char* text_;
+  size_t length_;
+  double number_;
+
+  // Disallow copy and assign.
+  JsonReader(const JsonReader&);
+  void operator=(const JsonReader&);
+};
+
+}  // namespace webgl_loader
+
+#endif  // WEBGL_LOADER_JSON_READER_H_
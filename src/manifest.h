@@ -0,0 +1,814 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_MANIFEST_H_
+#define WEBGL_LOADER_MANIFEST_H_
+
+#include <string.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base.h"
+#include "decompress.h"
+#include "json.h"
+#include "json_reader.h"
+#include "predict.h"
+#include "stream.h"
+
+namespace webgl_loader {
+
+// The manifest key of each |MeshFormat|'s range.
+const char* const kMeshFormatKeys[] = {
+  "indexRange", "codeRange", "lruCodeRange", "binaryRange",
+  "edgebreakerCodeRange", "gpuMesh"
+};
+
+const size_t kNumMeshFormats = sizeof(kMeshFormatKeys) / sizeof(char*);
+
+// A "materials" entry: a texture, or if |map_Kd| is empty, a color.
+struct ManifestMaterial {
+  ManifestMaterial() {
+    Kd[0] = Kd[1] = Kd[2] = 0;
+  }
+
+  std::string name;
+  int Kd[3];  // 0 to 255.
+  std::string map_Kd;
+};
+
+// A mesh, and the groups in it, where the manifest names them.
+struct ManifestMesh {
+  MeshEntry entry;
+  std::vector<std::string> names;
+  std::vector<size_t> lengths;
+};
+
+// A "urls" entry.
+struct ManifestUrl {
+  std::string path;
+  std::vector<ManifestMesh> meshes;
+};
+
+// A "lods" entry.
+struct ManifestLod {
+  float error;
+  std::vector<ManifestUrl> urls;
+};
+
+// What a manifest says, whether it was read from JSON or the binary
+// form.
+struct Manifest {
+  Manifest() {
+    memset(decode_offsets, 0, sizeof(decode_offsets));
+    memset(decode_scales, 0, sizeof(decode_scales));
+  }
+
+  std::vector<ManifestMaterial> materials;
+  // "decodeParams".
+  int decode_offsets[8];
+  float decode_scales[8];
+  std::vector<ManifestUrl> urls;
+  std::vector<ManifestLod> lods;
+};
+
+// JSON.
+
+void WriteJsonUrls(const std::vector<ManifestUrl>& urls, JsonSink* json) {
+  json->BeginObject();
+  for (size_t i = 0; i < urls.size(); ++i) {
+    json->PutString(urls[i].path.c_str());
+    json->BeginArray();
+    const std::vector<ManifestMesh>& meshes = urls[i].meshes;
+    for (size_t j = 0; j < meshes.size(); ++j) {
+      const MeshEntry& entry = meshes[j].entry;
+      json->BeginObject();
+      json->PutString("material");
+      json->PutString(entry.material.c_str());
+      const char* key = kMeshFormatKeys[entry.format];
+      switch (entry.format) {
+        case MESH_FORMAT_GPU_BUFFERS:
+          json->PutString(key);
+          json->PutUint(entry.code_start);
+          break;
+        case MESH_FORMAT_BINARY_RANGE: {
+          json->PutString(key);
+          const size_t range[2] = { entry.code_start, entry.code_length };
+          json->PutUintArray(range, 2);
+          break;
+        }
+        case MESH_FORMAT_INDEX_RANGE: {
+          json->PutString("attribRange");
+          const size_t attrib_range[2] = {
+            entry.attrib_start, entry.num_verts
+          };
+          json->PutUintArray(attrib_range, 2);
+          json->PutString(key);
+          const size_t range[2] = { entry.code_start, entry.num_tris };
+          json->PutUintArray(range, 2);
+          if (entry.num_bboxes != 0) {
+            json->PutString("bboxes");
+            json->PutUint(entry.bboxes_start);
+          }
+          break;
+        }
+        default: {
+          json->PutString("attribRange");
+          const size_t attrib_range[2] = {
+            entry.attrib_start, entry.num_verts
+          };
+          json->PutUintArray(attrib_range, 2);
+          json->PutString(key);
+          const size_t range[3] = {
+            entry.code_start, entry.code_length, entry.num_tris
+          };
+          json->PutUintArray(range, 3);
+          // Left out when unused, so older loaders can read the output.
+          if (!entry.predictors.IsTraversal()) {
+            json->PutString("predictors");
+            json->BeginArray();
+            json->PutString(kPredictorNames[entry.predictors.positions]);
+            json->PutString(kPredictorNames[entry.predictors.texcoords]);
+            json->End();
+          }
+        }
+      }
+      if (!meshes[j].names.empty()) {
+        json->PutString("names");
+        json->BeginArray();
+        for (size_t k = 0; k < meshes[j].names.size(); ++k) {
+          json->PutString(meshes[j].names[k].c_str());
+        }
+        json->End();
+        json->PutString("lengths");
+        json->PutUintArray(&meshes[j].lengths[0], meshes[j].lengths.size());
+      }
+      json->End();
+    }
+    json->End();
+  }
+  json->End();
+}
+
+// As obj2utf8x writes it, and loader.js reads it.
+void WriteJsonManifest(const Manifest& manifest, JsonSink* json) {
+  json->BeginObject();
+  json->PutString("materials");
+  json->BeginObject();
+  for (size_t i = 0; i < manifest.materials.size(); ++i) {
+    const ManifestMaterial& material = manifest.materials[i];
+    json->PutString(material.name.c_str());
+    json->BeginObject();
+    if (material.map_Kd.empty()) {
+      json->PutString("Kd");
+      json->PutIntArray(material.Kd, 3);
+    } else {
+      json->PutString("map_Kd");
+      json->PutString(material.map_Kd.c_str());
+    }
+    json->End();
+  }
+  json->End();
+  json->PutString("decodeParams");
+  json->BeginObject();
+  json->PutString("decodeOffsets");
+  json->PutIntArray(manifest.decode_offsets, 8);
+  json->PutString("decodeScales");
+  json->PutFloatArray(manifest.decode_scales, 8);
+  json->End();
+  json->PutString("urls");
+  WriteJsonUrls(manifest.urls, json);
+  if (!manifest.lods.empty()) {
+    json->PutString("lods");
+    json->BeginArray();
+    for (size_t i = 0; i < manifest.lods.size(); ++i) {
+      json->BeginObject();
+      json->PutString("error");
+      json->PutFloat(manifest.lods[i].error);
+      json->PutString("urls");
+      WriteJsonUrls(manifest.lods[i].urls, json);
+      json->End();
+    }
+    json->End();
+  }
+  json->End();
+}
+
+// Reads a JSON manifest, as |WriteJsonManifest| writes it, through
+// the pieces of it. Keys it doesn't know are skipped. Each returns
+// false if what it reads isn't what it expects.
+class JsonManifestReader {
+ public:
+  // |reader| is unowned and must not be NULL.
+  explicit JsonManifestReader(JsonReader* reader)
+      : reader_(reader) {
+  }
+
+  bool Read(Manifest* manifest) {
+    if (JSON_BEGIN_OBJECT != reader_->Next()) return false;
+    while (JSON_KEY == reader_->Next()) {
+      bool ok;
+      if (reader_->Equals("materials")) {
+        ok = ReadMaterials(&manifest->materials);
+      } else if (reader_->Equals("decodeParams")) {
+        ok = ReadDecodeParams(manifest);
+      } else if (reader_->Equals("urls")) {
+        ok = ReadUrls(&manifest->urls);
+      } else if (reader_->Equals("lods")) {
+        ok = ReadLods(&manifest->lods);
+      } else {
+        ok = reader_->Skip();
+      }
+      if (!ok) return false;
+    }
+    return JSON_END_OBJECT == reader_->token();
+  }
+
+ private:
+  bool ReadString(std::string* str) {
+    if (JSON_STRING != reader_->Next()) return false;
+    str->assign(reader_->text(), reader_->length());
+    return true;
+  }
+
+  bool ReadNumber(double* number) {
+    if (JSON_NUMBER != reader_->Next()) return false;
+    *number = reader_->number();
+    return true;
+  }
+
+  bool ReadUint(size_t* n) {
+    double number;
+    if (!ReadNumber(&number) || number < 0) return false;
+    *n = static_cast<size_t>(number);
+    return true;
+  }
+
+  // An array of exactly |n| unsigned integers.
+  bool ReadUints(size_t* values, size_t n) {
+    if (JSON_BEGIN_ARRAY != reader_->Next()) return false;
+    for (size_t i = 0; i < n; ++i) {
+      if (!ReadUint(&values[i])) return false;
+    }
+    return JSON_END_ARRAY == reader_->Next();
+  }
+
+  bool ReadMaterials(std::vector<ManifestMaterial>* materials) {
+    if (JSON_BEGIN_OBJECT != reader_->Next()) return false;
+    while (JSON_KEY == reader_->Next()) {
+      materials->push_back(ManifestMaterial());
+      ManifestMaterial& material = materials->back();
+      material.name.assign(reader_->text(), reader_->length());
+      if (JSON_BEGIN_OBJECT != reader_->Next()) return false;
+      while (JSON_KEY == reader_->Next()) {
+        if (reader_->Equals("Kd")) {
+          size_t kd[3];
+          if (!ReadUints(kd, 3)) return false;
+          for (size_t i = 0; i < 3; ++i) {
+            material.Kd[i] = static_cast<int>(kd[i]);
+          }
+        } else if (reader_->Equals("map_Kd")) {
+          if (!ReadString(&material.map_Kd)) return false;
+        } else if (!reader_->Skip()) {
+          return false;
+        }
+      }
+      if (JSON_END_OBJECT != reader_->token()) return false;
+    }
+    return JSON_END_OBJECT == reader_->token();
+  }
+
+  bool ReadDecodeParams(Manifest* manifest) {
+    if (JSON_BEGIN_OBJECT != reader_->Next()) return false;
+    while (JSON_KEY == reader_->Next()) {
+      const bool offsets = reader_->Equals("decodeOffsets");
+      if (!offsets && !reader_->Equals("decodeScales")) {
+        if (!reader_->Skip()) return false;
+        continue;
+      }
+      if (JSON_BEGIN_ARRAY != reader_->Next()) return false;
+      for (size_t i = 0; i < 8; ++i) {
+        double number;
+        if (!ReadNumber(&number)) return false;
+        if (offsets) {
+          manifest->decode_offsets[i] = static_cast<int>(number);
+        } else {
+          manifest->decode_scales[i] = static_cast<float>(number);
+        }
+      }
+      if (JSON_END_ARRAY != reader_->Next()) return false;
+    }
+    return JSON_END_OBJECT == reader_->token();
+  }
+
+  bool ReadUrls(std::vector<ManifestUrl>* urls) {
+    if (JSON_BEGIN_OBJECT != reader_->Next()) return false;
+    while (JSON_KEY == reader_->Next()) {
+      urls->push_back(ManifestUrl());
+      ManifestUrl& url = urls->back();
+      url.path.assign(reader_->text(), reader_->length());
+      if (JSON_BEGIN_ARRAY != reader_->Next()) return false;
+      while (JSON_BEGIN_OBJECT == reader_->Next()) {
+        url.meshes.push_back(ManifestMesh());
+        if (!ReadMesh(&url.meshes.back())) return false;
+      }
+      if (JSON_END_ARRAY != reader_->token()) return false;
+    }
+    return JSON_END_OBJECT == reader_->token();
+  }
+
+  // After its |JSON_BEGIN_OBJECT|.
+  bool ReadMesh(ManifestMesh* mesh) {
+    MeshEntry& entry = mesh->entry;
+    bool has_bboxes = false;
+    while (JSON_KEY == reader_->Next()) {
+      size_t format = 0;
+      while (format < kNumMeshFormats &&
+             !reader_->Equals(kMeshFormatKeys[format])) {
+        ++format;
+      }
+      if (format != kNumMeshFormats) {
+        entry.format = static_cast<MeshFormat>(format);
+        switch (entry.format) {
+          case MESH_FORMAT_GPU_BUFFERS:
+            if (!ReadUint(&entry.code_start)) return false;
+            break;
+          case MESH_FORMAT_BINARY_RANGE: {
+            size_t range[2];
+            if (!ReadUints(range, 2)) return false;
+            entry.code_start = range[0];
+            entry.code_length = range[1];
+            break;
+          }
+          case MESH_FORMAT_INDEX_RANGE: {
+            size_t range[2];
+            if (!ReadUints(range, 2)) return false;
+            entry.code_start = range[0];
+            entry.num_tris = range[1];
+            entry.code_length = 3 * range[1];
+            break;
+          }
+          default: {
+            size_t range[3];
+            if (!ReadUints(range, 3)) return false;
+            entry.code_start = range[0];
+            entry.code_length = range[1];
+            entry.num_tris = range[2];
+          }
+        }
+      } else if (reader_->Equals("material")) {
+        if (!ReadString(&entry.material)) return false;
+      } else if (reader_->Equals("attribRange")) {
+        size_t range[2];
+        if (!ReadUints(range, 2)) return false;
+        entry.attrib_start = range[0];
+        entry.num_verts = range[1];
+      } else if (reader_->Equals("bboxes")) {
+        if (!ReadUint(&entry.bboxes_start)) return false;
+        has_bboxes = true;
+      } else if (reader_->Equals("predictors")) {
+        if (!ReadPredictors(&entry.predictors)) return false;
+      } else if (reader_->Equals("names")) {
+        if (JSON_BEGIN_ARRAY != reader_->Next()) return false;
+        while (JSON_STRING == reader_->Next()) {
+          mesh->names.push_back(
+              std::string(reader_->text(), reader_->length()));
+        }
+        if (JSON_END_ARRAY != reader_->token()) return false;
+      } else if (reader_->Equals("lengths")) {
+        if (JSON_BEGIN_ARRAY != reader_->Next()) return false;
+        while (JSON_NUMBER == reader_->Next()) {
+          mesh->lengths.push_back(static_cast<size_t>(reader_->number()));
+        }
+        if (JSON_END_ARRAY != reader_->token()) return false;
+      } else if (!reader_->Skip()) {
+        return false;
+      }
+    }
+    // One bbox per group.
+    if (has_bboxes) entry.num_bboxes = mesh->names.size();
+    return JSON_END_OBJECT == reader_->token() &&
+        mesh->names.size() == mesh->lengths.size();
+  }
+
+  bool ReadPredictors(AttribPredictors* predictors) {
+    if (JSON_BEGIN_ARRAY != reader_->Next()) return false;
+    int found[2];
+    for (size_t i = 0; i < 2; ++i) {
+      if (JSON_STRING != reader_->Next()) return false;
+      found[i] = 0;
+      while (found[i] < NUM_PREDICTORS &&
+             !reader_->Equals(kPredictorNames[found[i]])) {
+        ++found[i];
+      }
+    }
+    predictors->positions = static_cast<AttribPredictor>(found[0]);
+    predictors->texcoords = static_cast<AttribPredictor>(found[1]);
+    return predictors->IsValid() && JSON_END_ARRAY == reader_->Next();
+  }
+
+  bool ReadLods(std::vector<ManifestLod>* lods) {
+    if (JSON_BEGIN_ARRAY != reader_->Next()) return false;
+    while (JSON_BEGIN_OBJECT == reader_->Next()) {
+      lods->push_back(ManifestLod());
+      ManifestLod& lod = lods->back();
+      lod.error = 0.f;
+      while (JSON_KEY == reader_->Next()) {
+        if (reader_->Equals("error")) {
+          double error;
+          if (!ReadNumber(&error)) return false;
+          lod.error = static_cast<float>(error);
+        } else if (reader_->Equals("urls")) {
+          if (!ReadUrls(&lod.urls)) return false;
+        } else if (!reader_->Skip()) {
+          return false;
+        }
+      }
+      if (JSON_END_OBJECT != reader_->token()) return false;
+    }
+    return JSON_END_ARRAY == reader_->token();
+  }
+
+  JsonReader* reader_;  // unowned.
+};
+
+// The binary form: the same contents, with each string stored once
+// and numbers as varints. Little-endian throughout:
+//
+//   "WLM" 1
+//   strings:    count, then each as length and bytes
+//   materials:  count, then each as name, map_Kd + 1 or 0 and three
+//               Kd bytes
+//   decode:     8 ZigZag offsets, 8 float32 scales
+//   urls:       count, then each as below
+//   lods:       count, then each as float32 error and urls
+//
+// Strings are varint indices into the string table. A url is its
+// path and count of meshes; a mesh is its material, |MeshFormat|,
+// ranges, predictors (code ranges only, positions * NUM_PREDICTORS +
+// texcoords), count of groups, their names and their lengths. Each
+// range's start is ZigZag, as a difference from where it would be if
+// everything were packed: the previous mesh's end, or the end of the
+// attribs before it in the same mesh. Those are nearly always 0.
+const char kBinaryManifestMagic[4] = { 'W', 'L', 'M', 1 };
+
+inline uint32 ZigZag32(int value) {
+  return (static_cast<uint32>(value) << 1) ^ static_cast<uint32>(value >> 31);
+}
+
+inline int UnZigZag32(uint32 code) {
+  return static_cast<int>(code >> 1) ^ -static_cast<int>(code & 1);
+}
+
+class BinaryManifestWriter {
+ public:
+  // |sink| is unowned and must not be NULL.
+  explicit BinaryManifestWriter(BufferedSink* sink)
+      : sink_(sink) {
+  }
+
+  void Write(const Manifest& manifest) {
+    // Gather the strings first, so that they can come first.
+    std::vector<const std::string*> strings;
+    AddStrings(manifest, &strings);
+    sink_->PutN(kBinaryManifestMagic, sizeof(kBinaryManifestMagic));
+    PutVarint(strings.size(), sink_);
+    for (size_t i = 0; i < strings.size(); ++i) {
+      PutVarint(strings[i]->size(), sink_);
+      sink_->PutN(strings[i]->data(), strings[i]->size());
+    }
+    PutVarint(manifest.materials.size(), sink_);
+    for (size_t i = 0; i < manifest.materials.size(); ++i) {
+      const ManifestMaterial& material = manifest.materials[i];
+      PutString(material.name);
+      if (material.map_Kd.empty()) {
+        PutVarint(0, sink_);
+        for (size_t j = 0; j < 3; ++j) {
+          sink_->Put(static_cast<char>(material.Kd[j]));
+        }
+      } else {
+        PutVarint(1 + string_indices_[material.map_Kd], sink_);
+      }
+    }
+    for (size_t i = 0; i < 8; ++i) {
+      PutVarint(ZigZag32(manifest.decode_offsets[i]), sink_);
+    }
+    for (size_t i = 0; i < 8; ++i) {
+      PutFloat(manifest.decode_scales[i]);
+    }
+    PutUrls(manifest.urls);
+    PutVarint(manifest.lods.size(), sink_);
+    for (size_t i = 0; i < manifest.lods.size(); ++i) {
+      PutFloat(manifest.lods[i].error);
+      PutUrls(manifest.lods[i].urls);
+    }
+  }
+
+ private:
+  void AddString(const std::string& str,
+                 std::vector<const std::string*>* strings) {
+    if (string_indices_.insert(std::make_pair(str, strings->size())).second) {
+      strings->push_back(&str);
+    }
+  }
+
+  void AddUrlStrings(const std::vector<ManifestUrl>& urls,
+                     std::vector<const std::string*>* strings) {
+    for (size_t i = 0; i < urls.size(); ++i) {
+      AddString(urls[i].path, strings);
+      for (size_t j = 0; j < urls[i].meshes.size(); ++j) {
+        const ManifestMesh& mesh = urls[i].meshes[j];
+        AddString(mesh.entry.material, strings);
+        for (size_t k = 0; k < mesh.names.size(); ++k) {
+          AddString(mesh.names[k], strings);
+        }
+      }
+    }
+  }
+
+  void AddStrings(const Manifest& manifest,
+                  std::vector<const std::string*>* strings) {
+    for (size_t i = 0; i < manifest.materials.size(); ++i) {
+      AddString(manifest.materials[i].name, strings);
+      if (!manifest.materials[i].map_Kd.empty()) {
+        AddString(manifest.materials[i].map_Kd, strings);
+      }
+    }
+    AddUrlStrings(manifest.urls, strings);
+    for (size_t i = 0; i < manifest.lods.size(); ++i) {
+      AddUrlStrings(manifest.lods[i].urls, strings);
+    }
+  }
+
+  void PutString(const std::string& str) {
+    PutVarint(string_indices_[str], sink_);
+  }
+
+  void PutFloat(float f) {
+    uint32 bits;
+    memcpy(&bits, &f, sizeof(bits));
+    char* out = sink_->Reserve(4);
+    for (size_t i = 0; i < 4; ++i) {
+      out[i] = static_cast<char>(bits >> (8 * i));
+    }
+    sink_->Commit(out + 4);
+  }
+
+  // Of |value| from |expected|.
+  void PutStart(size_t value, size_t expected) {
+    PutVarint(ZigZag32(static_cast<int>(value - expected)), sink_);
+  }
+
+  void PutUrls(const std::vector<ManifestUrl>& urls) {
+    PutVarint(urls.size(), sink_);
+    for (size_t i = 0; i < urls.size(); ++i) {
+      PutString(urls[i].path);
+      PutVarint(urls[i].meshes.size(), sink_);
+      size_t end = 0;
+      for (size_t j = 0; j < urls[i].meshes.size(); ++j) {
+        const ManifestMesh& mesh = urls[i].meshes[j];
+        const MeshEntry& entry = mesh.entry;
+        PutString(entry.material);
+        PutVarint(entry.format, sink_);
+        switch (entry.format) {
+          case MESH_FORMAT_GPU_BUFFERS:
+            PutStart(entry.code_start, j);
+            break;
+          case MESH_FORMAT_BINARY_RANGE:
+            PutStart(entry.code_start, end);
+            PutVarint(entry.code_length, sink_);
+            break;
+          case MESH_FORMAT_INDEX_RANGE:
+            PutStart(entry.attrib_start, end);
+            PutVarint(entry.num_verts, sink_);
+            PutStart(entry.code_start,
+                     entry.attrib_start + 8 * entry.num_verts);
+            PutVarint(entry.num_tris, sink_);
+            PutVarint(entry.num_bboxes, sink_);
+            if (entry.num_bboxes != 0) {
+              PutStart(entry.bboxes_start,
+                       entry.code_start + entry.code_length);
+            }
+            break;
+          default:
+            PutStart(entry.attrib_start, end);
+            PutVarint(entry.num_verts, sink_);
+            PutStart(entry.code_start,
+                     entry.attrib_start + 8 * entry.num_verts);
+            PutVarint(entry.code_length, sink_);
+            PutVarint(entry.num_tris, sink_);
+            PutVarint(entry.predictors.positions * NUM_PREDICTORS +
+                      entry.predictors.texcoords, sink_);
+        }
+        end = entry.End();
+        PutVarint(mesh.names.size(), sink_);
+        for (size_t k = 0; k < mesh.names.size(); ++k) {
+          PutString(mesh.names[k]);
+        }
+        for (size_t k = 0; k < mesh.lengths.size(); ++k) {
+          PutVarint(mesh.lengths[k], sink_);
+        }
+      }
+    }
+  }
+
+  BufferedSink* sink_;  // unowned.
+  std::map<std::string, size_t> string_indices_;
+};
+
+// Reads the binary form from memory. |Read| returns false if it is
+// malformed, or anything is out of range.
+class BinaryManifestReader {
+ public:
+  BinaryManifestReader(const char* data, size_t length)
+      : cursor_(data),
+        end_(data + length) {
+  }
+
+  bool Read(Manifest* manifest) {
+    if (static_cast<size_t>(end_ - cursor_) < sizeof(kBinaryManifestMagic) ||
+        0 != memcmp(cursor_, kBinaryManifestMagic,
+                    sizeof(kBinaryManifestMagic))) {
+      return false;
+    }
+    cursor_ += sizeof(kBinaryManifestMagic);
+    strings_.resize(GetCount());
+    for (size_t i = 0; i < strings_.size(); ++i) {
+      const size_t length = GetUint();
+      if (cursor_ == NULL || length > static_cast<size_t>(end_ - cursor_)) {
+        return false;
+      }
+      strings_[i].assign(cursor_, length);
+      cursor_ += length;
+    }
+    manifest->materials.resize(GetCount());
+    for (size_t i = 0; i < manifest->materials.size(); ++i) {
+      ManifestMaterial& material = manifest->materials[i];
+      material.name = GetString();
+      const size_t map_Kd = GetUint();
+      if (map_Kd != 0) {
+        material.map_Kd = GetString(map_Kd - 1);
+      } else if (cursor_ != NULL && end_ - cursor_ >= 3) {
+        for (size_t j = 0; j < 3; ++j) {
+          material.Kd[j] = static_cast<uint8>(*cursor_++);
+        }
+      } else {
+        return false;
+      }
+    }
+    for (size_t i = 0; i < 8; ++i) {
+      manifest->decode_offsets[i] = UnZigZag32(GetUint());
+    }
+    for (size_t i = 0; i < 8; ++i) {
+      manifest->decode_scales[i] = GetFloat();
+    }
+    GetUrls(&manifest->urls);
+    manifest->lods.resize(GetCount());
+    for (size_t i = 0; i < manifest->lods.size(); ++i) {
+      manifest->lods[i].error = GetFloat();
+      GetUrls(&manifest->lods[i].urls);
+    }
+    return cursor_ == end_;
+  }
+
+ private:
+  // Every failure leaves |cursor_| NULL, and the getters return 0
+  // after it.
+  uint32 GetUint() {
+    uint32 value = 0;
+    if (cursor_ != NULL) cursor_ = GetVarint(cursor_, end_, &value);
+    return value;
+  }
+
+  // Of things at least a byte each, so at most the bytes left.
+  size_t GetCount() {
+    const size_t count = GetUint();
+    if (cursor_ == NULL || count > static_cast<size_t>(end_ - cursor_)) {
+      cursor_ = NULL;
+      return 0;
+    }
+    return count;
+  }
+
+  const std::string& GetString(size_t index) {
+    static const std::string kEmpty;
+    if (index >= strings_.size()) {
+      cursor_ = NULL;
+      return kEmpty;
+    }
+    return strings_[index];
+  }
+
+  const std::string& GetString() {
+    return GetString(GetUint());
+  }
+
+  float GetFloat() {
+    if (cursor_ == NULL || end_ - cursor_ < 4) {
+      cursor_ = NULL;
+      return 0.f;
+    }
+    uint32 bits = 0;
+    for (size_t i = 0; i < 4; ++i) {
+      bits |= static_cast<uint32>(static_cast<uint8>(*cursor_++)) << (8 * i);
+    }
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+  }
+
+  size_t GetStart(size_t expected) {
+    return expected + UnZigZag32(GetUint());
+  }
+
+  void GetUrls(std::vector<ManifestUrl>* urls) {
+    urls->resize(GetCount());
+    for (size_t i = 0; i < urls->size(); ++i) {
+      ManifestUrl& url = (*urls)[i];
+      url.path = GetString();
+      url.meshes.resize(GetCount());
+      size_t end = 0;
+      for (size_t j = 0; j < url.meshes.size(); ++j) {
+        ManifestMesh& mesh = url.meshes[j];
+        MeshEntry& entry = mesh.entry;
+        entry.material = GetString();
+        const uint32 format = GetUint();
+        if (format >= kNumMeshFormats) {
+          cursor_ = NULL;
+          return;
+        }
+        entry.format = static_cast<MeshFormat>(format);
+        switch (entry.format) {
+          case MESH_FORMAT_GPU_BUFFERS:
+            entry.code_start = GetStart(j);
+            break;
+          case MESH_FORMAT_BINARY_RANGE:
+            entry.code_start = GetStart(end);
+            entry.code_length = GetUint();
+            break;
+          case MESH_FORMAT_INDEX_RANGE:
+            entry.attrib_start = GetStart(end);
+            entry.num_verts = GetUint();
+            entry.code_start =
+                GetStart(entry.attrib_start + 8 * entry.num_verts);
+            entry.num_tris = GetUint();
+            entry.code_length = 3 * entry.num_tris;
+            entry.num_bboxes = GetUint();
+            if (entry.num_bboxes != 0) {
+              entry.bboxes_start =
+                  GetStart(entry.code_start + entry.code_length);
+            }
+            break;
+          default: {
+            entry.attrib_start = GetStart(end);
+            entry.num_verts = GetUint();
+            entry.code_start =
+                GetStart(entry.attrib_start + 8 * entry.num_verts);
+            entry.code_length = GetUint();
+            entry.num_tris = GetUint();
+            const uint32 predictors = GetUint();
+            if (predictors >= NUM_PREDICTORS * NUM_PREDICTORS) {
+              cursor_ = NULL;
+              return;
+            }
+            entry.predictors.positions =
+                static_cast<AttribPredictor>(predictors / NUM_PREDICTORS);
+            entry.predictors.texcoords =
+                static_cast<AttribPredictor>(predictors % NUM_PREDICTORS);
+            if (!entry.predictors.IsValid()) cursor_ = NULL;
+          }
+        }
+        end = entry.End();
+        mesh.names.resize(GetCount());
+        for (size_t k = 0; k < mesh.names.size(); ++k) {
+          mesh.names[k] = GetString();
+        }
+        mesh.lengths.resize(mesh.names.size());
+        for (size_t k = 0; k < mesh.lengths.size(); ++k) {
+          mesh.lengths[k] = GetUint();
+        }
+        if (cursor_ == NULL) return;
+      }
+    }
+  }
+
+  const char* cursor_;  // NULL after an error.
+  const char* end_;
+  std::vector<std::string> strings_;
+};
+
+}  // namespace webgl_loader
+
+#endif  // WEBGL_LOADER_MANIFEST_H_
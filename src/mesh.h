@@ -28,6 +28,8 @@
 
 #include "base.h"
 #include "bounds.h"
+#include "inflate.h"
+#include "json.h"
 #include "stream.h"
 #include "utf8.h"
 
@@ -313,16 +315,23 @@ struct Material {
   float Kd[3];
   std::string map_Kd;
 
-  void DumpJson(FILE* out = stdout) const {
-    fprintf(out, "    \"%s\": { ", name.c_str());
+  // As a key and value of the manifest's "materials".
+  void DumpJson(webgl_loader::JsonSink* json) const {
+    json->PutString(name.c_str());
+    json->BeginObject();
     if (map_Kd.empty()) {
-      fprintf(out, "\"Kd\": [%hu, %hu, %hu] }",
-              Quantize(Kd[0], 0, 1, 255),
-              Quantize(Kd[1], 0, 1, 255),
-              Quantize(Kd[2], 0, 1, 255));
+      json->PutString("Kd");
+      const int kd[3] = {
+        Quantize(Kd[0], 0, 1, 255),
+        Quantize(Kd[1], 0, 1, 255),
+        Quantize(Kd[2], 0, 1, 255)
+      };
+      json->PutIntArray(kd, 3);
     } else {
-      fprintf(out, "\"map_Kd\": \"%s\" }", map_Kd.c_str());
+      json->PutString("map_Kd");
+      json->PutString(map_Kd.c_str());
     }
+    json->End();
   }
 };
 
@@ -407,14 +416,33 @@ typedef std::map<std::string, DrawBatch> MaterialBatches;
 // object.
 class WavefrontObjFile {
  public:
-  explicit WavefrontObjFile(FILE* fp) {
-    current_batch_ = &material_batches_[""];
-    current_batch_->Init(&positions_, &texcoords_, &normals_);
-    current_group_line_ = 0;
-    line_to_groups_.insert(std::make_pair(0, "default"));
+  // Reads |fp| to the end, inflating it first if it is gzipped.
+  explicit WavefrontObjFile(FILE* fp)
+      : error_(NULL) {
+    Init();
     ParseFile(fp);
   }
 
+  explicit WavefrontObjFile(webgl_loader::BufferedInput* input)
+      : error_(NULL) {
+    Init();
+    ParseInput(input);
+  }
+
+  // Like the above, inflating |input| first if it is gzipped, but
+  // where those exit on a malformed file, this stops reading it and
+  // sets |error| to why, for callers that go on to other files.
+  // Warnings name |path|, since such callers may be reading several
+  // at once.
+  WavefrontObjFile(webgl_loader::BufferedInput* input,
+                   const std::string& path, std::string* error)
+      : path_(path),
+        error_(error) {
+    error_->clear();
+    Init();
+    ParseMaybeGzipped(input);
+  }
+
   const MaterialList& materials() const {
     return materials_;
   }
@@ -451,18 +479,45 @@ class WavefrontObjFile {
            positions_.size(), texcoords_.size(), normals_.size());
   }
  private:
-  WavefrontObjFile() { }  // For testing.
+  WavefrontObjFile()  // For testing.
+      : error_(NULL) {
+  }
+
+  void Init() {
+    current_batch_ = &material_batches_[""];
+    current_batch_->Init(&positions_, &texcoords_, &normals_);
+    current_group_line_ = 0;
+    warned_smoothing_ = false;
+    line_to_groups_.insert(std::make_pair(0, "default"));
+    group_counts_["default"] = 0;
+  }
 
   void ParseFile(FILE* fp) {
-    // TODO: don't use a fixed-size buffer.
-    const size_t kLineBufferSize = 256;
-    char buffer[kLineBufferSize] = { 0 };
+    std::vector<char> buf(64 * 1024);
+    webgl_loader::BufferedInputStream input(fp, &buf[0], buf.size());
+    ParseMaybeGzipped(&input);
+  }
+
+  void ParseMaybeGzipped(webgl_loader::BufferedInput* input) {
+    if (webgl_loader::LooksGzipped(input)) {
+      webgl_loader::InflatingInput inflated(input);
+      ParseInput(&inflated);
+    } else {
+      ParseInput(input);
+    }
+  }
+
+  void ParseInput(webgl_loader::BufferedInput* input) {
+    std::vector<char> line;
     unsigned int line_num = 1;
-    while (fgets(buffer, kLineBufferSize, fp) != NULL) {
-      char* stripped = StripLeadingWhitespace(buffer);
+    while (!failed() && webgl_loader::GetLine(input, &line)) {
+      char* stripped = StripLeadingWhitespace(&line[0]);
       TerminateAtNewlineOrComment(stripped);
       ParseLine(stripped, line_num++);
     }
+    if (!failed() && webgl_loader::kEndOfFile != input->error()) {
+      FailLine("unreadable or corrupt input", line_num);
+    }
   }
 
   void ParseLine(const char* line, unsigned int line_num) {
@@ -474,7 +529,9 @@ class WavefrontObjFile {
         ParseFace(line + 1, line_num);
         break;
       case 'g':
-        if (isspace(line[1])) {
+        if (line[1] == '\0') {
+          ParseGroup(line + 1, line_num);
+        } else if (isspace(line[1])) {
           ParseGroup(line + 2, line_num);
         } else {
           goto unknown;
@@ -530,7 +587,8 @@ class WavefrontObjFile {
   void ParsePosition(const ShortFloatList& floats, unsigned int line_num) {
     if (floats.size() != positionDim() &&
         floats.size() != 6) {  // ignore r g b for now.
-      ErrorLine("bad position", line_num);
+      FailLine("bad position", line_num);
+      return;
     }
     floats.AppendNTo(&positions_, positionDim());
   }
@@ -539,14 +597,16 @@ class WavefrontObjFile {
     if ((floats.size() < 1) || (floats.size() > 3)) {
       // TODO: correctly handle 3-D texcoords intead of just
       // truncating.
-      ErrorLine("bad texcoord", line_num);
+      FailLine("bad texcoord", line_num);
+      return;
     }
     floats.AppendNTo(&texcoords_, texcoordDim());
   }
 
   void ParseNormal(const ShortFloatList& floats, unsigned int line_num) {
     if (floats.size() != normalDim()) {
-      ErrorLine("bad normal", line_num);
+      FailLine("bad normal", line_num);
+      return;
     }
     // Normalize to avoid out-of-bounds quantization. This should be
     // optional, in case someone wants to be using the normal magnitude as
@@ -581,16 +641,22 @@ class WavefrontObjFile {
     // The first index acts as the pivot for the triangle fan.
     line = ParseIndices(line, line_num, indices + 0, indices + 1, indices + 2);
     if (line == NULL) {
-      ErrorLine("bad first index", line_num);
+      FailLine("bad first index", line_num);
+      return;
     }
     line = ParseIndices(line, line_num, indices + 3, indices + 4, indices + 5);
     if (line == NULL) {
-      ErrorLine("bad second index", line_num);
+      FailLine("bad second index", line_num);
+      return;
     }
     // After the first two indices, each index introduces a new
     // triangle to the fan.
     while ((line = ParseIndices(line, line_num,
                                 indices + 6, indices + 7, indices + 8))) {
+      if (!IndicesInRange(indices)) {
+        FailLine("index out of range", line_num);
+        return;
+      }
       current_batch_->AddTriangle(current_group_line_, indices);
       // The most recent vertex is reused for the next triangle.
       indices[3] = indices[6];
@@ -600,6 +666,23 @@ class WavefrontObjFile {
     }
   }
 
+  // Whether the triangle's |indices|, each vertex's position, texcoord
+  // and normal, name attributes read so far. 0 is no texcoord or
+  // normal; relative (negative) indices aren't handled yet.
+  bool IndicesInRange(const int* indices) const {
+    const int num_positions = positions_.size() / positionDim();
+    const int num_texcoords = texcoords_.size() / texcoordDim();
+    const int num_normals = normals_.size() / normalDim();
+    for (size_t i = 0; i < 9; i += 3) {
+      if (indices[i] < 1 || indices[i] > num_positions ||
+          indices[i + 1] < 0 || indices[i + 1] > num_texcoords ||
+          indices[i + 2] < 0 || indices[i + 2] > num_normals) {
+        return false;
+      }
+    }
+    return true;
+  }
+
   // Parse a single group of indices, separated by slashes ('/').
   // TODO: convert negative indices (that is, relative to the end of
   // the current vertex positions) to more conventional positive
@@ -638,14 +721,18 @@ class WavefrontObjFile {
       group_counts_[token]++;
       line_to_groups_.insert(std::make_pair(line_num, token));
     }
+    // A "g" with no names goes back to the default group.
+    if (line_to_groups_.find(line_num) == line_to_groups_.end()) {
+      group_counts_["default"]++;
+      line_to_groups_.insert(std::make_pair(line_num, "default"));
+    }
     current_group_line_ = line_num;
   }
 
   void ParseSmoothingGroup(const char* line, unsigned int line_num) {
-    static bool once = true;
-    if (once) {
+    if (!warned_smoothing_) {
       WarnLine("s ignored", line_num);
-      once = false;
+      warned_smoothing_ = true;
     }
   }
 
@@ -669,20 +756,44 @@ class WavefrontObjFile {
     ToLower(StripLeadingWhitespace(line), &usemtl);
     MaterialBatches::iterator iter = material_batches_.find(usemtl);
     if (iter == material_batches_.end()) {
-      ErrorLine("material not found", line_num);
+      FailLine("material not found", line_num);
+      return;
     }
     current_batch_ = &iter->second;
   }
 
   void WarnLine(const char* why, unsigned int line_num) const {
-    fprintf(stderr, "WARNING: %s at line %u\n", why, line_num);
+    if (path_.empty()) {
+      fprintf(stderr, "WARNING: %s at line %u\n", why, line_num);
+    } else {
+      fprintf(stderr, "WARNING: %s: %s at line %u\n", path_.c_str(), why,
+              line_num);
+    }
   }
 
   void ErrorLine(const char* why, unsigned int line_num) const {
-    fprintf(stderr, "ERROR: %s at line %u\n", why, line_num);
+    if (path_.empty()) {
+      fprintf(stderr, "ERROR: %s at line %u\n", why, line_num);
+    } else {
+      fprintf(stderr, "ERROR: %s: %s at line %u\n", path_.c_str(), why,
+              line_num);
+    }
     exit(-1);
   }
 
+  // For a malformed line: exits, as |ErrorLine|, unless there is an
+  // |error_| to set, and then stops the parse.
+  void FailLine(const char* why, unsigned int line_num) {
+    if (error_ == NULL) ErrorLine(why, line_num);
+    char buf[32];
+    snprintf(buf, sizeof(buf), " at line %u", line_num);
+    *error_ = why + std::string(buf);
+  }
+
+  bool failed() const {
+    return error_ != NULL && !error_->empty();
+  }
+
   AttribList positions_;
   AttribList texcoords_;
   AttribList normals_;
@@ -696,6 +807,11 @@ class WavefrontObjFile {
   LineToGroups line_to_groups_;
   std::map<std::string, int> group_counts_;
   unsigned int current_group_line_;
+  // Once per file, rather than per process, so files can be read on
+  // several threads.
+  bool warned_smoothing_;
+  std::string path_;  // For warnings; empty if not given.
+  std::string* error_;  // unowned, and may be NULL.
 };
 
 #endif  // WEBGL_LOADER_MESH_H_
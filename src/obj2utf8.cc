@@ -18,6 +18,7 @@ exit;
 
 #include "bounds.h"
 #include "compress.h"
+#include "json.h"
 #include "mesh.h"
 #include "optimize.h"
 #include "stream.h"
@@ -38,14 +39,17 @@ int main(int argc, const char* argv[]) {
   WavefrontObjFile obj(fp);
   fclose(fp);
 
-  fputs("{\n  \"materials\": {\n", json_out);
+  webgl_loader::BufferedFileSink json_sink(json_out);
+  webgl_loader::JsonSink json(&json_sink);
+  json.set_pretty_depth(3);
+  json.BeginObject();
+  json.PutString("materials");
+  json.BeginObject();
   const MaterialList& materials = obj.materials();
   for (size_t i = 0; i < materials.size(); ++i) {
-    materials[i].DumpJson(json_out);
-    const bool last = i == materials.size() - 1;
-    fputs(",\n" + last, json_out);
+    materials[i].DumpJson(&json);
   }
-  fputs("  },\n", json_out);
+  json.End();
   
   const MaterialBatches& batches = obj.material_batches();
 
@@ -59,13 +63,15 @@ int main(int argc, const char* argv[]) {
   }
   webgl_loader::BoundsParams bounds_params = 
       webgl_loader::BoundsParams::FromBounds(bounds);
-  fputs("  \"decodeParams\": ", json_out);
-  bounds_params.DumpJson(json_out);
-  fputs(", \"urls\": {\n", json_out);
+  json.PutString("decodeParams");
+  bounds_params.DumpJson(&json);
+  json.PutString("urls");
+  json.BeginObject();
   // Pass 2: quantize, optimize, compress, report.
   FILE* utf8_out_fp = fopen(argv[2], "wb");
   CHECK(utf8_out_fp != NULL);
-  fprintf(json_out, "    \"%s\": [\n", argv[2]);
+  json.PutString(argv[2]);
+  json.BeginArray();
   webgl_loader::FileSink utf8_sink(utf8_out_fp);
   size_t offset = 0;
   MaterialBatches::const_iterator iter = batches.begin();
@@ -114,22 +120,19 @@ int main(int argc, const char* argv[]) {
       offset += num_attribs + num_indices;
     }
     for (size_t i = 0; i < webgl_meshes.size(); ++i) {
-      fprintf(json_out,
-              "      { \"material\": \"%s\",\n"
-              "        \"attribRange\": [" PRIuS ", " PRIuS "],\n"
-              "        \"indexRange\": [" PRIuS ", " PRIuS "]\n"
-              "      }",
-              material[i].c_str(),
-              attrib_start[i], attrib_length[i],
-              index_start[i], index_length[i]);
-      if (i != webgl_meshes.size() - 1) {
-        fputs(",\n", json_out);
-      }
+      json.BeginObject();
+      json.PutString("material");
+      json.PutString(material[i].c_str());
+      json.PutString("attribRange");
+      const size_t attrib_range[2] = { attrib_start[i], attrib_length[i] };
+      json.PutUintArray(attrib_range, 2);
+      json.PutString("indexRange");
+      const size_t index_range[2] = { index_start[i], index_length[i] };
+      json.PutUintArray(index_range, 2);
+      json.End();
     }
-    const bool last = (++iter == batches.end());
-    fputs(",\n" + last, json_out);
+    ++iter;
   }
-  fputs("    ]\n", json_out);
-  fputs("  }\n}", json_out);
+  json.EndAll();
   return 0;
 }
@@ -1,5 +1,5 @@
 #if 0  // A cute trick to making this .cc self-building from shell.
-g++ $0 -O2 -Wall -Werror -o `basename $0 .cc`;
+g++ $0 -O2 -Wall -Werror -pthread -o `basename $0 .cc`;
 exit;
 #endif
 // Copyright 2011 Google Inc. All Rights Reserved.
@@ -16,123 +16,174 @@ exit;
 // implied. See the License for the specific language governing
 // permissions and limitations under the License.
 
-#include "bounds.h"
-#include "compress.h"
+#include "build_cache.h"
+#include "convert.h"
+#include "convert_server.h"
+#include "json.h"
+#include "manifest.h"
 #include "mesh.h"
-#include "optimize.h"
 #include "stream.h"
 
+// For --binary-manifest.
+void WriteBinaryManifest(const webgl_loader::Manifest& manifest,
+                         const char* path) {
+  FILE* fp = fopen(path, "wb");
+  CHECK(fp != NULL);
+  webgl_loader::BufferedFileSink sink(fp);
+  webgl_loader::BinaryManifestWriter writer(&sink);
+  writer.Write(manifest);
+  sink.Flush();
+  fclose(fp);
+}
+
 int main(int argc, const char* argv[]) {
+  const char* const tool_path = argv[0];
   FILE* json_out = stdout;
+  webgl_loader::ConvertOptions options;
+  options.num_threads = webgl_loader::NumProcessors();
+  const char* binary_manifest_path = NULL;
+  const char* daemon_path = NULL;
+  const char* cache_dir = NULL;
+  uint64 cache_bytes = 0;
+  int num_threads = webgl_loader::NumProcessors();
+  int max_queued = 64;
+  while (argc > 1) {
+    int num_args = webgl_loader::ParseConvertFlag(argc - 1, argv + 1,
+                                                  &options);
+    if (num_args != 0) {
+      // Parsed.
+    } else if (0 == strcmp(argv[1], "--binary-manifest") && argc > 2) {
+      binary_manifest_path = argv[2];
+      num_args = 2;
+    } else if (0 == strcmp(argv[1], "--daemon") && argc > 2) {
+      daemon_path = argv[2];
+      num_args = 2;
+    } else if (0 == strcmp(argv[1], "--cache") && argc > 2) {
+      cache_dir = argv[2];
+      num_args = 2;
+    } else if (0 == strcmp(argv[1], "--cache-size") && argc > 2) {
+      cache_bytes = strtoull(argv[2], NULL, 10) << 20;
+      num_args = 2;
+    } else if (0 == strcmp(argv[1], "--threads") && argc > 2 &&
+               (num_threads = atoi(argv[2])) > 0) {
+      num_args = 2;
+    } else if (0 == strcmp(argv[1], "--queue") && argc > 2 &&
+               (max_queued = atoi(argv[2])) >= 0) {
+      num_args = 2;
+    } else {
+      break;
+    }
+    argc -= num_args;
+    argv += num_args;
+  }
+  webgl_loader::BuildCache* cache = NULL;
+  if (cache_dir != NULL) {
+    cache = new webgl_loader::BuildCache(cache_dir);
+    if (!cache->ok()) {
+      fprintf(stderr, "%s: %s\n", cache_dir, strerror(errno));
+      return -1;
+    }
+    // out is written over in place, so entries can't share its inode.
+    cache->set_copy_outputs(true);
+    // Any change to the tool might change what it writes.
+    options.tool_hash = webgl_loader::ToolHash(tool_path);
+    options.cache = cache;
+  }
+  if (daemon_path != NULL && argc == 1) {
+    webgl_loader::ConvertServer server(options, num_threads, max_queued);
+    if (!server.Start(daemon_path)) {
+      fprintf(stderr, "%s: %s\n", daemon_path, strerror(errno));
+      return -1;
+    }
+    fprintf(stderr, "%s: serving on %d threads.\n", daemon_path,
+            num_threads);
+    server.Wait();
+    return -1;
+  }
   if (argc != 3 && argc != 4) {
-    fprintf(stderr, "Usage: %s in.obj out.utf8\n\n"
-            "\tCompress in.obj to out.utf8 and writes JS to STDOUT.\n\n",
-            argv[0]);
+    fprintf(stderr, "Usage: %s [--lru | --edgebreaker] [--binary] [--verify] "
+            "[--predictors] [--lod r1,r2,...] [--weld p,t,n] "
+            "[--gpu 2_10_10_10 | --gpu octahedral] [--direct] [--sync]\n"
+            "\t[--stats] [--hash] [--binary-manifest out.manifest]\n"
+            "\t[--cache dir [--cache-size mib]] in.obj out [out.json]\n"
+            "   or: %s [flags] --daemon socket [--threads n] [--queue n]\n\n"
+            "\tCompress in.obj to out and writes JS to STDOUT.\n"
+            "\t--lru encodes edge matches with a move-to-front edge cache.\n"
+            "\t--edgebreaker codes connectivity with edgebreaker.h, and\n"
+            "\t  renumbers vertices in the order it visits them.\n"
+            "\t--binary range codes the output instead of using UTF-8.\n"
+            "\t--verify decodes out, and checks it against in.obj.\n"
+            "\t--predictors also re-predicts attributes with predict.h,\n"
+            "\t  for loaders that read the \"predictors\" entry.\n"
+            "\t--lod also writes simplified levels of detail, with these\n"
+            "\t  decreasing fractions of the triangles, to out.lod1, ...\n"
+            "\t--weld merges vertices whose quantized positions, texcoords\n"
+            "\t  and normals are within p, t and n quanta; 0,0,0 merges\n"
+            "\t  only vertices that quantize the same.\n"
+            "\t--gpu writes vertex and index buffers that can be uploaded\n"
+            "\t  as they are (see gpu.h), with normals in that format.\n"
+            "\t--direct writes out with O_DIRECT, past the page cache.\n"
+            "\t--sync waits for out to reach the disk before exiting.\n"
+            "\t--stats prints the size and byte entropy of each output.\n"
+            "\t--hash prints the Hash64 of each output.\n"
+            "\t--binary-manifest also writes the manifest in the compact\n"
+            "\t  binary form of manifest.h.\n"
+            "\t--cache reuses what was built before for models whose\n"
+            "\t  inputs haven't changed, from dir, and --cache-size then\n"
+            "\t  removes the least recently used down to mib MiB.\n"
+            "\t--daemon converts jobs from clients of a Unix domain socket\n"
+            "\t  (see convert_server.h), n at a time, with up to n more\n"
+            "\t  queued, on top of the flags before it.\n\n",
+            argv[0], argv[0]);
     return -1;
   } else if (argc == 4) {
     json_out = fopen(argv[3], "w");
     CHECK(json_out != NULL);
   }
 
-  FILE* fp = fopen(argv[1], "r");
-  WavefrontObjFile obj(fp);
-  fclose(fp);
-
-  fputs("{\n  \"materials\": {\n", json_out);
-  const MaterialList& materials = obj.materials();
-  for (size_t i = 0; i < materials.size(); ++i) {
-    materials[i].DumpJson(json_out);
-    const bool last = i == materials.size() - 1;
-    fputs(",\n" + last, json_out);
-  }
-  fputs("  },\n", json_out);
-  
-  const MaterialBatches& batches = obj.material_batches();
-
-  // Pass 1: compute bounds.
-  webgl_loader::Bounds bounds;
-  bounds.Clear();
-  for (MaterialBatches::const_iterator iter = batches.begin();
-       iter != batches.end(); ++iter) {
-    const DrawBatch& draw_batch = iter->second;
-    bounds.Enclose(draw_batch.draw_mesh().attribs);
-  }
-  webgl_loader::BoundsParams bounds_params = 
-      webgl_loader::BoundsParams::FromBounds(bounds);
-  fputs("  \"decodeParams\": ", json_out);
-  bounds_params.DumpJson(json_out);
-  fputs(",\n  \"urls\": {\n", json_out);
-  // Pass 2: quantize, optimize, compress, report.
-  FILE* utf8_out_fp = fopen(argv[2], "wb");
-  CHECK(utf8_out_fp != NULL);
-  fprintf(json_out, "    \"%s\": [\n", argv[2]);
-  webgl_loader::FileSink utf8_sink(utf8_out_fp);
-  size_t offset = 0;
-  MaterialBatches::const_iterator iter = batches.begin();
-  while (iter != batches.end()) {
-    const DrawMesh& draw_mesh = iter->second.draw_mesh();
-    if (draw_mesh.indices.empty()) {
-      ++iter;
-      continue;
+  webgl_loader::Manifest manifest;
+  bool verified = true;
+  bool hit = false;
+  uint64 key = 0;
+  if (cache != NULL) {
+    webgl_loader::Hash64 inputs;
+    if (!webgl_loader::HashObjInputs(argv[1], &inputs)) {
+      fprintf(stderr, "%s: %s\n", argv[1], strerror(errno));
+      return -1;
     }
-    QuantizedAttribList quantized_attribs;
-    webgl_loader::AttribsToQuantizedAttribs(draw_mesh.attribs, bounds_params,
-					    &quantized_attribs);
-    VertexOptimizer vertex_optimizer(quantized_attribs);
-    const std::vector<GroupStart>& group_starts = iter->second.group_starts();
-    WebGLMeshList webgl_meshes;
-    std::vector<size_t> group_lengths;
-    for (size_t i = 1; i < group_starts.size(); ++i) {
-      const size_t here = group_starts[i-1].offset;
-      const size_t length = group_starts[i].offset - here;
-      group_lengths.push_back(length);
-      vertex_optimizer.AddTriangles(&draw_mesh.indices[here], length,
-                                    &webgl_meshes);
-    }
-    const size_t here = group_starts.back().offset;
-    const size_t length = draw_mesh.indices.size() - here;
-    CHECK(length % 3 == 0);
-    group_lengths.push_back(length);
-    vertex_optimizer.AddTriangles(&draw_mesh.indices[here], length,
-                                  &webgl_meshes);
+    key = webgl_loader::ConvertKey(options, inputs, argv[2]);
+    hit = webgl_loader::FetchConverted(options, key, argv[2], &manifest);
+  }
+  if (!hit) {
+    FILE* fp = fopen(argv[1], "r");
+    WavefrontObjFile obj(fp);
+    fclose(fp);
 
-    std::vector<std::string> material;
-    // TODO: is this buffering still necessary?
-    std::vector<size_t> attrib_start, attrib_length, 
-        code_start, code_length, num_tris;
-    for (size_t i = 0; i < webgl_meshes.size(); ++i) {
-      const size_t num_attribs = webgl_meshes[i].attribs.size();
-      const size_t num_indices = webgl_meshes[i].indices.size();
-      CHECK(num_attribs % 8 == 0);
-      CHECK(num_indices % 3 == 0);
-      webgl_loader::EdgeCachingCompressor compressor(webgl_meshes[i].attribs,
-                                                     webgl_meshes[i].indices);
-      compressor.Compress(&utf8_sink);
-      material.push_back(iter->first);
-      attrib_start.push_back(offset);
-      attrib_length.push_back(num_attribs / 8);
-      code_start.push_back(offset + num_attribs);
-      code_length.push_back(compressor.codes().size());
-      num_tris.push_back(num_indices / 3);
-      offset += num_attribs + compressor.codes().size();
+    std::string error;
+    if (!webgl_loader::ConvertObj(options, obj, argv[2], &manifest,
+                                  &verified, &error)) {
+      fprintf(stderr, "%s\n", error.c_str());
+      return -1;
     }
-    for (size_t i = 0; i < webgl_meshes.size(); ++i) {
-      fprintf(json_out,
-              "      { \"material\": \"%s\",\n"
-              "        \"attribRange\": [" PRIuS ", " PRIuS "],\n"
-              "        \"codeRange\": [" PRIuS ", " PRIuS ", " PRIuS "]\n"
-              "      }",
-              material[i].c_str(),
-              attrib_start[i], attrib_length[i],
-              code_start[i], code_length[i], num_tris[i]);
-      if (i != webgl_meshes.size() - 1) {
-        fputs(",\n", json_out);
-      }
+    // One that didn't verify is converted again next time.
+    if (cache != NULL && verified &&
+        !webgl_loader::StoreConverted(options, key, manifest)) {
+      fprintf(stderr, "WARNING: %s couldn't be cached: %s\n", argv[1],
+              strerror(errno));
     }
-    const bool last = (++iter == batches.end());
-    fputs(",\n" + last, json_out);
   }
-  fputs("    ]\n", json_out);
-  fputs("  }\n}", json_out);
-  return 0;
+  {
+    webgl_loader::BufferedFileSink json_sink(json_out);
+    webgl_loader::JsonSink json(&json_sink);
+    json.set_pretty_depth(3);
+    webgl_loader::WriteJsonManifest(manifest, &json);
+  }
+  if (binary_manifest_path != NULL) {
+    WriteBinaryManifest(manifest, binary_manifest_path);
+  }
+  if (cache != NULL) {
+    webgl_loader::ReportCache(*cache, hit ? 1 : 0, 1, cache_bytes);
+    delete cache;
+  }
+  return verified ? 0 : 1;
 }
@@ -0,0 +1,313 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "bounds.h"
+#include "compress.h"
+#include "decompress.h"
+#include "gpu.h"
+#include "mesh.h"
+#include "optimize.h"
+#include "stream.h"
+#include "timer.h"
+#include "utf8.h"
+
+// Compares the output sizes and decode speeds of the different
+// encodings.
+namespace webgl_loader {
+
+enum Encoding {
+  ENCODING_UTF8,            // As in obj2utf8 and objcompress.
+  ENCODING_BACKREF,         // |EdgeCachingCompressor::Compress|.
+  ENCODING_LRU,             // |EdgeCachingCompressor::CompressWithLRU|.
+  ENCODING_LRU_TRAVERSAL,   // Without the predictors in predict.h.
+  ENCODING_EDGEBREAKER,     // |EdgeCachingCompressor::EncodeWithEdgebreaker|.
+  ENCODING_BINARY_BACKREF,  // |EdgeCachingCompressor::EmitBinary|.
+  ENCODING_BINARY_LRU,
+  ENCODING_BINARY_EDGEBREAKER,
+  ENCODING_GPU_2_10_10_10,  // |WriteGpuMeshes|, which isn't decoded.
+  ENCODING_GPU_OCTAHEDRAL,
+  NUM_ENCODINGS
+};
+
+const char* const kEncodingNames[NUM_ENCODINGS] = {
+  "utf8", "backref", "lru", "lru-traversal", "edgebreaker",
+  "binary-backref", "binary-lru", "binary-edgebreaker",
+  "gpu-2_10_10_10", "gpu-octahedral"
+};
+
+// Decoding is timed over this many repetitions, to get past the
+// timer resolution for small models.
+const int kNumDecodeRuns = 10;
+// Input is pushed to the decoder in pieces of this size, as if it
+// were arriving over the network.
+const size_t kPushSize = 64 * 1024;
+
+struct EncodingStats {
+  size_t bytes;
+  // The part of |bytes| for indices, rather than attributes.
+  size_t index_bytes;
+  size_t codes;
+  double decode_seconds;
+};
+
+size_t Utf8Bytes(const OptimizedIndexList& codes) {
+  size_t length = 0;
+  if (!codes.empty()) {
+    CHECK(Utf8Length(&codes[0], codes.size(), &length));
+  }
+  return length;
+}
+
+// All the meshes of an encoding, as a single file and its manifest.
+// The GPU encodings have no manifest, and keep their meshes to write
+// once they have all been seen.
+struct EncodedModel {
+  std::string bytes;
+  std::vector<MeshEntry> entries;
+  size_t num_words;
+  WebGLMeshList gpu_meshes;
+};
+
+bool IsGpuEncoding(Encoding encoding) {
+  return encoding == ENCODING_GPU_2_10_10_10 ||
+      encoding == ENCODING_GPU_OCTAHEDRAL;
+}
+
+// Writes the meshes of a GPU encoding to its bytes.
+void FinishGpuEncoding(Encoding encoding, const BoundsParams& params,
+                       EncodingStats* stats, EncodedModel* model) {
+  StringSink sink(&model->bytes);
+  WriteGpuMeshes(params, (encoding == ENCODING_GPU_OCTAHEDRAL) ?
+                 GPU_NORMALS_OCTAHEDRAL : GPU_NORMALS_INT_2_10_10_10,
+                 model->gpu_meshes, &sink);
+  stats->bytes = model->bytes.size();
+}
+
+// |mesh| is passed by value, since the edge caching compressors
+// rotate triangles in place.
+void Encode(Encoding encoding, WebGLMesh mesh, EncodingStats* stats,
+            EncodedModel* model) {
+  if (IsGpuEncoding(encoding)) {
+    stats->index_bytes += sizeof(uint16) * mesh.indices.size();
+    stats->codes += mesh.attribs.size() + mesh.indices.size();
+    model->gpu_meshes.push_back(mesh);
+    return;
+  }
+  StringSink sink(&model->bytes);
+  const size_t start_bytes = model->bytes.size();
+  MeshEntry entry;
+  entry.attrib_start = model->num_words;
+  entry.num_verts = mesh.attribs.size() / 8;
+  entry.code_start = model->num_words + mesh.attribs.size();
+  entry.num_tris = mesh.indices.size() / 3;
+  size_t codes = mesh.attribs.size();
+  switch (encoding) {
+    case ENCODING_UTF8:
+      CompressQuantizedAttribsToUtf8(mesh.attribs, &sink);
+      stats->index_bytes -= model->bytes.size();
+      CompressIndicesToUtf8(mesh.indices, &sink);
+      stats->index_bytes += model->bytes.size();
+      entry.format = MESH_FORMAT_INDEX_RANGE;
+      entry.code_length = mesh.indices.size();
+      codes += mesh.indices.size();
+      break;
+    case ENCODING_BACKREF:
+    case ENCODING_LRU:
+    case ENCODING_LRU_TRAVERSAL:
+    case ENCODING_EDGEBREAKER:
+    case ENCODING_BINARY_BACKREF:
+    case ENCODING_BINARY_LRU:
+    case ENCODING_BINARY_EDGEBREAKER: {
+      EdgeCachingCompressor compressor(mesh.attribs, mesh.indices);
+      compressor.set_choose_predictors(encoding != ENCODING_LRU_TRAVERSAL);
+      if (encoding == ENCODING_LRU || encoding == ENCODING_LRU_TRAVERSAL ||
+          encoding == ENCODING_BINARY_LRU) {
+        compressor.EncodeWithLRU();
+        entry.format = MESH_FORMAT_LRU_CODE_RANGE;
+      } else if (encoding == ENCODING_EDGEBREAKER ||
+                 encoding == ENCODING_BINARY_EDGEBREAKER) {
+        compressor.EncodeWithEdgebreaker();
+        entry.format = MESH_FORMAT_EDGEBREAKER_CODE_RANGE;
+      } else {
+        compressor.Encode();
+        entry.format = MESH_FORMAT_CODE_RANGE;
+      }
+      entry.code_length = compressor.codes().size();
+      entry.predictors = compressor.predictors();
+      if (encoding == ENCODING_BINARY_BACKREF ||
+          encoding == ENCODING_BINARY_LRU ||
+          encoding == ENCODING_BINARY_EDGEBREAKER) {
+        compressor.EmitBinary(&sink);
+        entry.format = MESH_FORMAT_BINARY_RANGE;
+        entry.code_start = start_bytes;
+        entry.code_length = model->bytes.size() - start_bytes;
+        std::string codes;
+        StringSink codes_sink(&codes);
+        RangeEncoder encoder(&codes_sink);
+        compressor.EncodeCodes(&encoder);
+        encoder.Flush();
+        stats->index_bytes += codes.size();
+      } else {
+        compressor.EmitUtf8(&sink);
+        stats->index_bytes += Utf8Bytes(compressor.codes());
+      }
+      codes += compressor.codes().size();
+      break;
+    }
+    default:
+      CHECK(false);
+  }
+  model->num_words = entry.End();
+  model->entries.push_back(entry);
+  stats->bytes += model->bytes.size() - start_bytes;
+  stats->codes += codes;
+}
+
+// Stands in for bufferData, by copying each buffer once, so that
+// decoding is timed from the bytes of a file to the point they could
+// be drawn.
+class UploadSink : public MeshSinkInterface {
+ public:
+  virtual void PutMesh(const MeshEntry&, const DecodedMesh& mesh) {
+    Upload(&mesh.attribs[0], sizeof(float) * mesh.attribs.size());
+    Upload(&mesh.indices[0], sizeof(uint16) * mesh.indices.size());
+  }
+
+  void Upload(const void* data, size_t size) {
+    staging_.resize(std::max(staging_.size(), size));
+    if (size > 0) memcpy(&staging_[0], data, size);
+  }
+
+ private:
+  std::vector<char> staging_;
+};
+
+// Decodes |model| as a loader would, from bytes to meshes, and
+// uploads them.
+void Decode(Encoding encoding, const EncodedModel& model,
+            const BoundsParams& params) {
+  UploadSink sink;
+  if (IsGpuEncoding(encoding)) {
+    GpuMeshFile file;
+    CHECK(file.Parse(model.bytes.data(), model.bytes.size()));
+    for (size_t i = 0; i < file.num_meshes(); ++i) {
+      const GpuMeshView& mesh = file.mesh(i);
+      sink.Upload(mesh.vertices, kGpuVertexStride * mesh.num_verts);
+      sink.Upload(mesh.indices, sizeof(uint16) * mesh.num_indices);
+    }
+    return;
+  }
+  MeshStreamDecoder decoder(params, model.entries, &sink);
+  for (size_t i = 0; i < model.bytes.size(); i += kPushSize) {
+    const size_t length = std::min(kPushSize, model.bytes.size() - i);
+    CHECK(decoder.Push(&model.bytes[i], length));
+  }
+  CHECK(decoder.Finish());
+}
+
+}  // namespace webgl_loader
+
+int main(int argc, const char* argv[]) {
+  using namespace webgl_loader;
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s in.obj\n\n"
+            "\tCompare the output size and decode speed of each encoding\n"
+            "\tof in.obj.\n\n",
+            argv[0]);
+    return -1;
+  }
+  FILE* fp = fopen(argv[1], "r");
+  CHECK(fp != NULL);
+  WavefrontObjFile obj(fp);
+  fclose(fp);
+
+  const MaterialBatches& batches = obj.material_batches();
+  Bounds bounds;
+  bounds.Clear();
+  for (MaterialBatches::const_iterator iter = batches.begin();
+       iter != batches.end(); ++iter) {
+    bounds.Enclose(iter->second.draw_mesh().attribs);
+  }
+  const BoundsParams bounds_params = BoundsParams::FromBounds(bounds);
+
+  EncodingStats stats[NUM_ENCODINGS] = { { 0, 0, 0, 0.0 } };
+  EncodedModel encoded[NUM_ENCODINGS];
+  for (int e = 0; e < NUM_ENCODINGS; ++e) {
+    encoded[e].num_words = 0;
+  }
+  size_t num_verts = 0, num_tris = 0;
+  for (MaterialBatches::const_iterator iter = batches.begin();
+       iter != batches.end(); ++iter) {
+    const DrawMesh& draw_mesh = iter->second.draw_mesh();
+    if (draw_mesh.indices.empty()) continue;
+    QuantizedAttribList quantized_attribs;
+    AttribsToQuantizedAttribs(draw_mesh.attribs, bounds_params,
+                              &quantized_attribs);
+    VertexOptimizer vertex_optimizer(quantized_attribs);
+    const std::vector<GroupStart>& group_starts = iter->second.group_starts();
+    WebGLMeshList webgl_meshes;
+    for (size_t i = 0; i < group_starts.size(); ++i) {
+      const size_t here = group_starts[i].offset;
+      const size_t end = (i + 1 < group_starts.size()) ?
+          group_starts[i + 1].offset : draw_mesh.indices.size();
+      vertex_optimizer.AddTriangles(&draw_mesh.indices[here], end - here,
+                                    &webgl_meshes);
+    }
+    for (size_t i = 0; i < webgl_meshes.size(); ++i) {
+      num_verts += webgl_meshes[i].attribs.size() / 8;
+      num_tris += webgl_meshes[i].indices.size() / 3;
+      for (int e = 0; e < NUM_ENCODINGS; ++e) {
+        Encode(static_cast<Encoding>(e), webgl_meshes[i], &stats[e],
+               &encoded[e]);
+      }
+    }
+  }
+
+  for (int e = 0; e < NUM_ENCODINGS; ++e) {
+    if (IsGpuEncoding(static_cast<Encoding>(e))) {
+      FinishGpuEncoding(static_cast<Encoding>(e), bounds_params, &stats[e],
+                        &encoded[e]);
+    }
+  }
+
+  for (int e = 0; e < NUM_ENCODINGS; ++e) {
+    Timer timer;
+    for (int run = 0; run < kNumDecodeRuns; ++run) {
+      Decode(static_cast<Encoding>(e), encoded[e], bounds_params);
+    }
+    stats[e].decode_seconds = timer.ElapsedSeconds() / kNumDecodeRuns;
+  }
+
+  printf(PRIuS " vertices, " PRIuS " triangles\n\n", num_verts, num_tris);
+  puts("||Encoding||Bytes||Codes||Bits/Triangle||Index Bits/Triangle"
+       "||Decode MB/s||Decode Mtri/s||Load-to-draw ms||");
+  for (int e = 0; e < NUM_ENCODINGS; ++e) {
+    printf("||%s||" PRIuS "||" PRIuS "||%.3f||%.3f||%.1f||%.2f||%.3f||\n",
+           kEncodingNames[e], stats[e].bytes, stats[e].codes,
+           8.0 * stats[e].bytes / num_tris,
+           8.0 * stats[e].index_bytes / num_tris,
+           stats[e].bytes / stats[e].decode_seconds / 1e6,
+           num_tris / stats[e].decode_seconds / 1e6,
+           1e3 * stats[e].decode_seconds);
+  }
+  return 0;
+}
@@ -0,0 +1,661 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_OBJCOMPRESS_H_
+#define WEBGL_LOADER_OBJCOMPRESS_H_
+
+// objcompress's pipeline, from OBJ files to UTF-8 mesh files and the
+// JS that loads them, one model at a time or many on a thread pool.
+// Tools that include this must be built with -pthread.
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "async_sink.h"
+#include "bounds.h"
+#include "build_cache.h"
+#include "compress.h"
+#include "decompress.h"
+#include "hash_sink.h"
+#include "instance.h"
+#include "json.h"
+#include "mesh.h"
+#include "optimize.h"
+#include "stream.h"
+#include "thread.h"
+
+// Where part of a group was written: its url, the index of its mesh
+// there, and its index in that mesh's "names".
+struct GroupPiece {
+  std::string url;
+  size_t mesh;
+  size_t group;
+};
+
+// A group that is drawn from an earlier one, for --dedup.
+struct GroupCopy {
+  std::string name;
+  std::string material;
+  webgl_loader::GroupInstance instance;
+};
+
+// The number of indices in group |i| of |batch|.
+size_t GroupLength(const DrawBatch& batch, size_t i) {
+  const std::vector<GroupStart>& group_starts = batch.group_starts();
+  const size_t end = (i + 1 < group_starts.size()) ?
+      group_starts[i + 1].offset : batch.draw_mesh().indices.size();
+  return end - group_starts[i].offset;
+}
+
+// About how many bytes |group| would have taken to write out.
+size_t CopyBytes(const webgl_loader::CanonicalGroup& group) {
+  std::string utf8;
+  webgl_loader::StringSink sink(&utf8);
+  webgl_loader::CompressQuantizedAttribsToUtf8(group.attribs, &sink);
+  for (size_t i = 0; i < group.indices.size(); ++i) {
+    webgl_loader::Uint16ToUtf8(group.indices[i] & 0xFFFF, &sink);
+  }
+  // And its bounding box.
+  return utf8.size() + 6;
+}
+
+// Reports that |path| couldn't be written, for |error|, an errno, and
+// removes it. Returns false.
+bool WriteFailed(const std::string& path, int error) {
+  fprintf(stderr, "%s: %s\n", path.c_str(), strerror(error));
+  unlink(path.c_str());
+  return false;
+}
+
+struct CompressOptions {
+  CompressOptions()
+      : verify(false),
+        dedup(false),
+        file_flags(0),
+        num_threads(webgl_loader::NumProcessors()),
+        cache(NULL),
+        tool_hash(0) {
+  }
+
+  bool verify;
+  bool dedup;
+  int file_flags;  // For |AsyncFileSink::Open|.
+  int num_threads;  // For --dedup's search.
+  webgl_loader::BuildCache* cache;  // For --cache, or NULL.
+  // Of this tool, for cache keys, so that a rebuilt one starts afresh.
+  uint64 tool_hash;
+};
+
+// Compresses the OBJ at |obj_path|, and writes its JS to |js_sink|:
+// the JSON object that follows |PutModelAssignment|'s. Each output is
+// written through |out_file| to |temp_path|, then named for its
+// contents and |suffix|, and the name added to |out_fns|. Meshes that
+// don't verify are added to |num_mismatches|.
+// Returns false, having said why, if the OBJ couldn't be read or
+// parsed, or an output written.
+bool CompressModel(const CompressOptions& options, const char* obj_path,
+                   const std::string& suffix, const std::string& temp_path,
+                   webgl_loader::AsyncFileSink* out_file,
+                   webgl_loader::BufferedSink* js_sink,
+                   size_t* num_mismatches,
+                   std::vector<std::string>* out_fns) {
+  FILE* fp = fopen(obj_path, "r");
+  if (!fp) {
+    fprintf(stderr, "%s: %s\n", obj_path, strerror(errno));
+    return false;
+  }
+  // A malformed OBJ fails this model, rather than exiting, so that
+  // a batch carries on without it.
+  std::vector<char> buf(64 * 1024);
+  webgl_loader::BufferedInputStream input(fp, &buf[0], buf.size());
+  std::string error;
+  WavefrontObjFile obj(&input, obj_path, &error);
+  fclose(fp);
+  if (!error.empty()) {
+    fprintf(stderr, "%s: %s\n", obj_path, error.c_str());
+    return false;
+  }
+
+  webgl_loader::JsonSink json(js_sink);
+  json.set_pretty_depth(3);
+  json.BeginObject();
+  json.PutString("materials");
+  json.BeginObject();
+  const MaterialList& materials = obj.materials();
+  for (size_t i = 0; i < materials.size(); ++i) {
+    materials[i].DumpJson(&json);
+  }
+  json.End();
+  
+  const MaterialBatches& batches = obj.material_batches();
+
+  // Pass 1: compute bounds.
+  webgl_loader::Bounds bounds;
+  bounds.Clear();
+  for (MaterialBatches::const_iterator iter = batches.begin();
+       iter != batches.end(); ++iter) {
+    const DrawBatch& draw_batch = iter->second;
+    bounds.Enclose(draw_batch.draw_mesh().attribs);
+  }
+  webgl_loader::BoundsParams bounds_params = 
+    webgl_loader::BoundsParams::FromBounds(bounds);
+  json.PutString("decodeParams");
+  bounds_params.DumpJson(&json);
+
+  // For --dedup, find every copy up front, so that the search can run
+  // in parallel. Group ids are in order over all batches.
+  webgl_loader::InstanceFinder instance_finder(bounds_params);
+  if (options.dedup) {
+    for (MaterialBatches::const_iterator iter = batches.begin();
+         iter != batches.end(); ++iter) {
+      const DrawMesh& draw_mesh = iter->second.draw_mesh();
+      if (draw_mesh.indices.empty()) continue;
+      const std::vector<GroupStart>& group_starts =
+          iter->second.group_starts();
+      for (size_t i = 0; i < group_starts.size(); ++i) {
+        instance_finder.AddGroup(draw_mesh.attribs,
+                                 &draw_mesh.indices[group_starts[i].offset],
+                                 GroupLength(iter->second, i));
+      }
+    }
+    instance_finder.Find(options.num_threads);
+  }
+
+  json.PutString("urls");
+  json.BeginObject();
+  std::vector<std::vector<GroupPiece> > pieces_by_id(
+      instance_finder.num_groups());
+  std::vector<GroupCopy> copies;
+  size_t num_groups = 0, num_transformed = 0, copy_bytes = 0;
+  // Each file is written out, on another thread, and hashed as it is
+  // compressed, and named for its hash once it is finished.
+  webgl_loader::HashingSink hashing_sink(out_file);
+  webgl_loader::BufferedSinkAdapter sink(&hashing_sink);
+  // Pass 2: quantize, optimize, compress, report.
+  for (MaterialBatches::const_iterator iter = batches.begin();
+       iter != batches.end(); ++iter) {
+    size_t offset = 0;
+    const DrawMesh& draw_mesh = iter->second.draw_mesh();
+    if (draw_mesh.indices.empty()) continue;
+    
+    QuantizedAttribList quantized_attribs;
+    webgl_loader::AttribsToQuantizedAttribs(draw_mesh.attribs, bounds_params,
+					    &quantized_attribs);
+    VertexOptimizer vertex_optimizer(quantized_attribs);
+    const std::vector<GroupStart>& group_starts = iter->second.group_starts();
+    WebGLMeshList webgl_meshes;
+    // Of the groups that are written out, rather than drawn from an
+    // earlier copy.
+    std::vector<size_t> group_indices;
+    std::vector<size_t> group_lengths;
+    std::vector<int> group_ids;
+    for (size_t i = 0; i < group_starts.size(); ++i) {
+      const size_t here = group_starts[i].offset;
+      const size_t length = GroupLength(iter->second, i);
+      const bool divisible_by_3 = length % 3 == 0;
+      CHECK(divisible_by_3);
+      int id = -1;
+      if (options.dedup) {
+        id = static_cast<int>(num_groups++);
+        const webgl_loader::GroupInstance& instance =
+            instance_finder.instance(id);
+        if (instance.source >= 0) {
+          GroupCopy copy;
+          copy.name = obj.LineToGroup(group_starts[i].group_line);
+          copy.material = iter->first;
+          copy.instance = instance;
+          copies.push_back(copy);
+          if (!instance.IsTranslation()) ++num_transformed;
+          copy_bytes += CopyBytes(instance_finder.canonical(id));
+          continue;
+        }
+      }
+      group_indices.push_back(i);
+      group_lengths.push_back(length);
+      group_ids.push_back(id);
+      vertex_optimizer.AddTriangles(&draw_mesh.indices[here], length,
+                                    &webgl_meshes);
+    }
+    if (webgl_meshes.empty()) continue;
+
+    if (!out_file->Open(temp_path.c_str(), options.file_flags)) {
+      fprintf(stderr, "%s: %s\n", temp_path.c_str(), strerror(errno));
+      return false;
+    }
+    hashing_sink.Reset();
+    std::vector<webgl_loader::MeshEntry> entries(webgl_meshes.size());
+    std::vector<std::string> material;
+    std::vector<size_t> attrib_start, attrib_length, index_start, index_length;
+    for (size_t i = 0; i < webgl_meshes.size(); ++i) {
+      const size_t num_attribs = webgl_meshes[i].attribs.size();
+      const size_t num_indices = webgl_meshes[i].indices.size();
+      const bool kBadSizes = num_attribs % 8 || num_indices % 3;
+      CHECK(!kBadSizes);
+      webgl_loader::CompressQuantizedAttribsToUtf8(webgl_meshes[i].attribs, 
+						   &sink);
+      webgl_loader::CompressIndicesToUtf8(webgl_meshes[i].indices, &sink);
+      material.push_back(iter->first);
+      attrib_start.push_back(offset);
+      attrib_length.push_back(num_attribs / 8);
+      index_start.push_back(offset + num_attribs);
+      index_length.push_back(num_indices / 3);
+      offset += num_attribs + num_indices;
+    }
+    // Each mesh's bounding boxes, one per group or piece of a group,
+    // follow all of the meshes. A group split between meshes starts
+    // one and ends the last.
+    std::vector<size_t> first_group(webgl_meshes.size());
+    std::vector<std::vector<size_t> > buffered_lengths(webgl_meshes.size());
+    // What each mesh's bboxes should decode to, for --verify.
+    std::vector<QuantizedAttribList> bbox_words(webgl_meshes.size());
+    size_t group_index = 0;
+    for (size_t i = 0; i < webgl_meshes.size(); ++i) {
+      first_group[i] = group_index;
+      size_t group_start = 0;
+      while (group_index < group_lengths.size()) {
+        const GroupStart& group = group_starts[group_indices[group_index]];
+        const size_t group_length = group_lengths[group_index];
+        const size_t next_start = group_start + group_length;
+        const size_t webgl_index_length = webgl_meshes[i].indices.size();
+        // TODO: bbox info is better placed at the head of the file,
+        // perhaps transposed. Also, when a group gets split between
+        // batches, the bbox gets stored twice.
+	webgl_loader::CompressAABBToUtf8(group.bounds, bounds_params, &sink);
+        if (options.verify) {
+          webgl_loader::QuantizeAABB(group.bounds, bounds_params,
+                                     &bbox_words[i]);
+        }
+        offset += 6;
+        if (next_start < webgl_index_length) {
+          buffered_lengths[i].push_back(group_length);
+          group_start = next_start;
+          ++group_index;
+        } else {
+          const size_t fits = webgl_index_length - group_start;
+          buffered_lengths[i].push_back(fits);
+          group_start = 0;
+          group_lengths[group_index] -= fits;
+          break;
+        }
+      }
+      entries[i].attrib_start = attrib_start[i];
+      entries[i].num_verts = attrib_length[i];
+      entries[i].code_start = index_start[i];
+      entries[i].code_length = 3 * index_length[i];
+      entries[i].num_tris = index_length[i];
+      entries[i].bboxes_start = offset - 6 * buffered_lengths[i].size();
+      entries[i].num_bboxes = buffered_lengths[i].size();
+    }
+    const uint64 hash = hashing_sink.Digest();
+    if (!out_file->Close()) {
+      return WriteFailed(temp_path, out_file->error());
+    }
+    // TODO: this needs to handle paths.
+    std::string out_fn;
+    if (!webgl_loader::RenameToContentName(temp_path, hash, suffix,
+                                           &out_fn)) {
+      return WriteFailed(temp_path, errno);
+    }
+    out_fns->push_back(out_fn);
+    json.PutString(out_fn.c_str());
+    json.BeginArray();
+    for (size_t i = 0; i < webgl_meshes.size(); ++i) {
+      json.BeginObject();
+      json.PutString("material");
+      json.PutString(material[i].c_str());
+      json.PutString("attribRange");
+      const size_t attrib_range[2] = { attrib_start[i], attrib_length[i] };
+      json.PutUintArray(attrib_range, 2);
+      json.PutString("indexRange");
+      const size_t index_range[2] = { index_start[i], index_length[i] };
+      json.PutUintArray(index_range, 2);
+      json.PutString("bboxes");
+      json.PutUint(entries[i].bboxes_start);
+      json.PutString("names");
+      json.BeginArray();
+      const std::vector<size_t>& lengths = buffered_lengths[i];
+      for (size_t k = 0; k < lengths.size(); ++k) {
+        const size_t index = first_group[i] + k;
+        const GroupStart& group = group_starts[group_indices[index]];
+        json.PutString(obj.LineToGroup(group.group_line).c_str());
+        if (options.dedup) {
+          GroupPiece piece = { out_fn, i, k };
+          pieces_by_id[group_ids[index]].push_back(piece);
+        }
+      }
+      json.End();
+      json.PutString("lengths");
+      json.PutUintArray(lengths.empty() ? NULL : &lengths[0], lengths.size());
+      json.End();
+    }
+    json.End();
+    if (options.verify) {
+      FILE* out_fp = fopen(out_fn.c_str(), "rb");
+      CHECK(out_fp != NULL);
+      webgl_loader::MeshVerifier verifier(&webgl_meshes);
+      verifier.set_expected_bboxes(bounds_params, &bbox_words);
+      webgl_loader::MeshStreamDecoder decoder(bounds_params, entries,
+                                              &verifier);
+      if (!webgl_loader::DecodeMeshFile(out_fp, &decoder)) {
+        fprintf(stderr, "%s: failed to decode.\n", out_fn.c_str());
+        ++*num_mismatches;
+      }
+      fclose(out_fp);
+      fprintf(stderr, "%s: verified " PRIuS " of " PRIuS " meshes, "
+              PRIuS " mismatched.\n", out_fn.c_str(), verifier.num_meshes(),
+              webgl_meshes.size(), verifier.num_mismatches());
+      *num_mismatches += verifier.num_mismatches();
+    }
+  }
+  json.End();
+  if (!options.dedup) {
+    json.EndAll();
+    js_sink->PutN(";\n", 2);
+    return true;
+  }
+  // Each copy is drawn as the pieces of its source group. Their
+  // positions p become scale * rotation(p) + offset, and their normals
+  // are rotated; a copy that is only translated leaves out rotation
+  // and scale.
+  json.PutString("instances");
+  json.BeginArray();
+  // One line each.
+  json.set_pretty_depth(2);
+  for (size_t i = 0; i < copies.size(); ++i) {
+    const GroupCopy& copy = copies[i];
+    const webgl_loader::GroupInstance& instance = copy.instance;
+    const std::vector<GroupPiece>& pieces = pieces_by_id[instance.source];
+    for (size_t k = 0; k < pieces.size(); ++k) {
+      json.BeginObject();
+      json.PutString("name");
+      json.PutString(copy.name.c_str());
+      json.PutString("material");
+      json.PutString(copy.material.c_str());
+      json.PutString("url");
+      json.PutString(pieces[k].url.c_str());
+      json.PutString("mesh");
+      json.PutUint(pieces[k].mesh);
+      json.PutString("group");
+      json.PutUint(pieces[k].group);
+      json.PutString("offset");
+      json.PutFloatArray(instance.offset, 3);
+      if (!instance.IsTranslation()) {
+        json.PutString("rotation");
+        json.PutFloatArray(instance.rotation, 4);
+        json.PutString("scale");
+        json.PutFloat(instance.scale);
+      }
+      json.End();
+    }
+  }
+  json.EndAll();
+  js_sink->PutN(";\n", 2);
+  fprintf(stderr, "%s: deduplicated " PRIuS " of " PRIuS " groups (" PRIuS
+          " rotated or scaled), saving about " PRIuS " bytes.\n",
+          obj_path, copies.size(), num_groups, num_transformed, copy_bytes);
+  return true;
+}
+
+// The model is a JSON object, assigned in JavaScript to its name, the
+// last part of |obj_path|.
+void PutModelAssignment(const char* obj_path,
+                        webgl_loader::BufferedSink* js_sink) {
+  webgl_loader::JsonSink json(js_sink);
+  js_sink->PutN("MODELS[", 7);
+  json.PutString(StripLeadingDir(obj_path));
+  js_sink->PutN("] = ", 4);
+}
+
+// Like |CompressModel|, but appends the whole JS to |js|. With
+// --cache, a model whose inputs and options are all as they were when
+// it was cached is taken from there, and |hit| set, rather than
+// compressed and verified again; one that isn't is compressed, and
+// cached unless it failed --verify. The name isn't cached with the
+// rest, so models with the same contents, such as foo.obj and
+// foo.obj.gz, share an entry.
+bool CompressModelCached(const CompressOptions& options,
+                         const char* obj_path, const std::string& suffix,
+                         const std::string& temp_path,
+                         webgl_loader::AsyncFileSink* out_file,
+                         std::string* js, size_t* num_mismatches,
+                         bool* hit) {
+  *hit = false;
+  {
+    webgl_loader::BufferedStringSink js_sink(js);
+    PutModelAssignment(obj_path, &js_sink);
+  }
+  uint64 key = 0;
+  if (options.cache != NULL) {
+    webgl_loader::Hash64 hash;
+    webgl_loader::HashBytes(reinterpret_cast<const char*>(&options.tool_hash),
+                            sizeof(options.tool_hash), &hash);
+    webgl_loader::HashString(options.dedup ? "dedup" : "", &hash);
+    webgl_loader::HashString(suffix, &hash);
+    if (!webgl_loader::HashObjInputs(obj_path, &hash)) {
+      fprintf(stderr, "%s: %s\n", obj_path, strerror(errno));
+      return false;
+    }
+    key = hash.Digest();
+    *hit = options.cache->Fetch(key, js);
+    if (*hit) return true;
+  }
+  const size_t js_start = js->size();
+  const size_t mismatches_before = *num_mismatches;
+  std::vector<std::string> out_fns;
+  bool ok;
+  {
+    webgl_loader::BufferedStringSink js_sink(js);
+    ok = CompressModel(options, obj_path, suffix, temp_path, out_file,
+                       &js_sink, num_mismatches, &out_fns);
+  }
+  // One that didn't verify is compressed again next time.
+  if (ok && options.cache != NULL &&
+      *num_mismatches == mismatches_before &&
+      !options.cache->Store(key, js->substr(js_start), out_fns)) {
+    fprintf(stderr, "WARNING: %s couldn't be cached: %s\n", obj_path,
+            strerror(errno));
+  }
+  return ok;
+}
+
+bool EndsWith(const std::string& str, const char* suffix) {
+  const size_t length = strlen(suffix);
+  return str.size() > length &&
+      0 == str.compare(str.size() - length, length, suffix);
+}
+
+// The OBJs for --batch: each line of the file at |path|, in order, or,
+// if it is a directory, its .obj and .obj.gz files, sorted by name.
+// Returns false, having said why, if |path| couldn't be read.
+bool ListInputs(const char* path, std::vector<std::string>* inputs) {
+  struct stat st;
+  if (0 == stat(path, &st) && S_ISDIR(st.st_mode)) {
+    DIR* dir = opendir(path);
+    if (!dir) {
+      fprintf(stderr, "%s: %s\n", path, strerror(errno));
+      return false;
+    }
+    std::vector<std::string> names;
+    while (const struct dirent* entry = readdir(dir)) {
+      const std::string name = entry->d_name;
+      if (EndsWith(name, ".obj") || EndsWith(name, ".obj.gz")) {
+        names.push_back(name);
+      }
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+    for (size_t i = 0; i < names.size(); ++i) {
+      inputs->push_back(std::string(path) + "/" + names[i]);
+    }
+    return true;
+  }
+  FILE* fp = fopen(path, "r");
+  if (!fp) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return false;
+  }
+  char line[4096];
+  while (fgets(line, sizeof(line), fp)) {
+    size_t length = strlen(line);
+    while (length > 0 && isspace(line[length - 1])) --length;
+    if (length > 0) inputs->push_back(std::string(line, length));
+  }
+  fclose(fp);
+  return true;
+}
+
+// Compresses many OBJs at once, one per call on |WorkStealingFor|. The
+// JS for them all goes to one sink, in the order they were listed,
+// however the threads run: each model's is written once every one
+// before it has been, and kept until then.
+class BatchCompressor {
+ public:
+  BatchCompressor(const CompressOptions& options,
+                  const std::vector<std::string>& obj_paths,
+                  const std::string& suffix,
+                  webgl_loader::BufferedSink* js_sink)
+      : options_(options),
+        obj_paths_(obj_paths),
+        suffix_(suffix),
+        js_sink_(js_sink),
+        pending_(obj_paths.size()),
+        done_(obj_paths.size(), false),
+        num_written_(0) {
+    // Each thread already has a model of its own.
+    options_.num_threads = 1;
+    CHECK(0 == pthread_mutex_init(&mutex_, NULL));
+  }
+
+  ~BatchCompressor() {
+    pthread_mutex_destroy(&mutex_);
+    for (size_t i = 0; i < scratch_.size(); ++i) {
+      delete scratch_[i];
+    }
+  }
+
+  void Run(int num_threads) {
+    char temp_fn[48];
+    for (int i = 0; i < num_threads; ++i) {
+      Scratch* scratch = new Scratch;
+      snprintf(temp_fn, sizeof(temp_fn), ".%d.%d.tmp",
+               static_cast<int>(getpid()), i);
+      scratch->temp_path = suffix_ + temp_fn;
+      scratch_.push_back(scratch);
+    }
+    webgl_loader::WorkStealingFor(obj_paths_.size(), &Compress, this,
+                                  num_threads);
+    CHECK(num_written_ == obj_paths_.size());
+  }
+
+  size_t num_failed() const {
+    size_t num_failed = 0;
+    for (size_t i = 0; i < scratch_.size(); ++i) {
+      num_failed += scratch_[i]->num_failed;
+    }
+    return num_failed;
+  }
+
+  size_t num_mismatches() const {
+    size_t num_mismatches = 0;
+    for (size_t i = 0; i < scratch_.size(); ++i) {
+      num_mismatches += scratch_[i]->num_mismatches;
+    }
+    return num_mismatches;
+  }
+
+  size_t num_hits() const {
+    size_t num_hits = 0;
+    for (size_t i = 0; i < scratch_.size(); ++i) {
+      num_hits += scratch_[i]->num_hits;
+    }
+    return num_hits;
+  }
+
+ private:
+  // What a thread keeps from one model to the next, rather than
+  // allocating it again: the output file's blocks and writer, and
+  // room for the model's JS.
+  struct Scratch {
+    Scratch()
+        : num_failed(0),
+          num_mismatches(0),
+          num_hits(0) {
+    }
+
+    webgl_loader::AsyncFileSink out_file;
+    std::string temp_path;  // Its own, so threads don't collide.
+    std::string js;
+    size_t num_failed;
+    size_t num_mismatches;
+    size_t num_hits;
+  };
+
+  static void Compress(void* self, size_t i, int thread) {
+    BatchCompressor* batch = static_cast<BatchCompressor*>(self);
+    Scratch* scratch = batch->scratch_[thread];
+    scratch->js.clear();
+    bool hit;
+    const bool ok = CompressModelCached(
+        batch->options_, batch->obj_paths_[i].c_str(), batch->suffix_,
+        scratch->temp_path, &scratch->out_file, &scratch->js,
+        &scratch->num_mismatches, &hit);
+    if (hit) ++scratch->num_hits;
+    if (!ok) {
+      // A model that failed is left out.
+      ++scratch->num_failed;
+      scratch->js.clear();
+    }
+    batch->Finish(i, &scratch->js);
+  }
+
+  // Writes |js|, model |i|'s, if every model before it has been, and
+  // then any after it that were waiting on it. Otherwise keeps a copy.
+  void Finish(size_t i, const std::string* js) {
+    webgl_loader::MutexLock lock(&mutex_);
+    if (i != num_written_) {
+      pending_[i] = *js;
+      done_[i] = true;
+      return;
+    }
+    js_sink_->PutN(js->data(), js->size());
+    ++num_written_;
+    while (num_written_ < done_.size() && done_[num_written_]) {
+      std::string& pending = pending_[num_written_];
+      js_sink_->PutN(pending.data(), pending.size());
+      std::string().swap(pending);
+      ++num_written_;
+    }
+  }
+
+  CompressOptions options_;
+  const std::vector<std::string>& obj_paths_;
+  const std::string suffix_;
+  std::vector<Scratch*> scratch_;  // One per thread.
+  pthread_mutex_t mutex_;
+  // Guarded by |mutex_|.
+  webgl_loader::BufferedSink* js_sink_;
+  std::vector<std::string> pending_;
+  std::vector<bool> done_;
+  size_t num_written_;
+};
+
+#endif  // WEBGL_LOADER_OBJCOMPRESS_H_
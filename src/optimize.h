@@ -67,11 +67,12 @@ class VertexOptimizer {
     }
 
     // TODO: with index bounds, no need to recompute everything.
-    // Compute initial vertex scores.
+    // Compute initial vertex scores. Vertices already written to the
+    // current mesh by earlier groups keep their output index, so that
+    // groups that share vertices don't write them twice.
     for (size_t i = 0; i < per_vertex_.size(); ++i) {
       VertexData& vertex_data = per_vertex_[i];
       vertex_data.cache_tag = kCacheSize;
-      vertex_data.output_index = kMaxOutputIndex;
       vertex_data.UpdateScore();
     }
 
@@ -0,0 +1,344 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_PREDICT_H_
+#define WEBGL_LOADER_PREDICT_H_
+
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "base.h"
+
+namespace webgl_loader {
+
+// Attribute predictors that run after all the triangles are decoded,
+// instead of during the traversal in |EdgeCachingCompressor|. That
+// way, a vertex can be predicted from every neighbor that precedes it
+// in vertex order, not just the triangle that introduced it. Each
+// attribute column only depends on earlier vertices in the same
+// column, and texcoords may also use any position, so decoders run
+// positions first and then texcoords.
+
+enum AttribPredictor {
+  // Predicted while traversing triangles, as |EdgeCachingCompressor|
+  // always has. The residuals are left as they were.
+  PREDICTOR_TRAVERSAL = 0,
+  PREDICTOR_PARALLELOGRAM = 1,  // |MultiParallelogramPredictor|.
+  PREDICTOR_STRETCH = 2,        // |UvStretchPredictor|, texcoords only.
+  NUM_PREDICTORS
+};
+
+// As they appear in the "predictors" manifest entry.
+const char* const kPredictorNames[NUM_PREDICTORS] = {
+  "traversal", "parallelogram", "stretch"
+};
+
+// The predictors chosen for a mesh.
+struct AttribPredictors {
+  AttribPredictors()
+      : positions(PREDICTOR_TRAVERSAL),
+        texcoords(PREDICTOR_TRAVERSAL) {
+  }
+
+  bool IsTraversal() const {
+    return positions == PREDICTOR_TRAVERSAL &&
+        texcoords == PREDICTOR_TRAVERSAL;
+  }
+
+  bool IsValid() const {
+    return positions < NUM_PREDICTORS && positions != PREDICTOR_STRETCH &&
+        texcoords < NUM_PREDICTORS;
+  }
+
+  AttribPredictor positions;  // Columns 0-2.
+  AttribPredictor texcoords;  // Columns 3-4.
+};
+
+// The triangles incident on each vertex, in triangle order.
+class VertexTriangles {
+ public:
+  // |indices| is unowned, and must outlive this.
+  VertexTriangles(const uint16* indices, size_t num_tris, size_t num_verts)
+      : indices_(indices),
+        starts_(num_verts + 1, 0),
+        triangles_(3 * num_tris) {
+    for (size_t i = 0; i < 3 * num_tris; ++i) {
+      ++starts_[indices[i] + 1];
+    }
+    for (size_t i = 0; i < num_verts; ++i) {
+      starts_[i + 1] += starts_[i];
+    }
+    std::vector<size_t> fill(starts_.begin(), starts_.end() - 1);
+    for (size_t i = 0; i < 3 * num_tris; ++i) {
+      const size_t triangle = i / 3;
+      // Degenerate triangles are listed once per occurrence; callers
+      // skip them anyway.
+      triangles_[fill[indices[i]]++] = triangle;
+    }
+  }
+
+  size_t begin(uint16 vertex) const { return starts_[vertex]; }
+  size_t end(uint16 vertex) const { return starts_[vertex + 1]; }
+
+  // The vertices of the |i|th triangle incident on some vertex, where
+  // |begin(vertex)| <= |i| < |end(vertex)|.
+  const uint16* triangle(size_t i) const {
+    return &indices_[3 * triangles_[i]];
+  }
+
+  // Finds the rest of |triangle| after |vertex|, preserving winding,
+  // so that |vertex| -> |*v1| -> |*v2| is a triangle.
+  static void Rotate(const uint16* triangle, uint16 vertex,
+                     uint16* v1, uint16* v2) {
+    const size_t i = triangle[0] == vertex ? 0 :
+        (triangle[1] == vertex ? 1 : 2);
+    *v1 = triangle[(i + 1) % 3];
+    *v2 = triangle[(i + 2) % 3];
+  }
+
+  // Finds the third vertex of the first triangle with the directed
+  // edge |v0| -> |v1| whose third vertex is less than |limit|.
+  bool FindOpposite(uint16 v0, uint16 v1, uint16 limit,
+                    uint16* opposite) const {
+    for (size_t i = begin(v0); i != end(v0); ++i) {
+      uint16 next, third;
+      Rotate(triangle(i), v0, &next, &third);
+      if (next == v1 && third < limit) {
+        *opposite = third;
+        return true;
+      }
+    }
+    return false;
+  }
+
+ private:
+  const uint16* indices_;  // unowned.
+  std::vector<size_t> starts_;
+  std::vector<size_t> triangles_;
+};
+
+class AttribPredictorInterface {
+ public:
+  virtual ~AttribPredictorInterface() { }
+
+  // Predicts columns [|column|, |column| + |num_columns|) of |vertex|
+  // in |attribs|, which are interleaved 8 wide. Those columns may only
+  // be read for vertices less than |vertex|, but positions (columns
+  // 0-2) may be read for any vertex when predicting texcoords.
+  virtual void Predict(const VertexTriangles& topology,
+                       const uint16* attribs, uint16 vertex,
+                       size_t column, size_t num_columns,
+                       int* predicted) const = 0;
+};
+
+// Constrained multi-parallelogram prediction: averages the
+// parallelogram predictions a + b - c over every incident triangle
+// (v, a, b) where the triangle (b, a, c) across the edge is already
+// decoded. Falls back to averaging decoded neighbors, and then to the
+// previous vertex.
+class MultiParallelogramPredictor : public AttribPredictorInterface {
+ public:
+  virtual void Predict(const VertexTriangles& topology,
+                       const uint16* attribs, uint16 vertex,
+                       size_t column, size_t num_columns,
+                       int* predicted) const {
+    int sums[8] = { 0 };
+    int num_parallelograms = 0;
+    for (size_t i = topology.begin(vertex); i != topology.end(vertex); ++i) {
+      uint16 a, b, c;
+      VertexTriangles::Rotate(topology.triangle(i), vertex, &a, &b);
+      if (a >= vertex || b >= vertex) continue;
+      if (!topology.FindOpposite(b, a, vertex, &c)) continue;
+      for (size_t j = column; j < column + num_columns; ++j) {
+        sums[j] += attribs[8*a + j] + attribs[8*b + j] - attribs[8*c + j];
+      }
+      ++num_parallelograms;
+    }
+    if (num_parallelograms != 0) {
+      for (size_t j = column; j < column + num_columns; ++j) {
+        predicted[j - column] = Clamp(sums[j] / num_parallelograms);
+      }
+      return;
+    }
+    int num_neighbors = 0;
+    for (size_t i = topology.begin(vertex); i != topology.end(vertex); ++i) {
+      uint16 neighbors[2];
+      VertexTriangles::Rotate(topology.triangle(i), vertex,
+                              &neighbors[0], &neighbors[1]);
+      for (size_t k = 0; k < 2; ++k) {
+        if (neighbors[k] >= vertex) continue;
+        for (size_t j = column; j < column + num_columns; ++j) {
+          sums[j] += attribs[8*neighbors[k] + j];
+        }
+        ++num_neighbors;
+      }
+    }
+    for (size_t j = column; j < column + num_columns; ++j) {
+      if (num_neighbors != 0) {
+        predicted[j - column] = sums[j] / num_neighbors;
+      } else {
+        predicted[j - column] = vertex ? attribs[8*(vertex - 1) + j] : 0;
+      }
+    }
+  }
+
+ private:
+  static int Clamp(int x) {
+    return x < 0 ? 0 : (x > 0xFFFF ? 0xFFFF : x);
+  }
+};
+
+// Predicts texcoords by assuming that each triangle is mapped without
+// stretching. For an incident triangle (v, a, b), the position of v
+// relative to the edge a -> b is carried over to texture space, on
+// the opposite side of the edge from the triangle across it, if any.
+// Averages over the incident triangles whose vertices are decoded,
+// and falls back to |MultiParallelogramPredictor|.
+class UvStretchPredictor : public AttribPredictorInterface {
+ public:
+  virtual void Predict(const VertexTriangles& topology,
+                       const uint16* attribs, uint16 vertex,
+                       size_t column, size_t num_columns,
+                       int* predicted) const {
+    DCHECK(num_columns == 2);
+    double sums[2] = { 0, 0 };
+    int num_triangles = 0;
+    const uint16* const pv = &attribs[8*vertex];
+    for (size_t i = topology.begin(vertex); i != topology.end(vertex); ++i) {
+      uint16 a, b, c;
+      VertexTriangles::Rotate(topology.triangle(i), vertex, &a, &b);
+      if (a >= vertex || b >= vertex) continue;
+      const uint16* const pa = &attribs[8*a];
+      const uint16* const pb = &attribs[8*b];
+      double ab[3], av[3];
+      double ab_length2 = 0, dot = 0;
+      for (size_t j = 0; j < 3; ++j) {
+        ab[j] = static_cast<double>(pb[j]) - pa[j];
+        av[j] = static_cast<double>(pv[j]) - pa[j];
+        ab_length2 += ab[j] * ab[j];
+        dot += ab[j] * av[j];
+      }
+      if (ab_length2 == 0) continue;
+      // |s| is how far along a -> b the foot of v is, and |t| is the
+      // distance from the edge, both relative to the edge length.
+      const double s = dot / ab_length2;
+      double perp_length2 = 0;
+      for (size_t j = 0; j < 3; ++j) {
+        const double perp = av[j] - s * ab[j];
+        perp_length2 += perp * perp;
+      }
+      const double t = sqrt(perp_length2 / ab_length2);
+      const double u_a = pa[column], v_a = pa[column + 1];
+      const double u_ab = pb[column] - u_a;
+      const double v_ab = pb[column + 1] - v_a;
+      // Counter-clockwise, unless the triangle across the edge is
+      // already there.
+      double side = 1;
+      if (topology.FindOpposite(b, a, vertex, &c)) {
+        const uint16* const pc = &attribs[8*c];
+        const double cross = u_ab * (pc[column + 1] - v_a) -
+            v_ab * (pc[column] - u_a);
+        if (cross > 0) side = -1;
+      }
+      sums[0] += u_a + s * u_ab - side * t * v_ab;
+      sums[1] += v_a + s * v_ab + side * t * u_ab;
+      ++num_triangles;
+    }
+    if (num_triangles == 0) {
+      MultiParallelogramPredictor fallback;
+      fallback.Predict(topology, attribs, vertex, column, num_columns,
+                       predicted);
+      return;
+    }
+    for (size_t j = 0; j < 2; ++j) {
+      const double average = floor(sums[j] / num_triangles + 0.5);
+      predicted[j] = average < 0 ? 0 :
+          (average > 0xFFFF ? 0xFFFF : static_cast<int>(average));
+    }
+  }
+};
+
+// Returns NULL for |PREDICTOR_TRAVERSAL|, which isn't a post pass.
+const AttribPredictorInterface* GetPredictor(AttribPredictor predictor) {
+  static const MultiParallelogramPredictor kParallelogram;
+  static const UvStretchPredictor kStretch;
+  switch (predictor) {
+    case PREDICTOR_PARALLELOGRAM: return &kParallelogram;
+    case PREDICTOR_STRETCH: return &kStretch;
+    default: return NULL;
+  }
+}
+
+// Writes the residuals of |attribs| (interleaved) against |predictor|
+// to columns [|column|, |column| + |num_columns|) of |deltas|, which
+// are transposed like |EdgeCachingCompressor::deltas()|.
+void EncodeResiduals(const AttribPredictorInterface& predictor,
+                     const VertexTriangles& topology,
+                     const QuantizedAttribList& attribs,
+                     size_t column, size_t num_columns,
+                     uint16* deltas) {
+  const size_t num_verts = attribs.size() / 8;
+  int predicted[8];
+  for (size_t i = 0; i < num_verts; ++i) {
+    predictor.Predict(topology, &attribs[0], i, column, num_columns,
+                      predicted);
+    for (size_t j = 0; j < num_columns; ++j) {
+      const int residual = attribs[8*i + column + j] - predicted[j];
+      deltas[num_verts*(column + j) + i] = ZigZag(residual);
+    }
+  }
+}
+
+// The inverse of |EncodeResiduals|, in vertex order.
+void DecodeResiduals(const AttribPredictorInterface& predictor,
+                     const VertexTriangles& topology,
+                     const uint16* deltas, size_t num_verts,
+                     size_t column, size_t num_columns,
+                     uint16* attribs) {
+  int predicted[8];
+  for (size_t i = 0; i < num_verts; ++i) {
+    predictor.Predict(topology, attribs, i, column, num_columns, predicted);
+    for (size_t j = 0; j < num_columns; ++j) {
+      attribs[8*i + column + j] = static_cast<uint16>(
+          predicted[j] + UnZigZag(deltas[num_verts*(column + j) + i]));
+    }
+  }
+}
+
+// The order-0 entropy, in bits, of columns [|column|, |column| +
+// |num_columns|) of transposed |deltas|. This is roughly what an
+// adaptive coder would spend on them.
+double ResidualEntropy(const uint16* deltas, size_t num_verts,
+                       size_t column, size_t num_columns) {
+  double bits = 0;
+  for (size_t j = column; j < column + num_columns; ++j) {
+    std::vector<uint16> sorted(deltas + num_verts*j,
+                               deltas + num_verts*(j + 1));
+    std::sort(sorted.begin(), sorted.end());
+    for (size_t i = 0; i < num_verts;) {
+      size_t run = i + 1;
+      while (run < num_verts && sorted[run] == sorted[i]) ++run;
+      const double count = run - i;
+      bits += count * log(num_verts / count) / log(2.0);
+      i = run;
+    }
+  }
+  return bits;
+}
+
+}  // namespace webgl_loader
+
+#endif  // WEBGL_LOADER_PREDICT_H_
@@ -0,0 +1,152 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_PREFETCH_H_
+#define WEBGL_LOADER_PREFETCH_H_
+
+// Tools that include this must be built with -pthread.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <semaphore.h>
+#include <stdio.h>
+
+#include <vector>
+
+#include "base.h"
+#include "stream.h"
+#include "thread.h"
+
+namespace webgl_loader {
+
+// A |BufferedInputStream| that reads ahead on its own thread, so that
+// whoever consumes it only waits on the disk when it gets ahead of
+// it. The reader fills a ring of |num_buffers| in order, and |Refill|
+// hands out each in turn, giving the last one back to be filled
+// again. As with |AsyncFileSink|, a pair of counting semaphores keeps
+// count of the filled and free buffers.
+class PrefetchingInputStream : public BufferedInput {
+ public:
+  // |fp| is unowned, and must not be read by anything else until this
+  // is destroyed.
+  explicit PrefetchingInputStream(FILE* fp, size_t buffer_size = 256 * 1024,
+                                  size_t num_buffers = 3)
+      : BufferedInput(RefillPrefetched),
+        fp_(fp),
+        buffers_(num_buffers),
+        next_read_(0),
+        holding_(false),
+        stopping_(false) {
+    CHECK(num_buffers >= 2);
+    // Disable buffering since we're doing it ourselves.
+    setvbuf(fp_, NULL, _IONBF, 0);
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fileno(fp_), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    for (size_t i = 0; i < buffers_.size(); ++i) {
+      buffers_[i].data.resize(buffer_size);
+    }
+    CHECK(0 == pthread_mutex_init(&mutex_, NULL));
+    CHECK(0 == sem_init(&filled_, 0, 0));
+    CHECK(0 == sem_init(&free_, 0, num_buffers));
+    CHECK(0 == pthread_create(&reader_, NULL, &PrefetchingInputStream::Run,
+                              this));
+  }
+
+  // Stops the reader, which may have read past what was consumed.
+  ~PrefetchingInputStream() {
+    {
+      MutexLock lock(&mutex_);
+      stopping_ = true;
+    }
+    CHECK(0 == sem_post(&free_));
+    CHECK(0 == pthread_join(reader_, NULL));
+    sem_destroy(&filled_);
+    sem_destroy(&free_);
+    pthread_mutex_destroy(&mutex_);
+  }
+
+ protected:
+  static ErrorCode RefillPrefetched(BufferedInput* bi) {
+    return static_cast<PrefetchingInputStream*>(bi)->DoRefillPrefetched();
+  }
+
+ private:
+  struct Buffer {
+    std::vector<char> data;
+    size_t length;
+    // What |fread| left behind after |length|: kEndOfFile or
+    // kFileError, which end the stream, or kNoError.
+    ErrorCode error;
+  };
+
+  // As |BufferedInputStream::DoRefillFread|.
+  ErrorCode DoRefillPrefetched() {
+    if (holding_) {
+      CHECK(0 == sem_post(&free_));
+    }
+    while (0 != sem_wait(&filled_)) CHECK(errno == EINTR);
+    holding_ = true;
+    const Buffer& buffer = buffers_[next_read_];
+    next_read_ = (next_read_ + 1) % buffers_.size();
+    if (buffer.error == kFileError) return fail(kFileError);
+    begin_ = cursor = &buffer.data[0];
+    end_ = begin_ + buffer.length;
+    if (buffer.error == kEndOfFile) refiller_ = RefillEndOfFile;
+    return kNoError;
+  }
+
+  static void* Run(void* self) {
+    static_cast<PrefetchingInputStream*>(self)->Read();
+    return NULL;
+  }
+
+  bool stopping() {
+    MutexLock lock(&mutex_);
+    return stopping_;
+  }
+
+  // The reader thread. It stops after the end of the file or an
+  // error, or when told to.
+  void Read() {
+    size_t next_fill = 0;
+    for (;;) {
+      while (0 != sem_wait(&free_)) CHECK(errno == EINTR);
+      if (stopping()) return;
+      Buffer& buffer = buffers_[next_fill];
+      next_fill = (next_fill + 1) % buffers_.size();
+      buffer.length = fread(&buffer.data[0], 1, buffer.data.size(), fp_);
+      buffer.error = kNoError;
+      if (buffer.length < buffer.data.size()) {
+        buffer.error = ferror(fp_) ? kFileError : kEndOfFile;
+      }
+      CHECK(0 == sem_post(&filled_));
+      if (buffer.error != kNoError) return;
+    }
+  }
+
+  FILE* fp_;  // unowned.
+  std::vector<Buffer> buffers_;
+  size_t next_read_;  // The next buffer |Refill| takes.
+  bool holding_;  // Whether |Refill| has a buffer to give back.
+  pthread_t reader_;
+  pthread_mutex_t mutex_;
+  bool stopping_;  // Guarded by |mutex_|.
+  sem_t filled_;  // Buffers read, and not yet taken by |Refill|.
+  sem_t free_;  // Buffers given back, and not yet being read.
+};
+
+}  // namespace webgl_loader
+
+#endif  // WEBGL_LOADER_PREFETCH_H_
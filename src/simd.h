@@ -0,0 +1,247 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_SIMD_H_
+#define WEBGL_LOADER_SIMD_H_
+
+// Vector versions of the inner loops that every tool runs over whole
+// meshes. Each picks the widest instruction set the compiler was
+// told it may use (SSE2 is always there on x86-64; AVX2 needs
+// -mavx2 or -march=native), and has a scalar version that the others
+// must match exactly. Define WEBGL_LOADER_NO_SIMD to use only that.
+
+#include "base.h"
+
+#ifndef WEBGL_LOADER_NO_SIMD
+# if defined(__AVX2__)
+#  define WEBGL_LOADER_AVX2 1
+#  include <immintrin.h>
+# endif
+# if defined(__SSE2__) || defined(_M_X64)
+#  define WEBGL_LOADER_SSE2 1
+#  include <emmintrin.h>
+# endif
+# if defined(__SSSE3__)
+#  define WEBGL_LOADER_SSSE3 1
+#  include <tmmintrin.h>
+# endif
+# if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#  define WEBGL_LOADER_NEON 1
+#  include <arm_neon.h>
+# endif
+#endif
+
+namespace webgl_loader {
+
+// The name of the instruction set the kernels below use.
+const char* SimdName() {
+#if defined(WEBGL_LOADER_AVX2)
+  return "avx2";
+#elif defined(WEBGL_LOADER_SSSE3)
+  return "ssse3";
+#elif defined(WEBGL_LOADER_SSE2)
+  return "sse2";
+#elif defined(WEBGL_LOADER_NEON)
+  return "neon";
+#else
+  return "scalar";
+#endif
+}
+
+// The index of the lowest set bit of |bits|, which must not be 0.
+inline size_t CountTrailingZeros(uint32 bits) {
+#if defined(__GNUC__)
+  return __builtin_ctz(bits);
+#else
+  size_t count = 0;
+  while (!(bits & 1)) {
+    bits >>= 1;
+    ++count;
+  }
+  return count;
+#endif
+}
+
+// Writes |num_verts| interleaved 8-wide |attribs| to |planar| as 8
+// columns of |num_verts|, each value replaced by the ZigZag of its
+// difference from the value above it in the column (0 for the first
+// row), as |CompressQuantizedAttribsToUtf8| writes them. |planar|
+// must have room for 8 * |num_verts| and not overlap |attribs|.
+void TransposeDeltaZigZagScalar(const uint16* attribs, size_t num_verts,
+                                uint16* planar) {
+  for (size_t j = 0; j < 8; ++j) {
+    uint16 prev = 0;
+    uint16* column = planar + num_verts * j;
+    for (size_t i = 0; i < num_verts; ++i) {
+      const uint16 word = attribs[8 * i + j];
+      column[i] = ZigZag(static_cast<int16>(word - prev));
+      prev = word;
+    }
+  }
+}
+
+#if defined(WEBGL_LOADER_SSE2)
+// Transposes 8 rows of 8 uint16s in place.
+inline void Transpose8x8(__m128i* rows) {
+  const __m128i a0 = _mm_unpacklo_epi16(rows[0], rows[1]);
+  const __m128i a1 = _mm_unpackhi_epi16(rows[0], rows[1]);
+  const __m128i a2 = _mm_unpacklo_epi16(rows[2], rows[3]);
+  const __m128i a3 = _mm_unpackhi_epi16(rows[2], rows[3]);
+  const __m128i a4 = _mm_unpacklo_epi16(rows[4], rows[5]);
+  const __m128i a5 = _mm_unpackhi_epi16(rows[4], rows[5]);
+  const __m128i a6 = _mm_unpacklo_epi16(rows[6], rows[7]);
+  const __m128i a7 = _mm_unpackhi_epi16(rows[6], rows[7]);
+  const __m128i b0 = _mm_unpacklo_epi32(a0, a2);
+  const __m128i b1 = _mm_unpackhi_epi32(a0, a2);
+  const __m128i b2 = _mm_unpacklo_epi32(a1, a3);
+  const __m128i b3 = _mm_unpackhi_epi32(a1, a3);
+  const __m128i b4 = _mm_unpacklo_epi32(a4, a6);
+  const __m128i b5 = _mm_unpackhi_epi32(a4, a6);
+  const __m128i b6 = _mm_unpacklo_epi32(a5, a7);
+  const __m128i b7 = _mm_unpackhi_epi32(a5, a7);
+  rows[0] = _mm_unpacklo_epi64(b0, b4);
+  rows[1] = _mm_unpackhi_epi64(b0, b4);
+  rows[2] = _mm_unpacklo_epi64(b1, b5);
+  rows[3] = _mm_unpackhi_epi64(b1, b5);
+  rows[4] = _mm_unpacklo_epi64(b2, b6);
+  rows[5] = _mm_unpackhi_epi64(b2, b6);
+  rows[6] = _mm_unpacklo_epi64(b3, b7);
+  rows[7] = _mm_unpackhi_epi64(b3, b7);
+}
+
+inline __m128i ZigZag8(__m128i words) {
+  return _mm_xor_si128(_mm_slli_epi16(words, 1), _mm_srai_epi16(words, 15));
+}
+#endif
+
+#if defined(WEBGL_LOADER_AVX2)
+// |Transpose8x8| on each 128-bit half of |rows| at once.
+inline void Transpose8x8x2(__m256i* rows) {
+  const __m256i a0 = _mm256_unpacklo_epi16(rows[0], rows[1]);
+  const __m256i a1 = _mm256_unpackhi_epi16(rows[0], rows[1]);
+  const __m256i a2 = _mm256_unpacklo_epi16(rows[2], rows[3]);
+  const __m256i a3 = _mm256_unpackhi_epi16(rows[2], rows[3]);
+  const __m256i a4 = _mm256_unpacklo_epi16(rows[4], rows[5]);
+  const __m256i a5 = _mm256_unpackhi_epi16(rows[4], rows[5]);
+  const __m256i a6 = _mm256_unpacklo_epi16(rows[6], rows[7]);
+  const __m256i a7 = _mm256_unpackhi_epi16(rows[6], rows[7]);
+  const __m256i b0 = _mm256_unpacklo_epi32(a0, a2);
+  const __m256i b1 = _mm256_unpackhi_epi32(a0, a2);
+  const __m256i b2 = _mm256_unpacklo_epi32(a1, a3);
+  const __m256i b3 = _mm256_unpackhi_epi32(a1, a3);
+  const __m256i b4 = _mm256_unpacklo_epi32(a4, a6);
+  const __m256i b5 = _mm256_unpackhi_epi32(a4, a6);
+  const __m256i b6 = _mm256_unpacklo_epi32(a5, a7);
+  const __m256i b7 = _mm256_unpackhi_epi32(a5, a7);
+  rows[0] = _mm256_unpacklo_epi64(b0, b4);
+  rows[1] = _mm256_unpackhi_epi64(b0, b4);
+  rows[2] = _mm256_unpacklo_epi64(b1, b5);
+  rows[3] = _mm256_unpackhi_epi64(b1, b5);
+  rows[4] = _mm256_unpacklo_epi64(b2, b6);
+  rows[5] = _mm256_unpackhi_epi64(b2, b6);
+  rows[6] = _mm256_unpacklo_epi64(b3, b7);
+  rows[7] = _mm256_unpackhi_epi64(b3, b7);
+}
+#endif
+
+// |TransposeDeltaZigZagScalar|, a block of vertices at a time. On x86
+// each vertex is one register, so the deltas are taken between
+// vertices for all 8 columns at once, before transposing. NEON can
+// load the columns apart, so it takes them after.
+void TransposeDeltaZigZag(const uint16* attribs, size_t num_verts,
+                          uint16* planar) {
+  size_t i = 0;
+#if defined(WEBGL_LOADER_SSE2)
+  __m128i prev = _mm_setzero_si128();
+# if defined(WEBGL_LOADER_AVX2)
+  // Vertices i..i+7 in the low halves, and i+8..i+15 in the high.
+  for (; i + 16 <= num_verts; i += 16) {
+    const __m128i* in = reinterpret_cast<const __m128i*>(attribs + 8 * i);
+    __m256i rows[8];
+    __m128i lo = prev;
+    __m128i hi = _mm_loadu_si128(in + 7);
+    for (size_t k = 0; k < 8; ++k) {
+      const __m128i lo_row = _mm_loadu_si128(in + k);
+      const __m128i hi_row = _mm_loadu_si128(in + 8 + k);
+      const __m256i row = _mm256_inserti128_si256(
+          _mm256_castsi128_si256(lo_row), hi_row, 1);
+      const __m256i above = _mm256_inserti128_si256(
+          _mm256_castsi128_si256(lo), hi, 1);
+      const __m256i delta = _mm256_sub_epi16(row, above);
+      rows[k] = _mm256_xor_si256(_mm256_slli_epi16(delta, 1),
+                                 _mm256_srai_epi16(delta, 15));
+      lo = lo_row;
+      hi = hi_row;
+    }
+    prev = hi;
+    Transpose8x8x2(rows);
+    for (size_t j = 0; j < 8; ++j) {
+      _mm256_storeu_si256(
+          reinterpret_cast<__m256i*>(planar + num_verts * j + i), rows[j]);
+    }
+  }
+# endif
+  for (; i + 8 <= num_verts; i += 8) {
+    const __m128i* in = reinterpret_cast<const __m128i*>(attribs + 8 * i);
+    __m128i rows[8];
+    for (size_t k = 0; k < 8; ++k) {
+      const __m128i row = _mm_loadu_si128(in + k);
+      rows[k] = ZigZag8(_mm_sub_epi16(row, prev));
+      prev = row;
+    }
+    Transpose8x8(rows);
+    for (size_t j = 0; j < 8; ++j) {
+      _mm_storeu_si128(
+          reinterpret_cast<__m128i*>(planar + num_verts * j + i), rows[j]);
+    }
+  }
+#elif defined(WEBGL_LOADER_NEON)
+  uint16x8_t prev[8];
+  for (size_t j = 0; j < 8; ++j) {
+    prev[j] = vdupq_n_u16(0);
+  }
+  for (; i + 8 <= num_verts; i += 8) {
+    // Each half has columns k and k + 4 alternating, for 4 vertices.
+    const uint16x8x4_t first = vld4q_u16(attribs + 8 * i);
+    const uint16x8x4_t second = vld4q_u16(attribs + 8 * i + 32);
+    for (size_t k = 0; k < 4; ++k) {
+      const uint16x8x2_t columns = vuzpq_u16(first.val[k], second.val[k]);
+      for (size_t half = 0; half < 2; ++half) {
+        const size_t j = k + 4 * half;
+        const uint16x8_t column = columns.val[half];
+        const int16x8_t delta = vreinterpretq_s16_u16(
+            vsubq_u16(column, vextq_u16(prev[j], column, 7)));
+        const uint16x8_t code = veorq_u16(
+            vreinterpretq_u16_s16(vshlq_n_s16(delta, 1)),
+            vreinterpretq_u16_s16(vshrq_n_s16(delta, 15)));
+        vst1q_u16(planar + num_verts * j + i, code);
+        prev[j] = column;
+      }
+    }
+  }
+#endif
+  // The last few vertices, which continue from the block before.
+  for (size_t j = 0; j < 8; ++j) {
+    uint16 prev_word = (i > 0) ? attribs[8 * (i - 1) + j] : 0;
+    for (size_t k = i; k < num_verts; ++k) {
+      const uint16 word = attribs[8 * k + j];
+      planar[num_verts * j + k] = ZigZag(static_cast<int16>(word - prev_word));
+      prev_word = word;
+    }
+  }
+}
+
+}  // namespace webgl_loader
+
+#endif  // WEBGL_LOADER_SIMD_H_
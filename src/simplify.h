@@ -0,0 +1,619 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_SIMPLIFY_H_
+#define WEBGL_LOADER_SIMPLIFY_H_
+
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "base.h"
+
+namespace webgl_loader {
+
+// Quadric error edge collapse, after Garland and Heckbert's "Surface
+// Simplification Using Quadric Error Metrics". Each collapse moves a
+// vertex onto a neighbor, so attributes are never interpolated, and
+// a simplified |DrawMesh| only needs new indices.
+//
+// A |DrawMesh| vertex is a (position, texcoord, normal) triple, so a
+// UV seam or a normal crease is where a position has more than one
+// vertex (a "wedge" each). Vertices are classified by how their
+// edges are shared:
+//   VERTEX_MANIFOLD: one wedge, closed fan. Collapses anywhere.
+//   VERTEX_BORDER: one wedge on a single open border. Collapses
+//     along the border.
+//   VERTEX_SEAM: two wedges, each on one side of a seam. Collapses
+//     along the seam, together with its other wedge.
+//   VERTEX_LOCKED: anything else, including positions used by more
+//     than one group, so groups still meet without cracks.
+
+enum VertexKind {
+  VERTEX_MANIFOLD,
+  VERTEX_BORDER,
+  VERTEX_SEAM,
+  VERTEX_LOCKED
+};
+
+// The sum of squared distances to a set of weighted planes, as a
+// symmetric 4x4 matrix.
+class Quadric {
+ public:
+  Quadric() {
+    for (size_t i = 0; i < 10; ++i) {
+      m_[i] = 0.0;
+    }
+    weight_ = 0.0;
+  }
+
+  // Adds the plane n.p + d = 0, for unit n.
+  void AddPlane(const double n[3], double d, double weight) {
+    m_[0] += weight * n[0] * n[0];
+    m_[1] += weight * n[0] * n[1];
+    m_[2] += weight * n[0] * n[2];
+    m_[3] += weight * n[0] * d;
+    m_[4] += weight * n[1] * n[1];
+    m_[5] += weight * n[1] * n[2];
+    m_[6] += weight * n[1] * d;
+    m_[7] += weight * n[2] * n[2];
+    m_[8] += weight * n[2] * d;
+    m_[9] += weight * d * d;
+    weight_ += weight;
+  }
+
+  void Add(const Quadric& that) {
+    for (size_t i = 0; i < 10; ++i) {
+      m_[i] += that.m_[i];
+    }
+    weight_ += that.weight_;
+  }
+
+  // The weighted mean of the squared distances from |p| to the planes.
+  double Error(const float* p) const {
+    if (weight_ <= 0.0) return 0.0;
+    const double x = p[0], y = p[1], z = p[2];
+    const double sum =
+        m_[0]*x*x + 2*m_[1]*x*y + 2*m_[2]*x*z + 2*m_[3]*x +
+        m_[4]*y*y + 2*m_[5]*y*z + 2*m_[6]*y +
+        m_[7]*z*z + 2*m_[8]*z +
+        m_[9];
+    return std::max(sum, 0.0) / weight_;
+  }
+
+ private:
+  double m_[10];
+  double weight_;
+};
+
+class MeshSimplifier {
+ public:
+  // |mesh| is unowned, and must outlive this. Group i starts at
+  // |group_offsets|[i] in |mesh|.indices, as |GroupStart::offset|.
+  MeshSimplifier(const DrawMesh& mesh,
+                 const std::vector<size_t>& group_offsets)
+      : attribs_(mesh.attribs),
+        indices_(mesh.indices),
+        num_verts_(mesh.attribs.size() / 8),
+        num_groups_(group_offsets.size()),
+        remap_(num_verts_),
+        quadrics_(num_verts_),
+        max_error_(0.0) {
+    CHECK(indices_.size() % 3 == 0);
+    for (size_t i = 0; i < num_verts_; ++i) {
+      remap_[i] = i;
+    }
+    for (size_t group = 0; group < num_groups_; ++group) {
+      const size_t end = (group + 1 < num_groups_) ?
+          group_offsets[group + 1] : indices_.size();
+      triangle_groups_.resize(end / 3, group);
+    }
+    triangle_groups_.resize(indices_.size() / 3, 0);
+    FindWedges();
+    BuildAdjacency();
+    ClassifyVertices();
+    InitQuadrics();
+  }
+
+  // Collapses edges until there are at most |target_tris| triangles,
+  // or no more can be collapsed. Calling this again with a smaller
+  // target continues from here, which is how to make a LOD chain.
+  void Simplify(size_t target_tris) {
+    while (indices_.size() / 3 > target_tris &&
+           CollapsePass(target_tris)) {
+    }
+  }
+
+  const IndexList& indices() const {
+    return indices_;
+  }
+
+  // The start of each group in |indices|. Groups may become empty.
+  void GetGroupOffsets(std::vector<size_t>* offsets) const {
+    offsets->assign(num_groups_, 0);
+    for (size_t i = 0; i < triangle_groups_.size(); ++i) {
+      if (triangle_groups_[i] + 1 < num_groups_) {
+        (*offsets)[triangle_groups_[i] + 1] += 3;
+      }
+    }
+    for (size_t group = 1; group < num_groups_; ++group) {
+      (*offsets)[group] += (*offsets)[group - 1];
+    }
+  }
+
+  // The largest collapse error so far, as a distance in position
+  // units: roughly how far the simplified surface strays from the
+  // original.
+  double error() const {
+    return sqrt(max_error_);
+  }
+
+  VertexKind kind(int vertex) const {
+    return kinds_[vertex];
+  }
+
+ private:
+  // A border edge is weighted like a face this much larger, so that
+  // borders and seams keep their shape.
+  static const int kBorderWeight = 10;
+
+  struct Collapse {
+    double error;
+    int from;
+    int to;
+    // The other wedges, for a seam collapse, or -1.
+    int twin_from;
+    int twin_to;
+
+    bool operator<(const Collapse& that) const {
+      if (error != that.error) return error < that.error;
+      if (from != that.from) return from < that.from;
+      return to < that.to;
+    }
+  };
+
+  const float* Position(int vertex) const {
+    return &attribs_[8 * vertex];
+  }
+
+  // Vertices with the same position are linked into a cycle by
+  // |wedge_next_|, and share |position_|, the lowest of them.
+  void FindWedges() {
+    std::vector<int> order(num_verts_);
+    for (size_t i = 0; i < num_verts_; ++i) {
+      order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), PositionLess(attribs_));
+    position_.resize(num_verts_);
+    wedge_next_.resize(num_verts_);
+    size_t first = 0;
+    for (size_t i = 0; i < num_verts_; ++i) {
+      if (i + 1 < num_verts_ &&
+          SamePosition(Position(order[i]), Position(order[i + 1]))) {
+        continue;
+      }
+      for (size_t j = first; j <= i; ++j) {
+        position_[order[j]] = order[first];
+        wedge_next_[order[j]] = order[j == i ? first : j + 1];
+      }
+      first = i + 1;
+    }
+  }
+
+  static bool SamePosition(const float* a, const float* b) {
+    return a[0] == b[0] && a[1] == b[1] && a[2] == b[2];
+  }
+
+  // Orders vertices by position, then index.
+  class PositionLess {
+   public:
+    explicit PositionLess(const AttribList& attribs)
+        : attribs_(attribs) {
+    }
+
+    bool operator()(int a, int b) const {
+      for (size_t i = 0; i < 3; ++i) {
+        if (attribs_[8*a + i] != attribs_[8*b + i]) {
+          return attribs_[8*a + i] < attribs_[8*b + i];
+        }
+      }
+      return a < b;
+    }
+
+   private:
+    const AttribList& attribs_;
+  };
+
+  static uint64 EdgeKey(int from, int to) {
+    return (static_cast<uint64>(from) << 32) | static_cast<uint32>(to);
+  }
+
+  bool HasEdge(int from, int to) const {
+    return std::binary_search(edges_.begin(), edges_.end(),
+                              EdgeKey(from, to));
+  }
+
+  // Whether there is a triangle on only one side of the edge.
+  bool IsOpenEdge(int a, int b) const {
+    return HasEdge(a, b) != HasEdge(b, a);
+  }
+
+  // Rebuilds the triangles around each vertex, and the set of
+  // directed edges, from |indices_|.
+  void BuildAdjacency() {
+    const size_t num_tris = indices_.size() / 3;
+    vertex_starts_.assign(num_verts_ + 1, 0);
+    for (size_t i = 0; i < indices_.size(); ++i) {
+      ++vertex_starts_[indices_[i] + 1];
+    }
+    for (size_t i = 0; i < num_verts_; ++i) {
+      vertex_starts_[i + 1] += vertex_starts_[i];
+    }
+    std::vector<size_t> fill(vertex_starts_.begin(), vertex_starts_.end() - 1);
+    vertex_triangles_.resize(indices_.size());
+    edges_.resize(indices_.size());
+    for (size_t i = 0; i < num_tris; ++i) {
+      for (size_t k = 0; k < 3; ++k) {
+        const int vertex = indices_[3*i + k];
+        vertex_triangles_[fill[vertex]++] = i;
+        edges_[3*i + k] = EdgeKey(vertex, indices_[3*i + (k + 1) % 3]);
+      }
+    }
+    std::sort(edges_.begin(), edges_.end());
+  }
+
+  void ClassifyVertices() {
+    const size_t num_tris = indices_.size() / 3;
+    // Open edge counts, at each vertex and at each position.
+    std::vector<int> open_out(num_verts_, 0), open_in(num_verts_, 0);
+    std::vector<int> position_open(num_verts_, 0);
+    std::vector<int> position_group(num_verts_, -1);
+    std::vector<bool> mixed_groups(num_verts_, false);
+    for (size_t i = 0; i < num_tris; ++i) {
+      for (size_t k = 0; k < 3; ++k) {
+        const int from = indices_[3*i + k];
+        const int to = indices_[3*i + (k + 1) % 3];
+        if (!HasEdge(to, from)) {
+          ++open_out[from];
+          ++open_in[to];
+          if (!HasPositionEdge(to, from)) {
+            ++position_open[position_[from]];
+            ++position_open[position_[to]];
+          }
+        }
+        int& group = position_group[position_[from]];
+        if (group < 0) {
+          group = triangle_groups_[i];
+        } else if (group != static_cast<int>(triangle_groups_[i])) {
+          mixed_groups[position_[from]] = true;
+        }
+      }
+    }
+    kinds_.assign(num_verts_, VERTEX_LOCKED);
+    for (size_t i = 0; i < num_verts_; ++i) {
+      const int position = position_[i];
+      if (mixed_groups[position]) continue;
+      const bool one_border = open_out[i] == 1 && open_in[i] == 1;
+      const int twin = wedge_next_[i];
+      if (twin == static_cast<int>(i)) {
+        if (open_out[i] == 0 && open_in[i] == 0) {
+          kinds_[i] = VERTEX_MANIFOLD;
+        } else if (one_border && position_open[position] == 2) {
+          kinds_[i] = VERTEX_BORDER;
+        }
+      } else if (wedge_next_[twin] == static_cast<int>(i)) {
+        if (one_border && open_out[twin] == 1 && open_in[twin] == 1 &&
+            position_open[position] == 0) {
+          kinds_[i] = VERTEX_SEAM;
+        }
+      }
+    }
+  }
+
+  // Like |HasEdge|, but between any wedges of the two positions.
+  bool HasPositionEdge(int from, int to) const {
+    int wedge_from = from;
+    do {
+      int wedge_to = to;
+      do {
+        if (HasEdge(wedge_from, wedge_to)) return true;
+        wedge_to = wedge_next_[wedge_to];
+      } while (wedge_to != to);
+      wedge_from = wedge_next_[wedge_from];
+    } while (wedge_from != from);
+    return false;
+  }
+
+  // Each vertex starts with the planes of its triangles, weighted by
+  // area, and the planes through its open edges that are
+  // perpendicular to their triangles.
+  void InitQuadrics() {
+    const size_t num_tris = indices_.size() / 3;
+    for (size_t i = 0; i < num_tris; ++i) {
+      const int* triangle = &indices_[3*i];
+      double normal[3];
+      const double area = 0.5 * FaceNormal(Position(triangle[0]),
+                                           Position(triangle[1]),
+                                           Position(triangle[2]), normal);
+      if (area == 0.0) continue;
+      const double d = -Dot(normal, Position(triangle[0]));
+      for (size_t k = 0; k < 3; ++k) {
+        quadrics_[triangle[k]].AddPlane(normal, d, area);
+      }
+      for (size_t k = 0; k < 3; ++k) {
+        const int from = triangle[k];
+        const int to = triangle[(k + 1) % 3];
+        if (HasEdge(to, from)) continue;
+        double edge[3];
+        for (size_t j = 0; j < 3; ++j) {
+          edge[j] = Position(to)[j] - Position(from)[j];
+        }
+        double border[3];
+        Cross(edge, normal, border);
+        const double length = sqrt(Dot(border, border));
+        if (length == 0.0) continue;
+        for (size_t j = 0; j < 3; ++j) {
+          border[j] /= length;
+        }
+        const double border_d = -Dot(border, Position(from));
+        const double weight = kBorderWeight * Dot(edge, edge);
+        quadrics_[from].AddPlane(border, border_d, weight);
+        quadrics_[to].AddPlane(border, border_d, weight);
+      }
+    }
+  }
+
+  // Fills in |collapse| if |from| may collapse onto |to|.
+  bool CanCollapse(int from, int to, Collapse* collapse) const {
+    if (position_[from] == position_[to]) return false;
+    collapse->from = from;
+    collapse->to = to;
+    collapse->twin_from = -1;
+    collapse->twin_to = -1;
+    switch (kinds_[from]) {
+      case VERTEX_MANIFOLD:
+        break;
+      case VERTEX_BORDER:
+        if (!IsOpenEdge(from, to)) return false;
+        break;
+      case VERTEX_SEAM: {
+        if (!IsOpenEdge(from, to)) return false;
+        const int twin_from = wedge_next_[from];
+        for (int twin_to = wedge_next_[to]; twin_to != to;
+             twin_to = wedge_next_[twin_to]) {
+          if (IsOpenEdge(twin_from, twin_to)) {
+            collapse->twin_from = twin_from;
+            collapse->twin_to = twin_to;
+            break;
+          }
+        }
+        if (collapse->twin_from < 0) return false;
+        break;
+      }
+      default:
+        return false;
+    }
+    collapse->error = quadrics_[from].Error(Position(to));
+    if (collapse->twin_from >= 0) {
+      collapse->error += quadrics_[collapse->twin_from].Error(Position(to));
+    }
+    return true;
+  }
+
+  // Whether moving |from| onto |to| would turn any of the triangles
+  // around |from| over.
+  bool Flips(int from, int to) const {
+    for (size_t i = vertex_starts_[from]; i < vertex_starts_[from + 1]; ++i) {
+      const int* triangle = &indices_[3 * vertex_triangles_[i]];
+      if (position_[triangle[0]] == position_[to] ||
+          position_[triangle[1]] == position_[to] ||
+          position_[triangle[2]] == position_[to]) {
+        continue;  // Removed by the collapse.
+      }
+      const float* before[3];
+      const float* after[3];
+      for (size_t k = 0; k < 3; ++k) {
+        before[k] = Position(triangle[k]);
+        after[k] = triangle[k] == from ? Position(to) : before[k];
+      }
+      double normal_before[3], normal_after[3];
+      FaceNormal(before[0], before[1], before[2], normal_before);
+      FaceNormal(after[0], after[1], after[2], normal_after);
+      if (Dot(normal_before, normal_after) <= 0.0) return true;
+    }
+    return false;
+  }
+
+  // Stops collapses this pass that would involve the triangles
+  // around |vertex|, so that |Flips| always sees current positions.
+  void LockNeighbors(int vertex, std::vector<bool>* locked) const {
+    for (size_t i = vertex_starts_[vertex]; i < vertex_starts_[vertex + 1];
+         ++i) {
+      const int* triangle = &indices_[3 * vertex_triangles_[i]];
+      for (size_t k = 0; k < 3; ++k) {
+        (*locked)[position_[triangle[k]]] = true;
+      }
+    }
+  }
+
+  // Makes a round of the cheapest collapses that don't overlap, and
+  // returns false if there were none.
+  bool CollapsePass(size_t target_tris) {
+    const size_t num_tris = indices_.size() / 3;
+    std::vector<Collapse> collapses;
+    Collapse collapse;
+    for (size_t i = 0; i < indices_.size(); ++i) {
+      const int a = indices_[i];
+      const int b = indices_[i - i % 3 + (i + 1) % 3];
+      if (CanCollapse(a, b, &collapse)) collapses.push_back(collapse);
+      if (CanCollapse(b, a, &collapse)) collapses.push_back(collapse);
+    }
+    if (collapses.empty()) return false;
+    std::sort(collapses.begin(), collapses.end());
+    // Most collapses remove two triangles. Past the ones needed to
+    // reach |target_tris|, collapses this pass would be too
+    // expensive compared to ones that open up in the next pass. The
+    // cheapest ones may all be blocked, though, so there is always
+    // at least one.
+    const size_t goal = (num_tris - target_tris + 1) / 2;
+    const double error_limit =
+        1.5 * collapses[std::min(goal, collapses.size()) - 1].error;
+    std::vector<bool> locked(num_verts_, false);
+    size_t removed = 0;
+    for (size_t i = 0; i < collapses.size(); ++i) {
+      const Collapse& c = collapses[i];
+      if (removed > 0 && c.error > error_limit) break;
+      if (locked[position_[c.from]] || locked[position_[c.to]]) continue;
+      if (Flips(c.from, c.to)) continue;
+      if (c.twin_from >= 0 && Flips(c.twin_from, c.twin_to)) continue;
+      LockNeighbors(c.from, &locked);
+      if (c.twin_from >= 0) {
+        LockNeighbors(c.twin_from, &locked);
+        remap_[c.twin_from] = c.twin_to;
+        quadrics_[c.twin_to].Add(quadrics_[c.twin_from]);
+        removed += NumShared(c.twin_from, c.twin_to);
+      }
+      remap_[c.from] = c.to;
+      quadrics_[c.to].Add(quadrics_[c.from]);
+      removed += NumShared(c.from, c.to);
+      max_error_ = std::max(max_error_, c.error);
+      if (removed >= num_tris - target_tris) break;
+    }
+    if (removed == 0) return false;
+    RemoveCollapsed();
+    BuildAdjacency();
+    return true;
+  }
+
+  // The number of triangles around |from| that also use |to|'s
+  // position, which collapsing |from| onto |to| removes.
+  size_t NumShared(int from, int to) const {
+    size_t count = 0;
+    for (size_t i = vertex_starts_[from]; i < vertex_starts_[from + 1]; ++i) {
+      const int* triangle = &indices_[3 * vertex_triangles_[i]];
+      for (size_t k = 0; k < 3; ++k) {
+        if (position_[triangle[k]] == position_[to]) {
+          ++count;
+          break;
+        }
+      }
+    }
+    return count;
+  }
+
+  bool IsDegenerate(size_t triangle) const {
+    const int a = position_[remap_[indices_[3*triangle + 0]]];
+    const int b = position_[remap_[indices_[3*triangle + 1]]];
+    const int c = position_[remap_[indices_[3*triangle + 2]]];
+    return a == b || b == c || c == a;
+  }
+
+  // Applies |remap_|, and drops triangles with no area left.
+  void RemoveCollapsed() {
+    const size_t num_tris = indices_.size() / 3;
+    size_t kept = 0;
+    for (size_t i = 0; i < num_tris; ++i) {
+      if (IsDegenerate(i)) continue;
+      for (size_t k = 0; k < 3; ++k) {
+        indices_[3*kept + k] = remap_[indices_[3*i + k]];
+      }
+      triangle_groups_[kept++] = triangle_groups_[i];
+    }
+    indices_.resize(3 * kept);
+    triangle_groups_.resize(kept);
+  }
+
+  static double Dot(const double a[3], const double b[3]) {
+    return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+  }
+
+  static double Dot(const double a[3], const float* b) {
+    return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+  }
+
+  static void Cross(const double a[3], const double b[3], double out[3]) {
+    out[0] = a[1]*b[2] - a[2]*b[1];
+    out[1] = a[2]*b[0] - a[0]*b[2];
+    out[2] = a[0]*b[1] - a[1]*b[0];
+  }
+
+  // Sets |normal| to the unit normal of the triangle, and returns
+  // twice its area.
+  static double FaceNormal(const float* p0, const float* p1,
+                           const float* p2, double normal[3]) {
+    double e1[3], e2[3];
+    for (size_t i = 0; i < 3; ++i) {
+      e1[i] = p1[i] - p0[i];
+      e2[i] = p2[i] - p0[i];
+    }
+    Cross(e1, e2, normal);
+    const double length = sqrt(Dot(normal, normal));
+    if (length > 0.0) {
+      for (size_t i = 0; i < 3; ++i) {
+        normal[i] /= length;
+      }
+    }
+    return length;
+  }
+
+  const AttribList& attribs_;
+  IndexList indices_;
+  const size_t num_verts_;
+  const size_t num_groups_;
+  std::vector<uint32> triangle_groups_;
+  std::vector<int> position_;
+  std::vector<int> wedge_next_;
+  std::vector<VertexKind> kinds_;
+  // Where each vertex has been collapsed to. Only applied to
+  // |indices_| once per pass, so there are no chains.
+  std::vector<int> remap_;
+  std::vector<Quadric> quadrics_;
+  double max_error_;
+  // Rebuilt by |BuildAdjacency| after each pass.
+  std::vector<size_t> vertex_starts_;
+  std::vector<uint32> vertex_triangles_;
+  std::vector<uint64> edges_;
+};
+
+// One level of detail of a |DrawMesh|.
+struct LodLevel {
+  IndexList indices;
+  std::vector<size_t> group_offsets;
+  // As |MeshSimplifier::error|.
+  double error;
+};
+
+// Simplifies |mesh| to each fraction of its triangles in |ratios|,
+// which should be decreasing. Each level continues from the last, so
+// errors only grow along the chain.
+void BuildLodChain(const DrawMesh& mesh,
+                   const std::vector<size_t>& group_offsets,
+                   const std::vector<double>& ratios,
+                   std::vector<LodLevel>* levels) {
+  MeshSimplifier simplifier(mesh, group_offsets);
+  const size_t num_tris = mesh.indices.size() / 3;
+  levels->resize(ratios.size());
+  for (size_t i = 0; i < ratios.size(); ++i) {
+    simplifier.Simplify(static_cast<size_t>(ratios[i] * num_tris));
+    LodLevel& level = (*levels)[i];
+    level.indices = simplifier.indices();
+    simplifier.GetGroupOffsets(&level.group_offsets);
+    level.error = simplifier.error();
+  }
+}
+
+}  // namespace webgl_loader
+
+#endif  // WEBGL_LOADER_SIMPLIFY_H_
@@ -16,6 +16,9 @@
 #define WEBGL_LOADER_STREAM_H_
 
 #include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -141,12 +144,281 @@ class ByteHistogramSink : public ByteSinkInterface {
   ByteSinkInterface* sink_;  // unowned.
 };
 
+// A sink that producers write into directly, instead of through a
+// virtual call per byte: |Reserve| returns room for at least n bytes,
+// the producer fills some of it and |Commit|s how far it got. Put and
+// PutN are inline. Only when the room runs out does the subclass see
+// the bytes, a block at a time, in |MakeRoom|. Call |Flush| to push
+// out what has been written so far; the subclasses do at destruction.
+class BufferedSink {
+ public:
+  virtual ~BufferedSink() { }
+
+  char* Reserve(size_t n) {
+    if (static_cast<size_t>(limit_ - cursor_) < n) MakeRoom(n);
+    return cursor_;
+  }
+
+  // |end| is just past the last byte written since |Reserve|.
+  void Commit(char* end) {
+    DCHECK(cursor_ <= end && end <= limit_);
+    cursor_ = end;
+  }
+
+  void Put(char c) {
+    if (cursor_ == limit_) MakeRoom(1);
+    *cursor_++ = c;
+  }
+
+  // Copies a block at a time, so |len| may be more than fits.
+  void PutN(const char* data, size_t len) {
+    size_t room = limit_ - cursor_;
+    while (len > room) {
+      if (room != 0) memcpy(cursor_, data, room);
+      cursor_ += room;
+      data += room;
+      len -= room;
+      MakeRoom(1);
+      room = limit_ - cursor_;
+    }
+    if (len == 0) return;
+    memcpy(cursor_, data, len);
+    cursor_ += len;
+  }
+
+  void Flush() {
+    MakeRoom(0);
+  }
+
+  // How much |Reserve| can hand out without calling |MakeRoom|.
+  size_t room() const {
+    return limit_ - cursor_;
+  }
+
+ protected:
+  BufferedSink()
+      : cursor_(NULL),
+        limit_(NULL) {
+  }
+
+  // Passes on the bytes written since the last call, and leaves room
+  // for at least |n| more in [|cursor_|, |limit_|).
+  virtual void MakeRoom(size_t n) = 0;
+
+  char* cursor_;
+  char* limit_;
+
+ private:
+  // Disallow copy and assignment.
+  BufferedSink(const BufferedSink&);
+  void operator=(const BufferedSink&);
+};
+
+// Blocks for the sinks below that copy to something else.
+const size_t kSinkBlockSize = 64 * 1024;
+
+// Buffers writes to |fp|, which it doesn't own, in blocks of at least
+// |block_size|.
+class BufferedFileSink : public BufferedSink {
+ public:
+  explicit BufferedFileSink(FILE* fp, size_t block_size = kSinkBlockSize)
+      : fp_(fp),
+        block_(block_size) {
+    cursor_ = &block_[0];
+    limit_ = cursor_ + block_.size();
+  }
+
+  virtual ~BufferedFileSink() {
+    Flush();
+  }
+
+ protected:
+  virtual void MakeRoom(size_t n) {
+    const size_t length = cursor_ - &block_[0];
+    if (length != 0) fwrite(&block_[0], 1, length, fp_);
+    if (n > block_.size()) block_.resize(n);
+    cursor_ = &block_[0];
+    limit_ = cursor_ + block_.size();
+  }
+
+ private:
+  FILE* fp_;  // unowned.
+  std::vector<char> block_;
+};
+
+// Buffers writes to |sink|, which it doesn't own, so that producers
+// written for |BufferedSink| can write to any |ByteSinkInterface|
+// with a single PutN per block.
+class BufferedByteSink : public BufferedSink {
+ public:
+  explicit BufferedByteSink(ByteSinkInterface* sink,
+                            size_t block_size = kSinkBlockSize)
+      : sink_(sink),
+        block_(block_size) {
+    cursor_ = &block_[0];
+    limit_ = cursor_ + block_.size();
+  }
+
+  virtual ~BufferedByteSink() {
+    Flush();
+  }
+
+ protected:
+  virtual void MakeRoom(size_t n) {
+    const size_t length = cursor_ - &block_[0];
+    if (length != 0) sink_->PutN(&block_[0], length);
+    if (n > block_.size()) block_.resize(n);
+    cursor_ = &block_[0];
+    limit_ = cursor_ + block_.size();
+  }
+
+ private:
+  ByteSinkInterface* sink_;  // unowned.
+  std::vector<char> block_;
+};
+
+// Appends to |container|, a std::vector<char> or std::string that it
+// doesn't own, by writing straight into its storage. The container is
+// oversized while writing, and only trimmed to what was written by
+// |Flush|, so don't look at it before then.
+template <typename Container>
+class BufferedAppendSink : public BufferedSink {
+ public:
+  explicit BufferedAppendSink(Container* container)
+      : container_(container) {
+  }
+
+  virtual ~BufferedAppendSink() {
+    Flush();
+  }
+
+ protected:
+  // Between flushes, |cursor_| and |limit_| point into |container_|.
+  // After one, they are NULL until the next write.
+  virtual void MakeRoom(size_t n) {
+    const size_t length = (cursor_ != NULL) ?
+        cursor_ - &(*container_)[0] : container_->size();
+    if (n == 0) {
+      container_->resize(length);
+      cursor_ = limit_ = NULL;
+      return;
+    }
+    const size_t size = std::max(length + std::max(n, kSinkBlockSize),
+                                 2 * length);
+    container_->resize(size);
+    cursor_ = &(*container_)[0] + length;
+    limit_ = &(*container_)[0] + size;
+  }
+
+ private:
+  Container* container_;  // unowned.
+};
+
+typedef BufferedAppendSink<std::vector<char> > BufferedVectorSink;
+typedef BufferedAppendSink<std::string> BufferedStringSink;
+
+// The other way round from |BufferedByteSink|: lets a producer that
+// takes a |ByteSinkInterface| write to a |BufferedSink|.
+class BufferedSinkAdapter : public ByteSinkInterface {
+ public:
+  // |sink| is unowned and must not be NULL.
+  explicit BufferedSinkAdapter(BufferedSink* sink)
+      : sink_(sink) {
+  }
+
+  virtual void Put(char c) {
+    sink_->Put(c);
+  }
+
+  virtual size_t PutN(const char* data, size_t len) {
+    sink_->PutN(data, len);
+    return len;
+  }
+
+ private:
+  BufferedSink* sink_;  // unowned.
+};
+
+// Like |BufferedSinkAdapter|, but passes everything on to each of
+// several branches, so that one encoding pass can feed, say, a file, a
+// |ByteHistogramSink| and a |HashingSink|. Each branch has its own
+// buffer and only sees a block when it fills, so a branch that is slow
+// to take a block, or an |AsyncFileSink| waiting on its writer,
+// doesn't make the others copy or call out any more often.
+class FanOutSink : public ByteSinkInterface {
+ public:
+  // |branch| is unowned and must outlive this.
+  void AddBranch(BufferedSink* branch) {
+    branches_.push_back(branch);
+  }
+
+  virtual void Put(char c) {
+    for (size_t i = 0; i < branches_.size(); ++i) {
+      branches_[i]->Put(c);
+    }
+  }
+
+  virtual size_t PutN(const char* data, size_t len) {
+    for (size_t i = 0; i < branches_.size(); ++i) {
+      branches_[i]->PutN(data, len);
+    }
+    return len;
+  }
+
+  void Flush() {
+    for (size_t i = 0; i < branches_.size(); ++i) {
+      branches_[i]->Flush();
+    }
+  }
+
+ private:
+  std::vector<BufferedSink*> branches_;  // unowned.
+};
+
+// Little-endian base-128 variable length integers, used by the binary
+// formats. Small values take a single byte.
+inline char* PutVarint(uint32 value, char* out) {
+  while (value >= 0x80) {
+    *out++ = static_cast<char>(0x80 | (value & 0x7F));
+    value >>= 7;
+  }
+  *out++ = static_cast<char>(value);
+  return out;
+}
+
+inline void PutVarint(uint32 value, BufferedSink* sink) {
+  sink->Commit(PutVarint(value, sink->Reserve(5)));
+}
+
+void PutVarint(uint32 value, ByteSinkInterface* sink) {
+  char buf[5];
+  sink->PutN(buf, PutVarint(value, buf) - buf);
+}
+
+// Returns a pointer just past the varint, or NULL if it doesn't fit
+// in [|data|, |end|) or in a uint32.
+const char* GetVarint(const char* data, const char* end, uint32* value) {
+  uint32 result = 0;
+  for (int shift = 0; shift < 35 && data != end; shift += 7) {
+    const uint8 byte = static_cast<uint8>(*data++);
+    // The 5th byte has room for only the top 4 bits, and must be last.
+    if (shift == 28 && byte > 0x0F) return NULL;
+    result |= static_cast<uint32>(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      *value = result;
+      return data;
+    }
+  }
+  return NULL;
+}
+
 // TODO: does it make sense to have a global enum? How should 
 // new BufferedInput implementations define new error codes? 
 enum ErrorCode {
   kNoError = 0, 
   kEndOfFile = 1,
   kFileError = 2,  // TODO: translate errno.
+  kCorruptInput = 3,  // Compressed data that doesn't decode.
 };
 
 // Adapted from ryg's BufferedStream abstraction:
@@ -227,6 +499,29 @@ class BufferedInput {
   void operator=(const BufferedInput&);
 };
 
+// Reads the next line of |input| into |line|, with its newline if it
+// has one, and terminates it with a NUL. Returns false once |input|
+// has no more lines; |input|'s error says why.
+bool GetLine(BufferedInput* input, std::vector<char>* line) {
+  line->clear();
+  while (kNoError == input->Refill()) {
+    const char* start = input->cursor;
+    const char* newline = static_cast<const char*>(
+        memchr(start, '\n', input->end() - start));
+    if (newline != NULL) {
+      input->cursor = newline + 1;
+      line->insert(line->end(), start, input->cursor);
+      line->push_back('\0');
+      return true;
+    }
+    line->insert(line->end(), start, input->end());
+    input->cursor = input->end();
+  }
+  if (line->empty()) return false;
+  line->push_back('\0');
+  return true;
+}
+
 class BufferedInputStream : public BufferedInput {
  public:
   BufferedInputStream(FILE* fp, char* buf, size_t size)
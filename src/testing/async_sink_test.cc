@@ -0,0 +1,266 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -pthread -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <signal.h>
+#include <sys/wait.h>
+
+#include <string>
+
+#include "../async_sink.h"
+#include "../timer.h"
+
+namespace webgl_loader {
+
+// Returns the contents of |path|.
+std::string ReadFile(const char* path) {
+  std::string contents;
+  FILE* fp = fopen(path, "rb");
+  CHECK(fp != NULL);
+  char buf[4096];
+  size_t length;
+  while ((length = fread(buf, 1, sizeof(buf), fp)) != 0) {
+    contents.append(buf, length);
+  }
+  fclose(fp);
+  return contents;
+}
+
+class AsyncFileSinkTest {
+ public:
+  AsyncFileSinkTest() {
+    strcpy(path_, "/tmp/async_sink_test.XXXXXX");
+    const int fd = mkstemp(path_);
+    CHECK(fd >= 0);
+    close(fd);
+  }
+
+  ~AsyncFileSinkTest() {
+    unlink(path_);
+  }
+
+  // Writes a mix of single bytes, small and large copies, and
+  // reservations bigger than a block, and appends the same to
+  // |expected|.
+  void Write(BufferedSink* sink, std::string* expected) {
+    for (size_t i = 0; i < 10000; ++i) {
+      const char c = static_cast<char>(i * 7);
+      sink->Put(c);
+      expected->push_back(c);
+    }
+    std::string big(100000, 'x');
+    for (size_t i = 0; i < big.size(); ++i) {
+      big[i] = static_cast<char>(i % 251);
+    }
+    sink->PutN(big.data(), 13);
+    sink->PutN(big.data(), big.size());
+    expected->append(big, 0, 13);
+    expected->append(big);
+    char* out = sink->Reserve(20000);
+    for (size_t i = 0; i < 20000; ++i) {
+      out[i] = static_cast<char>(i % 13);
+      expected->push_back(out[i]);
+    }
+    sink->Commit(out + 20000);
+    sink->Flush();
+    for (size_t i = 0; i < 3; ++i) {
+      sink->Put('!');
+      expected->push_back('!');
+    }
+  }
+
+  // With blocks smaller than some of the writes, and a ring as short
+  // as it can be. The sink can be reopened.
+  void TestWrite(int flags) {
+    AsyncFileSink sink(4096, 2);
+    for (size_t pass = 0; pass < 2; ++pass) {
+      std::string expected;
+      CHECK(sink.Open(path_, flags));
+      Write(&sink, &expected);
+      CHECK(sink.Close());
+      CHECK(!sink.is_open());
+      CHECK(expected == ReadFile(path_));
+    }
+    // Nothing written is an empty file.
+    CHECK(sink.Open(path_, flags));
+    CHECK(sink.Close());
+    CHECK(ReadFile(path_).empty());
+  }
+
+  void TestErrors() {
+    AsyncFileSink sink;
+    CHECK(!sink.Open("/nonexistent/async_sink_test", 0));
+    CHECK(sink.Close());
+    // The error is seen by the writer, and passed on by |Close|.
+    if (sink.Open("/dev/full", 0)) {
+      std::string expected;
+      Write(&sink, &expected);
+      CHECK(!sink.Close());
+      CHECK(ENOSPC == sink.error());
+    }
+  }
+
+ private:
+  char path_[32];
+};
+
+const double kPipeMBps = 50.0;
+const size_t kPipeBurst = 1 << 20;
+const size_t kChunkSize = 64 * 1024;
+
+// Writes to a pipe that takes |kPipeBurst| at a time, and then
+// stalls as a network mount might while it sends them on at
+// |kPipeMBps|. The producer spends as long on each chunk as the pipe
+// takes to send it.
+class AsyncFileSinkBench {
+ public:
+  explicit AsyncFileSinkBench(size_t num_bytes)
+      : num_bytes_(num_bytes) {
+    strcpy(path_, "/tmp/async_sink_bench.XXXXXX");
+    CHECK(NULL != mkdtemp(path_));
+    strcat(path_, "/fifo");
+    CHECK(0 == mkfifo(path_, 0600));
+  }
+
+  ~AsyncFileSinkBench() {
+    unlink(path_);
+    *strrchr(path_, '/') = '\0';
+    rmdir(path_);
+  }
+
+  // Reads the pipe until it is closed, pausing after each
+  // |kPipeBurst| for as long as it takes to send at |kPipeMBps|.
+  void Drain() {
+    const int fd = open(path_, O_RDONLY);
+    CHECK(fd >= 0);
+    std::vector<char> buf(kChunkSize);
+    size_t burst = 0;
+    ssize_t length;
+    while ((length = read(fd, &buf[0], buf.size())) > 0) {
+      burst += length;
+      if (burst < kPipeBurst) continue;
+      const double wait = burst / (kPipeMBps * 1e6);
+      struct timespec ts;
+      ts.tv_sec = static_cast<time_t>(wait);
+      ts.tv_nsec = static_cast<long>((wait - ts.tv_sec) * 1e9);
+      nanosleep(&ts, NULL);
+      burst = 0;
+    }
+    close(fd);
+  }
+
+  // Stands in for compressing a chunk.
+  static void Work(char* out) {
+    Timer timer;
+    uint32 state = 1;
+    const double seconds = kChunkSize / (kPipeMBps * 1e6);
+    do {
+      for (size_t i = 0; i < kChunkSize; ++i) {
+        state = state * 1664525u + 1013904223u;
+        out[i] = static_cast<char>(state >> 24);
+      }
+    } while (timer.ElapsedSeconds() < seconds);
+  }
+
+  void Produce(ByteSinkInterface* sink) {
+    std::vector<char> chunk(kChunkSize);
+    for (size_t i = 0; i < num_bytes_; i += kChunkSize) {
+      Work(&chunk[0]);
+      sink->PutN(&chunk[0], chunk.size());
+    }
+  }
+
+  void Produce(BufferedSink* sink) {
+    for (size_t i = 0; i < num_bytes_; i += kChunkSize) {
+      char* out = sink->Reserve(kChunkSize);
+      Work(out);
+      sink->Commit(out + kChunkSize);
+    }
+    sink->Flush();
+  }
+
+  void StartReader() {
+    fflush(stdout);
+    reader_ = fork();
+    CHECK(reader_ >= 0);
+    if (reader_ == 0) {
+      Drain();
+      _exit(0);
+    }
+  }
+
+  // Once the reader has everything.
+  void Report(const char* name, const Timer& timer) {
+    int status;
+    CHECK(reader_ == wait(&status));
+    printf("%-20s %8.2f s\n", name, timer.ElapsedSeconds());
+  }
+
+  FILE* OpenPipe() {
+    StartReader();
+    FILE* fp = fopen(path_, "wb");
+    CHECK(fp != NULL);
+    return fp;
+  }
+
+  void Run() {
+    printf("%.0f MB through a pipe that sends at %.0f MB/s:\n",
+           num_bytes_ / 1e6, kPipeMBps);
+    Timer timer;
+    FILE* fp = OpenPipe();
+    FileSink file_sink(fp);
+    Produce(&file_sink);
+    fclose(fp);
+    Report("FileSink", timer);
+
+    timer.Reset();
+    fp = OpenPipe();
+    BufferedFileSink buffered_file_sink(fp);
+    Produce(&buffered_file_sink);
+    fclose(fp);
+    Report("BufferedFileSink", timer);
+
+    timer.Reset();
+    StartReader();
+    AsyncFileSink async_sink;
+    CHECK(async_sink.Open(path_, 0));
+    Produce(&async_sink);
+    CHECK(async_sink.Close());
+    Report("AsyncFileSink", timer);
+  }
+
+ private:
+  size_t num_bytes_;
+  char path_[64];
+  pid_t reader_;
+};
+
+}  // namespace webgl_loader
+
+int main(int argc, char* argv[]) {
+  webgl_loader::AsyncFileSinkTest tester;
+  tester.TestWrite(0);
+  tester.TestWrite(webgl_loader::ASYNC_FILE_DIRECT);
+  tester.TestWrite(webgl_loader::ASYNC_FILE_DIRECT |
+                   webgl_loader::ASYNC_FILE_SYNC);
+  tester.TestErrors();
+  if (argc > 1) {
+    webgl_loader::AsyncFileSinkBench bench(atol(argv[1]));
+    bench.Run();
+  }
+  return 0;
+}
@@ -0,0 +1,298 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -pthread -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "../build_cache.h"
+#include "../objcompress.h"
+#include "../timer.h"
+
+namespace webgl_loader {
+
+void WriteFile(const char* path, const std::string& contents) {
+  FILE* fp = fopen(path, "wb");
+  CHECK(fp != NULL);
+  CHECK(contents.size() == fwrite(contents.data(), 1, contents.size(), fp));
+  fclose(fp);
+}
+
+std::string ReadFile(const char* path) {
+  std::string contents;
+  FILE* fp = fopen(path, "rb");
+  CHECK(fp != NULL);
+  char buf[4096];
+  size_t length;
+  while ((length = fread(buf, 1, sizeof(buf), fp)) != 0) {
+    contents.append(buf, length);
+  }
+  fclose(fp);
+  return contents;
+}
+
+bool Exists(const std::string& path) {
+  struct stat st;
+  return 0 == stat(path.c_str(), &st);
+}
+
+// Sets when the entry for |key| was last used to |when|.
+void SetUsed(const BuildCache& cache, uint64 key, time_t when) {
+  struct timeval times[2];
+  times[0].tv_sec = times[1].tv_sec = when;
+  times[0].tv_usec = times[1].tv_usec = 0;
+  CHECK(0 == utimes((cache.EntryPath(key) + "/model.js").c_str(), times));
+}
+
+uint64 ObjKey(const char* path) {
+  Hash64 hash;
+  CHECK(HashObjInputs(path, &hash));
+  return hash.Digest();
+}
+
+// Runs in a directory of its own, which it removes after.
+class BuildCacheTest {
+ public:
+  BuildCacheTest()
+      : dir_(MakeDir()),
+        cache_("cache") {
+    CHECK(cache_.ok());
+  }
+
+  ~BuildCacheTest() {
+    std::vector<std::string> names;
+    ListDir("cache", &names);
+    for (size_t i = 0; i < names.size(); ++i) {
+      RemoveDir("cache/" + names[i]);
+    }
+    CHECK(0 == chdir(".."));
+    RemoveDir(dir_ + "/cache");
+    RemoveDir(dir_);
+  }
+
+  // A key changes with the OBJ and its MTL, but not with how the OBJ
+  // is stored.
+  void TestKeys() {
+    const std::string obj = "mtllib a.mtl\nv 0 0 0\nv 1 0 0\nv 0 1 0\n"
+        "usemtl a\nf 1 2 3\n";
+    WriteFile("a.obj", obj);
+    const uint64 no_mtl = ObjKey("a.obj");
+    WriteFile("a.mtl", "newmtl a\nKd 1 0 0\n");
+    const uint64 red = ObjKey("a.obj");
+    CHECK(red != no_mtl);
+    CHECK(red == ObjKey("a.obj"));
+    WriteFile("a.mtl", "newmtl a\nKd 0 1 0\n");
+    const uint64 green = ObjKey("a.obj");
+    CHECK(green != red);
+    WriteFile("b.obj", obj + "f 3 2 1\n");
+    CHECK(green != ObjKey("b.obj"));
+    // The same OBJ, gzipped, with no compression.
+    std::string gzipped("\x1F\x8B\x08\0\0\0\0\0\0\xFF\x01", 11);
+    gzipped += static_cast<char>(obj.size());
+    gzipped += '\0';
+    gzipped += static_cast<char>(~obj.size());
+    gzipped += '\xFF';
+    gzipped += obj;
+    const uint32 crc = Crc32(0, obj.data(), obj.data() + obj.size());
+    const uint32 trailer[2] = { crc, static_cast<uint32>(obj.size()) };
+    gzipped.append(reinterpret_cast<const char*>(trailer), sizeof(trailer));
+    WriteFile("a.obj.gz", gzipped);
+    CHECK(green == ObjKey("a.obj.gz"));
+    Hash64 hash;
+    CHECK(!HashObjInputs("missing.obj", &hash));
+  }
+
+  // A hit puts back the files that were stored, and the JS.
+  void TestStoreAndFetch() {
+    WriteFile("1.utf8", "first");
+    WriteFile("2.utf8", "second");
+    std::vector<std::string> paths;
+    paths.push_back("1.utf8");
+    paths.push_back("2.utf8");
+    CHECK(cache_.Store(1, "MODELS[\"a\"] = {};\n", paths));
+    // An entry that is there is kept.
+    CHECK(cache_.Store(1, "other", std::vector<std::string>()));
+    unlink("1.utf8");
+    unlink("2.utf8");
+    std::string js = "before\n";
+    CHECK(!cache_.Fetch(2, &js));
+    CHECK(cache_.Fetch(1, &js));
+    CHECK(js == "before\nMODELS[\"a\"] = {};\n");
+    CHECK(ReadFile("1.utf8") == "first");
+    CHECK(ReadFile("2.utf8") == "second");
+    // Outputs already there are left alone.
+    CHECK(cache_.Fetch(1, &js));
+  }
+
+  // The entries used longest ago go first.
+  void TestCollect() {
+    const std::string contents(1000, 'x');
+    std::vector<std::string> paths(1, "out.utf8");
+    const time_t now = time(NULL);
+    for (uint64 key = 10; key < 14; ++key) {
+      WriteFile("out.utf8", contents);
+      CHECK(cache_.Store(key, "", paths));
+      unlink("out.utf8");
+      SetUsed(cache_, key, now - 100 + key);
+    }
+    // Entry 1, from above, is oldest of all.
+    SetUsed(cache_, 1, now - 1000);
+    std::string js;
+    CHECK(cache_.Fetch(10, &js));
+    // A temporary directory from a tool that stopped long ago.
+    const std::string temp = "cache/tmp.stale";
+    CHECK(0 == mkdir(temp.c_str(), 0777));
+    struct timeval times[2] = { { now - 7200, 0 }, { now - 7200, 0 } };
+    CHECK(0 == utimes(temp.c_str(), times));
+    BuildCacheStats stats;
+    cache_.Collect(2500, &stats);
+    CHECK(2 == stats.num_entries);
+    CHECK(2000 == stats.num_bytes);
+    CHECK(3 == stats.num_evicted);
+    CHECK(!Exists(temp));
+    // Evicted entries are renamed out of the way first, and then gone.
+    std::vector<std::string> names;
+    CHECK(ListDir("cache", &names));
+    CHECK(2 == names.size());
+    for (size_t i = 0; i < names.size(); ++i) {
+      CHECK(0 != names[i].compare(0, 4, "tmp."));
+    }
+    CHECK(!Exists(cache_.EntryPath(1)));
+    CHECK(!Exists(cache_.EntryPath(11)));
+    CHECK(!Exists(cache_.EntryPath(12)));
+    CHECK(Exists(cache_.EntryPath(13)));
+    CHECK(Exists(cache_.EntryPath(10)));
+    CHECK(ReadFile("out.utf8") == contents);
+  }
+
+  // Models with the same contents share an entry, but each is still
+  // assigned to its own name.
+  void TestSameContentsAnotherName() {
+    const std::string obj = "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 3\n";
+    WriteFile("model.obj", obj);
+    WriteFile("copy.obj", obj);
+    CompressOptions options;
+    options.cache = &cache_;
+    AsyncFileSink out_file;
+    size_t num_mismatches = 0;
+    std::string model_js, copy_js;
+    bool hit;
+    CHECK(CompressModelCached(options, "model.obj", "m.utf8", "m.tmp",
+                              &out_file, &model_js, &num_mismatches, &hit));
+    CHECK(!hit);
+    CHECK(CompressModelCached(options, "copy.obj", "m.utf8", "m.tmp",
+                              &out_file, &copy_js, &num_mismatches, &hit));
+    CHECK(hit);
+    const std::string model_name = "MODELS[\"model.obj\"] = ";
+    const std::string copy_name = "MODELS[\"copy.obj\"] = ";
+    CHECK(0 == model_js.compare(0, model_name.size(), model_name));
+    CHECK(0 == copy_js.compare(0, copy_name.size(), copy_name));
+    CHECK(model_js.substr(model_name.size()) ==
+          copy_js.substr(copy_name.size()));
+  }
+
+  // Outputs that keep their names are copied in and out, so writing
+  // over one in place leaves the entry as it was, and a hit puts it
+  // back where it was.
+  void TestCopyOutputs() {
+    BuildCache copying("cache");
+    copying.set_copy_outputs(true);
+    CHECK(0 == mkdir("out", 0777));
+    WriteFile("out/model.utf8", "first");
+    CHECK(copying.Store(20, "{}",
+                        std::vector<std::string>(1, "out/model.utf8")));
+    WriteFile("out/model.utf8", "second");
+    std::string js;
+    CHECK(copying.Fetch(20, "out", &js));
+    CHECK(js == "{}");
+    CHECK(ReadFile("out/model.utf8") == "first");
+    RemoveDir("out");
+  }
+
+  // Hits for |num_models| models, each of a few files, as for a batch
+  // where nothing has changed, and how fast their OBJs are hashed.
+  void Bench(size_t num_models) {
+    std::string obj;
+    char line[64];
+    for (int i = 0; i < 100000; ++i) {
+      snprintf(line, sizeof(line), "v %d.125 %d.5 %d.25\n", i, i / 7, i % 3);
+      obj += line;
+    }
+    WriteFile("bench.obj", obj);
+    Timer timer;
+    uint64 key = 0;
+    for (int i = 0; i < 10; ++i) {
+      key += ObjKey("bench.obj");
+    }
+    const double hash_seconds = timer.ElapsedSeconds() / 10;
+    std::vector<std::string> paths;
+    for (size_t i = 0; i < 3; ++i) {
+      snprintf(line, sizeof(line), "bench%d.utf8", static_cast<int>(i));
+      WriteFile(line, std::string(20000, 'x'));
+      paths.push_back(line);
+    }
+    for (size_t i = 0; i < num_models; ++i) {
+      CHECK(cache_.Store(key + i, "MODELS[\"bench\"] = {};\n", paths));
+    }
+    timer.Reset();
+    std::string js;
+    for (size_t i = 0; i < num_models; ++i) {
+      CHECK(cache_.Fetch(key + i, &js));
+    }
+    const double fetch_seconds = timer.ElapsedSeconds();
+    timer.Reset();
+    BuildCacheStats stats;
+    cache_.Collect(0, &stats);
+    const double collect_seconds = timer.ElapsedSeconds();
+    printf("Hashed a " PRIuS " byte OBJ at %.0f MB/s; " PRIuS " hits "
+           "at %.0f/s; collected " PRIuS " entries in %.1f ms\n",
+           obj.size(), obj.size() / hash_seconds / 1e6, num_models,
+           num_models / fetch_seconds, stats.num_evicted,
+           1e3 * collect_seconds);
+  }
+
+ private:
+  static std::string MakeDir() {
+    char dir[] = "/tmp/build_cache_test.XXXXXX";
+    CHECK(mkdtemp(dir) != NULL);
+    CHECK(0 == chdir(dir));
+    return dir;
+  }
+
+  const std::string dir_;
+  BuildCache cache_;
+};
+
+}  // namespace webgl_loader
+
+int main(int argc, char* argv[]) {
+  {
+    webgl_loader::BuildCacheTest tester;
+    tester.TestKeys();
+    tester.TestStoreAndFetch();
+    tester.TestCollect();
+    tester.TestSameContentsAnotherName();
+    tester.TestCopyOutputs();
+  }
+  if (argc > 1) {
+    webgl_loader::BuildCacheTest bench;
+    bench.Bench(atol(argv[1]));
+  }
+  return 0;
+}
@@ -16,10 +16,523 @@ exit;
 // implied. See the License for the specific language governing
 // permissions and limitations under the License.
 
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+
 #include "../compress.h"
+#include "../decompress.h"
+#include "../optimize.h"
+
+namespace webgl_loader {
+
+class CompressTest {
+ public:
+  CompressTest() {
+    Bounds bounds;
+    bounds.Clear();
+    for (size_t i = 0; i < 8; ++i) {
+      bounds.mins[i] = 0;
+      bounds.maxes[i] = 1;
+    }
+    params_ = BoundsParams::FromBounds(bounds);
+  }
+
+  // A wavy |n| x |n| grid of quads, which is mostly strips of edge
+  // matches.
+  void MakeGrid(size_t n, DrawMesh* mesh) {
+    for (size_t y = 0; y <= n; ++y) {
+      for (size_t x = 0; x <= n; ++x) {
+        const float u = float(x) / n;
+        const float v = float(y) / n;
+        const float z = 0.1f * sin(6 * u) * cos(4 * v);
+        const float attribs[8] = { u, v, z + 0.5f, u, v, 0.f, 0.f, 1.f };
+        mesh->attribs.insert(mesh->attribs.end(), attribs, attribs + 8);
+      }
+    }
+    for (size_t y = 0; y < n; ++y) {
+      for (size_t x = 0; x < n; ++x) {
+        const int i = y * (n + 1) + x;
+        const int quad[6] = { i, i + 1, i + int(n) + 2,
+                              i, i + int(n) + 2, i + int(n) + 1 };
+        mesh->indices.insert(mesh->indices.end(), quad, quad + 6);
+      }
+    }
+  }
+
+  // Triangles with random vertices, which rarely share edges.
+  void MakeSoup(size_t num_verts, size_t num_tris, DrawMesh* mesh) {
+    srand(1);
+    for (size_t i = 0; i < 8 * num_verts; ++i) {
+      mesh->attribs.push_back(rand() / float(RAND_MAX));
+    }
+    for (size_t i = 0; i < 3 * num_tris; ++i) {
+      mesh->indices.push_back(rand() % num_verts);
+    }
+  }
+
+  void TestRoundTrip(const DrawMesh& draw_mesh) {
+    QuantizedAttribList quantized_attribs;
+    AttribsToQuantizedAttribs(draw_mesh.attribs, params_, &quantized_attribs);
+    VertexOptimizer vertex_optimizer(quantized_attribs);
+    WebGLMeshList webgl_meshes;
+    vertex_optimizer.AddTriangles(&draw_mesh.indices[0],
+                                  draw_mesh.indices.size(), &webgl_meshes);
+    for (size_t i = 0; i < webgl_meshes.size(); ++i) {
+      TestRoundTrip(EDGE_CACHING_BACKREF, webgl_meshes[i]);
+      TestRoundTrip(EDGE_CACHING_LRU, webgl_meshes[i]);
+      TestRoundTrip(EDGE_CACHING_EDGEBREAKER, webgl_meshes[i]);
+    }
+  }
+
+  // |mesh| is passed by value, since the compressor rotates triangles
+  // in place, or renumbers the whole mesh.
+  void TestRoundTrip(EdgeCachingMode mode, WebGLMesh mesh) {
+    std::string utf8;
+    StringSink sink(&utf8);
+    EdgeCachingCompressor compressor(mesh.attribs, mesh.indices);
+    compressor.set_choose_predictors(true);
+    if (mode == EDGE_CACHING_LRU) {
+      compressor.CompressWithLRU(&sink);
+    } else if (mode == EDGE_CACHING_EDGEBREAKER) {
+      compressor.CompressWithEdgebreaker(&sink);
+    } else {
+      compressor.Compress(&sink);
+    }
+    CHECK(!utf8.empty());
+    const size_t num_verts = mesh.attribs.size() / 8;
+    const size_t num_tris = mesh.indices.size() / 3;
+
+    // Decode the UTF-8 back to the streams.
+    std::vector<uint16> words;
+    CHECK(Utf8ToUint16(utf8.data(), utf8.size(), &words));
+    CHECK(words.size() == compressor.deltas().size() +
+          compressor.codes().size());
+    CHECK(std::equal(compressor.deltas().begin(), compressor.deltas().end(),
+                     words.begin()));
+    EdgeCachingDecompressor decompressor(params_, &words[0], num_verts,
+                                         &words[8 * num_verts],
+                                         compressor.codes().size(),
+                                         num_tris);
+    DecodedMesh decoded;
+    decompressor.set_predictors(compressor.predictors());
+    CHECK(decompressor.Decompress(mode, &decoded));
+    CheckDecodedMesh(mesh, decoded);
+
+    // Truncated code streams must be rejected, not overrun.
+    EdgeCachingDecompressor truncated(params_, &words[0], num_verts,
+                                      &words[8 * num_verts],
+                                      compressor.codes().size() - 1,
+                                      num_tris);
+    truncated.set_predictors(compressor.predictors());
+    CHECK(!truncated.Decompress(mode, &decoded));
+
+    // Backrefs 0-2 would be to the triangle being decoded.
+    if (mode == EDGE_CACHING_BACKREF) {
+      OptimizedIndexList edge_codes = compressor.edge_codes();
+      size_t t = 0;
+      while (t < edge_codes.size() &&
+             !(edge_codes[t] >= 3 && edge_codes[t] < 3 * t &&
+               edge_codes[t] < EdgeCachingCompressor::kMaxLruSize)) {
+        ++t;
+      }
+      CHECK(t < edge_codes.size());
+      edge_codes[t] %= 3;
+      EdgeCachingDecompressor self_ref(params_, &words[0], num_verts, num_tris,
+                                       &edge_codes[0], edge_codes.size(),
+                                       &compressor.index_codes()[0],
+                                       compressor.index_codes().size());
+      self_ref.set_predictors(compressor.predictors());
+      CHECK(!self_ref.Decompress(mode, &decoded));
+    }
+
+    // The binary format should decode to the same mesh, and be smaller.
+    std::string binary;
+    StringSink binary_sink(&binary);
+    compressor.EmitBinary(&binary_sink);
+    CHECK(binary.size() < utf8.size());
+    // Trailing bytes belong to the next mesh, and are not consumed.
+    binary.append("trailing");
+    size_t consumed = 0;
+    DecodedMesh binary_decoded;
+    CHECK(DecompressBinaryMesh(binary.data(), binary.size(), params_,
+                               &binary_decoded, &consumed));
+    CHECK(consumed == binary.size() - strlen("trailing"));
+    CheckDecodedMesh(mesh, binary_decoded);
+    CHECK(!DecompressBinaryMesh(binary.data(), consumed - 1, params_,
+                                &binary_decoded));
+  }
+
+  void TestGrid() {
+    DrawMesh mesh;
+    MakeGrid(40, &mesh);
+    TestRoundTrip(mesh);
+  }
+
+  void TestSoup() {
+    DrawMesh mesh;
+    MakeSoup(500, 2000, &mesh);
+    TestRoundTrip(mesh);
+  }
+
+  void TestSimpleRoundTrip() {
+    WebGLMesh mesh = MakeGridMesh(20);
+    size_t num_words = 0;
+    std::string utf8;
+    const MeshEntry entry = AppendMesh(MESH_FORMAT_INDEX_RANGE, &mesh,
+                                       &num_words, &utf8);
+    std::vector<uint16> words;
+    CHECK(Utf8ToUint16(utf8.data(), utf8.size(), &words));
+    CHECK(words.size() == num_words);
+    DecodedMesh decoded;
+    CHECK(DecompressSimpleMesh(params_, &words[0], entry.num_verts,
+                               &words[entry.code_start], entry.num_tris,
+                               &decoded));
+    CHECK(MatchesDecodedMesh(mesh, MESH_FORMAT_INDEX_RANGE, decoded));
+    // High water mark codes can't refer to vertices not yet seen.
+    words[entry.code_start + 1] = 2;
+    CHECK(!DecompressSimpleMesh(params_, &words[0], entry.num_verts,
+                                &words[entry.code_start], entry.num_tris,
+                                &decoded));
+  }
+
+  void TestAABBs() {
+    Bounds bounds;
+    bounds.Clear();
+    const float mins[3] = { 0.25f, 0.f, 0.5f };
+    const float maxes[3] = { 0.75f, 0.125f, 1.f };
+    for (size_t i = 0; i < 3; ++i) {
+      bounds.mins[i] = mins[i];
+      bounds.maxes[i] = maxes[i];
+    }
+    std::string utf8;
+    StringSink sink(&utf8);
+    CompressAABBToUtf8(bounds, params_, &sink);
+    CompressAABBToUtf8(bounds, params_, &sink);
+    std::vector<uint16> words;
+    CHECK(Utf8ToUint16(utf8.data(), utf8.size(), &words));
+    CHECK(12 == words.size());
+    AttribList bboxes;
+    DecompressAABBs(params_, &words[0], 2, &bboxes);
+    CHECK(12 == bboxes.size());
+    const float kTolerance = 2.f / 16383;
+    for (size_t i = 0; i < 3; ++i) {
+      CHECK(fabs(bboxes[i] - 0.5f * (mins[i] + maxes[i])) < kTolerance);
+      CHECK(fabs(bboxes[3 + i] - 0.5f * (maxes[i] - mins[i])) < kTolerance);
+      CHECK(bboxes[i] == bboxes[6 + i]);
+    }
+  }
+
+  // Records the meshes from a |MeshStreamDecoder|, and how much input
+  // had been pushed when each arrived.
+  class RecordingSink : public MeshSinkInterface {
+   public:
+    explicit RecordingSink(const size_t* pushed)
+        : pushed_(pushed) {
+    }
+
+    virtual void PutMesh(const MeshEntry& entry, const DecodedMesh& mesh) {
+      meshes.push_back(mesh);
+      pushed_when_decoded.push_back(*pushed_);
+    }
+
+    std::vector<DecodedMesh> meshes;
+    std::vector<size_t> pushed_when_decoded;
+
+   private:
+    const size_t* pushed_;
+  };
+
+  void TestStreaming() {
+    const MeshFormat formats[4] = {
+      MESH_FORMAT_INDEX_RANGE, MESH_FORMAT_CODE_RANGE,
+      MESH_FORMAT_LRU_CODE_RANGE, MESH_FORMAT_EDGEBREAKER_CODE_RANGE
+    };
+    WebGLMeshList meshes;
+    std::vector<MeshEntry> entries;
+    std::vector<size_t> mesh_ends;
+    std::string utf8;
+    size_t num_words = 0;
+    for (size_t i = 0; i < 4; ++i) {
+      meshes.push_back(MakeGridMesh(10 + i));
+      entries.push_back(AppendMesh(formats[i], &meshes.back(), &num_words,
+                                   &utf8));
+      mesh_ends.push_back(utf8.size());
+    }
+    // Push a byte at a time, which splits multi-byte characters.
+    size_t pushed = 0;
+    RecordingSink sink(&pushed);
+    MeshStreamDecoder decoder(params_, entries, &sink);
+    while (pushed < utf8.size()) {
+      ++pushed;
+      CHECK(decoder.Push(&utf8[pushed - 1], 1));
+    }
+    CHECK(decoder.Finish());
+    CHECK(4 == sink.meshes.size());
+    for (size_t i = 0; i < 4; ++i) {
+      // Each mesh is decoded as soon as its last byte arrives.
+      CHECK(mesh_ends[i] == sink.pushed_when_decoded[i]);
+      CHECK(MatchesDecodedMesh(meshes[i], formats[i], sink.meshes[i]));
+    }
+
+    // A truncated stream doesn't finish.
+    MeshStreamDecoder truncated(params_, entries, &sink);
+    CHECK(truncated.Push(utf8.data(), utf8.size() - 1));
+    CHECK(3 == truncated.num_decoded());
+    CHECK(!truncated.Finish());
+
+    // Nor does one that refers to more input than there is.
+    entries.back().code_length += 1;
+    MeshStreamDecoder overlong(params_, entries, &sink);
+    CHECK(overlong.Push(utf8.data(), utf8.size()));
+    CHECK(!overlong.Finish());
+  }
+
+  void TestBinaryStreaming() {
+    WebGLMeshList meshes;
+    std::vector<MeshEntry> entries;
+    std::string binary;
+    StringSink sink(&binary);
+    for (size_t i = 0; i < 2; ++i) {
+      meshes.push_back(MakeGridMesh(10 + i));
+      MeshEntry entry;
+      entry.format = MESH_FORMAT_BINARY_RANGE;
+      entry.code_start = binary.size();
+      EdgeCachingCompressor compressor(meshes.back().attribs,
+                                       meshes.back().indices);
+      compressor.set_choose_predictors(true);
+      compressor.EncodeWithLRU();
+      compressor.EmitBinary(&sink);
+      entry.code_length = binary.size() - entry.code_start;
+      entries.push_back(entry);
+    }
+    MeshVerifier verifier(&meshes);
+    MeshStreamDecoder decoder(params_, entries, &verifier);
+    const size_t kChunkSize = 7;
+    for (size_t i = 0; i < binary.size(); i += kChunkSize) {
+      CHECK(decoder.Push(&binary[i], std::min(kChunkSize, binary.size() - i)));
+    }
+    CHECK(decoder.Finish());
+    CHECK(2 == verifier.num_meshes());
+    CHECK(0 == verifier.num_mismatches());
+  }
+
+  // Bboxes are compared by value, not just counted.
+  void TestVerifyBBoxes() {
+    WebGLMeshList meshes(1, MakeGridMesh(10));
+    size_t num_words = 0;
+    std::string utf8;
+    std::vector<MeshEntry> entries(
+        1, AppendMesh(MESH_FORMAT_INDEX_RANGE, &meshes[0], &num_words, &utf8));
+    Bounds bounds;
+    bounds.Clear();
+    for (size_t i = 0; i < 3; ++i) {
+      bounds.mins[i] = 0.25f;
+      bounds.maxes[i] = 0.75f;
+    }
+    StringSink sink(&utf8);
+    CompressAABBToUtf8(bounds, params_, &sink);
+    entries[0].bboxes_start = num_words;
+    entries[0].num_bboxes = 1;
+    std::vector<QuantizedAttribList> bbox_words(1);
+    QuantizeAABB(bounds, params_, &bbox_words[0]);
+    CHECK(6 == bbox_words[0].size());
+    for (size_t i = 0; i < 2; ++i) {
+      MeshVerifier verifier(&meshes);
+      verifier.set_expected_bboxes(params_, &bbox_words);
+      MeshStreamDecoder decoder(params_, entries, &verifier);
+      CHECK(decoder.Push(utf8.data(), utf8.size()));
+      CHECK(decoder.Finish());
+      CHECK(1 == verifier.num_meshes());
+      CHECK(i == verifier.num_mismatches());
+      // Off by one in an extent is still a mismatch.
+      ++bbox_words[0][3];
+    }
+  }
+
+  void TestLruIsSmaller() {
+    DrawMesh draw_mesh;
+    MakeGrid(40, &draw_mesh);
+    QuantizedAttribList quantized_attribs;
+    AttribsToQuantizedAttribs(draw_mesh.attribs, params_, &quantized_attribs);
+    VertexOptimizer vertex_optimizer(quantized_attribs);
+    WebGLMeshList webgl_meshes;
+    vertex_optimizer.AddTriangles(&draw_mesh.indices[0],
+                                  draw_mesh.indices.size(), &webgl_meshes);
+    CHECK(1 == webgl_meshes.size());
+    OptimizedIndexList indices = webgl_meshes[0].indices;
+    std::string backref_utf8, lru_utf8;
+    StringSink backref_sink(&backref_utf8), lru_sink(&lru_utf8);
+    EdgeCachingCompressor backref(webgl_meshes[0].attribs,
+                                  webgl_meshes[0].indices);
+    backref.Compress(&backref_sink);
+    EdgeCachingCompressor lru(webgl_meshes[0].attribs, indices);
+    lru.CompressWithLRU(&lru_sink);
+    CHECK(lru.codes().size() <= backref.codes().size());
+    CHECK(lru_utf8.size() <= backref_utf8.size());
+  }
+
+  void TestEdgebreaker() {
+    // A grid is one seed, then mostly C, R, L and X. The spiral wraps
+    // back onto the boundary it started along once per row, which
+    // costs an S and its index code.
+    WebGLMesh grid = MakeGridMesh(40);
+    WebGLMesh lru_grid = grid;
+    EdgeCachingCompressor lru(lru_grid.attribs, lru_grid.indices);
+    lru.EncodeWithLRU();
+    EdgeCachingCompressor edgebreaker(grid.attribs, grid.indices);
+    edgebreaker.EncodeWithEdgebreaker();
+    CHECK(edgebreaker.index_codes().size() <= 3 + 41);
+    CHECK(3 * edgebreaker.codes().size() < lru.codes().size());
+
+    // Non-manifold and inconsistently wound triangles fall back to S
+    // and X symbols and more seeds. From a quad (0, 1, 2, 3): a third
+    // triangle on the edge 0 -> 2, one wound the other way, an exact
+    // duplicate, a degenerate triangle, and a separate component that
+    // reuses vertex 3.
+    const uint16 kIndices[] = {
+      0, 1, 2,  0, 2, 3,  2, 0, 4,  0, 2, 5,  1, 2, 0,  0, 1, 2,
+      4, 4, 5,  3, 6, 7,  7, 6, 8
+    };
+    WebGLMesh mesh;
+    for (size_t i = 0; i < 9; ++i) {
+      const uint16 attribs[8] = {
+        uint16(100 * (i % 3)), uint16(100 * (i / 3)), uint16(7 * i * i),
+        uint16(10 * i), uint16(5 * i), 511, 511, 1022
+      };
+      mesh.attribs.insert(mesh.attribs.end(), attribs, attribs + 8);
+    }
+    mesh.indices.assign(kIndices, kIndices + sizeof(kIndices) / 2);
+    TestRoundTrip(EDGE_CACHING_EDGEBREAKER, mesh);
+  }
+
+  // Each predictor must decode what it encodes, including on soup,
+  // where most vertices fall back to simpler predictions.
+  void TestPredictors() {
+    DrawMesh soup;
+    MakeSoup(500, 2000, &soup);
+    WebGLMesh soup_mesh;
+    AttribsToQuantizedAttribs(soup.attribs, params_, &soup_mesh.attribs);
+    soup_mesh.indices.assign(soup.indices.begin(), soup.indices.end());
+    const WebGLMesh meshes[2] = { MakeGridMesh(40), soup_mesh };
+    for (size_t m = 0; m < 2; ++m) {
+      const WebGLMesh& mesh = meshes[m];
+      const size_t num_verts = mesh.attribs.size() / 8;
+      VertexTriangles topology(&mesh.indices[0], mesh.indices.size() / 3,
+                               num_verts);
+      // Positions come first, since texcoord predictors may use them.
+      const AttribPredictorInterface& positions =
+          *GetPredictor(PREDICTOR_PARALLELOGRAM);
+      for (int p = PREDICTOR_PARALLELOGRAM; p < NUM_PREDICTORS; ++p) {
+        const AttribPredictorInterface& texcoords =
+            *GetPredictor(static_cast<AttribPredictor>(p));
+        std::vector<uint16> deltas(mesh.attribs.size());
+        EncodeResiduals(positions, topology, mesh.attribs, 0, 3, &deltas[0]);
+        EncodeResiduals(texcoords, topology, mesh.attribs, 3, 2, &deltas[0]);
+        QuantizedAttribList decoded(mesh.attribs.size(), 0);
+        DecodeResiduals(positions, topology, &deltas[0], num_verts, 0, 3,
+                        &decoded[0]);
+        DecodeResiduals(texcoords, topology, &deltas[0], num_verts, 3, 2,
+                        &decoded[0]);
+        for (size_t i = 0; i < num_verts; ++i) {
+          CHECK(std::equal(&mesh.attribs[8*i], &mesh.attribs[8*i + 5],
+                           &decoded[8*i]));
+        }
+      }
+    }
+
+    // A smooth grid should prefer, and benefit from, the post pass.
+    WebGLMesh grid = meshes[0];
+    EdgeCachingCompressor traversal(grid.attribs, grid.indices);
+    traversal.EncodeWithLRU();
+    CHECK(traversal.predictors().IsTraversal());
+    EdgeCachingCompressor predicted(grid.attribs, grid.indices);
+    predicted.set_choose_predictors(true);
+    predicted.EncodeWithLRU();
+    CHECK(predicted.predictors().positions != PREDICTOR_TRAVERSAL);
+    const size_t num_verts = grid.attribs.size() / 8;
+    CHECK(ResidualEntropy(&predicted.deltas()[0], num_verts, 0, 5) <
+          ResidualEntropy(&traversal.deltas()[0], num_verts, 0, 5));
+  }
+
+ private:
+  void CheckDecodedMesh(const WebGLMesh& mesh, const DecodedMesh& decoded) {
+    // |Compress| rotates triangles in place, and the decoded triangles
+    // should match exactly.
+    CHECK(MatchesDecodedMesh(mesh, MESH_FORMAT_CODE_RANGE, decoded));
+    for (size_t i = 0; i < mesh.attribs.size(); i += 8) {
+      for (size_t j = 0; j < 5; ++j) {
+        const float expected = params_.decodeScales[j] *
+            (mesh.attribs[i + j] + params_.decodeOffsets[j]);
+        CHECK(expected == decoded.attribs[i + j]);
+      }
+    }
+  }
+
+  WebGLMesh MakeGridMesh(size_t n) {
+    DrawMesh draw_mesh;
+    MakeGrid(n, &draw_mesh);
+    QuantizedAttribList quantized_attribs;
+    AttribsToQuantizedAttribs(draw_mesh.attribs, params_, &quantized_attribs);
+    VertexOptimizer vertex_optimizer(quantized_attribs);
+    WebGLMeshList webgl_meshes;
+    vertex_optimizer.AddTriangles(&draw_mesh.indices[0],
+                                  draw_mesh.indices.size(), &webgl_meshes);
+    CHECK(1 == webgl_meshes.size());
+    return webgl_meshes[0];
+  }
+
+  // Appends |mesh| to |utf8| in |format|, and returns its entry.
+  // |mesh| may be rotated or renumbered by the edge caching
+  // compressors.
+  MeshEntry AppendMesh(MeshFormat format, WebGLMesh* mesh,
+                       size_t* num_words, std::string* utf8) {
+    StringSink sink(utf8);
+    MeshEntry entry;
+    entry.format = format;
+    entry.attrib_start = *num_words;
+    entry.num_verts = mesh->attribs.size() / 8;
+    entry.num_tris = mesh->indices.size() / 3;
+    entry.code_start = *num_words + mesh->attribs.size();
+    if (format == MESH_FORMAT_INDEX_RANGE) {
+      CompressQuantizedAttribsToUtf8(mesh->attribs, &sink);
+      CompressIndicesToUtf8(mesh->indices, &sink);
+      entry.code_length = mesh->indices.size();
+    } else {
+      EdgeCachingCompressor compressor(mesh->attribs, mesh->indices);
+      compressor.set_choose_predictors(true);
+      if (format == MESH_FORMAT_LRU_CODE_RANGE) {
+        compressor.CompressWithLRU(&sink);
+      } else if (format == MESH_FORMAT_EDGEBREAKER_CODE_RANGE) {
+        compressor.CompressWithEdgebreaker(&sink);
+      } else {
+        compressor.Compress(&sink);
+      }
+      entry.code_length = compressor.codes().size();
+      entry.predictors = compressor.predictors();
+    }
+    *num_words = entry.code_start + entry.code_length;
+    return entry;
+  }
+
+  BoundsParams params_;
+};
 
-// TODO: write tests!
+}  // namespace webgl_loader
 
 int main(int argc, char* argv[]) {
+  webgl_loader::CompressTest tester;
+  tester.TestGrid();
+  tester.TestSoup();
+  tester.TestLruIsSmaller();
+  tester.TestPredictors();
+  tester.TestEdgebreaker();
+  tester.TestSimpleRoundTrip();
+  tester.TestAABBs();
+  tester.TestStreaming();
+  tester.TestBinaryStreaming();
+  tester.TestVerifyBBoxes();
   return 0;
 }
@@ -0,0 +1,420 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -pthread -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <dirent.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "../convert_server.h"
+#include "../timer.h"
+
+namespace webgl_loader {
+
+void WriteFile(const char* path, const std::string& contents) {
+  FILE* fp = fopen(path, "wb");
+  CHECK(fp != NULL);
+  CHECK(contents.size() == fwrite(contents.data(), 1, contents.size(), fp));
+  fclose(fp);
+}
+
+std::string ReadFile(const char* path) {
+  std::string contents;
+  CHECK(ReadFileToString(path, &contents));
+  return contents;
+}
+
+// A |size| by |size| grid of quads, with texcoords and normals, in
+// two materials.
+std::string GridObj(int size) {
+  std::string obj = "mtllib grid.mtl\n";
+  char line[256];
+  for (int y = 0; y <= size; ++y) {
+    for (int x = 0; x <= size; ++x) {
+      snprintf(line, sizeof(line), "v %d %d %d\nvt %f %f\nvn 0 0 1\n", x, y,
+               (x * y) % 7, static_cast<float>(x) / size,
+               static_cast<float>(y) / size);
+      obj += line;
+    }
+  }
+  for (int y = 0; y < size; ++y) {
+    obj += (y < size / 2) ? "usemtl red\n" : "usemtl green\n";
+    for (int x = 0; x < size; ++x) {
+      const int a = y * (size + 1) + x + 1;
+      const int b = a + size + 1;
+      snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n",
+               a, a, a, a + 1, a + 1, a + 1, b + 1, b + 1, b + 1, b, b, b);
+      obj += line;
+    }
+  }
+  return obj;
+}
+
+// |contents| as a gzip member of stored blocks, which need not be
+// deflated to be inflated.
+std::string StoredGzip(const std::string& contents) {
+  std::string gzipped("\x1F\x8B\x08\0\0\0\0\0\0\xFF", 10);
+  size_t done = 0;
+  do {
+    const size_t length = std::min<size_t>(contents.size() - done, 0xFFFF);
+    const bool last = done + length == contents.size();
+    gzipped += static_cast<char>(last);
+    gzipped += static_cast<char>(length);
+    gzipped += static_cast<char>(length >> 8);
+    gzipped += static_cast<char>(~length);
+    gzipped += static_cast<char>(~length >> 8);
+    gzipped.append(contents, done, length);
+    done += length;
+  } while (done != contents.size());
+  const uint32 trailer[2] = {
+    Crc32(0, contents.data(), contents.data() + contents.size()),
+    static_cast<uint32>(contents.size())
+  };
+  gzipped.append(reinterpret_cast<const char*>(trailer), sizeof(trailer));
+  return gzipped;
+}
+
+ConvertJob PathJob(const char* input, const char* out) {
+  ConvertJob job;
+  job.input = input;
+  job.out = out;
+  return job;
+}
+
+ConvertReply Run(const char* socket_path, const ConvertJob& job) {
+  std::string response;
+  CHECK(RunConvertJob(socket_path, job, &response));
+  ConvertReply reply;
+  CHECK(ReadConvertReply(response, &reply));
+  return reply;
+}
+
+// The sum over jobs of one client each, run from several threads.
+struct Clients {
+  const char* socket_path;
+  std::vector<int> ok;
+};
+
+void RunClient(void* arg, size_t i) {
+  Clients* clients = static_cast<Clients*>(arg);
+  char out[32];
+  snprintf(out, sizeof(out), "client%d.utf8", static_cast<int>(i));
+  clients->ok[i] = Run(clients->socket_path, PathJob("grid.obj", out)).ok;
+}
+
+// Runs in a directory of its own, which it removes after.
+class ConvertServerTest {
+ public:
+  ConvertServerTest()
+      : dir_(MakeDir()) {
+    WriteFile("grid.mtl", "newmtl red\nKd 1 0 0\nnewmtl green\nKd 0 1 0\n");
+    WriteFile("grid.obj", GridObj(20));
+  }
+
+  ~ConvertServerTest() {
+    DIR* dir = opendir(".");
+    CHECK(dir != NULL);
+    while (struct dirent* entry = readdir(dir)) {
+      unlink(entry->d_name);
+    }
+    closedir(dir);
+    CHECK(0 == chdir(".."));
+    CHECK(0 == rmdir(dir_.c_str()));
+  }
+
+  // A job by path gets what obj2utf8x would write, and its manifest.
+  void TestByPath() {
+    ConvertOptions options;
+    options.lod_ratios.push_back(0.5);
+    Manifest expected;
+    bool verified = false;
+    std::string error;
+    {
+      FILE* fp = fopen("grid.obj", "r");
+      WavefrontObjFile obj(fp);
+      fclose(fp);
+      CHECK(ConvertObj(options, obj, "expected.utf8", &expected, &verified,
+                       &error));
+    }
+    ConvertServer server(ConvertOptions(), 2, 4);
+    CHECK(server.Start("server.sock"));
+    ConvertJob job = PathJob("grid.obj", "a.utf8");
+    job.args.push_back("--verify");
+    job.args.push_back("--lod");
+    job.args.push_back("0.5");
+    const ConvertReply reply = Run("server.sock", job);
+    CHECK(reply.ok);
+    CHECK(reply.verified);
+    CHECK(2 == reply.files.size());
+    CHECK(reply.files[0] == "a.utf8");
+    CHECK(reply.files[1] == "a.lod1.utf8");
+    CHECK(ReadFile("a.utf8") == ReadFile("expected.utf8"));
+    CHECK(ReadFile("a.lod1.utf8") == ReadFile("expected.lod1.utf8"));
+    const Manifest& manifest = reply.manifest;
+    CHECK(manifest.materials.size() == expected.materials.size());
+    CHECK(manifest.urls.size() == 1);
+    CHECK(manifest.urls[0].meshes.size() == expected.urls[0].meshes.size());
+    CHECK(manifest.lods.size() == 1);
+    CHECK(0 == memcmp(manifest.decode_offsets, expected.decode_offsets,
+                      sizeof(manifest.decode_offsets)));
+    CHECK(reply.seconds.total > 0);
+    CHECK(reply.seconds.total >= reply.seconds.convert);
+    // The server's own flags are where each job starts.
+    server.Stop();
+    ConvertOptions binary;
+    binary.use_binary = true;
+    ConvertServer binary_server(binary, 1, 0);
+    CHECK(binary_server.Start("server.sock"));
+    const ConvertReply binary_reply =
+        Run("server.sock", PathJob("grid.obj", "b.utf8"));
+    CHECK(binary_reply.ok);
+    CHECK(MESH_FORMAT_BINARY_RANGE ==
+          binary_reply.manifest.urls[0].meshes[0].entry.format);
+  }
+
+  // The OBJ may come with the job, gzipped or not.
+  void TestByBytes() {
+    ConvertServer server(ConvertOptions(), 1, 4);
+    CHECK(server.Start("server.sock"));
+    CHECK(Run("server.sock", PathJob("grid.obj", "path.utf8")).ok);
+    ConvertJob job;
+    job.data = ReadFile("grid.obj");
+    job.out = "bytes.utf8";
+    CHECK(Run("server.sock", job).ok);
+    CHECK(ReadFile("bytes.utf8") == ReadFile("path.utf8"));
+    job.data = StoredGzip(job.data);
+    job.out = "gzip.utf8";
+    CHECK(Run("server.sock", job).ok);
+    CHECK(ReadFile("gzip.utf8") == ReadFile("path.utf8"));
+  }
+
+  // A job that fails says why, and the server goes on.
+  void TestErrors() {
+    ConvertServer server(ConvertOptions(), 1, 4);
+    CHECK(server.Start("server.sock"));
+    WriteFile("bad.obj", "v 0 0 0\nv 1 0 0\nf 1 2 3\n");
+    ConvertReply reply = Run("server.sock", PathJob("bad.obj", "bad.utf8"));
+    CHECK(!reply.ok);
+    CHECK(reply.error == "bad.obj: index out of range at line 3");
+    reply = Run("server.sock", PathJob("missing.obj", "bad.utf8"));
+    CHECK(!reply.ok);
+    CHECK(reply.error == "missing.obj: No such file or directory");
+    ConvertJob job = PathJob("grid.obj", "bad.utf8");
+    job.args.push_back("--lod");
+    reply = Run("server.sock", job);
+    CHECK(!reply.ok);
+    CHECK(reply.error == "bad flag: --lod");
+    reply = Run("server.sock", PathJob("grid.obj", "no/such/dir.utf8"));
+    CHECK(!reply.ok);
+    CHECK(reply.error == "no/such/dir.utf8: No such file or directory");
+    CHECK(Run("server.sock", PathJob("grid.obj", "good.utf8")).ok);
+    const ConvertServerStats stats = WaitForJobs(&server, 5);
+    CHECK(4 == stats.num_failed);
+  }
+
+  // With a build cache, a job whose inputs haven't changed, however
+  // they are sent, gets its files back from there.
+  void TestCache() {
+    BuildCache cache("cache");
+    cache.set_copy_outputs(true);
+    ConvertOptions options;
+    options.cache = &cache;
+    ConvertServer server(options, 1, 4);
+    CHECK(server.Start("server.sock"));
+    const ConvertReply built =
+        Run("server.sock", PathJob("grid.obj", "cached.utf8"));
+    CHECK(built.ok);
+    CHECK(!built.cached);
+    const std::string expected = ReadFile("cached.utf8");
+    unlink("cached.utf8");
+    ConvertReply reply = Run("server.sock",
+                             PathJob("grid.obj", "cached.utf8"));
+    CHECK(reply.ok);
+    CHECK(reply.cached);
+    CHECK(reply.verified);
+    CHECK(reply.files == built.files);
+    CHECK(ReadFile("cached.utf8") == expected);
+    CHECK(reply.manifest.urls[0].meshes.size() ==
+          built.manifest.urls[0].meshes.size());
+    ConvertJob job;
+    job.data = ReadFile("grid.obj");
+    job.out = "cached.utf8";
+    CHECK(Run("server.sock", job).cached);
+    job.data = GridObj(10);
+    reply = Run("server.sock", job);
+    CHECK(reply.ok);
+    CHECK(!reply.cached);
+    const ConvertServerStats stats = WaitForJobs(&server, 4);
+    CHECK(2 == stats.num_cached);
+    server.Stop();
+    std::vector<std::string> names;
+    CHECK(ListDir("cache", &names));
+    for (size_t i = 0; i < names.size(); ++i) {
+      RemoveDir("cache/" + names[i]);
+    }
+    CHECK(0 == rmdir("cache"));
+  }
+
+  // Past its threads and queue, jobs are turned away at once.
+  void TestBusy() {
+    ConvertServer server(ConvertOptions(), 1, 1);
+    CHECK(server.Start("server.sock"));
+    // Two clients that have yet to send their jobs hold the thread and
+    // the queue. Connections are accepted in order.
+    const int running = ConnectUnix("server.sock");
+    const int queued = ConnectUnix("server.sock");
+    CHECK(running >= 0 && queued >= 0);
+    ConvertReply reply = Run("server.sock", PathJob("grid.obj", "c.utf8"));
+    CHECK(!reply.ok);
+    CHECK(reply.error == "busy");
+    close(running);
+    close(queued);
+    WaitForJobs(&server, 2);
+    CHECK(Run("server.sock", PathJob("grid.obj", "c.utf8")).ok);
+    const ConvertServerStats stats = WaitForJobs(&server, 3);
+    CHECK(1 == stats.num_busy);
+    CHECK(2 == stats.num_failed);
+  }
+
+  // Jobs from many clients at once all run.
+  void TestConcurrent() {
+    ConvertServer server(ConvertOptions(), 3, 16);
+    CHECK(server.Start("server.sock"));
+    Clients clients;
+    clients.socket_path = "server.sock";
+    clients.ok.resize(16);
+    ParallelFor(clients.ok.size(), &RunClient, &clients, 8);
+    const std::string expected = ReadFile("client0.utf8");
+    for (size_t i = 0; i < clients.ok.size(); ++i) {
+      CHECK(clients.ok[i]);
+      char out[32];
+      snprintf(out, sizeof(out), "client%d.utf8", static_cast<int>(i));
+      CHECK(ReadFile(out) == expected);
+    }
+  }
+
+  // Latency of |num_jobs| jobs, one after another, to a server, and
+  // with a process forked for each. With |binary|, an obj2utf8x, each
+  // process runs it, as a service would; otherwise it only converts,
+  // so that the cost of the fork itself shows.
+  void Bench(size_t num_jobs, const char* binary) {
+    WriteFile("bench.obj", GridObj(30));
+    std::vector<double> seconds;
+    {
+      ConvertServer server(ConvertOptions(), NumProcessors(), 16);
+      CHECK(server.Start("server.sock"));
+      double server_seconds = 0.0;
+      for (size_t i = 0; i < num_jobs; ++i) {
+        Timer timer;
+        const ConvertReply reply =
+            Run("server.sock", PathJob("bench.obj", "bench.utf8"));
+        seconds.push_back(timer.ElapsedSeconds());
+        CHECK(reply.ok);
+        server_seconds += reply.seconds.total;
+      }
+      Report("server", &seconds);
+      printf("  mean %.2f ms of it in the server\n",
+             1e3 * server_seconds / num_jobs);
+    }
+    seconds.clear();
+    // Or children would print it again.
+    fflush(stdout);
+    for (size_t i = 0; i < num_jobs; ++i) {
+      Timer timer;
+      const pid_t pid = fork();
+      CHECK(pid >= 0);
+      if (pid == 0) {
+        if (binary != NULL) {
+          CHECK(freopen("/dev/null", "w", stdout) != NULL);
+          CHECK(freopen("/dev/null", "w", stderr) != NULL);
+          execl(binary, binary, "bench.obj", "bench.utf8",
+                static_cast<char*>(NULL));
+          _exit(127);
+        }
+        FILE* fp = fopen("bench.obj", "r");
+        WavefrontObjFile obj(fp);
+        fclose(fp);
+        Manifest manifest;
+        bool verified;
+        std::string error;
+        _exit(ConvertObj(ConvertOptions(), obj, "bench.utf8", &manifest,
+                         &verified, &error) ? 0 : 1);
+      }
+      int status;
+      CHECK(pid == waitpid(pid, &status, 0));
+      CHECK(WIFEXITED(status) && 0 == WEXITSTATUS(status));
+      seconds.push_back(timer.ElapsedSeconds());
+    }
+    Report(binary != NULL ? "fork+exec per job" : "fork per job", &seconds);
+  }
+
+ private:
+  static std::string MakeDir() {
+    char dir[] = "/tmp/convert_server_test.XXXXXX";
+    CHECK(mkdtemp(dir) != NULL);
+    CHECK(0 == chdir(dir));
+    return dir;
+  }
+
+  // Jobs are counted just after their replies are sent.
+  static ConvertServerStats WaitForJobs(ConvertServer* server,
+                                        size_t num_jobs) {
+    ConvertServerStats stats;
+    while ((stats = server->stats()).num_jobs != num_jobs) {
+      usleep(1000);
+    }
+    return stats;
+  }
+
+  static void Report(const char* name, std::vector<double>* seconds) {
+    std::sort(seconds->begin(), seconds->end());
+    const size_t n = seconds->size();
+    printf("%s: " PRIuS " jobs, p50 %.2f ms, p99 %.2f ms\n", name, n,
+           1e3 * (*seconds)[n / 2], 1e3 * (*seconds)[(n * 99) / 100]);
+  }
+
+  const std::string dir_;
+};
+
+}  // namespace webgl_loader
+
+int main(int argc, char* argv[]) {
+  // The tests and bench each run in a directory of their own.
+  char binary[PATH_MAX];
+  if (argc > 2) {
+    CHECK(realpath(argv[2], binary) != NULL);
+  }
+  {
+    webgl_loader::ConvertServerTest tester;
+    tester.TestByPath();
+    tester.TestByBytes();
+    tester.TestErrors();
+    tester.TestCache();
+    tester.TestBusy();
+    tester.TestConcurrent();
+  }
+  if (argc > 1) {
+    webgl_loader::ConvertServerTest bench;
+    bench.Bench(atol(argv[1]), argc > 2 ? binary : NULL);
+  }
+  return 0;
+}
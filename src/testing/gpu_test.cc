@@ -0,0 +1,133 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <math.h>
+
+#include <string>
+
+#include "../gpu.h"
+
+namespace webgl_loader {
+
+class GpuTest {
+ public:
+  GpuTest() {
+    Bounds bounds;
+    bounds.Clear();
+    bounds.mins[0] = bounds.mins[1] = bounds.mins[2] = -1.f;
+    bounds.maxes[0] = bounds.maxes[1] = bounds.maxes[2] = 1.f;
+    params_ = BoundsParams::FromBounds(bounds);
+  }
+
+  // A fan of triangles around a vertex on a unit sphere, whose
+  // texcoords wrap past 1 if |wrap|.
+  void MakeMesh(bool wrap, WebGLMesh* mesh) {
+    const size_t kNumVerts = 40;
+    for (size_t i = 0; i < kNumVerts; ++i) {
+      const float theta = 0.3f * i;
+      const float phi = 0.17f * i - 3.f;
+      const float n[3] = {
+        cos(theta) * sin(phi), sin(theta) * sin(phi), cos(phi)
+      };
+      const uint16 attribs[8] = {
+        static_cast<uint16>(8191 * (n[0] + 1.f)),
+        static_cast<uint16>(8191 * (n[1] + 1.f)),
+        static_cast<uint16>(8191 * (n[2] + 1.f)),
+        static_cast<uint16>(wrap ? 97 * i : 25 * i),
+        static_cast<uint16>(1023 - 25 * i),
+        static_cast<uint16>(511 + 511 * n[0]),
+        static_cast<uint16>(511 + 511 * n[1]),
+        static_cast<uint16>(511 + 511 * n[2])
+      };
+      mesh->attribs.insert(mesh->attribs.end(), attribs, attribs + 8);
+    }
+    for (size_t i = 1; i + 1 < kNumVerts; ++i) {
+      mesh->indices.push_back(0);
+      mesh->indices.push_back(i);
+      mesh->indices.push_back(i + 1);
+    }
+  }
+
+  // Both normal formats, and both texcoord formats, unpack to what
+  // was packed.
+  void TestRoundTrip() {
+    for (int format = 0; format < 2; ++format) {
+      for (int wrap = 0; wrap < 2; ++wrap) {
+        WebGLMeshList meshes(2);
+        MakeMesh(wrap, &meshes[0]);
+        MakeMesh(false, &meshes[1]);
+        meshes[1].indices.pop_back();
+        meshes[1].indices.pop_back();
+        meshes[1].indices.pop_back();
+        std::string bytes;
+        StringSink sink(&bytes);
+        const GpuNormalFormat normals = static_cast<GpuNormalFormat>(format);
+        CHECK((wrap ? GPU_TEXCOORDS_QUANTIZED : GPU_TEXCOORDS_UNORM16) ==
+              WriteGpuMeshes(params_, normals, meshes, &sink));
+        GpuMeshFile file;
+        CHECK(file.Parse(bytes.data(), bytes.size()));
+        CHECK(normals == file.normal_format());
+        CHECK(2 == file.num_meshes());
+        for (size_t i = 0; i < 3; ++i) {
+          CHECK(params_.decodeScales[i] == file.decode_scales()[i]);
+        }
+        for (size_t i = 0; i < meshes.size(); ++i) {
+          const GpuMeshView& view = file.mesh(i);
+          CHECK(0 == (view.vertices - bytes.data()) % kGpuVertexStride);
+          DecodedMesh mesh;
+          file.Unpack(i, &mesh);
+          CHECK(MatchesDecodedMesh(meshes[i], MESH_FORMAT_GPU_BUFFERS, mesh));
+        }
+      }
+    }
+  }
+
+  // Headers that are short, or wrong, or point past the end, fail.
+  void TestBadHeaders() {
+    WebGLMeshList meshes(1);
+    MakeMesh(false, &meshes[0]);
+    std::string bytes;
+    StringSink sink(&bytes);
+    WriteGpuMeshes(params_, GPU_NORMALS_OCTAHEDRAL, meshes, &sink);
+    GpuMeshFile file;
+    CHECK(file.Parse(bytes.data(), bytes.size()));
+    CHECK(!file.Parse(bytes.data(), kGpuHeaderSize - 1));
+    CHECK(!file.Parse(bytes.data(), bytes.size() - 1));
+    std::string bad = bytes;
+    bad[0] = 'X';
+    CHECK(!file.Parse(bad.data(), bad.size()));
+    bad = bytes;
+    PutLittleEndian32(2, &bad[12]);
+    CHECK(!file.Parse(bad.data(), bad.size()));
+    bad = bytes;
+    PutLittleEndian32(1000, &bad[8]);
+    CHECK(!file.Parse(bad.data(), bad.size()));
+  }
+
+ private:
+  BoundsParams params_;
+};
+
+}  // namespace webgl_loader
+
+int main(int argc, char* argv[]) {
+  webgl_loader::GpuTest tester;
+  tester.TestRoundTrip();
+  tester.TestBadHeaders();
+  return 0;
+}
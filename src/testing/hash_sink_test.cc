@@ -0,0 +1,237 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -pthread -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <stdlib.h>
+
+#include <string>
+
+#include "../async_sink.h"
+#include "../hash_sink.h"
+#include "../timer.h"
+
+namespace webgl_loader {
+
+uint64 HashOf(const std::string& data) {
+  Hash64 hash;
+  hash.Update(data.data(), data.size());
+  return hash.Digest();
+}
+
+std::string TestData(size_t length) {
+  std::string data(length, '\0');
+  for (size_t i = 0; i < length; ++i) {
+    data[i] = static_cast<char>(i * 13 + (i >> 7));
+  }
+  return data;
+}
+
+void WriteFile(const std::string& path, const std::string& contents) {
+  FILE* fp = fopen(path.c_str(), "wb");
+  CHECK(fp != NULL);
+  CHECK(contents.size() == fwrite(contents.data(), 1, contents.size(), fp));
+  fclose(fp);
+}
+
+class HashSinkTest {
+ public:
+  HashSinkTest() {
+    strcpy(dir_, "/tmp/hash_sink_test.XXXXXX");
+    CHECK(NULL != mkdtemp(dir_));
+  }
+
+  ~HashSinkTest() {
+    rmdir(dir_);
+  }
+
+  void TestHash64() {
+    CHECK(0xEF46DB3751D8E999ULL == HashOf(""));
+    CHECK(0x44BC2CF5AD770999ULL == HashOf("abc"));
+    // Any way of splitting the input hashes the same.
+    const std::string data = TestData(1000);
+    for (size_t length = 0; length < 100; ++length) {
+      const std::string prefix = data.substr(0, length);
+      const uint64 expected = HashOf(prefix);
+      for (size_t split = 0; split <= length; ++split) {
+        Hash64 hash;
+        hash.Update(prefix.data(), split);
+        CHECK(HashOf(prefix.substr(0, split)) == hash.Digest());
+        hash.Update(prefix.data() + split, length - split);
+        CHECK(expected == hash.Digest());
+      }
+    }
+    Hash64 hash;
+    for (size_t i = 0; i < data.size(); ++i) {
+      hash.Update(&data[i], 1);
+    }
+    CHECK(HashOf(data) == hash.Digest());
+    CHECK(HashOf(data) != HashOf(data.substr(1)));
+  }
+
+  // What goes through is what was written, in every way of writing
+  // it, and is what was hashed.
+  void TestHashingSink() {
+    const std::string data = TestData(300000);
+    std::string out;
+    BufferedStringSink string_sink(&out);
+    HashingSink sink(&string_sink);
+    for (size_t i = 0; i < 1000; ++i) {
+      sink.Put(data[i]);
+    }
+    sink.PutN(data.data() + 1000, 200000);
+    char* reserved = sink.Reserve(kHashWindow + 1000);
+    memcpy(reserved, data.data() + 201000, 99000);
+    sink.Commit(reserved + 99000);
+    CHECK(HashOf(data) == sink.Digest());
+    string_sink.Flush();
+    CHECK(data == out);
+    sink.Reset();
+    sink.PutN("abc", 3);
+    CHECK(HashOf("abc") == sink.Digest());
+  }
+
+  void TestRename() {
+    const std::string contents = TestData(5000);
+    const uint64 hash = HashOf(contents);
+    const std::string temp_path = std::string(dir_) + "/temp";
+    std::string name;
+    CHECK(0 == chdir(dir_));
+    WriteFile(temp_path, contents);
+    CHECK(RenameToContentName(temp_path, hash, "utf8", &name));
+    char hex[17];
+    ToHex(static_cast<uint32>(hash >> 32), hex);
+    ToHex(static_cast<uint32>(hash), hex + 8);
+    const std::string expected = std::string(hex) + ".utf8";
+    CHECK(expected == name);
+    CHECK(0 != access(temp_path.c_str(), F_OK));
+    // The same contents again keep the same file.
+    WriteFile(temp_path, contents);
+    CHECK(RenameToContentName(temp_path, hash, "utf8", &name));
+    CHECK(expected == name);
+    CHECK(0 != access(temp_path.c_str(), F_OK));
+    // Different contents under the same hash go elsewhere, and keep
+    // going there.
+    const std::string other = contents.substr(1);
+    for (size_t i = 0; i < 2; ++i) {
+      WriteFile(temp_path, other);
+      CHECK(RenameToContentName(temp_path, hash, "utf8", &name));
+      CHECK(std::string(hex) + "-1.utf8" == name);
+    }
+    CHECK(SameContents(expected.c_str(), expected.c_str()));
+    CHECK(!SameContents(expected.c_str(), name.c_str()));
+    unlink(name.c_str());
+    unlink(expected.c_str());
+    CHECK(0 == chdir("/"));
+  }
+
+ private:
+  char dir_[32];
+};
+
+// Compresses to a file the old way, keeping it all in memory until it
+// can be hashed and named, and the new, hashing it on the way out.
+class HashSinkBench {
+ public:
+  explicit HashSinkBench(size_t num_bytes)
+      : data_(TestData(num_bytes)) {
+  }
+
+  // Returns MB/s.
+  double TimeHash(bool simple) {
+    Timer timer;
+    uint64 hash;
+    if (simple) {
+      hash = SimpleHash(&data_[0], data_.size());
+    } else {
+      hash = HashOf(data_);
+    }
+    const double seconds = timer.ElapsedSeconds();
+    CHECK(hash != 0);
+    return data_.size() / seconds / 1e6;
+  }
+
+  // As the encoders write: a few bytes at a time, through a virtual
+  // call.
+  void Produce(ByteSinkInterface* sink) {
+    for (size_t i = 0; i < data_.size(); i += 16) {
+      sink->PutN(&data_[i], std::min<size_t>(16, data_.size() - i));
+    }
+  }
+
+  double TimeBuffered(const char* path) {
+    Timer timer;
+    std::vector<char> buffer;
+    VectorSink sink(&buffer);
+    Produce(&sink);
+    const uint32 hash = SimpleHash(&buffer[0], buffer.size());
+    AsyncFileSink file;
+    CHECK(file.Open(path, 0));
+    file.PutN(&buffer[0], buffer.size());
+    CHECK(file.Close());
+    const double seconds = timer.ElapsedSeconds();
+    CHECK(hash != 0);
+    return seconds;
+  }
+
+  double TimeFused(const char* path) {
+    Timer timer;
+    AsyncFileSink file;
+    CHECK(file.Open(path, 0));
+    HashingSink hashing_sink(&file);
+    BufferedSinkAdapter sink(&hashing_sink);
+    Produce(&sink);
+    const uint64 hash = hashing_sink.Digest();
+    CHECK(file.Close());
+    const double seconds = timer.ElapsedSeconds();
+    CHECK(hash != 0);
+    return seconds;
+  }
+
+  void Run() {
+    printf("hash MB/s: SimpleHash %.0f, Hash64 %.0f\n",
+           TimeHash(true), TimeHash(false));
+    char path[] = "/var/tmp/hash_sink_bench.XXXXXX";
+    const int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    close(fd);
+    double buffered = 1e9, fused = 1e9;
+    for (size_t run = 0; run < 3; ++run) {
+      buffered = std::min(buffered, TimeBuffered(path));
+      fused = std::min(fused, TimeFused(path));
+    }
+    unlink(path);
+    printf("%.0f MB to a file: buffer, hash and write %.3f s, "
+           "hash while writing %.3f s\n", data_.size() / 1e6, buffered, fused);
+  }
+
+ private:
+  std::string data_;
+};
+
+}  // namespace webgl_loader
+
+int main(int argc, char* argv[]) {
+  webgl_loader::HashSinkTest tester;
+  tester.TestHash64();
+  tester.TestHashingSink();
+  tester.TestRename();
+  if (argc > 1) {
+    webgl_loader::HashSinkBench bench(atol(argv[1]));
+    bench.Run();
+  }
+  return 0;
+}
@@ -0,0 +1,452 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "../inflate.h"
+#include "../mesh.h"
+#include "../timer.h"
+
+namespace webgl_loader {
+
+// Made by Python's gzip and zlib modules from |TestText|: a dynamic
+// Huffman block, with a file name in the header; fixed Huffman; a
+// stored block of the first 40 bytes; and zlib with a dynamic block.
+const uint8 kDynamicGzip[] = {
+  0x1f, 0x8b, 0x08, 0x08, 0x00, 0x00, 0x00, 0x00, 0x02, 0xff, 0x74, 0x2e,
+  0x6f, 0x62, 0x6a, 0x00, 0x55, 0xd1, 0xcb, 0x0d, 0x43, 0x31, 0x08, 0x44,
+  0xd1, 0xbd, 0xab, 0x98, 0x06, 0x12, 0x0c, 0xfe, 0x37, 0x94, 0x0a, 0xa2,
+  0x57, 0x7f, 0x26, 0x91, 0xe1, 0xc5, 0x0b, 0x24, 0x24, 0xce, 0xea, 0x72,
+  0x21, 0x3f, 0x1b, 0x32, 0x1e, 0x9a, 0xae, 0x37, 0xf7, 0xcc, 0xb1, 0x96,
+  0x5e, 0x50, 0x51, 0x98, 0x18, 0x8a, 0x94, 0x74, 0x41, 0x89, 0x4a, 0x20,
+  0x75, 0xb4, 0x01, 0xaa, 0x54, 0x22, 0x23, 0xea, 0x81, 0xcc, 0xd1, 0x06,
+  0x68, 0xd2, 0x88, 0x0a, 0x91, 0x05, 0x2a, 0x8e, 0x36, 0x40, 0x97, 0x4e,
+  0x54, 0x89, 0x5a, 0xa0, 0xea, 0x68, 0x03, 0x0c, 0x19, 0x44, 0x8d, 0x48,
+  0x03, 0x35, 0x47, 0x1b, 0x60, 0xca, 0x24, 0xea, 0x3c, 0xd4, 0x40, 0xdd,
+  0xd1, 0x06, 0x58, 0xb2, 0x88, 0xc6, 0x91, 0x60, 0x38, 0xda, 0x00, 0x9a,
+  0x45, 0x33, 0xd9, 0x3c, 0x22, 0x4c, 0x67, 0x41, 0xa0, 0x8c, 0xc6, 0x2b,
+  0xd6, 0x11, 0x62, 0x45, 0xd2, 0x1b, 0x41, 0x4d, 0xd4, 0xbe, 0x61, 0xf3,
+  0xd1, 0xe3, 0xce, 0x7f, 0x2b, 0x68, 0x11, 0xfd, 0x3d, 0x41, 0x8f, 0x2c,
+  0xf1, 0x85, 0x3f, 0x05, 0xad, 0xa2, 0x35, 0x7d, 0x00, 0x3d, 0xdc, 0xef,
+  0x2c, 0xd6, 0x01, 0x00, 0x00
+};
+
+const uint8 kFixedGzip[] = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x2b, 0x53,
+  0x30, 0xd0, 0x33, 0x55, 0x30, 0x50, 0xd0, 0x35, 0xe4, 0x2a, 0x2b, 0x01,
+  0xb2, 0x0d, 0x80, 0xd8, 0xc8, 0x94, 0x2b, 0x4d, 0xc1, 0x50, 0xdf, 0x50,
+  0xc1, 0x48, 0xdf, 0x48, 0xc1, 0x58, 0xdf, 0x98, 0xab, 0x4c, 0xc1, 0x10,
+  0xa8, 0xc8, 0x18, 0xae, 0xc8, 0x10, 0xa6, 0x08, 0xaa, 0x40, 0xc1, 0x44,
+  0xdf, 0x04, 0xa8, 0xc8, 0x08, 0xa8, 0xc8, 0x0c, 0xae, 0xc8, 0x08, 0xa6,
+  0x08, 0xaa, 0x40, 0xc1, 0x54, 0xdf, 0x14, 0xa8, 0xc8, 0x18, 0xa8, 0xc8,
+  0x08, 0xae, 0xc8, 0x18, 0xa6, 0x08, 0xaa, 0x40, 0xc1, 0x4c, 0xdf, 0x0c,
+  0xa8, 0xc8, 0x04, 0xa8, 0xc8, 0x14, 0xae, 0xc8, 0x04, 0xa6, 0x08, 0xaa,
+  0x40, 0xc1, 0x5c, 0xdf, 0x1c, 0xa8, 0xc8, 0x14, 0xa8, 0xc8, 0x10, 0xae,
+  0xc8, 0x14, 0xa6, 0x08, 0xaa, 0x40, 0xc1, 0x42, 0xdf, 0x02, 0xa8, 0xc8,
+  0x0c, 0x28, 0x61, 0x02, 0x57, 0x64, 0x06, 0x53, 0x04, 0x55, 0xa0, 0x60,
+  0xa9, 0x6f, 0x09, 0x54, 0x64, 0x8e, 0x12, 0x04, 0xe6, 0x30, 0x45, 0x50,
+  0x05, 0x0a, 0x86, 0x06, 0xfa, 0x86, 0x06, 0x40, 0x65, 0x16, 0x28, 0x81,
+  0x60, 0x01, 0x53, 0x06, 0x57, 0xa2, 0x60, 0x08, 0x0c, 0x34, 0xa0, 0xac,
+  0x82, 0x25, 0x4a, 0x40, 0x58, 0xc2, 0x83, 0x14, 0xa1, 0x48, 0xc1, 0xd0,
+  0x48, 0xdf, 0xd0, 0x08, 0x14, 0xb0, 0x06, 0x28, 0xe1, 0x81, 0x08, 0x7e,
+  0x84, 0x2a, 0x05, 0x43, 0x63, 0x7d, 0x43, 0x70, 0x24, 0x18, 0xa2, 0x04,
+  0x0b, 0x3c, 0x16, 0x90, 0x54, 0x29, 0x18, 0x9a, 0xe8, 0x1b, 0x9a, 0x70,
+  0x01, 0x00, 0x3d, 0xdc, 0xef, 0x2c, 0xd6, 0x01, 0x00, 0x00
+};
+
+const uint8 kStoredGzip[] = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x03, 0x01, 0x28,
+  0x00, 0xd7, 0xff, 0x76, 0x20, 0x30, 0x2e, 0x35, 0x20, 0x30, 0x20, 0x2d,
+  0x31, 0x0a, 0x76, 0x74, 0x20, 0x30, 0x2e, 0x30, 0x20, 0x30, 0x2e, 0x32,
+  0x35, 0x0a, 0x66, 0x20, 0x31, 0x2f, 0x31, 0x20, 0x32, 0x2f, 0x32, 0x20,
+  0x33, 0x2f, 0x33, 0x0a, 0x76, 0x20, 0x31, 0x4e, 0x1c, 0x57, 0x19, 0x28,
+  0x00, 0x00, 0x00
+};
+
+const uint8 kZlib[] = {
+  0x78, 0xda, 0x55, 0xd1, 0xcb, 0x0d, 0x43, 0x31, 0x08, 0x44, 0xd1, 0xbd,
+  0xab, 0x98, 0x06, 0x12, 0x0c, 0xfe, 0x37, 0x94, 0x0a, 0xa2, 0x57, 0x7f,
+  0x26, 0x91, 0xe1, 0xc5, 0x0b, 0x24, 0x24, 0xce, 0xea, 0x72, 0x21, 0x3f,
+  0x1b, 0x32, 0x1e, 0x9a, 0xae, 0x37, 0xf7, 0xcc, 0xb1, 0x96, 0x5e, 0x50,
+  0x51, 0x98, 0x18, 0x8a, 0x94, 0x74, 0x41, 0x89, 0x4a, 0x20, 0x75, 0xb4,
+  0x01, 0xaa, 0x54, 0x22, 0x23, 0xea, 0x81, 0xcc, 0xd1, 0x06, 0x68, 0xd2,
+  0x88, 0x0a, 0x91, 0x05, 0x2a, 0x8e, 0x36, 0x40, 0x97, 0x4e, 0x54, 0x89,
+  0x5a, 0xa0, 0xea, 0x68, 0x03, 0x0c, 0x19, 0x44, 0x8d, 0x48, 0x03, 0x35,
+  0x47, 0x1b, 0x60, 0xca, 0x24, 0xea, 0x3c, 0xd4, 0x40, 0xdd, 0xd1, 0x06,
+  0x58, 0xb2, 0x88, 0xc6, 0x91, 0x60, 0x38, 0xda, 0x00, 0x9a, 0x45, 0x33,
+  0xd9, 0x3c, 0x22, 0x4c, 0x67, 0x41, 0xa0, 0x8c, 0xc6, 0x2b, 0xd6, 0x11,
+  0x62, 0x45, 0xd2, 0x1b, 0x41, 0x4d, 0xd4, 0xbe, 0x61, 0xf3, 0xd1, 0xe3,
+  0xce, 0x7f, 0x2b, 0x68, 0x11, 0xfd, 0x3d, 0x41, 0x8f, 0x2c, 0xf1, 0x85,
+  0x3f, 0x05, 0xad, 0xa2, 0x35, 0x7d, 0x00, 0x0c, 0x67, 0x5a, 0xe4
+};
+
+std::string TestText() {
+  std::string text;
+  for (int i = 0; i < 12; ++i) {
+    char line[64];
+    snprintf(line, sizeof(line), "v %d.5 %d -1\nvt 0.%d 0.25\n"
+             "f %d/%d %d/%d %d/%d\n", i, i * 3 % 7, i % 10,
+             i + 1, i + 1, i + 2, i + 2, i + 3, i + 3);
+    text += line;
+  }
+  return text;
+}
+
+// Hands out its data |piece_size| bytes at a time.
+class PieceInput : public BufferedInput {
+ public:
+  PieceInput(const std::string& data, size_t piece_size)
+      : BufferedInput(RefillPiece),
+        data_(data),
+        piece_size_(piece_size),
+        offset_(0) {
+    cursor = begin_ = end_ = data_.data();
+  }
+
+ private:
+  static ErrorCode RefillPiece(BufferedInput* bi) {
+    return static_cast<PieceInput*>(bi)->DoRefillPiece();
+  }
+
+  ErrorCode DoRefillPiece() {
+    if (offset_ == data_.size()) return fail(kEndOfFile);
+    const size_t length = std::min(piece_size_, data_.size() - offset_);
+    begin_ = cursor = data_.data() + offset_;
+    end_ = begin_ + length;
+    offset_ += length;
+    return kNoError;
+  }
+
+  const std::string data_;
+  size_t piece_size_;
+  size_t offset_;
+};
+
+// Writes deflate's bits, for streams that are easier to build than
+// to embed.
+class BitWriter {
+ public:
+  BitWriter()
+      : bits_(0),
+        num_bits_(0) {
+  }
+
+  void Put(uint32 value, int n) {
+    bits_ |= value << num_bits_;
+    num_bits_ += n;
+    while (num_bits_ >= 8) {
+      bytes_.push_back(static_cast<char>(bits_ & 0xFF));
+      bits_ >>= 8;
+      num_bits_ -= 8;
+    }
+  }
+
+  // Huffman codes go from their high bit.
+  void PutCode(uint32 code, int n) {
+    for (int i = n - 1; i >= 0; --i) {
+      Put((code >> i) & 1, 1);
+    }
+  }
+
+  // From the fixed literal/length code.
+  void PutFixedSymbol(int symbol) {
+    if (symbol < 144) {
+      PutCode(0x30 + symbol, 8);
+    } else if (symbol < 256) {
+      PutCode(0x190 + symbol - 144, 9);
+    } else if (symbol < 280) {
+      PutCode(symbol - 256, 7);
+    } else {
+      PutCode(0xC0 + symbol - 280, 8);
+    }
+  }
+
+  const std::string& Finish() {
+    if (num_bits_ > 0) Put(0, 8 - num_bits_);
+    return bytes_;
+  }
+
+ private:
+  uint32 bits_;
+  int num_bits_;
+  std::string bytes_;
+};
+
+std::string ToString(const uint8* data, size_t length) {
+  return std::string(reinterpret_cast<const char*>(data), length);
+}
+
+class InflateTest {
+ public:
+  // Inflates |compressed|, fed |piece_size| bytes at a time, with an
+  // output buffer of |buffer_size|. Returns the error it ended with.
+  ErrorCode Inflate(const std::string& compressed, size_t piece_size,
+                    size_t buffer_size, std::string* out) {
+    PieceInput source(compressed, piece_size);
+    InflatingInput input(&source, buffer_size);
+    out->clear();
+    while (kNoError == input.Refill()) {
+      out->append(input.cursor, input.end());
+      input.cursor = input.end();
+    }
+    return input.error();
+  }
+
+  // Every way of feeding and draining |compressed| gives |expected|.
+  void CheckInflates(const std::string& compressed,
+                     const std::string& expected) {
+    static const size_t kSizes[] = { 1, 7, 300, 256 * 1024 };
+    for (size_t i = 0; i < 4; ++i) {
+      for (size_t j = 0; j < 4; ++j) {
+        std::string out;
+        CHECK(kEndOfFile == Inflate(compressed, kSizes[i], kSizes[j], &out));
+        CHECK(expected == out);
+      }
+    }
+  }
+
+  void TestChecksums() {
+    const char kDigits[] = "123456789";
+    CHECK(0xCBF43926u == Crc32(0, kDigits, kDigits + 9));
+    CHECK(0xCBF43926u == Crc32(Crc32(0, kDigits, kDigits + 4),
+                              kDigits + 4, kDigits + 9));
+    const char kWikipedia[] = "Wikipedia";
+    CHECK(0x11E60398u == Adler32(1, kWikipedia, kWikipedia + 9));
+    const std::string zeroes(100000, '\xFF');
+    CHECK(Adler32(1, zeroes.data(), zeroes.data() + zeroes.size()) ==
+          Adler32(Adler32(1, zeroes.data(), zeroes.data() + 6000),
+                  zeroes.data() + 6000, zeroes.data() + zeroes.size()));
+  }
+
+  void TestFormats() {
+    const std::string text = TestText();
+    CheckInflates(ToString(kDynamicGzip, sizeof(kDynamicGzip)), text);
+    CheckInflates(ToString(kFixedGzip, sizeof(kFixedGzip)), text);
+    CheckInflates(ToString(kStoredGzip, sizeof(kStoredGzip)),
+                  text.substr(0, 40));
+    CheckInflates(ToString(kZlib, sizeof(kZlib)), text);
+    // Concatenated members, as from "cat a.gz b.gz".
+    CheckInflates(ToString(kStoredGzip, sizeof(kStoredGzip)) +
+                  ToString(kFixedGzip, sizeof(kFixedGzip)),
+                  text.substr(0, 40) + text);
+  }
+
+  // A stored block bigger than the window, then a match that reaches
+  // all the way back, which overlaps itself, as zlib.
+  void TestFarMatch() {
+    std::string expected;
+    for (size_t i = 0; i < 40000; ++i) {
+      expected.push_back(static_cast<char>(i * 7 + (i >> 9)));
+    }
+    BitWriter writer;
+    writer.Put(0x78, 8);
+    writer.Put(0x01, 8);
+    writer.Put(0, 1);  // Not final.
+    writer.Put(0, 2);  // Stored.
+    writer.Finish();
+    writer.Put(40000, 16);
+    writer.Put(40000 ^ 0xFFFF, 16);
+    for (size_t i = 0; i < expected.size(); ++i) {
+      writer.Put(static_cast<uint8>(expected[i]), 8);
+    }
+    writer.Put(1, 1);  // Final.
+    writer.Put(1, 2);  // Fixed Huffman.
+    // Length 258, distance 32768, twice; then distance 1, length 10.
+    for (size_t i = 0; i < 2; ++i) {
+      writer.PutFixedSymbol(285);
+      writer.PutCode(29, 5);
+      writer.Put(8191, 13);
+      expected += expected.substr(expected.size() - 32768, 258);
+    }
+    writer.PutFixedSymbol('!');
+    writer.PutFixedSymbol(264);
+    writer.PutCode(0, 5);
+    expected += std::string(11, '!');
+    writer.PutFixedSymbol(256);
+    std::string compressed = writer.Finish();
+    const uint32 adler = Adler32(1, expected.data(),
+                                 expected.data() + expected.size());
+    for (int shift = 24; shift >= 0; shift -= 8) {
+      compressed.push_back(static_cast<char>(adler >> shift));
+    }
+    CheckInflates(compressed, expected);
+    // But not before the start.
+    compressed[2] = 3;  // Final, fixed Huffman.
+    std::string out;
+    CHECK(kCorruptInput == Inflate(compressed, 1000, 1000, &out));
+  }
+
+  void TestErrors() {
+    const std::string good = ToString(kDynamicGzip, sizeof(kDynamicGzip));
+    std::string out;
+    // Cut short anywhere.
+    for (size_t length = 0; length < good.size(); ++length) {
+      CHECK(kCorruptInput == Inflate(good.substr(0, length), 1000, 1000,
+                                     &out));
+    }
+    // A CRC or length that doesn't match.
+    for (size_t i = good.size() - 8; i < good.size(); ++i) {
+      std::string bad = good;
+      bad[i] ^= 1;
+      CHECK(kCorruptInput == Inflate(bad, 1000, 1000, &out));
+    }
+    // Not compressed at all.
+    CHECK(kCorruptInput == Inflate("v 1 2 3\n", 1000, 1000, &out));
+    // Reserved block type.
+    std::string reserved = ToString(kStoredGzip, sizeof(kStoredGzip));
+    reserved[10] = 7;
+    CHECK(kCorruptInput == Inflate(reserved, 1000, 1000, &out));
+  }
+
+  // The OBJ parser takes gzipped input as it is. This one is stored,
+  // since the test streams above aren't meshes.
+  void TestObj() {
+    std::string obj;
+    for (int i = 0; i < 12; ++i) {
+      char line[64];
+      snprintf(line, sizeof(line), "v %d 0 %d\nvt 0.%d 0.5\n", i, i % 3, i);
+      obj += line;
+    }
+    for (int i = 1; i <= 10; ++i) {
+      char line[64];
+      snprintf(line, sizeof(line), "f %d/%d %d/%d %d/%d\n",
+               i, i, i + 1, i + 1, i + 2, i + 2);
+      obj += line;
+    }
+    const uint32 crc = Crc32(0, obj.data(), obj.data() + obj.size());
+    BitWriter writer;
+    static const uint8 kHeader[] = {
+      0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 0xFF
+    };
+    for (size_t i = 0; i < sizeof(kHeader); ++i) writer.Put(kHeader[i], 8);
+    writer.Put(1, 1);  // Final.
+    writer.Put(0, 2);  // Stored.
+    writer.Finish();
+    writer.Put(obj.size(), 16);
+    writer.Put(obj.size() ^ 0xFFFF, 16);
+    for (size_t i = 0; i < obj.size(); ++i) {
+      writer.Put(static_cast<uint8>(obj[i]), 8);
+    }
+    for (int shift = 0; shift < 32; shift += 8) {
+      writer.Put((crc >> shift) & 0xFF, 8);
+    }
+    for (int shift = 0; shift < 32; shift += 8) {
+      writer.Put((obj.size() >> shift) & 0xFF, 8);
+    }
+    const std::string& compressed = writer.Finish();
+
+    char path[] = "/tmp/inflate_test.XXXXXX";
+    const int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    CHECK(static_cast<ssize_t>(compressed.size()) ==
+          write(fd, compressed.data(), compressed.size()));
+    close(fd);
+    FILE* fp = fopen(path, "rb");
+    CHECK(fp != NULL);
+    WavefrontObjFile obj_file(fp);
+    fclose(fp);
+    unlink(path);
+    const MaterialBatches& batches = obj_file.material_batches();
+    CHECK(1 == batches.size());
+    const DrawMesh& mesh = batches.begin()->second.draw_mesh();
+    CHECK(3 * 10 == mesh.indices.size());
+  }
+};
+
+// Parses |path|, an .obj.gz, both by inflating it to a file first, as
+// with gunzip, and by inflating it as it is parsed.
+class InflateBench {
+ public:
+  explicit InflateBench(const char* path)
+      : path_(path) {
+  }
+
+  // Returns seconds.
+  double Parse(FILE* fp, size_t* num_indices) {
+    Timer timer;
+    WavefrontObjFile obj(fp);
+    const MaterialBatches& batches = obj.material_batches();
+    *num_indices = 0;
+    for (MaterialBatches::const_iterator iter = batches.begin();
+         iter != batches.end(); ++iter) {
+      *num_indices += iter->second.draw_mesh().indices.size();
+    }
+    return timer.ElapsedSeconds();
+  }
+
+  void Run() {
+    // Inflate to a temporary file, then parse that.
+    Timer timer;
+    FILE* in = fopen(path_, "rb");
+    CHECK(in != NULL);
+    std::vector<char> buf(64 * 1024);
+    BufferedInputStream compressed(in, &buf[0], buf.size());
+    InflatingInput inflated(&compressed);
+    char temp_path[] = "/var/tmp/inflate_bench.XXXXXX";
+    const int fd = mkstemp(temp_path);
+    CHECK(fd >= 0);
+    FILE* out = fdopen(fd, "wb");
+    while (kNoError == inflated.Refill()) {
+      fwrite(inflated.cursor, 1, inflated.end() - inflated.cursor, out);
+      inflated.cursor = inflated.end();
+    }
+    CHECK(kEndOfFile == inflated.error());
+    fclose(out);
+    fclose(in);
+    const double inflate_seconds = timer.ElapsedSeconds();
+    const double inflated_mb = inflated.total_out() / 1e6;
+    size_t num_indices, streamed_num_indices;
+    in = fopen(temp_path, "rb");
+    const double parse_seconds = Parse(in, &num_indices);
+    fclose(in);
+    unlink(temp_path);
+    in = fopen(path_, "rb");
+    const double streamed_seconds = Parse(in, &streamed_num_indices);
+    fclose(in);
+    CHECK(num_indices == streamed_num_indices);
+    printf("%.1f MB inflated at %.0f MB/s\n"
+           "inflate to file, then parse: %.3f s (%.3f + %.3f)\n"
+           "parse while inflating:       %.3f s\n",
+           inflated_mb, inflated_mb / inflate_seconds,
+           inflate_seconds + parse_seconds, inflate_seconds, parse_seconds,
+           streamed_seconds);
+  }
+
+ private:
+  const char* path_;
+};
+
+}  // namespace webgl_loader
+
+int main(int argc, char* argv[]) {
+  webgl_loader::InflateTest tester;
+  tester.TestChecksums();
+  tester.TestFormats();
+  tester.TestFarMatch();
+  tester.TestErrors();
+  tester.TestObj();
+  if (argc > 1) {
+    webgl_loader::InflateBench bench(argv[1]);
+    bench.Run();
+  }
+  return 0;
+}
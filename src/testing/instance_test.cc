@@ -0,0 +1,197 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -pthread -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <math.h>
+
+#include "../instance.h"
+
+namespace webgl_loader {
+
+class InstanceTest {
+ public:
+  InstanceTest() {
+    Bounds bounds;
+    bounds.Clear();
+    bounds.mins[0] = bounds.mins[1] = bounds.mins[2] = 0.f;
+    bounds.maxes[0] = bounds.maxes[1] = bounds.maxes[2] = 100.f;
+    params_ = BoundsParams::FromBounds(bounds);
+  }
+
+  // Appends a tetrahedron at |x|, |y|, |z|, its vertices in the order
+  // given by |order|, to |attribs| and |indices|.
+  void AddPart(float x, float y, float z, const int* order,
+               AttribList* attribs, IndexList* indices) {
+    static const float kCorners[4][3] = {
+      { 0.f, 0.f, 0.f }, { 1.3f, 0.f, 0.f }, { 0.f, 2.7f, 0.f },
+      { 0.f, 0.f, 0.9f }
+    };
+    static const int kTriangles[12] = { 0, 2, 1, 0, 1, 3, 0, 3, 2, 1, 2, 3 };
+    const int first = static_cast<int>(attribs->size() / 8);
+    int where[4];
+    for (size_t i = 0; i < 4; ++i) {
+      const float* corner = kCorners[order[i]];
+      const float attrib[8] = {
+        x + corner[0], y + corner[1], z + corner[2],
+        0.25f * order[i], 0.5f, 0.6f, 0.f, 0.8f
+      };
+      attribs->insert(attribs->end(), attrib, attrib + 8);
+      where[order[i]] = first + i;
+    }
+    for (size_t i = 0; i < 12; ++i) {
+      indices->push_back(where[kTriangles[i]]);
+    }
+  }
+
+  void Make(const AttribList& attribs, const IndexList& indices,
+            size_t part, CanonicalGroup* group) {
+    MakeCanonicalGroup(attribs, params_, &indices[12 * part], 12, group);
+  }
+
+  // Translated copies are found, wherever their vertices are.
+  void TestCopies() {
+    static const int kInOrder[4] = { 0, 1, 2, 3 };
+    static const int kShuffled[4] = { 2, 0, 3, 1 };
+    AttribList attribs;
+    IndexList indices;
+    AddPart(1.f, 2.f, 3.f, kInOrder, &attribs, &indices);
+    AddPart(41.f, 7.5f, 3.f, kShuffled, &attribs, &indices);
+    AddPart(-20.f, 60.f, 33.25f, kInOrder, &attribs, &indices);
+    DuplicateGroupFinder finder;
+    CanonicalGroup group;
+    GroupInstance instance;
+    int id;
+    Make(attribs, indices, 0, &group);
+    CHECK(!finder.Add(group, &id, &instance));
+    CHECK(0 == id);
+    const float expected[2][3] = {
+      { 40.f, 5.5f, 0.f }, { -21.f, 58.f, 30.25f }
+    };
+    for (size_t i = 1; i < 3; ++i) {
+      Make(attribs, indices, i, &group);
+      CHECK(finder.Add(group, &id, &instance));
+      CHECK(static_cast<int>(i) == id);
+      CHECK(0 == instance.source);
+      for (size_t j = 0; j < 3; ++j) {
+        CHECK(fabs(expected[i - 1][j] - instance.offset[j]) < 1e-4);
+      }
+    }
+  }
+
+  // Different geometry, or the same geometry with different texcoords,
+  // is not a copy.
+  void TestDifferent() {
+    static const int kInOrder[4] = { 0, 1, 2, 3 };
+    AttribList attribs;
+    IndexList indices;
+    AddPart(1.f, 2.f, 3.f, kInOrder, &attribs, &indices);
+    AddPart(11.f, 2.f, 3.f, kInOrder, &attribs, &indices);
+    AddPart(21.f, 2.f, 3.f, kInOrder, &attribs, &indices);
+    // Stretch the second, and move the third's texcoords.
+    attribs[8 * 5 + 0] += 0.5f;
+    attribs[8 * 9 + 3] += 0.5f;
+    DuplicateGroupFinder finder;
+    CanonicalGroup group;
+    GroupInstance instance;
+    int id;
+    for (size_t i = 0; i < 3; ++i) {
+      Make(attribs, indices, i, &group);
+      CHECK(!finder.Add(group, &id, &instance));
+      CHECK(static_cast<int>(i) == id);
+    }
+  }
+
+  // Turns and scales part |part| about the origin.
+  void Transform(size_t part, const float* rotation, float scale,
+                 AttribList* attribs) {
+    for (size_t i = 4 * part; i < 4 * part + 4; ++i) {
+      float* vertex = &(*attribs)[8 * i];
+      float turned[3];
+      RotateByQuaternion(rotation, vertex, turned);
+      for (size_t j = 0; j < 3; ++j) {
+        vertex[j] = scale * turned[j];
+      }
+      RotateByQuaternion(rotation, vertex + 5, turned);
+      for (size_t j = 0; j < 3; ++j) {
+        vertex[5 + j] = turned[j];
+      }
+    }
+  }
+
+  // Rotated and scaled copies are found, and so are translated copies
+  // of them, but not mirrored ones.
+  void TestTransformed() {
+    static const int kInOrder[4] = { 0, 1, 2, 3 };
+    const float quarter = sqrt(0.5f);
+    const float rotation[4] = { 0.f, quarter, 0.f, quarter };
+    const float other[4] = { 0.5f, -0.5f, 0.5f, 0.5f };
+    AttribList attribs;
+    IndexList indices;
+    for (size_t i = 0; i < 6; ++i) {
+      AddPart(1.f, 2.f, 3.f, kInOrder, &attribs, &indices);
+    }
+    Transform(1, rotation, 1.f, &attribs);
+    Transform(2, other, 2.5f, &attribs);
+    Transform(3, other, 2.5f, &attribs);
+    for (size_t i = 0; i < 4; ++i) {
+      attribs[8 * (12 + i) + 1] += 10.f;
+      attribs[8 * (16 + i) + 1] *= -1.f;
+      attribs[8 * (16 + i) + 6] *= -1.f;
+    }
+    InstanceFinder finder(params_);
+    for (size_t i = 0; i < 6; ++i) {
+      finder.AddGroup(attribs, &indices[12 * i], 12);
+    }
+    finder.Find(4);
+    CHECK(-1 == finder.instance(0).source);
+    CHECK(0 == finder.instance(1).source);
+    CHECK(0 == finder.instance(2).source);
+    CHECK(0 == finder.instance(3).source);
+    CHECK(-1 == finder.instance(4).source);
+    CHECK(0 == finder.instance(5).source);
+    CHECK(finder.instance(5).IsTranslation());
+    for (size_t part = 1; part < 4; ++part) {
+      const GroupInstance& instance = finder.instance(part);
+      CHECK(!instance.IsTranslation());
+      for (size_t i = 0; i < 4; ++i) {
+        const float* from = &attribs[8 * i];
+        const float* to = &attribs[8 * (4 * part + i)];
+        float moved[3], turned[3];
+        RotateByQuaternion(instance.rotation, from, moved);
+        RotateByQuaternion(instance.rotation, from + 5, turned);
+        for (size_t j = 0; j < 3; ++j) {
+          CHECK(fabs(instance.scale * moved[j] + instance.offset[j] -
+                     to[j]) < 1e-3);
+          CHECK(fabs(turned[j] - to[5 + j]) < 1e-3);
+        }
+      }
+    }
+  }
+
+ private:
+  BoundsParams params_;
+};
+
+}  // namespace webgl_loader
+
+int main(int argc, char* argv[]) {
+  webgl_loader::InstanceTest tester;
+  tester.TestCopies();
+  tester.TestDifferent();
+  tester.TestTransformed();
+  return 0;
+}
@@ -0,0 +1,460 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <math.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "../json.h"
+#include "../json_reader.h"
+#include "../timer.h"
+
+namespace webgl_loader {
+
+// Hands out |data| |chunk_size| bytes at a time, so that tokens are
+// split between buffers.
+class ChunkedInput : public BufferedInput {
+ public:
+  ChunkedInput(const std::string& data, size_t chunk_size)
+      : BufferedInput(RefillChunk),
+        data_(data),
+        chunk_size_(chunk_size),
+        offset_(0) {
+    cursor = begin_ = end_ = data_.data();
+  }
+
+ private:
+  static ErrorCode RefillChunk(BufferedInput* bi) {
+    return static_cast<ChunkedInput*>(bi)->DoRefillChunk();
+  }
+
+  ErrorCode DoRefillChunk() {
+    if (offset_ == data_.size()) return fail(kEndOfFile);
+    const size_t length = std::min(chunk_size_, data_.size() - offset_);
+    cursor = begin_ = data_.data() + offset_;
+    end_ = begin_ + length;
+    offset_ += length;
+    return kNoError;
+  }
+
+  const std::string& data_;
+  size_t chunk_size_;
+  size_t offset_;
+};
+
+// Writes a manifest like obj2utf8x's, with |num_groups| urls.
+void WriteManifest(size_t num_groups, JsonSink* json) {
+  json->BeginObject();
+  json->PutString("materials");
+  json->BeginObject();
+  json->PutString("skin");
+  json->BeginObject();
+  json->PutString("map_Kd");
+  json->PutString("hand.ppm");
+  json->End();
+  json->PutString("preview");
+  json->BeginObject();
+  const int kd[] = { 184, 136, 234 };
+  json->PutString("Kd");
+  json->PutIntArray(kd, 3);
+  json->End();
+  json->End();
+  json->PutString("decodeParams");
+  json->BeginObject();
+  const int offsets[] = { -7473, -239, -8362, 0, 0, -511, -511, -511 };
+  const float scales[] = { 4.9755297e-5f, 4.9755297e-5f, 4.9755297e-5f,
+                           9.775171e-4f, 9.775171e-4f, 1.9569471e-3f,
+                           1.9569471e-3f, 1.9569471e-3f };
+  json->PutString("decodeOffsets");
+  json->PutIntArray(offsets, 8);
+  json->PutString("decodeScales");
+  json->PutFloatArray(scales, 8);
+  json->End();
+  json->PutString("urls");
+  json->BeginObject();
+  char name[32];
+  for (size_t i = 0; i < num_groups; ++i) {
+    snprintf(name, sizeof(name), "group_%lu.utf8",
+             static_cast<unsigned long>(i));
+    json->PutString(name);
+    json->BeginArray();
+    json->BeginObject();
+    json->PutString("material");
+    json->PutString(i % 2 ? "skin" : "preview");
+    const size_t attrib_range[] = { 0, 100 + i };
+    const size_t index_range[] = { 800 + 8 * i, 30 * i };
+    const size_t lengths[] = { 10 * i, 7, 1234567 };
+    json->PutString("attribRange");
+    json->PutUintArray(attrib_range, 2);
+    json->PutString("indexRange");
+    json->PutUintArray(index_range, 2);
+    json->PutString("bboxes");
+    json->PutUint(12 * i);
+    json->PutString("names");
+    json->BeginArray();
+    json->PutString("figure \"2\"\n");
+    json->PutString("default");
+    json->PutString("\xE6\x89\x8B");
+    json->End();
+    json->PutString("lengths");
+    json->PutUintArray(lengths, 3);
+    json->PutString("error");
+    json->PutFloat(0.001f * i);
+    json->PutString("visible");
+    json->PutBool(i % 3 != 0);
+    json->PutString("parent");
+    json->PutNull();
+    json->End();
+    json->End();
+  }
+  json->EndAll();
+}
+
+std::string Manifest(size_t num_groups, size_t pretty_depth) {
+  std::string out;
+  {
+    BufferedStringSink sink(&out);
+    JsonSink json(&sink);
+    json.set_pretty_depth(pretty_depth);
+    WriteManifest(num_groups, &json);
+  }
+  return out;
+}
+
+// Writes what |reader| reads to |json|. Numbers that were written as
+// floats come back out the same.
+void Copy(JsonReader* reader, JsonSink* json) {
+  for (;;) {
+    switch (reader->Next()) {
+      case JSON_NULL:
+        json->PutNull();
+        break;
+      case JSON_BOOL:
+        json->PutBool(reader->boolean());
+        break;
+      case JSON_NUMBER:
+        if (reader->number() == floor(reader->number()) &&
+            fabs(reader->number()) < 2e9) {
+          json->PutInt(static_cast<int>(reader->number()));
+        } else {
+          json->PutFloat(static_cast<float>(reader->number()));
+        }
+        break;
+      case JSON_STRING:
+      case JSON_KEY:
+        json->PutString(
+            std::string(reader->text(), reader->length()).c_str());
+        break;
+      case JSON_BEGIN_ARRAY:
+        json->BeginArray();
+        break;
+      case JSON_BEGIN_OBJECT:
+        json->BeginObject();
+        break;
+      case JSON_END_ARRAY:
+      case JSON_END_OBJECT:
+        json->End();
+        break;
+      case JSON_END:
+        return;
+      case JSON_ERROR:
+        CHECK(false);
+    }
+  }
+}
+
+class JsonReaderTest {
+ public:
+  void TestScalars() {
+    CheckOne("null", JSON_NULL);
+    CheckOne(" true ", JSON_BOOL);
+    CHECK(reader_->boolean());
+    CheckOne("false", JSON_BOOL);
+    CHECK(!reader_->boolean());
+    CheckOne("-12", JSON_NUMBER);
+    CHECK(-12.0 == reader_->number());
+    CHECK(reader_->Equals("-12"));
+    CheckOne("1.5e-7", JSON_NUMBER);
+    CHECK(1.5e-7 == reader_->number());
+    CheckOne("12345678901234567890", JSON_NUMBER);
+    CHECK(12345678901234567890.0 == reader_->number());
+    CheckOne("\"abc\"", JSON_STRING);
+    CHECK(reader_->Equals("abc"));
+    CHECK(!reader_->Equals("ab"));
+    CheckOne("\"\"", JSON_STRING);
+    CHECK(reader_->Equals(""));
+    CheckOne("\"a\\\"\\\\\\/\\b\\f\\n\\r\\t\\u00e9\\u2028\\ud83d\\ude00\"",
+             JSON_STRING);
+    CHECK(reader_->Equals("a\"\\/\b\f\n\r\t\xC3\xA9\xE2\x80\xA8"
+                          "\xF0\x9F\x98\x80"));
+    CheckOne("\"\\u0000\"", JSON_STRING);
+    CHECK(1 == reader_->length() && '\0' == reader_->text()[0]);
+  }
+
+  void TestStructure() {
+    static const JsonToken kTokens[] = {
+      JSON_BEGIN_OBJECT,
+      JSON_KEY, JSON_BEGIN_ARRAY, JSON_END_ARRAY,
+      JSON_KEY, JSON_BEGIN_ARRAY,
+      JSON_NUMBER, JSON_BEGIN_OBJECT, JSON_END_OBJECT, JSON_STRING,
+      JSON_END_ARRAY,
+      JSON_END_OBJECT,
+      JSON_END, JSON_END
+    };
+    Read("{\"a\": [ ], \"b\" : [1, {}, \"c\"] }");
+    for (size_t i = 0; i < sizeof(kTokens) / sizeof(kTokens[0]); ++i) {
+      CHECK(kTokens[i] == reader_->Next());
+      if (i == 5) {
+        CHECK(2 == reader_->depth());
+      }
+    }
+    CHECK(kNoError == reader_->error());
+    CHECK(0 == reader_->depth());
+  }
+
+  // Whatever follows the value is left unread.
+  void TestTrailing() {
+    Read("MODELS[\"hand\"] = [1] ;");
+    input_->cursor += 7;
+    CHECK(JSON_STRING == reader_->Next());
+    CHECK(reader_->Equals("hand"));
+    CHECK(JSON_END == reader_->Next());
+    input_->cursor += 4;
+    JsonReader reader(input_);
+    CHECK(JSON_BEGIN_ARRAY == reader.Next());
+    CHECK(JSON_NUMBER == reader.Next());
+    CHECK(JSON_END_ARRAY == reader.Next());
+    CHECK(JSON_END == reader.Next());
+    CHECK(std::string(" ;") == std::string(input_->cursor, input_->end()));
+  }
+
+  void TestErrors() {
+    static const char* const kBad[] = {
+      "", "   ", "[1,]", "[1 2]", "{\"a\" 1}", "{\"a\":}", "{1:2}",
+      "{\"a\":1,}", "[1}", "\"abc", "[", "{\"a\":", "tru", "nul", "-",
+      "1-2", "1e", ".5", "\"\\x\"", "\"\\u12g4\"", "\"\\udc00\"",
+      "\"\\ud800x\"", "\"a\nb\"", "'a'", "]"
+    };
+    for (size_t i = 0; i < sizeof(kBad) / sizeof(kBad[0]); ++i) {
+      Read(kBad[i]);
+      JsonToken token;
+      do {
+        token = reader_->Next();
+      } while (token != JSON_END && token != JSON_ERROR);
+      CHECK(JSON_ERROR == token);
+      CHECK(kCorruptInput == reader_->error());
+      CHECK(JSON_ERROR == reader_->Next());
+    }
+    // Too deep.
+    Read(std::string(JsonReader::kMaxDepth + 1, '['));
+    for (size_t i = 0; i < JsonReader::kMaxDepth; ++i) {
+      CHECK(JSON_BEGIN_ARRAY == reader_->Next());
+    }
+    CHECK(JSON_ERROR == reader_->Next());
+    // Too long.
+    std::string long_string = "\"" + std::string(5000, 'x') + "\"";
+    Read(long_string);
+    CHECK(JSON_STRING == reader_->Next());
+    ChunkedInput input(long_string, 1000);
+    JsonReader reader(&input);
+    CHECK(JSON_ERROR == reader.Next());
+    // Cut short while skipping.
+    Read("[[1, \"]\"]");
+    CHECK(JSON_BEGIN_ARRAY == reader_->Next());
+    CHECK(!reader_->Skip());
+    CHECK(JSON_ERROR == reader_->token());
+  }
+
+  // What |JsonSink| writes reads back the same, however the input is
+  // split. It is written compactly, as the copy can't tell which
+  // arrays were written whole.
+  void TestRoundTrip() {
+    const std::string manifest = Manifest(20, 0);
+    static const size_t kChunkSizes[] = { 1, 2, 3, 7, 64, 1 << 20 };
+    for (size_t i = 0; i < sizeof(kChunkSizes) / sizeof(size_t); ++i) {
+      ChunkedInput input(manifest, kChunkSizes[i]);
+      JsonReader reader(&input);
+      std::string out;
+      {
+        BufferedStringSink sink(&out);
+        JsonSink json(&sink);
+        Copy(&reader, &json);
+      }
+      CHECK(manifest == out);
+      CHECK(kNoError == reader.error());
+    }
+  }
+
+  // Finds the decode parameters and counts the urls, skipping the rest.
+  void TestSkip() {
+    const std::string manifest = Manifest(20, 3);
+    static const size_t kChunkSizes[] = { 1, 5, 1 << 20 };
+    for (size_t i = 0; i < sizeof(kChunkSizes) / sizeof(size_t); ++i) {
+      ChunkedInput input(manifest, kChunkSizes[i]);
+      JsonReader reader(&input);
+      CHECK(JSON_BEGIN_OBJECT == reader.Next());
+      size_t num_urls = 0;
+      double first_scale = 0.0;
+      while (JSON_KEY == reader.Next()) {
+        if (reader.Equals("decodeParams")) {
+          CHECK(JSON_BEGIN_OBJECT == reader.Next());
+          CHECK(JSON_KEY == reader.Next());
+          CHECK(reader.Equals("decodeOffsets"));
+          CHECK(reader.Skip());
+          CHECK(JSON_KEY == reader.Next());
+          CHECK(reader.Equals("decodeScales"));
+          CHECK(JSON_BEGIN_ARRAY == reader.Next());
+          CHECK(JSON_NUMBER == reader.Next());
+          first_scale = reader.number();
+          CHECK(reader.SkipRest());
+          CHECK(JSON_END_ARRAY == reader.token());
+          CHECK(JSON_END_OBJECT == reader.Next());
+        } else if (reader.Equals("urls")) {
+          CHECK(JSON_BEGIN_OBJECT == reader.Next());
+          while (JSON_KEY == reader.Next()) {
+            ++num_urls;
+            CHECK(reader.Skip());
+            CHECK(JSON_END_ARRAY == reader.token());
+          }
+          CHECK(JSON_END_OBJECT == reader.token());
+        } else {
+          CHECK(reader.Skip());
+        }
+      }
+      CHECK(JSON_END_OBJECT == reader.token());
+      CHECK(JSON_END == reader.Next());
+      CHECK(20 == num_urls);
+      CHECK(4.9755297e-5f == static_cast<float>(first_scale));
+    }
+    // Skipping after a scalar, or its key, passes just that.
+    Read("{\"a\": 1, \"b\": [2]}");
+    CHECK(JSON_BEGIN_OBJECT == reader_->Next());
+    CHECK(JSON_KEY == reader_->Next());
+    CHECK(reader_->Skip());
+    CHECK(JSON_NUMBER == reader_->token());
+    CHECK(reader_->Skip());
+    CHECK(JSON_KEY == reader_->Next());
+    CHECK(reader_->Equals("b"));
+    CHECK(reader_->SkipRest());
+    CHECK(JSON_END_OBJECT == reader_->token());
+    CHECK(JSON_END == reader_->Next());
+  }
+
+  ~JsonReaderTest() {
+    delete reader_;
+    delete input_;
+  }
+
+  JsonReaderTest()
+      : input_(NULL),
+        reader_(NULL) {
+  }
+
+ private:
+  void Read(const std::string& json) {
+    delete reader_;
+    delete input_;
+    json_ = json;
+    input_ = new BufferedInput(json_.data(), json_.size());
+    reader_ = new JsonReader(input_, 4096);
+  }
+
+  void CheckOne(const char* json, JsonToken token) {
+    Read(json);
+    CHECK(token == reader_->Next());
+    CHECK(JSON_END == reader_->Next());
+  }
+
+  std::string json_;
+  BufferedInput* input_;
+  JsonReader* reader_;
+};
+
+// Reads a manifest of |num_groups| urls from a file, token by token
+// and skipping the urls.
+class JsonReaderBench {
+ public:
+  explicit JsonReaderBench(size_t num_groups)
+      : manifest_(Manifest(num_groups, 3)) {
+    strcpy(path_, "/var/tmp/json_reader_bench.XXXXXX");
+    const int fd = mkstemp(path_);
+    CHECK(fd >= 0);
+    CHECK(static_cast<ssize_t>(manifest_.size()) ==
+          write(fd, manifest_.data(), manifest_.size()));
+    close(fd);
+  }
+
+  ~JsonReaderBench() {
+    unlink(path_);
+  }
+
+  // Returns MB/s.
+  double Time(bool skip) {
+    Timer timer;
+    FILE* fp = fopen(path_, "rb");
+    CHECK(fp != NULL);
+    std::vector<char> buf(64 * 1024);
+    BufferedInputStream input(fp, &buf[0], buf.size());
+    JsonReader reader(&input);
+    size_t num_tokens = 0;
+    for (;;) {
+      const JsonToken token = reader.Next();
+      if (token == JSON_END) break;
+      CHECK(token != JSON_ERROR);
+      ++num_tokens;
+      if (skip && reader.depth() == 3) reader.Skip();
+    }
+    CHECK(num_tokens != 0);
+    fclose(fp);
+    return manifest_.size() / timer.ElapsedSeconds() / 1e6;
+  }
+
+  // The best of a few runs.
+  void Run() {
+    double full = 0.0, skipped = 0.0;
+    for (size_t run = 0; run < 3; ++run) {
+      full = std::max(full, Time(false));
+      skipped = std::max(skipped, Time(true));
+    }
+    printf("%.1f MB manifest, MB/s: every token %.0f, skipping urls %.0f\n",
+           manifest_.size() / 1e6, full, skipped);
+  }
+
+ private:
+  std::string manifest_;
+  char path_[40];
+};
+
+}  // namespace webgl_loader
+
+int main(int argc, char* argv[]) {
+  webgl_loader::JsonReaderTest tester;
+  tester.TestScalars();
+  tester.TestStructure();
+  tester.TestTrailing();
+  tester.TestErrors();
+  tester.TestRoundTrip();
+  tester.TestSkip();
+  if (argc > 1) {
+    webgl_loader::JsonReaderBench bench(atol(argv[1]));
+    bench.Run();
+  }
+  return 0;
+}
@@ -22,8 +22,11 @@ exit;
 
 #include <float.h>
 #include <limits.h>
+#include <stdlib.h>
 #include <string>
 
+#include "../timer.h"
+
 namespace webgl_loader {
 
 class JsonSinkTest {
@@ -61,18 +64,95 @@ class JsonSinkTest {
     json_.PutFloat(123.456);
     CheckString("123.456");
     json_.PutFloat(FLT_MAX);
-    CheckString("3.40282e+38");
+    CheckString("3.4028235e+38");
     json_.PutFloat(-FLT_MAX);
-    CheckString("-3.40282e+38");
+    CheckString("-3.4028235e+38");
     json_.PutFloat(FLT_MIN);
-    CheckString("1.17549e-38");
+    CheckString("1.1754944e-38");
     json_.PutFloat(-FLT_MIN);
-    CheckString("-1.17549e-38");
+    CheckString("-1.1754944e-38");
+    // Laid out as JavaScript would.
+    const float kFloats[] = {
+      0.0f, 1.0f, 0.1f, 1.0f / 511, 1.5e-7f, 1e-6f, 123456789.0f, 1e21f,
+      1e20f, 2.5f, -0.0f, 1e-45f
+    };
+    const char* const kExpected[] = {
+      "0", "1", "0.1", "0.0019569471", "1.5e-7", "0.000001", "123456790",
+      "1e+21", "100000000000000000000", "2.5", "-0", "1e-45"
+    };
+    for (size_t i = 0; i < sizeof(kFloats) / sizeof(kFloats[0]); ++i) {
+      json_.PutFloat(kFloats[i]);
+      CheckString(kExpected[i]);
+    }
+  }
+
+  // Every float reads back as itself, in at most 9 digits.
+  void TestFloatRoundTrip() {
+    uint32 state = 1;
+    for (size_t i = 0; i < 1000000; ++i) {
+      state = state * 1664525u + 1013904223u;
+      float f;
+      memcpy(&f, &state, sizeof(f));
+      if (f != f || f > FLT_MAX || f < -FLT_MAX) continue;
+      char buf[32];
+      *FormatFloat(f, buf) = '\0';
+      CHECK(f == strtof(buf, NULL));
+      char shortest[32];
+      // No fewer digits would do.
+      for (int precision = 1; precision <= 9; ++precision) {
+        snprintf(shortest, sizeof(shortest), "%.*g", precision, f);
+        if (strtof(shortest, NULL) == f) break;
+      }
+      CHECK(SignificantDigits(buf) <= SignificantDigits(shortest));
+    }
+  }
+
+  void TestIntArrays() {
+    const int kInts[] = { 0, -1, 10, INT_MIN, INT_MAX };
+    json_.PutIntArray(kInts, 5);
+    CheckString("[0,-1,10,-2147483648,2147483647]");
+    json_.PutIntArray(kInts, 0);
+    CheckString("[]");
+    const size_t kSizes[] = { 0, 99, 100, 12345678901ULL };
+    json_.BeginArray();
+    json_.PutUintArray(kSizes, 4);
+    json_.PutUint(7);
+    json_.End();
+    CheckString("[[0,99,100,12345678901],7]");
+    const float kFloats[] = { 0.5f, -2.0f, 1e30f };
+    json_.PutFloatArray(kFloats, 3);
+    CheckString("[0.5,-2,1e+30]");
   }
 
   void TestString() {
     json_.PutString("foo");
     CheckString("\"foo\"");
+    json_.PutString("a\"b\\c\n\t\x01\x1F\xC3\xA9\xE2\x80\xA8\xE2\x80\xA6");
+    CheckString("\"a\\\"b\\\\c\\n\\t\\u0001\\u001f\xC3\xA9\\u2028"
+                "\xE2\x80\xA6\"");
+  }
+
+  void TestPretty() {
+    std::string out;
+    StringSink sink(&out);
+    {
+      JsonSink json(&sink);
+      json.set_pretty_depth(2);
+      json.BeginObject();
+      json.PutString("a");
+      json.BeginArray();
+      json.PutInt(1);
+      json.BeginObject();
+      json.PutString("b");
+      json.PutInt(2);
+      json.End();
+      json.End();
+      json.PutString("c");
+      json.BeginArray();
+      json.End();
+      json.End();
+    }
+    CHECK(out == "{\n  \"a\":[\n    1,\n    {\"b\":2}\n  ],\n  \"c\":[]\n}");
   }
 
   void TestArray() {
@@ -131,6 +211,18 @@ class JsonSinkTest {
   }
 
  private:
+  // From the first non-zero digit to the last.
+  static size_t SignificantDigits(const char* number) {
+    size_t digits = 0, nonzero_digits = 0;
+    for (; *number && *number != 'e'; ++number) {
+      if (*number < '0' || *number > '9') continue;
+      if (digits == 0 && *number == '0') continue;
+      ++digits;
+      if (*number != '0') nonzero_digits = digits;
+    }
+    return nonzero_digits;
+  }
+
   void CheckString(const char* str) {
     CHECK(buf_ == str);
     buf_.clear();
@@ -141,17 +233,126 @@ class JsonSinkTest {
   JsonSink json_;
 };
 
+// Writes the "urls" part of a manifest for |num_groups| groups, the
+// old way with fprintf and with |JsonSink|, to /dev/null.
+class JsonBench {
+ public:
+  explicit JsonBench(size_t num_groups)
+      : num_groups_(num_groups) {
+    for (size_t i = 0; i < 8; ++i) {
+      lengths_[i] = 1000 + 137 * i;
+    }
+  }
+
+  double TimeFprintf(FILE* fp) {
+    Timer timer;
+    fputs("{\n  \"urls\": {\n", fp);
+    for (size_t i = 0; i < num_groups_; ++i) {
+      fprintf(fp, "    \"group_%lu.utf8\": [\n", static_cast<unsigned long>(i));
+      fprintf(fp, "      { \"material\": \"mat_%lu\",\n"
+              "        \"attribRange\": [%lu, %lu],\n"
+              "        \"indexRange\": [%lu, %lu],\n"
+              "        \"bboxes\": %lu,\n"
+              "        \"names\": [\"group_%lu\"],\n"
+              "        \"lengths\": [",
+              static_cast<unsigned long>(i % 16), 0UL,
+              static_cast<unsigned long>(i), static_cast<unsigned long>(8 * i),
+              static_cast<unsigned long>(3 * i),
+              static_cast<unsigned long>(12 * i),
+              static_cast<unsigned long>(i));
+      for (size_t j = 0; j < 8; ++j) {
+        fprintf(fp, j == 0 ? "%lu" : ", %lu",
+                static_cast<unsigned long>(lengths_[j]));
+      }
+      fprintf(fp, "],\n        \"error\": %f\n      }\n    ]%s\n",
+              0.001 * i, i + 1 == num_groups_ ? "" : ",");
+    }
+    fputs("  }\n}\n", fp);
+    fflush(fp);
+    return timer.ElapsedSeconds();
+  }
+
+  double TimeJsonSink(FILE* fp) {
+    Timer timer;
+    BufferedFileSink sink(fp);
+    JsonSink json(&sink);
+    json.set_pretty_depth(3);
+    json.BeginObject();
+    json.PutString("urls");
+    json.BeginObject();
+    char name[32];
+    for (size_t i = 0; i < num_groups_; ++i) {
+      snprintf(name, sizeof(name), "group_%lu.utf8",
+               static_cast<unsigned long>(i));
+      json.PutString(name);
+      json.BeginArray();
+      json.BeginObject();
+      json.PutString("material");
+      snprintf(name, sizeof(name), "mat_%lu",
+               static_cast<unsigned long>(i % 16));
+      json.PutString(name);
+      const size_t attrib_range[2] = { 0, i };
+      const size_t index_range[2] = { 8 * i, 3 * i };
+      json.PutString("attribRange");
+      json.PutUintArray(attrib_range, 2);
+      json.PutString("indexRange");
+      json.PutUintArray(index_range, 2);
+      json.PutString("bboxes");
+      json.PutUint(12 * i);
+      json.PutString("names");
+      json.BeginArray();
+      snprintf(name, sizeof(name), "group_%lu",
+               static_cast<unsigned long>(i));
+      json.PutString(name);
+      json.End();
+      json.PutString("lengths");
+      json.PutUintArray(lengths_, 8);
+      json.PutString("error");
+      json.PutFloat(0.001f * i);
+      json.End();
+      json.End();
+    }
+    json.EndAll();
+    sink.Flush();
+    return timer.ElapsedSeconds();
+  }
+
+  // The best of a few runs.
+  void Run() {
+    FILE* fp = fopen("/dev/null", "wb");
+    CHECK(fp != NULL);
+    double old_way = 1e9, new_way = 1e9;
+    for (size_t run = 0; run < 3; ++run) {
+      old_way = std::min(old_way, TimeFprintf(fp));
+      new_way = std::min(new_way, TimeJsonSink(fp));
+    }
+    fclose(fp);
+    printf("%lu groups: fprintf %.3f s, JsonSink %.3f s\n",
+           static_cast<unsigned long>(num_groups_), old_way, new_way);
+  }
+
+ private:
+  size_t num_groups_;
+  size_t lengths_[8];
+};
+
 }  // namespace webgl_loader
 
-int main() {
+int main(int argc, char* argv[]) {
   webgl_loader::JsonSinkTest tester;
   tester.TestNull();
   tester.TestBool();
   tester.TestInt();
   tester.TestFloat();
+  tester.TestFloatRoundTrip();
+  tester.TestIntArrays();
   tester.TestString();
   tester.TestArray();
   tester.TestObject();
-    
+  tester.TestPretty();
+  if (argc > 1) {
+    webgl_loader::JsonBench bench(atol(argv[1]));
+    bench.Run();
+  }
   return 0;
 }
@@ -0,0 +1,278 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <stdlib.h>
+
+#include <string>
+
+#include "../manifest.h"
+#include "../timer.h"
+
+namespace webgl_loader {
+
+// A mesh of |num_groups| named groups in each format, packed as the
+// compressors pack them.
+void AddMeshes(size_t num_groups, size_t first_group, ManifestUrl* url) {
+  size_t offset = 0;
+  for (size_t format = 0; format < kNumMeshFormats; ++format) {
+    url->meshes.push_back(ManifestMesh());
+    ManifestMesh& mesh = url->meshes.back();
+    MeshEntry& entry = mesh.entry;
+    entry.format = static_cast<MeshFormat>(format);
+    entry.material = format % 2 ? "skin" : "nails";
+    entry.num_verts = 100 + 7 * first_group;
+    entry.num_tris = 150 + 11 * first_group;
+    switch (entry.format) {
+      case MESH_FORMAT_GPU_BUFFERS:
+        entry.num_verts = entry.num_tris = 0;
+        entry.code_start = url->meshes.size() - 1;
+        break;
+      case MESH_FORMAT_BINARY_RANGE:
+        entry.num_verts = entry.num_tris = 0;
+        entry.code_start = offset;
+        entry.code_length = 2000 + first_group;
+        break;
+      case MESH_FORMAT_INDEX_RANGE:
+        entry.attrib_start = offset;
+        entry.code_start = offset + 8 * entry.num_verts;
+        entry.code_length = 3 * entry.num_tris;
+        entry.bboxes_start = entry.code_start + entry.code_length;
+        entry.num_bboxes = num_groups;
+        break;
+      default:
+        entry.attrib_start = offset;
+        // Not always packed.
+        entry.code_start = offset + 8 * entry.num_verts + (format == 2);
+        entry.code_length = 300 + first_group;
+        entry.predictors.positions = PREDICTOR_PARALLELOGRAM;
+        entry.predictors.texcoords =
+            format == 1 ? PREDICTOR_STRETCH : PREDICTOR_TRAVERSAL;
+    }
+    offset = entry.End();
+    char name[32];
+    for (size_t i = 0; i < num_groups; ++i) {
+      snprintf(name, sizeof(name), "leaf_%lu",
+               static_cast<unsigned long>(first_group + i));
+      mesh.names.push_back(name);
+      mesh.lengths.push_back(3 * (first_group + i + 1));
+    }
+  }
+}
+
+Manifest MakeManifest(size_t num_urls, size_t groups_per_mesh,
+                      size_t num_lods) {
+  Manifest manifest;
+  manifest.materials.resize(2);
+  manifest.materials[0].name = "skin";
+  manifest.materials[0].map_Kd = "hand.ppm";
+  manifest.materials[1].name = "nails";
+  manifest.materials[1].Kd[0] = 184;
+  manifest.materials[1].Kd[1] = 0;
+  manifest.materials[1].Kd[2] = 255;
+  const int offsets[] = { -7473, -239, -8362, 0, 0, -511, -511, -511 };
+  const float scales[] = { 4.9755297e-5f, 4.9755297e-5f, 4.9755297e-5f,
+                           9.775171e-4f, 9.775171e-4f, 1.9569471e-3f,
+                           1.9569471e-3f, 1.9569471e-3f };
+  memcpy(manifest.decode_offsets, offsets, sizeof(offsets));
+  memcpy(manifest.decode_scales, scales, sizeof(scales));
+  size_t first_group = 0;
+  for (size_t i = 0; i < num_urls; ++i) {
+    manifest.urls.push_back(ManifestUrl());
+    manifest.urls.back().path = i % 2 ? "hand.utf8" : "hand.lod1.utf8";
+    AddMeshes(groups_per_mesh, first_group, &manifest.urls.back());
+    first_group += groups_per_mesh;
+  }
+  for (size_t i = 0; i < num_lods; ++i) {
+    manifest.lods.push_back(ManifestLod());
+    manifest.lods.back().error = 0.125f * (i + 1);
+    manifest.lods.back().urls = manifest.urls;
+  }
+  return manifest;
+}
+
+std::string ToJson(const Manifest& manifest) {
+  std::string out;
+  {
+    BufferedStringSink sink(&out);
+    JsonSink json(&sink);
+    json.set_pretty_depth(3);
+    WriteJsonManifest(manifest, &json);
+  }
+  return out;
+}
+
+std::string ToBinary(const Manifest& manifest) {
+  std::string out;
+  BufferedStringSink sink(&out);
+  BinaryManifestWriter writer(&sink);
+  writer.Write(manifest);
+  sink.Flush();
+  return out;
+}
+
+bool FromJson(const std::string& json, Manifest* manifest) {
+  BufferedInput input(json.data(), json.size());
+  JsonReader reader(&input);
+  JsonManifestReader manifest_reader(&reader);
+  return manifest_reader.Read(manifest);
+}
+
+bool FromBinary(const std::string& binary, Manifest* manifest) {
+  BinaryManifestReader reader(binary.data(), binary.size());
+  return reader.Read(manifest);
+}
+
+class ManifestTest {
+ public:
+  ManifestTest()
+      : manifest_(MakeManifest(3, 4, 2)),
+        json_(ToJson(manifest_)) {
+  }
+
+  // Each form reads back as it was written, and as the other.
+  void TestRoundTrip() {
+    Manifest from_json;
+    CHECK(FromJson(json_, &from_json));
+    CHECK(json_ == ToJson(from_json));
+    const std::string binary = ToBinary(manifest_);
+    CHECK(binary.size() < json_.size() / 4);
+    Manifest from_binary;
+    CHECK(FromBinary(binary, &from_binary));
+    CHECK(json_ == ToJson(from_binary));
+    CHECK(binary == ToBinary(from_json));
+  }
+
+  // As obj2utf8x writes it.
+  void TestNoNames() {
+    const Manifest manifest = MakeManifest(1, 0, 0);
+    const std::string json = ToJson(manifest);
+    CHECK(std::string::npos == json.find("names"));
+    CHECK(std::string::npos == json.find("lods"));
+    Manifest from_binary;
+    CHECK(FromBinary(ToBinary(manifest), &from_binary));
+    CHECK(json == ToJson(from_binary));
+  }
+
+  // Keys that aren't known are passed over.
+  void TestUnknownKeys() {
+    std::string json = json_;
+    json.insert(1, "\"comment\":{\"urls\":[1,2]},");
+    Manifest manifest;
+    CHECK(FromJson(json, &manifest));
+    CHECK(json_ == ToJson(manifest));
+  }
+
+  // Truncated or damaged input fails, without reading past the end.
+  void TestBadBinary() {
+    const std::string binary = ToBinary(manifest_);
+    for (size_t length = 0; length < binary.size(); ++length) {
+      Manifest manifest;
+      CHECK(!FromBinary(binary.substr(0, length), &manifest));
+    }
+    std::string extra = binary + '\0';
+    Manifest manifest;
+    CHECK(!FromBinary(extra, &manifest));
+    for (size_t i = 0; i < binary.size(); ++i) {
+      std::string damaged = binary;
+      damaged[i] = static_cast<char>(0xFF);
+      Manifest manifest;
+      FromBinary(damaged, &manifest);
+    }
+  }
+
+  void TestBadJson() {
+    static const char* const kBad[] = {
+      "[]",
+      "{\"urls\":[]}",
+      "{\"urls\":{\"a\":[{\"codeRange\":[1,2]}]}}",
+      "{\"urls\":{\"a\":[{\"names\":[\"x\"]}]}}",
+      "{\"urls\":{\"a\":[{\"predictors\":[\"stretch\",\"traversal\"]}]}}",
+      "{\"decodeParams\":{\"decodeOffsets\":[1,2,3]}}"
+    };
+    for (size_t i = 0; i < sizeof(kBad) / sizeof(kBad[0]); ++i) {
+      Manifest manifest;
+      CHECK(!FromJson(kBad[i], &manifest));
+    }
+  }
+
+ private:
+  const Manifest manifest_;
+  const std::string json_;
+};
+
+// Compares the two forms for a manifest of |num_groups| named groups,
+// as for a model of many small parts.
+class ManifestBench {
+ public:
+  explicit ManifestBench(size_t num_groups)
+      : manifest_(MakeManifest(num_groups / (16 * kNumMeshFormats), 16, 0)),
+        json_(ToJson(manifest_)),
+        binary_(ToBinary(manifest_)) {
+  }
+
+  // Returns seconds.
+  double TimeRead(bool binary) {
+    Timer timer;
+    Manifest manifest;
+    CHECK(binary ? FromBinary(binary_, &manifest) :
+          FromJson(json_, &manifest));
+    const double seconds = timer.ElapsedSeconds();
+    CHECK(manifest.urls.size() == manifest_.urls.size());
+    return seconds;
+  }
+
+  // The best of a few runs.
+  void Run() {
+    double json_seconds = 1e9, binary_seconds = 1e9;
+    for (size_t run = 0; run < 3; ++run) {
+      json_seconds = std::min(json_seconds, TimeRead(false));
+      binary_seconds = std::min(binary_seconds, TimeRead(true));
+    }
+    size_t num_groups = 0;
+    for (size_t i = 0; i < manifest_.urls.size(); ++i) {
+      for (size_t j = 0; j < manifest_.urls[i].meshes.size(); ++j) {
+        num_groups += manifest_.urls[i].meshes[j].names.size();
+      }
+    }
+    printf(PRIuS " groups: JSON " PRIuS " bytes, read in "
+           "%.1f ms; binary " PRIuS " bytes, read in %.1f ms\n",
+           num_groups, json_.size(), 1e3 * json_seconds, binary_.size(),
+           1e3 * binary_seconds);
+  }
+
+ private:
+  const Manifest manifest_;
+  const std::string json_;
+  const std::string binary_;
+};
+
+}  // namespace webgl_loader
+
+int main(int argc, char* argv[]) {
+  webgl_loader::ManifestTest tester;
+  tester.TestRoundTrip();
+  tester.TestNoNames();
+  tester.TestUnknownKeys();
+  tester.TestBadBinary();
+  tester.TestBadJson();
+  if (argc > 1) {
+    webgl_loader::ManifestBench bench(atol(argv[1]));
+    bench.Run();
+  }
+  return 0;
+}
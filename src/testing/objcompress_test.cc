@@ -0,0 +1,118 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -pthread -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "../objcompress.h"
+
+namespace webgl_loader {
+
+const char kTriangle[] = "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 3\n";
+
+void WriteFile(const std::string& path, const std::string& contents) {
+  FILE* fp = fopen(path.c_str(), "wb");
+  CHECK(fp != NULL);
+  CHECK(contents.size() == fwrite(contents.data(), 1, contents.size(), fp));
+  fclose(fp);
+}
+
+// Runs in a directory of its own, which it removes after.
+class ObjCompressTest {
+ public:
+  ObjCompressTest()
+      : dir_(MakeDir()) {
+    CHECK(0 == mkdir("in", 0777));
+  }
+
+  ~ObjCompressTest() {
+    CHECK(0 == chdir(".."));
+    RemoveDir(dir_ + "/in");
+    RemoveDir(dir_);
+  }
+
+  // A directory lists its OBJs by name; a file, its lines in order.
+  void TestListInputs() {
+    WriteFile("in/b.obj", kTriangle);
+    WriteFile("in/a.obj.gz", "");
+    WriteFile("in/notes.txt", "");
+    WriteFile("list", "in/b.obj\n\nin/a.obj.gz  \n");
+    std::vector<std::string> inputs;
+    CHECK(ListInputs("in", &inputs));
+    CHECK(2 == inputs.size());
+    CHECK("in/a.obj.gz" == inputs[0]);
+    CHECK("in/b.obj" == inputs[1]);
+    inputs.clear();
+    CHECK(ListInputs("list", &inputs));
+    CHECK(2 == inputs.size());
+    CHECK("in/b.obj" == inputs[0]);
+    CHECK("in/a.obj.gz" == inputs[1]);
+    CHECK(!ListInputs("missing", &inputs));
+    unlink("in/a.obj.gz");
+    unlink("in/b.obj");
+    unlink("in/notes.txt");
+    unlink("list");
+  }
+
+  // A malformed model is left out, and the rest are still written, in
+  // order.
+  void TestBatchWithMalformedModel() {
+    WriteFile("in/a.obj", kTriangle);
+    WriteFile("in/b.obj", std::string("v x y z\n") + kTriangle);
+    WriteFile("in/c.obj", std::string(kTriangle) + "f 3 2 1\n");
+    std::vector<std::string> obj_paths;
+    CHECK(ListInputs("in", &obj_paths));
+    CompressOptions options;
+    options.verify = true;
+    std::string js;
+    {
+      BufferedStringSink js_sink(&js);
+      BatchCompressor compressor(options, obj_paths, "out.utf8", &js_sink);
+      compressor.Run(2);
+      CHECK(1 == compressor.num_failed());
+      CHECK(0 == compressor.num_mismatches());
+    }
+    const size_t a = js.find("MODELS[\"a.obj\"]");
+    const size_t c = js.find("MODELS[\"c.obj\"]");
+    CHECK(a != std::string::npos);
+    CHECK(c != std::string::npos);
+    CHECK(a < c);
+    CHECK(std::string::npos == js.find("b.obj"));
+  }
+
+ private:
+  static std::string MakeDir() {
+    char dir[] = "/tmp/objcompress_test.XXXXXX";
+    CHECK(mkdtemp(dir) != NULL);
+    CHECK(0 == chdir(dir));
+    return dir;
+  }
+
+  const std::string dir_;
+};
+
+}  // namespace webgl_loader
+
+int main(int argc, char* argv[]) {
+  webgl_loader::ObjCompressTest tester;
+  tester.TestListInputs();
+  tester.TestBatchWithMalformedModel();
+  return 0;
+}
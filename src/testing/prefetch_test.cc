@@ -0,0 +1,302 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -pthread -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "../prefetch.h"
+#include "../timer.h"
+
+namespace webgl_loader {
+
+// Reads |input| to the end, and returns what it held.
+std::string ReadAll(BufferedInput* input) {
+  std::string contents;
+  while (kNoError == input->Refill()) {
+    contents.append(input->cursor, input->end());
+    input->cursor = input->end();
+  }
+  return contents;
+}
+
+class PrefetchingInputStreamTest {
+ public:
+  PrefetchingInputStreamTest() {
+    strcpy(path_, "/tmp/prefetch_test.XXXXXX");
+    const int fd = mkstemp(path_);
+    CHECK(fd >= 0);
+    close(fd);
+  }
+
+  ~PrefetchingInputStreamTest() {
+    unlink(path_);
+  }
+
+  void WriteFile(size_t length) {
+    contents_.resize(length);
+    for (size_t i = 0; i < length; ++i) {
+      contents_[i] = static_cast<char>(i * 31 + (i >> 8));
+    }
+    FILE* fp = fopen(path_, "wb");
+    CHECK(fp != NULL);
+    CHECK(length == fwrite(contents_.data(), 1, length, fp));
+    fclose(fp);
+  }
+
+  // Files that end inside, at the end of, and past the end of the
+  // ring read the same as with |BufferedInputStream|, and then
+  // read as zeroes.
+  void TestRead() {
+    const size_t kLengths[] = { 0, 1, 1000, 4096, 3 * 4096, 100000 };
+    for (size_t i = 0; i < sizeof(kLengths) / sizeof(kLengths[0]); ++i) {
+      WriteFile(kLengths[i]);
+      FILE* fp = fopen(path_, "rb");
+      CHECK(fp != NULL);
+      PrefetchingInputStream input(fp, 4096, 3);
+      CHECK(contents_ == ReadAll(&input));
+      CHECK(kEndOfFile == input.error());
+      CHECK(kEndOfFile == input.Refill());
+      CHECK(input.cursor != input.end() && 0 == *input.cursor);
+      fclose(fp);
+    }
+  }
+
+  // Reads only the first buffer of |fp|.
+  void ReadFirst(FILE* fp) {
+    PrefetchingInputStream input(fp, 4096, 2);
+    CHECK(kNoError == input.Refill());
+    CHECK(0 == memcmp(contents_.data(), input.cursor, 4096));
+  }
+
+  // The reader can be stopped before the end, while it waits for a
+  // buffer to be given back.
+  void TestStopEarly() {
+    WriteFile(100000);
+    FILE* fp = fopen(path_, "rb");
+    CHECK(fp != NULL);
+    ReadFirst(fp);
+    fclose(fp);
+  }
+
+  void TestError() {
+    FILE* fp = fopen("/", "rb");
+    CHECK(fp != NULL);
+    PrefetchingInputStream input(fp);
+    CHECK(kFileError == input.Refill());
+    CHECK(kFileError == input.error());
+    fclose(fp);
+  }
+
+ private:
+  char path_[32];
+  std::string contents_;
+};
+
+// A refiller for the benchmark that calls read(2) directly.
+class ReadInputStream : public BufferedInput {
+ public:
+  ReadInputStream(int fd, char* buf, size_t size)
+      : BufferedInput(RefillRead),
+        fd_(fd),
+        buf_(buf),
+        size_(size) {
+    cursor = begin_ = end_ = buf;
+  }
+
+ private:
+  static ErrorCode RefillRead(BufferedInput* bi) {
+    return static_cast<ReadInputStream*>(bi)->DoRefillRead();
+  }
+
+  ErrorCode DoRefillRead() {
+    ssize_t bytes_read;
+    while ((bytes_read = read(fd_, buf_, size_)) < 0) {
+      if (errno != EINTR) return fail(kFileError);
+    }
+    if (bytes_read == 0) return fail(kEndOfFile);
+    cursor = begin_;
+    end_ = begin_ + bytes_read;
+    return kNoError;
+  }
+
+  int fd_;
+  char* buf_;
+  size_t size_;
+};
+
+// Times each way of reading a file through a |BufferedInput|, while
+// the consumer counts bytes as |ByteHistogramSink| would, with the
+// file in the page cache and not.
+class PrefetchBench {
+ public:
+  explicit PrefetchBench(size_t num_bytes)
+      : num_bytes_(num_bytes) {
+    strcpy(path_, "/var/tmp/prefetch_bench.XXXXXX");
+    const int fd = mkstemp(path_);
+    CHECK(fd >= 0);
+    std::vector<char> block(1 << 20);
+    uint32 state = 1;
+    for (size_t i = 0; i < num_bytes; i += block.size()) {
+      for (size_t j = 0; j < block.size(); ++j) {
+        state = state * 1664525u + 1013904223u;
+        block[j] = static_cast<char>(state >> 24);
+      }
+      const size_t length = std::min(block.size(), num_bytes - i);
+      CHECK(static_cast<ssize_t>(length) == write(fd, &block[0], length));
+    }
+    CHECK(0 == fsync(fd));
+    close(fd);
+  }
+
+  ~PrefetchBench() {
+    unlink(path_);
+  }
+
+  // Drops the file from the page cache, or reads it into it.
+  void SetCache(bool cold) {
+    const int fd = open(path_, O_RDONLY);
+    CHECK(fd >= 0);
+    if (cold) {
+      CHECK(0 == posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED));
+    } else {
+      std::vector<char> buf(1 << 20);
+      while (read(fd, &buf[0], buf.size()) > 0) { }
+    }
+    close(fd);
+  }
+
+  // Returns MB/s.
+  double Consume(BufferedInput* input, const Timer& timer) {
+    size_t histo[256] = { 0 };
+    size_t total = 0;
+    while (kNoError == input->Refill()) {
+      for (const char* p = input->cursor; p != input->end(); ++p) {
+        ++histo[static_cast<uint8>(*p)];
+      }
+      total += input->end() - input->cursor;
+      input->cursor = input->end();
+    }
+    CHECK(total == num_bytes_);
+    CHECK(histo[0] != 0);
+    return num_bytes_ / timer.ElapsedSeconds() / 1e6;
+  }
+
+  double TimeFread(size_t buffer_size) {
+    Timer timer;
+    FILE* fp = fopen(path_, "rb");
+    CHECK(fp != NULL);
+    std::vector<char> buf(buffer_size);
+    BufferedInputStream input(fp, &buf[0], buf.size());
+    const double mbps = Consume(&input, timer);
+    fclose(fp);
+    return mbps;
+  }
+
+  double TimeRead(size_t buffer_size) {
+    Timer timer;
+    const int fd = open(path_, O_RDONLY);
+    CHECK(fd >= 0);
+    std::vector<char> buf(buffer_size);
+    ReadInputStream input(fd, &buf[0], buf.size());
+    const double mbps = Consume(&input, timer);
+    close(fd);
+    return mbps;
+  }
+
+  double TimeMmap() {
+    Timer timer;
+    const int fd = open(path_, O_RDONLY);
+    CHECK(fd >= 0);
+    void* data = mmap(NULL, num_bytes_, PROT_READ, MAP_PRIVATE, fd, 0);
+    CHECK(data != MAP_FAILED);
+    BufferedInput input(static_cast<const char*>(data), num_bytes_);
+    const double mbps = Consume(&input, timer);
+    munmap(data, num_bytes_);
+    close(fd);
+    return mbps;
+  }
+
+  double TimePrefetch(size_t buffer_size) {
+    Timer timer;
+    FILE* fp = fopen(path_, "rb");
+    CHECK(fp != NULL);
+    double mbps;
+    {
+      PrefetchingInputStream input(fp, buffer_size);
+      mbps = Consume(&input, timer);
+    }
+    fclose(fp);
+    return mbps;
+  }
+
+  double Time(int method, size_t buffer_size) {
+    switch (method) {
+      case 0: return TimeFread(buffer_size);
+      case 1: return TimeRead(buffer_size);
+      case 2: return TimeMmap();
+      default: return TimePrefetch(buffer_size);
+    }
+  }
+
+  // The best of a few runs, since the others share the machine.
+  void Run() {
+    static const size_t kBufferSizes[] = {
+      16 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024
+    };
+    static const size_t kNumRuns = 3;
+    printf("%.0f MB, MB/s     fread      read      mmap  prefetch\n",
+           num_bytes_ / 1e6);
+    for (int cold = 1; cold >= 0; --cold) {
+      for (size_t i = 0; i < sizeof(kBufferSizes) / sizeof(size_t); ++i) {
+        const size_t size = kBufferSizes[i];
+        printf("%s %5dK", cold ? "cold" : "warm", static_cast<int>(size / 1024));
+        for (int method = 0; method < 4; ++method) {
+          double best = 0.0;
+          for (size_t run = 0; run < kNumRuns; ++run) {
+            SetCache(cold);
+            best = std::max(best, Time(method, size));
+          }
+          printf(" %9.0f", best);
+        }
+        printf("\n");
+      }
+    }
+  }
+
+ private:
+  size_t num_bytes_;
+  char path_[40];
+};
+
+}  // namespace webgl_loader
+
+int main(int argc, char* argv[]) {
+  webgl_loader::PrefetchingInputStreamTest tester;
+  tester.TestRead();
+  tester.TestStopEarly();
+  tester.TestError();
+  if (argc > 1) {
+    webgl_loader::PrefetchBench bench(atol(argv[1]));
+    bench.Run();
+  }
+  return 0;
+}
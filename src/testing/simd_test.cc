@@ -0,0 +1,90 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+// Checks the kernels in simd.h against their scalar versions. With a
+// vertex count, also times them on a mesh that size:
+//
+//   ./simd_test 10000000
+
+#include <stdlib.h>
+
+#include <vector>
+
+#include "../simd.h"
+#include "../timer.h"
+
+namespace webgl_loader {
+
+// Attribs that wander like a real mesh's, with some large jumps.
+void MakeAttribs(size_t num_verts, unsigned int seed,
+                 QuantizedAttribList* attribs) {
+  srand(seed);
+  attribs->resize(8 * num_verts);
+  uint16 walk[8] = { 0 };
+  for (size_t i = 0; i < num_verts; ++i) {
+    for (size_t j = 0; j < 8; ++j) {
+      walk[j] += (rand() % 16 == 0) ? rand() : rand() % 64 - 32;
+      (*attribs)[8 * i + j] = walk[j];
+    }
+  }
+}
+
+void TestTransposeDeltaZigZag() {
+  for (size_t num_verts = 0; num_verts < 100; ++num_verts) {
+    QuantizedAttribList attribs;
+    MakeAttribs(num_verts, num_verts, &attribs);
+    // Guard words past the end catch a kernel that writes too far.
+    QuantizedAttribList expected(attribs.size() + 16, 0xBEEF);
+    QuantizedAttribList actual(attribs.size() + 16, 0xBEEF);
+    if (num_verts > 0) {
+      TransposeDeltaZigZagScalar(&attribs[0], num_verts, &expected[0]);
+      TransposeDeltaZigZag(&attribs[0], num_verts, &actual[0]);
+    }
+    CHECK(expected == actual);
+    if (num_verts > 1) {
+      CHECK(ZigZag(static_cast<int16>(attribs[8 + 3] - attribs[3])) ==
+            expected[num_verts * 3 + 1]);
+    }
+  }
+}
+
+void BenchTransposeDeltaZigZag(size_t num_verts) {
+  QuantizedAttribList attribs;
+  MakeAttribs(num_verts, 1, &attribs);
+  QuantizedAttribList planar(attribs.size());
+  const double megabytes = sizeof(uint16) * attribs.size() / 1e6;
+  Timer timer;
+  TransposeDeltaZigZagScalar(&attribs[0], num_verts, &planar[0]);
+  const double scalar_seconds = timer.ElapsedSeconds();
+  timer.Reset();
+  TransposeDeltaZigZag(&attribs[0], num_verts, &planar[0]);
+  const double simd_seconds = timer.ElapsedSeconds();
+  printf("TransposeDeltaZigZag, " PRIuS " vertices: scalar %.0f MB/s, "
+         "%s %.0f MB/s\n", num_verts, megabytes / scalar_seconds,
+         SimdName(), megabytes / simd_seconds);
+}
+
+}  // namespace webgl_loader
+
+int main(int argc, char* argv[]) {
+  webgl_loader::TestTransposeDeltaZigZag();
+  if (argc > 1) {
+    webgl_loader::BenchTransposeDeltaZigZag(atol(argv[1]));
+  }
+  return 0;
+}
@@ -0,0 +1,213 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -pthread -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <math.h>
+
+#include <vector>
+
+#include "../simplify.h"
+#include "../thread.h"
+
+namespace webgl_loader {
+
+class SimplifyTest {
+ public:
+  // An |n| x |n| grid of quads over the unit square, with a UV seam
+  // down x = 1/2: vertices right of it have texcoords shifted by 2,
+  // and those on it have one vertex for each side. The top and bottom
+  // halves are separate groups.
+  void MakeGrid(size_t n, float wave, DrawMesh* mesh,
+                std::vector<size_t>* group_offsets) {
+    std::vector<int> left(n + 1), right(n + 1);
+    std::vector<int> grid((n + 1) * (n + 1));
+    int num_verts = 0;
+    for (size_t y = 0; y <= n; ++y) {
+      for (size_t x = 0; x <= n; ++x) {
+        const float u = float(x) / n;
+        const float v = float(y) / n;
+        const float z = wave * sin(6 * u) * cos(4 * v);
+        const float attribs[8] = { u, v, z, u, v, 0.f, 0.f, 1.f };
+        grid[y * (n + 1) + x] = num_verts++;
+        mesh->attribs.insert(mesh->attribs.end(), attribs, attribs + 8);
+        if (2 * x >= n) {
+          mesh->attribs[mesh->attribs.size() - 5] += 2.f;
+        }
+        if (2 * x == n) {
+          right[y] = grid[y * (n + 1) + x];
+          left[y] = num_verts++;
+          mesh->attribs.insert(mesh->attribs.end(), attribs, attribs + 8);
+        }
+      }
+    }
+    group_offsets->push_back(0);
+    for (size_t y = 0; y < n; ++y) {
+      if (2 * y == n) group_offsets->push_back(mesh->indices.size());
+      for (size_t x = 0; x < n; ++x) {
+        int corners[4] = {
+          grid[y * (n + 1) + x], grid[y * (n + 1) + x + 1],
+          grid[(y + 1) * (n + 1) + x + 1], grid[(y + 1) * (n + 1) + x]
+        };
+        if (2 * (x + 1) == n) {
+          corners[1] = left[y];
+          corners[2] = left[y + 1];
+        }
+        const int quad[6] = { corners[0], corners[1], corners[2],
+                              corners[0], corners[2], corners[3] };
+        mesh->indices.insert(mesh->indices.end(), quad, quad + 6);
+      }
+    }
+  }
+
+  void TestKinds() {
+    DrawMesh mesh;
+    std::vector<size_t> group_offsets;
+    MakeGrid(8, 0.f, &mesh, &group_offsets);
+    MeshSimplifier simplifier(mesh, group_offsets);
+    // Each row has 10 vertices. By (x, y): (1, 1), (0, 1), both sides
+    // of (4, 1), (4, 0) and (1, 4).
+    CHECK(VERTEX_MANIFOLD == simplifier.kind(11));
+    CHECK(VERTEX_BORDER == simplifier.kind(10));
+    CHECK(VERTEX_SEAM == simplifier.kind(14));
+    CHECK(VERTEX_SEAM == simplifier.kind(15));
+    CHECK(VERTEX_LOCKED == simplifier.kind(4));
+    CHECK(VERTEX_LOCKED == simplifier.kind(4 * 10 + 1));
+  }
+
+  void TestFlat() {
+    DrawMesh mesh;
+    std::vector<size_t> group_offsets;
+    MakeGrid(40, 0.f, &mesh, &group_offsets);
+    const size_t num_tris = mesh.indices.size() / 3;
+    MeshSimplifier simplifier(mesh, group_offsets);
+    simplifier.Simplify(num_tris / 4);
+    const IndexList& indices = simplifier.indices();
+    CHECK(indices.size() / 3 <= num_tris / 4);
+    CHECK(indices.size() / 3 > num_tris / 16);
+    // Nothing moves off the plane.
+    CHECK(simplifier.error() < 1e-6);
+    // Groups keep their triangles, and the line between them.
+    std::vector<size_t> offsets;
+    simplifier.GetGroupOffsets(&offsets);
+    CHECK(2 == offsets.size());
+    CHECK(0 == offsets[0]);
+    std::vector<bool> used(mesh.attribs.size() / 8, false);
+    for (size_t i = 0; i < indices.size(); ++i) {
+      const float v = mesh.attribs[8*indices[i] + 1];
+      CHECK(i < offsets[1] ? v <= 0.5f : v >= 0.5f);
+      used[indices[i]] = true;
+    }
+    for (size_t i = 0; i < used.size(); ++i) {
+      if (mesh.attribs[8*i + 1] == 0.5f) {
+        CHECK(used[i]);
+      }
+    }
+    // No triangle crosses the seam.
+    for (size_t i = 0; i < indices.size(); i += 3) {
+      const float u0 = mesh.attribs[8*indices[i + 0] + 3];
+      const float u1 = mesh.attribs[8*indices[i + 1] + 3];
+      const float u2 = mesh.attribs[8*indices[i + 2] + 3];
+      CHECK((u0 < 1.f) == (u1 < 1.f));
+      CHECK((u0 < 1.f) == (u2 < 1.f));
+    }
+  }
+
+  void TestLodChain() {
+    DrawMesh mesh;
+    std::vector<size_t> group_offsets;
+    MakeGrid(40, 0.1f, &mesh, &group_offsets);
+    std::vector<double> ratios;
+    ratios.push_back(0.5);
+    ratios.push_back(0.25);
+    ratios.push_back(0.06);
+    std::vector<LodLevel> levels;
+    BuildLodChain(mesh, group_offsets, ratios, &levels);
+    CHECK(3 == levels.size());
+    for (size_t i = 0; i < levels.size(); ++i) {
+      CHECK(levels[i].indices.size() / 3 <=
+            ratios[i] * mesh.indices.size() / 3);
+      CHECK(levels[i].error > 0.0);
+      CHECK(levels[i].error < 0.1);
+      if (i > 0) {
+        CHECK(levels[i].error >= levels[i - 1].error);
+      }
+    }
+  }
+
+  struct Batches {
+    std::vector<DrawMesh> meshes;
+    std::vector<size_t> group_offsets;
+    std::vector<double> ratios;
+    std::vector<std::vector<LodLevel> > levels;
+  };
+
+  static void SimplifyBatch(void* arg, size_t i) {
+    Batches* batches = static_cast<Batches*>(arg);
+    BuildLodChain(batches->meshes[i], batches->group_offsets,
+                  batches->ratios, &batches->levels[i]);
+  }
+
+  // Running batches in parallel gives the same chains as in series.
+  void TestParallel() {
+    Batches batches;
+    batches.meshes.resize(8);
+    for (size_t i = 0; i < batches.meshes.size(); ++i) {
+      batches.group_offsets.clear();
+      MakeGrid(10 + 3 * i, 0.05f, &batches.meshes[i], &batches.group_offsets);
+    }
+    batches.ratios.push_back(0.5);
+    batches.ratios.push_back(0.1);
+    batches.levels.resize(batches.meshes.size());
+    ParallelFor(batches.meshes.size(), &SimplifyBatch, &batches, 4);
+    for (size_t i = 0; i < batches.meshes.size(); ++i) {
+      std::vector<LodLevel> levels;
+      BuildLodChain(batches.meshes[i], batches.group_offsets, batches.ratios,
+                    &levels);
+      for (size_t j = 0; j < levels.size(); ++j) {
+        CHECK(levels[j].indices == batches.levels[i][j].indices);
+        CHECK(levels[j].error == batches.levels[i][j].error);
+      }
+    }
+  }
+
+  // Duplicate, degenerate and non-manifold triangles don't stop the
+  // rest from simplifying.
+  void TestSoup() {
+    DrawMesh mesh;
+    std::vector<size_t> group_offsets;
+    MakeGrid(20, 0.05f, &mesh, &group_offsets);
+    const int extra[] = { 0, 1, 22, 0, 1, 22, 5, 5, 6, 1, 0, 100, 3, 3, 3 };
+    mesh.indices.insert(mesh.indices.end(), extra,
+                        extra + sizeof(extra) / sizeof(extra[0]));
+    const size_t num_tris = mesh.indices.size() / 3;
+    MeshSimplifier simplifier(mesh, group_offsets);
+    simplifier.Simplify(num_tris / 4);
+    CHECK(simplifier.indices().size() / 3 <= num_tris / 4);
+  }
+};
+
+}  // namespace webgl_loader
+
+int main(int argc, char* argv[]) {
+  webgl_loader::SimplifyTest tester;
+  tester.TestKinds();
+  tester.TestFlat();
+  tester.TestLodChain();
+  tester.TestParallel();
+  tester.TestSoup();
+  return 0;
+}
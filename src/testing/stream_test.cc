@@ -18,6 +18,7 @@ exit;
 
 #include "../base.h"
 #include "../stream.h"
+#include "../timer.h"
 
 #include <iostream>  // DO NOT SUBMIT
 #include <string>
@@ -47,11 +48,200 @@ class BufferedInputTest {
   }
 };
 
+class BufferedSinkTest {
+ public:
+  // Writes the same bytes every way a producer can.
+  void Write(BufferedSink* sink) {
+    for (int i = 0; i < 1000; ++i) {
+      sink->Put(static_cast<char>(i));
+    }
+    char* out = sink->Reserve(10);
+    for (int i = 0; i < 5; ++i) *out++ = 'r';
+    sink->Commit(out);
+    sink->PutN(big_.data(), big_.size());
+    PutVarint(300, sink);
+  }
+
+  std::string Expected() const {
+    std::string expected;
+    for (int i = 0; i < 1000; ++i) {
+      expected += static_cast<char>(i);
+    }
+    return expected + "rrrrr" + big_ + "\xAC\x02";
+  }
+
+  void WriteFile(FILE* fp) {
+    BufferedFileSink sink(fp, 1000);
+    Write(&sink);
+  }
+
+  void TestSinks() {
+    big_.assign(3 * kSinkBlockSize + 17, 'b');
+    const std::string expected = Expected();
+    {
+      std::string str("head");
+      {
+        BufferedStringSink sink(&str);
+        Write(&sink);
+        sink.Flush();
+        CHECK(str == "head" + expected);
+        // Writing carries on after a flush.
+        Write(&sink);
+      }
+      CHECK(str == "head" + expected + expected);
+    }
+    {
+      std::vector<char> vec;
+      {
+        BufferedVectorSink sink(&vec);
+        Write(&sink);
+      }
+      CHECK(std::string(vec.begin(), vec.end()) == expected);
+    }
+    {
+      std::string str;
+      StringSink string_sink(&str);
+      {
+        BufferedByteSink sink(&string_sink, 100);
+        Write(&sink);
+        BufferedSinkAdapter adapter(&sink);
+        adapter.PutN("xy", 2);
+      }
+      CHECK(str == expected + "xy");
+    }
+    {
+      FILE* fp = tmpfile();
+      CHECK(fp != NULL);
+      WriteFile(fp);
+      std::string read(expected.size() + 1, '\0');
+      rewind(fp);
+      CHECK(expected.size() == fread(&read[0], 1, read.size(), fp));
+      read.resize(expected.size());
+      CHECK(read == expected);
+      fclose(fp);
+    }
+  }
+
+  // Every branch gets everything, however it is buffered.
+  void TestFanOut() {
+    std::string expected;
+    for (int i = 0; i < 1000; ++i) {
+      expected += static_cast<char>(i);
+    }
+    expected += big_;
+    std::string a, b;
+    BufferedStringSink sink_a(&a);
+    StringSink string_sink(&b);
+    BufferedByteSink sink_b(&string_sink, 100);
+    FanOutSink fan_out;
+    fan_out.AddBranch(&sink_a);
+    fan_out.AddBranch(&sink_b);
+    for (int i = 0; i < 1000; ++i) {
+      fan_out.Put(static_cast<char>(i));
+    }
+    fan_out.PutN(big_.data(), big_.size());
+    fan_out.Flush();
+    CHECK(a == expected);
+    CHECK(b == expected);
+  }
+
+  // Varints decode what was encoded, and nothing that is cut short or
+  // too big for a uint32.
+  void TestVarints() {
+    const uint32 kValues[] = { 0, 127, 128, 300, 1u << 28, 0xFFFFFFFFu };
+    for (size_t i = 0; i < sizeof(kValues) / sizeof(kValues[0]); ++i) {
+      char buf[5];
+      const char* end = PutVarint(kValues[i], buf);
+      uint32 value = 0;
+      CHECK(end == GetVarint(buf, end, &value));
+      CHECK(kValues[i] == value);
+      CHECK(NULL == GetVarint(buf, end - 1, &value));
+    }
+    uint32 value = 0;
+    const char kTooBig[] = "\xFF\xFF\xFF\xFF\x7F";
+    CHECK(NULL == GetVarint(kTooBig, kTooBig + 5, &value));
+    const char kMax[] = "\xFF\xFF\xFF\xFF\x0F";
+    CHECK(kMax + 5 == GetVarint(kMax, kMax + 5, &value));
+    CHECK(0xFFFFFFFFu == value);
+    const char kSixBytes[] = "\xFF\xFF\xFF\xFF\x8F\x00";
+    CHECK(NULL == GetVarint(kSixBytes, kSixBytes + 6, &value));
+  }
+
+ private:
+  std::string big_;
+};
+
+// Bytes per second written one at a time, through |ByteSinkInterface|
+// and through |BufferedSink|.
+class SinkBench {
+ public:
+  explicit SinkBench(size_t num_bytes)
+      : num_bytes_(num_bytes) {
+  }
+
+  void Report(const char* name, double seconds) {
+    printf("%-28s %8.0f MB/s\n", name, num_bytes_ / seconds / 1e6);
+  }
+
+  void Time(const char* name, ByteSinkInterface* sink) {
+    Timer timer;
+    for (size_t i = 0; i < num_bytes_; ++i) {
+      sink->Put(static_cast<char>(i));
+    }
+    Report(name, timer.ElapsedSeconds());
+  }
+
+  void Time(const char* name, BufferedSink* sink) {
+    Timer timer;
+    for (size_t i = 0; i < num_bytes_; ++i) {
+      sink->Put(static_cast<char>(i));
+    }
+    sink->Flush();
+    Report(name, timer.ElapsedSeconds());
+  }
+
+  void Run() {
+    FILE* fp = fopen("/dev/null", "wb");
+    CHECK(fp != NULL);
+    std::string str;
+    std::vector<char> vec;
+    FileSink file_sink(fp);
+    Time("FileSink", &file_sink);
+    VectorSink vector_sink(&vec);
+    Time("VectorSink", &vector_sink);
+    StringSink string_sink(&str);
+    Time("StringSink", &string_sink);
+    BufferedFileSink buffered_file_sink(fp);
+    Time("BufferedFileSink", &buffered_file_sink);
+    vec.clear();
+    BufferedVectorSink buffered_vector_sink(&vec);
+    Time("BufferedVectorSink", &buffered_vector_sink);
+    str.clear();
+    BufferedStringSink buffered_string_sink(&str);
+    Time("BufferedStringSink", &buffered_string_sink);
+    str.clear();
+    BufferedByteSink buffered_byte_sink(&string_sink);
+    Time("BufferedByteSink(StringSink)", &buffered_byte_sink);
+    fclose(fp);
+  }
+
+ private:
+  size_t num_bytes_;
+};
+
 }  // namespace webgl_loader
 
-int main() {
+int main(int argc, char* argv[]) {
   webgl_loader::BufferedInputTest tester;
   tester.TestFromMemory();
-    
+  webgl_loader::BufferedSinkTest sink_tester;
+  sink_tester.TestSinks();
+  sink_tester.TestFanOut();
+  sink_tester.TestVarints();
+  // With a byte count, times each sink writing that many bytes.
+  if (argc > 1) {
+    webgl_loader::SinkBench bench(atol(argv[1]));
+    bench.Run();
+  }
   return 0;
 }
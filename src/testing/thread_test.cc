@@ -0,0 +1,175 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -pthread -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <stdlib.h>
+
+#include <map>
+#include <vector>
+
+#include "../thread.h"
+#include "../timer.h"
+
+namespace webgl_loader {
+
+// Counts the calls for each i, and notes the threads they were on.
+struct Calls {
+  explicit Calls(size_t n)
+      : counts(n, 0),
+        threads(n, -1),
+        num_done(0),
+        last(0) {
+    CHECK(0 == pthread_mutex_init(&mutex, NULL));
+    CHECK(0 == pthread_cond_init(&done, NULL));
+  }
+
+  ~Calls() {
+    pthread_cond_destroy(&done);
+    pthread_mutex_destroy(&mutex);
+  }
+
+  std::vector<int> counts;
+  std::vector<int> threads;
+  pthread_mutex_t mutex;
+  pthread_cond_t done;
+  // Guarded by |mutex|.
+  size_t num_done;
+  size_t last;
+  std::map<int, size_t> last_by_thread;
+};
+
+void Count(void* arg, size_t i, int thread) {
+  Calls* calls = static_cast<Calls*>(arg);
+  ++calls->counts[i];
+  calls->threads[i] = thread;
+}
+
+void CountAny(void* arg, size_t i) {
+  Count(arg, i, 0);
+}
+
+// The call for 0 waits for every other to finish, so the rest of its
+// thread's queue can only be run by others stealing it.
+void WaitForOthers(void* arg, size_t i, int thread) {
+  Calls* calls = static_cast<Calls*>(arg);
+  Count(arg, i, thread);
+  MutexLock lock(&calls->mutex);
+  ++calls->num_done;
+  if (i == 0) {
+    while (calls->num_done != calls->counts.size()) {
+      pthread_cond_wait(&calls->done, &calls->mutex);
+    }
+  } else if (calls->num_done == calls->counts.size()) {
+    pthread_cond_signal(&calls->done);
+  }
+  calls->last = i;
+  calls->last_by_thread[thread] = i;
+}
+
+class ThreadTest {
+ public:
+  // Every i is run once, on one of the threads asked for.
+  void TestEachOnce() {
+    const size_t kSizes[] = { 0, 1, 3, 4, 5, 1000 };
+    for (size_t k = 0; k < sizeof(kSizes) / sizeof(kSizes[0]); ++k) {
+      const size_t n = kSizes[k];
+      for (int num_threads = 1; num_threads <= 8; num_threads *= 2) {
+        Calls stealing(n);
+        WorkStealingFor(n, &Count, &stealing, num_threads);
+        Calls shared(n);
+        ParallelFor(n, &CountAny, &shared, num_threads);
+        for (size_t i = 0; i < n; ++i) {
+          CHECK(1 == stealing.counts[i]);
+          CHECK(stealing.threads[i] >= 0);
+          CHECK(stealing.threads[i] < num_threads);
+          CHECK(1 == shared.counts[i]);
+        }
+      }
+    }
+  }
+
+  // A thread that is stuck has the rest of its queue taken.
+  void TestSteal() {
+    const size_t n = 100;
+    const int num_threads = 4;
+    Calls calls(n);
+    WorkStealingFor(n, &WaitForOthers, &calls, num_threads);
+    for (size_t i = 0; i < n; ++i) {
+      CHECK(1 == calls.counts[i]);
+    }
+    CHECK(0 == calls.last);
+    CHECK(0 == calls.last_by_thread[calls.threads[0]]);
+  }
+};
+
+// Runs |num_calls| calls that take from none to a few microseconds, as
+// a batch of small and large models would, on 1 up to |NumProcessors|
+// threads, and prints calls per second for each way of sharing them.
+class ThreadBench {
+ public:
+  explicit ThreadBench(size_t num_calls)
+      : num_calls_(num_calls),
+        sums_(num_calls) {
+  }
+
+  void Run() {
+    for (int num_threads = 1; ; num_threads *= 2) {
+      if (num_threads > NumProcessors()) num_threads = NumProcessors();
+      Timer timer;
+      ParallelFor(num_calls_, &SpinAny, this, num_threads);
+      const double shared_seconds = timer.ElapsedSeconds();
+      timer.Reset();
+      WorkStealingFor(num_calls_, &Spin, this, num_threads);
+      const double stealing_seconds = timer.ElapsedSeconds();
+      printf("%d threads: ParallelFor %.0f calls/s, "
+             "WorkStealingFor %.0f calls/s\n", num_threads,
+             num_calls_ / shared_seconds, num_calls_ / stealing_seconds);
+      if (num_threads == NumProcessors()) break;
+    }
+  }
+
+ private:
+  static void Spin(void* arg, size_t i, int thread) {
+    ThreadBench* bench = static_cast<ThreadBench*>(arg);
+    uint32 sum = static_cast<uint32>(i);
+    const size_t length = (i * 2654435761u) % 4096;
+    for (size_t k = 0; k < length; ++k) {
+      sum = sum * 1664525u + 1013904223u;
+    }
+    bench->sums_[i] = sum;
+  }
+
+  static void SpinAny(void* arg, size_t i) {
+    Spin(arg, i, 0);
+  }
+
+  const size_t num_calls_;
+  std::vector<uint32> sums_;
+};
+
+}  // namespace webgl_loader
+
+int main(int argc, char* argv[]) {
+  webgl_loader::ThreadTest tester;
+  tester.TestEachOnce();
+  tester.TestSteal();
+  if (argc > 1) {
+    webgl_loader::ThreadBench bench(atol(argv[1]));
+    bench.Run();
+  }
+  return 0;
+}
@@ -0,0 +1,305 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+// Checks the bulk UTF-8 routines in utf8.h against the scalar ones,
+// and the decoder against every sequence of up to 3 bytes. With a
+// word count, also times them on that many words:
+//
+//   ./utf8_test 100000000
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "../timer.h"
+#include "../utf8.h"
+
+namespace webgl_loader {
+
+// What good_codepoints writes: |Uint16ToUtf8| of each word in order,
+// skipping those it can't encode.
+std::string ScalarUtf8(const std::vector<uint16>& words) {
+  std::string utf8;
+  StringSink sink(&utf8);
+  for (size_t i = 0; i < words.size(); ++i) {
+    Uint16ToUtf8(words[i], &sink);
+  }
+  return utf8;
+}
+
+std::string BulkUtf8(const std::vector<uint16>& words) {
+  std::string utf8;
+  StringSink sink(&utf8);
+  CHECK(Uint16ArrayToUtf8(words.empty() ? NULL : &words[0], words.size(),
+                          &sink));
+  return utf8;
+}
+
+// Mostly small codes, like residuals, with runs of each length.
+void MakeWords(size_t num_words, unsigned int seed,
+               std::vector<uint16>* words) {
+  srand(seed);
+  words->resize(num_words);
+  for (size_t i = 0; i < num_words; ++i) {
+    const int kind = (i / 13 + rand() % 2) % 4;
+    const uint16 word = (kind == 0) ? rand() % 0x80 :
+        (kind == 1) ? rand() % kUtf8TwoByteLimit :
+        (kind == 2) ? rand() % kUtf8EncodableEnd :
+        kUtf8SurrogatePairStart - 4 + rand() % 8;
+    (*words)[i] = word;
+  }
+}
+
+// The same bytes as good_codepoints, for every encodable word.
+void TestGoodCodepoints() {
+  std::vector<uint16> words;
+  for (size_t word = 0; word < 65536; ++word) {
+    words.push_back(word);
+  }
+  size_t length;
+  CHECK(!Utf8Length(&words[0], words.size(), &length));
+  std::string utf8;
+  StringSink sink(&utf8);
+  CHECK(!Uint16ArrayToUtf8(&words[0], words.size(), &sink));
+  CHECK(utf8.empty());
+  words.resize(kUtf8EncodableEnd);
+  const std::string expected = ScalarUtf8(words);
+  CHECK(Utf8Length(&words[0], words.size(), &length));
+  CHECK(expected.size() == length);
+  CHECK(expected == BulkUtf8(words));
+}
+
+// Every length and alignment, so each tail is covered.
+void TestMixed() {
+  for (size_t num_words = 0; num_words < 200; ++num_words) {
+    std::vector<uint16> words;
+    MakeWords(num_words, num_words, &words);
+    CHECK(ScalarUtf8(words) == BulkUtf8(words));
+  }
+  std::vector<uint16> words;
+  MakeWords(100000, 1, &words);
+  CHECK(ScalarUtf8(words) == BulkUtf8(words));
+  words.assign(40000, 'a');
+  CHECK(ScalarUtf8(words) == BulkUtf8(words));
+  // One bad word anywhere fails the lot.
+  words[39999] = 0xFFFF;
+  size_t length;
+  CHECK(!Utf8Length(&words[0], words.size(), &length));
+}
+
+// What all_codepoints writes for |codepoint|, surrogates included.
+std::string CodepointUtf8(uint32 codepoint) {
+  std::string utf8;
+  if (codepoint < 0x80) {
+    utf8 += static_cast<char>(codepoint);
+  } else if (codepoint < 0x800) {
+    utf8 += static_cast<char>(kUtf8TwoBytePrefix + (codepoint >> 6));
+    utf8 += static_cast<char>(kUtf8MoreBytesPrefix +
+                              (codepoint & kUtf8MoreBytesMask));
+  } else {
+    utf8 += static_cast<char>(kUtf8ThreeBytePrefix + (codepoint >> 12));
+    utf8 += static_cast<char>(kUtf8MoreBytesPrefix +
+                              ((codepoint >> 6) & kUtf8MoreBytesMask));
+    utf8 += static_cast<char>(kUtf8MoreBytesPrefix +
+                              (codepoint & kUtf8MoreBytesMask));
+  }
+  return utf8;
+}
+
+// Each codepoint of all_codepoints decodes to its word, undoing the
+// surrogate shift, except for the surrogates themselves. All of them
+// at once, less the surrogates, decode to every encodable word.
+void TestAllCodepoints() {
+  std::string all;
+  for (uint32 codepoint = 0; codepoint < 0x10000; ++codepoint) {
+    const std::string utf8 = CodepointUtf8(codepoint);
+    std::vector<uint16> words;
+    const bool surrogate = codepoint >= kUtf8SurrogatePairStart &&
+        codepoint < kUtf8SurrogatePairStart + kUtf8SurrogatePairNum;
+    CHECK(surrogate != Utf8ToUint16(utf8.data(), utf8.size(), &words));
+    if (surrogate) continue;
+    CHECK(1 == words.size());
+    CHECK(words[0] == (codepoint < kUtf8SurrogatePairStart ? codepoint :
+                       codepoint - kUtf8SurrogatePairNum));
+    all += utf8;
+  }
+  std::vector<uint16> words;
+  CHECK(Utf8ToUint16(all.data(), all.size(), &words));
+  CHECK(kUtf8EncodableEnd == words.size());
+  for (size_t i = 0; i < words.size(); ++i) {
+    CHECK(i == words[i]);
+  }
+}
+
+// Every sequence of 1 to 3 bytes is accepted exactly when it is one
+// character that |Uint16ToUtf8| would write, or a valid sequence of
+// shorter ones.
+void TestAllSequences() {
+  std::vector<uint16> words;
+  for (uint32 bytes = 0; bytes < (1u << 24); ++bytes) {
+    const char utf8[3] = {
+      static_cast<char>(bytes >> 16), static_cast<char>(bytes >> 8),
+      static_cast<char>(bytes)
+    };
+    for (size_t length = 1; length <= 3; ++length) {
+      // Each shorter sequence is covered by the bytes below it.
+      if (length < 3 && (bytes & ((1u << (8 * (3 - length))) - 1)) != 0) {
+        continue;
+      }
+      words.clear();
+      const bool ok = Utf8ToUint16(utf8, length, &words);
+      std::string encoded;
+      StringSink sink(&encoded);
+      for (size_t i = 0; ok && i < words.size(); ++i) {
+        CHECK(Uint16ToUtf8(words[i], &sink));
+      }
+      if (ok) {
+        CHECK(encoded == std::string(utf8, length));
+      } else {
+        // Only invalid if no way of encoding words gives these bytes.
+        const uint8 lead = static_cast<uint8>(utf8[0]);
+        const bool could_be_one_char =
+            (lead >= 0xC2 && lead < 0xE0 && length == 2) ||
+            (lead >= 0xE0 && lead < 0xF0 && length == 3);
+        if (could_be_one_char) {
+          const uint16 word = (length == 2) ?
+              ((lead & 0x1F) << 6) | (utf8[1] & 0x3F) :
+              ((lead & 0x0F) << 12) | ((utf8[1] & 0x3F) << 6) |
+              (utf8[2] & 0x3F);
+          const bool shifted = word >= kUtf8SurrogatePairStart +
+              kUtf8SurrogatePairNum;
+          std::string expected;
+          StringSink expected_sink(&expected);
+          if (Uint16ToUtf8(shifted ? word - kUtf8SurrogatePairNum : word,
+                           &expected_sink)) {
+            CHECK(expected != std::string(utf8, length));
+          }
+        }
+      }
+    }
+  }
+}
+
+// Whole buffers, ASCII runs long enough for the vector path with bad
+// bytes at every offset, and the same input a few bytes at a time
+// through a |BufferedInputStream|.
+void TestDecodeBuffers() {
+  std::vector<uint16> words;
+  MakeWords(100000, 2, &words);
+  for (size_t i = 0; i < words.size(); i += 7) {
+    for (size_t j = i; j < i + 40 && j < words.size(); ++j) words[j] = 'x';
+  }
+  const std::string utf8 = BulkUtf8(words);
+  std::vector<uint16> decoded(3, 7);
+  CHECK(Utf8ToUint16(utf8.data(), utf8.size(), &decoded));
+  CHECK(decoded.size() == 3 + words.size());
+  CHECK(std::equal(words.begin(), words.end(), decoded.begin() + 3));
+  for (size_t bad = 0; bad < 40; ++bad) {
+    std::string ascii(40, 'a');
+    ascii[bad] = '\x80';
+    decoded.clear();
+    CHECK(!Utf8ToUint16(ascii.data(), ascii.size(), &decoded));
+    CHECK(bad == decoded.size());
+  }
+  FILE* fp = tmpfile();
+  CHECK(fp != NULL);
+  fwrite(utf8.data(), 1, utf8.size(), fp);
+  rewind(fp);
+  char buf[5];
+  BufferedInputStream input(fp, buf, sizeof(buf));
+  decoded.clear();
+  CHECK(Utf8ToUint16(&input, &decoded));
+  CHECK(decoded == words);
+  fclose(fp);
+  // A character cut off at the end.
+  BufferedInput truncated(utf8.data(), utf8.size() - 1);
+  decoded.clear();
+  CHECK(Utf8ToUint16(&truncated, &decoded) ==
+        (static_cast<uint8>(utf8[utf8.size() - 1]) < 0x80));
+}
+
+void BenchUint16ArrayToUtf8(size_t num_words) {
+  std::vector<uint16> words;
+  MakeWords(num_words, 1, &words);
+  // Timed the second time round, once the output pages are mapped.
+  std::string scalar, bulk;
+  StringSink scalar_sink(&scalar);
+  StringSink bulk_sink(&bulk);
+  double scalar_seconds = 0.0, bulk_seconds = 0.0;
+  for (int run = 0; run < 2; ++run) {
+    scalar.clear();
+    bulk.clear();
+    Timer timer;
+    for (size_t i = 0; i < words.size(); ++i) {
+      Uint16ToUtf8(words[i], &scalar_sink);
+    }
+    scalar_seconds = timer.ElapsedSeconds();
+    timer.Reset();
+    CHECK(Uint16ArrayToUtf8(&words[0], words.size(), &bulk_sink));
+    bulk_seconds = timer.ElapsedSeconds();
+  }
+  CHECK(scalar == bulk);
+  const double megabytes = sizeof(uint16) * num_words / 1e6;
+  printf("Uint16ArrayToUtf8, " PRIuS " words: scalar %.0f MB/s, "
+         "%s %.0f MB/s\n", num_words, megabytes / scalar_seconds,
+         SimdName(), megabytes / bulk_seconds);
+}
+
+// In GB/s of UTF-8: for mixed words, for mostly small codes like
+// those from obj2utf8x, and for ASCII.
+void BenchUtf8ToUint16(size_t num_words) {
+  static const char* const kKinds[3] = { "mixed", "small", "ascii" };
+  static const uint16 kLimits[3] = { 0xFFFF, 0x90, 0x80 };
+  std::vector<uint16> words;
+  MakeWords(num_words, 1, &words);
+  for (int kind = 0; kind < 3; ++kind) {
+    for (size_t i = 0; i < words.size(); ++i) words[i] %= kLimits[kind];
+    const std::string utf8 = BulkUtf8(words);
+    std::vector<uint16> decoded(utf8.size() + 16);
+    size_t num_decoded = 0;
+    double seconds = 0.0;
+    for (int run = 0; run < 2; ++run) {
+      Timer timer;
+      CHECK(Utf8ToUint16Buffer(utf8.data(), utf8.size(), &decoded[0],
+                               &num_decoded));
+      seconds = timer.ElapsedSeconds();
+    }
+    decoded.resize(num_decoded);
+    CHECK(decoded == words);
+    printf("Utf8ToUint16Buffer, %s words: %s %.2f GB/s\n", kKinds[kind],
+           SimdName(), utf8.size() / seconds / 1e9);
+  }
+}
+
+}  // namespace webgl_loader
+
+int main(int argc, char* argv[]) {
+  webgl_loader::TestGoodCodepoints();
+  webgl_loader::TestMixed();
+  webgl_loader::TestAllCodepoints();
+  webgl_loader::TestAllSequences();
+  webgl_loader::TestDecodeBuffers();
+  if (argc > 1) {
+    webgl_loader::BenchUint16ArrayToUtf8(atol(argv[1]));
+    webgl_loader::BenchUtf8ToUint16(atol(argv[1]));
+  }
+  return 0;
+}
@@ -75,8 +75,38 @@ class ParseIndicesTester {
   WavefrontObjFile obj_;
 };
 
+// Given somewhere to say why, a malformed file stops the parse,
+// rather than exiting or indexing past the attributes.
+void TestParseErrors() {
+  const char kTriangle[] = "v 0 0 0\nv 1 0 0\nv 0 1 0\nvn 0 0 1\n";
+  const char* const kBad[][2] = {
+    { "f 1 2 4\n", "index out of range at line 5" },
+    { "f 1//1 2//1 3//2\n", "index out of range at line 5" },
+    { "f 1/1 2/1 3/1\n", "index out of range at line 5" },
+    { "f 0 1 2\n", "bad first index at line 5" },
+    { "f 1\n", "bad second index at line 5" },
+    { "usemtl missing\nf 1 2 3\n", "material not found at line 5" },
+    { "v 0 0\n", "bad position at line 5" },
+  };
+  for (size_t i = 0; i < sizeof(kBad) / sizeof(kBad[0]); ++i) {
+    const std::string text = kTriangle + std::string(kBad[i][0]);
+    webgl_loader::BufferedInput input(text.data(), text.size());
+    std::string error = "stale";
+    WavefrontObjFile obj(&input, "test.obj", &error);
+    CHECK(error == kBad[i][1]);
+  }
+  const std::string text = kTriangle + std::string("f 1//1 2//1 3//1\n");
+  webgl_loader::BufferedInput input(text.data(), text.size());
+  std::string error = "stale";
+  WavefrontObjFile obj(&input, "test.obj", &error);
+  CHECK(error.empty());
+  const DrawBatch& batch = obj.material_batches().find("")->second;
+  CHECK(3 == batch.draw_mesh().indices.size());
+}
+
 int main(int argc, char* argv[]) {
   ParseIndicesTester tester;
   tester.Test();
+  TestParseErrors();
   return 0;
 }
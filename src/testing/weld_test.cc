@@ -0,0 +1,81 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include "../weld.h"
+
+namespace webgl_loader {
+
+class WeldTest {
+ public:
+  void AddVertex(uint16 x, uint16 y, uint16 z, uint16 u, uint16 n,
+                 QuantizedAttribList* attribs) {
+    const uint16 vertex[8] = { x, y, z, u, 0, 511, 511, n };
+    attribs->insert(attribs->end(), vertex, vertex + 8);
+  }
+
+  void TestExact() {
+    QuantizedAttribList attribs;
+    AddVertex(10, 10, 10, 0, 1023, &attribs);
+    AddVertex(20, 10, 10, 0, 1023, &attribs);
+    AddVertex(10, 10, 10, 0, 1023, &attribs);  // Same as 0.
+    AddVertex(10, 10, 10, 5, 1023, &attribs);  // Another texcoord.
+    AddVertex(11, 10, 10, 0, 1023, &attribs);  // Another position.
+    AddVertex(20, 10, 10, 0, 1023, &attribs);  // Same as 1.
+    const WeldTolerances exact = { 0, 0, 0 };
+    std::vector<int> remap;
+    CHECK(2 == FindWeldedVertices(attribs, exact, &remap));
+    const int expected[6] = { 0, 1, 0, 3, 4, 1 };
+    for (size_t i = 0; i < 6; ++i) {
+      CHECK(expected[i] == remap[i]);
+    }
+    // The first triangle collapses, and is dropped.
+    const int indices[6] = { 0, 2, 1, 3, 4, 5 };
+    IndexList welded;
+    CHECK(1 == RemapTriangles(remap, indices, 6, &welded));
+    CHECK(3 == welded.size());
+    CHECK(3 == welded[0]);
+    CHECK(4 == welded[1]);
+    CHECK(1 == welded[2]);
+  }
+
+  // Vertices within tolerance weld to the first one kept, even across
+  // a cell boundary, but no further.
+  void TestTolerance() {
+    QuantizedAttribList attribs;
+    AddVertex(99, 50, 50, 0, 1020, &attribs);
+    AddVertex(101, 51, 49, 1, 1023, &attribs);
+    AddVertex(103, 50, 50, 0, 1020, &attribs);
+    AddVertex(100, 50, 50, 0, 1010, &attribs);
+    const WeldTolerances tolerances = { 2, 1, 4 };
+    std::vector<int> remap;
+    CHECK(1 == FindWeldedVertices(attribs, tolerances, &remap));
+    CHECK(0 == remap[0]);
+    CHECK(0 == remap[1]);
+    CHECK(2 == remap[2]);
+    CHECK(3 == remap[3]);
+  }
+};
+
+}  // namespace webgl_loader
+
+int main(int argc, char* argv[]) {
+  webgl_loader::WeldTest tester;
+  tester.TestExact();
+  tester.TestTolerance();
+  return 0;
+}
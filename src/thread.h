@@ -0,0 +1,237 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_THREAD_H_
+#define WEBGL_LOADER_THREAD_H_
+
+// Tools that include this must be built with -pthread.
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "base.h"
+
+namespace webgl_loader {
+
+// The number of threads worth running at once.
+int NumProcessors() {
+  const long num_processors = sysconf(_SC_NPROCESSORS_ONLN);
+  return num_processors > 0 ? static_cast<int>(num_processors) : 1;
+}
+
+class MutexLock {
+ public:
+  explicit MutexLock(pthread_mutex_t* mutex)
+      : mutex_(mutex) {
+    CHECK(0 == pthread_mutex_lock(mutex_));
+  }
+
+  ~MutexLock() {
+    pthread_mutex_unlock(mutex_);
+  }
+
+ private:
+  pthread_mutex_t* mutex_;
+};
+
+typedef void (*ParallelFunction)(void* arg, size_t i);
+
+// Shared by the threads of |ParallelFor|.
+class ParallelForState {
+ public:
+  ParallelForState(size_t n, ParallelFunction fn, void* arg)
+      : n_(n),
+        fn_(fn),
+        arg_(arg),
+        next_(0) {
+    CHECK(0 == pthread_mutex_init(&mutex_, NULL));
+  }
+
+  ~ParallelForState() {
+    pthread_mutex_destroy(&mutex_);
+  }
+
+  static void* Run(void* self) {
+    ParallelForState* state = static_cast<ParallelForState*>(self);
+    size_t i;
+    while (state->Next(&i)) {
+      state->fn_(state->arg_, i);
+    }
+    return NULL;
+  }
+
+ private:
+  bool Next(size_t* i) {
+    MutexLock lock(&mutex_);
+    if (next_ == n_) return false;
+    *i = next_++;
+    return true;
+  }
+
+  const size_t n_;
+  const ParallelFunction fn_;
+  void* const arg_;
+  pthread_mutex_t mutex_;
+  size_t next_;  // Guarded by |mutex_|.
+};
+
+// Calls |fn|(|arg|, i) for each i in [0, |n|), on up to |num_threads|
+// threads, and returns once they all have. Calls may run in any
+// order, so |fn| must only touch state that belongs to its i. Each
+// thread takes the next i as it finishes the last one, so uneven
+// calls balance out.
+void ParallelFor(size_t n, ParallelFunction fn, void* arg, int num_threads) {
+  ParallelForState state(n, fn, arg);
+  if (num_threads > static_cast<int>(n)) {
+    num_threads = static_cast<int>(n);
+  }
+  // The calling thread is one of the workers.
+  std::vector<pthread_t> threads(num_threads > 1 ? num_threads - 1 : 0);
+  for (size_t i = 0; i < threads.size(); ++i) {
+    CHECK(0 == pthread_create(&threads[i], NULL, &ParallelForState::Run,
+                              &state));
+  }
+  ParallelForState::Run(&state);
+  for (size_t i = 0; i < threads.size(); ++i) {
+    CHECK(0 == pthread_join(threads[i], NULL));
+  }
+}
+
+// Also passed the index of the thread it runs on, in [0, num_threads),
+// for state that each thread keeps for itself.
+typedef void (*WorkerFunction)(void* arg, size_t i, int thread);
+
+// Shared by the threads of |WorkStealingFor|. Each thread has a queue
+// of the i's first + stride * k, for k in [0, count), under its own
+// lock, so the threads only meet when one runs out.
+class WorkStealingState {
+ public:
+  WorkStealingState(size_t n, WorkerFunction fn, void* arg, int num_threads)
+      : fn_(fn),
+        arg_(arg),
+        workers_(num_threads) {
+    const size_t stride = workers_.size();
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      Worker& worker = workers_[i];
+      worker.state = this;
+      worker.index = static_cast<int>(i);
+      CHECK(0 == pthread_mutex_init(&worker.mutex, NULL));
+      worker.first = i;
+      worker.count = (n + stride - 1 - i) / stride;
+    }
+  }
+
+  ~WorkStealingState() {
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      pthread_mutex_destroy(&workers_[i].mutex);
+    }
+  }
+
+  // Runs thread |index|, and returns once no thread has work left.
+  void Work(int index) {
+    Run(&workers_[index]);
+  }
+
+  void Start(int index, pthread_t* thread) {
+    CHECK(0 == pthread_create(thread, NULL, &WorkStealingState::Run,
+                              &workers_[index]));
+  }
+
+ private:
+  struct Worker {
+    WorkStealingState* state;
+    int index;
+    pthread_mutex_t mutex;
+    size_t first;  // Guarded by |mutex|, with |count|.
+    size_t count;
+  };
+
+  static void* Run(void* self) {
+    Worker* worker = static_cast<Worker*>(self);
+    WorkStealingState* state = worker->state;
+    size_t i;
+    while (state->Next(worker, &i) || state->Steal(worker, &i)) {
+      state->fn_(state->arg_, i, worker->index);
+    }
+    return NULL;
+  }
+
+  // Takes the front of |worker|'s own queue.
+  bool Next(Worker* worker, size_t* i) {
+    MutexLock lock(&worker->mutex);
+    if (worker->count == 0) return false;
+    *i = worker->first;
+    worker->first += workers_.size();
+    --worker->count;
+    return true;
+  }
+
+  // Takes the back half of the next queue after |worker|'s that has
+  // any left, and returns the first of them in |i|. Only one lock is
+  // held at a time; what is taken is the thief's from then on, so once
+  // every queue is empty, every i has been run or is about to be.
+  bool Steal(Worker* thief, size_t* i) {
+    const size_t num_workers = workers_.size();
+    for (size_t k = 1; k < num_workers; ++k) {
+      Worker& victim = workers_[(thief->index + k) % num_workers];
+      size_t first, count;
+      {
+        MutexLock lock(&victim.mutex);
+        if (victim.count == 0) continue;
+        count = (victim.count + 1) / 2;
+        victim.count -= count;
+        first = victim.first + num_workers * victim.count;
+      }
+      *i = first;
+      MutexLock lock(&thief->mutex);
+      thief->first = first + num_workers;
+      thief->count = count - 1;
+      return true;
+    }
+    return false;
+  }
+
+  const WorkerFunction fn_;
+  void* const arg_;
+  std::vector<Worker> workers_;
+};
+
+// Like |ParallelFor|, but |fn|(|arg|, i, thread) is also passed which
+// of the |num_threads| threads it is on. Thread t starts with every
+// |num_threads|'th i from t, and takes them in order; one that runs
+// out takes the back half of another's. So i's start about in order,
+// and threads rarely wait on each other, even for many small calls.
+void WorkStealingFor(size_t n, WorkerFunction fn, void* arg,
+                     int num_threads) {
+  if (num_threads > static_cast<int>(n)) {
+    num_threads = static_cast<int>(n);
+  }
+  if (num_threads < 1) num_threads = 1;
+  WorkStealingState state(n, fn, arg, num_threads);
+  // The calling thread is thread 0.
+  std::vector<pthread_t> threads(num_threads - 1);
+  for (size_t i = 0; i < threads.size(); ++i) {
+    state.Start(static_cast<int>(i + 1), &threads[i]);
+  }
+  state.Work(0);
+  for (size_t i = 0; i < threads.size(); ++i) {
+    CHECK(0 == pthread_join(threads[i], NULL));
+  }
+}
+
+}  // namespace webgl_loader
+
+#endif  // WEBGL_LOADER_THREAD_H_
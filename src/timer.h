@@ -0,0 +1,50 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_TIMER_H_
+#define WEBGL_LOADER_TIMER_H_
+
+#include <time.h>
+
+namespace webgl_loader {
+
+// A wall-clock stopwatch for benchmarks.
+// TODO: Windows.
+class Timer {
+ public:
+  Timer() {
+    Reset();
+  }
+
+  void Reset() {
+    start_ = Now();
+  }
+
+  double ElapsedSeconds() const {
+    return Now() - start_;
+  }
+
+  static double Now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+  }
+
+ private:
+  double start_;
+};
+
+}  // namespace webgl_loader
+
+#endif  // WEBGL_LOADER_TIMER_H_
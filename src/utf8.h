@@ -15,7 +15,13 @@
 #ifndef WEBGL_LOADER_UTF8_H_
 #define WEBGL_LOADER_UTF8_H_
 
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
 #include "base.h"
+#include "simd.h"
 #include "stream.h"
 
 namespace webgl_loader {
@@ -56,6 +62,409 @@ bool Uint16ToUtf8(uint16 word, ByteSinkInterface* sink) {
   return true;
 }
 
+// |Uint16ArrayToUtf8| writes the same bytes as |Uint16ToUtf8| does
+// for each of an array of words, but a register at a time, into a
+// buffer that |Utf8Length| sizes exactly.
+
+// Sets |length| to the number of bytes |Uint16ToUtf8| would write for
+// |words|. Returns |false| if any of them can't be encoded.
+bool Utf8Length(const uint16* words, size_t num_words, size_t* length) {
+  // Counts the bytes short of 3 per word.
+  size_t saved = 0;
+  size_t i = 0;
+#if defined(WEBGL_LOADER_SSE2)
+  const __m128i ascii_max = _mm_set1_epi16(0x7F);
+  const __m128i two_byte_max = _mm_set1_epi16(kUtf8TwoByteLimit - 1);
+  const __m128i encodable_max = _mm_set1_epi16(kUtf8EncodableEnd - 1);
+  const __m128i zero = _mm_setzero_si128();
+  bool encodable = true;
+  while (i + 8 <= num_words && encodable) {
+    // Per lane, flushed before it can overflow.
+    __m128i lane_saved = zero;
+    const size_t block_end = std::min(num_words & ~size_t(7),
+                                      i + 8 * 8192);
+    for (; i < block_end; i += 8) {
+      const __m128i w = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(words + i));
+      // Unsigned w <= max iff saturating w - max is 0.
+      const __m128i one_byte = _mm_cmpeq_epi16(_mm_subs_epu16(w, ascii_max),
+                                               zero);
+      const __m128i two_bytes = _mm_cmpeq_epi16(
+          _mm_subs_epu16(w, two_byte_max), zero);
+      const __m128i ok = _mm_cmpeq_epi16(_mm_subs_epu16(w, encodable_max),
+                                         zero);
+      if (_mm_movemask_epi8(ok) != 0xFFFF) {
+        encodable = false;
+        break;
+      }
+      // The masks are -1 where true.
+      lane_saved = _mm_sub_epi16(_mm_sub_epi16(lane_saved, one_byte),
+                                 two_bytes);
+    }
+    const __m128i sums = _mm_madd_epi16(lane_saved, _mm_set1_epi16(1));
+    int lanes[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sums);
+    saved += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  }
+  if (!encodable) return false;
+#endif
+  for (; i < num_words; ++i) {
+    const uint16 word = words[i];
+    if (word >= kUtf8EncodableEnd) return false;
+    saved += (word < 0x80) ? 2 : (word < kUtf8TwoByteLimit) ? 1 : 0;
+  }
+  *length = 3 * num_words - saved;
+  return true;
+}
+
+// |Uint16ToUtf8| for a single word, to memory.
+inline char* PutUtf8(uint16 word, char* out) {
+  if (word < 0x80) {
+    *out++ = static_cast<char>(word);
+  } else if (word < kUtf8TwoByteLimit) {
+    *out++ = static_cast<char>(kUtf8TwoBytePrefix + (word >> 6));
+    *out++ = static_cast<char>(kUtf8MoreBytesPrefix +
+                               (word & kUtf8MoreBytesMask));
+  } else {
+    if (word >= kUtf8SurrogatePairStart) {
+      word += kUtf8SurrogatePairNum;
+    }
+    *out++ = static_cast<char>(kUtf8ThreeBytePrefix + (word >> 12));
+    *out++ = static_cast<char>(kUtf8MoreBytesPrefix +
+                               ((word >> 6) & kUtf8MoreBytesMask));
+    *out++ = static_cast<char>(kUtf8MoreBytesPrefix +
+                               (word & kUtf8MoreBytesMask));
+  }
+  return out;
+}
+
+#if defined(WEBGL_LOADER_SSSE3)
+// For each pattern of which of 4 words need at least 2 bytes (low 4
+// bits) and which need 3 (high 4 bits), the shuffle that packs their
+// bytes from [lead, middle, last, 0] in each 32-bit lane, and the
+// number of bytes that makes.
+struct Utf8PackTable {
+  uint8 shuffles[256][16];
+  uint8 lengths[256];
+
+  Utf8PackTable() {
+    for (size_t pattern = 0; pattern < 256; ++pattern) {
+      size_t length = 0;
+      for (size_t lane = 0; lane < 4; ++lane) {
+        uint8* shuffle = shuffles[pattern];
+        shuffle[length++] = 4 * lane;
+        if (pattern & (0x10 << lane)) shuffle[length++] = 4 * lane + 1;
+        if (pattern & (0x01 << lane)) shuffle[length++] = 4 * lane + 2;
+      }
+      lengths[pattern] = length;
+      for (size_t j = length; j < 16; ++j) {
+        shuffles[pattern][j] = 0x80;
+      }
+    }
+  }
+};
+
+// Packs the 4 words in the 32-bit lanes of |w|, already shifted past
+// the surrogate pairs, to |out|. Writes 16 bytes, of which the
+// returned number are used.
+inline size_t PackUtf8x4(__m128i w, const Utf8PackTable& table, char* out) {
+  const __m128i two_or_more = _mm_cmpgt_epi32(w, _mm_set1_epi32(0x7F));
+  const __m128i three = _mm_cmpgt_epi32(
+      w, _mm_set1_epi32(kUtf8TwoByteLimit - 1));
+  const __m128i more_mask = _mm_set1_epi32(kUtf8MoreBytesMask);
+  const __m128i more_prefix = _mm_set1_epi32(kUtf8MoreBytesPrefix);
+  const __m128i lead1 = w;
+  const __m128i lead2 = _mm_or_si128(_mm_srli_epi32(w, 6),
+                                     _mm_set1_epi32(kUtf8TwoBytePrefix));
+  const __m128i lead3 = _mm_or_si128(_mm_srli_epi32(w, 12),
+                                     _mm_set1_epi32(kUtf8ThreeBytePrefix));
+  const __m128i lead = _mm_or_si128(
+      _mm_andnot_si128(two_or_more, lead1),
+      _mm_or_si128(_mm_and_si128(_mm_andnot_si128(three, two_or_more), lead2),
+                   _mm_and_si128(three, lead3)));
+  const __m128i middle = _mm_or_si128(
+      _mm_and_si128(_mm_srli_epi32(w, 6), more_mask), more_prefix);
+  const __m128i last = _mm_or_si128(_mm_and_si128(w, more_mask), more_prefix);
+  const __m128i bytes = _mm_or_si128(
+      lead, _mm_or_si128(_mm_slli_epi32(middle, 8), _mm_slli_epi32(last, 16)));
+  const int pattern =
+      _mm_movemask_ps(_mm_castsi128_ps(two_or_more)) |
+      (_mm_movemask_ps(_mm_castsi128_ps(three)) << 4);
+  const __m128i shuffle = _mm_loadu_si128(
+      reinterpret_cast<const __m128i*>(table.shuffles[pattern]));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(out),
+                   _mm_shuffle_epi8(bytes, shuffle));
+  return table.lengths[pattern];
+}
+#endif
+
+// Writes the UTF-8 for |words|, which must all be encodable, to
+// [|out|, |out_end|), which must be exactly |Utf8Length| long. Runs
+// of 8 ASCII words are packed at once, and with SSSE3 so are other
+// runs, 4 words per shuffle. Returns |out_end|.
+char* Uint16ArrayToUtf8Buffer(const uint16* words, size_t num_words,
+                              char* out, char* out_end) {
+  size_t i = 0;
+#if defined(WEBGL_LOADER_SSE2)
+# if defined(WEBGL_LOADER_SSSE3)
+  static const Utf8PackTable kPackTable;
+# endif
+  const __m128i ascii_max = _mm_set1_epi16(0x7F);
+  const __m128i zero = _mm_setzero_si128();
+  // A block writes up to 24 bytes, and stores whole registers.
+  while (i + 8 <= num_words && out_end - out >= 32) {
+    __m128i w = _mm_loadu_si128(reinterpret_cast<const __m128i*>(words + i));
+    const __m128i one_byte = _mm_cmpeq_epi16(_mm_subs_epu16(w, ascii_max),
+                                             zero);
+    if (_mm_movemask_epi8(one_byte) == 0xFFFF) {
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(out),
+                       _mm_packus_epi16(w, w));
+      out += 8;
+      i += 8;
+      continue;
+    }
+# if defined(WEBGL_LOADER_SSSE3)
+    const __m128i below_surrogates = _mm_cmpeq_epi16(
+        _mm_subs_epu16(w, _mm_set1_epi16(kUtf8SurrogatePairStart - 1)), zero);
+    w = _mm_add_epi16(w, _mm_andnot_si128(
+        below_surrogates, _mm_set1_epi16(kUtf8SurrogatePairNum)));
+    out += PackUtf8x4(_mm_unpacklo_epi16(w, zero), kPackTable, out);
+    out += PackUtf8x4(_mm_unpackhi_epi16(w, zero), kPackTable, out);
+# else
+    for (size_t k = 0; k < 8; ++k) {
+      out = PutUtf8(words[i + k], out);
+    }
+# endif
+    i += 8;
+  }
+#elif defined(WEBGL_LOADER_NEON) && defined(__aarch64__)
+  while (i + 8 <= num_words) {
+    const uint16x8_t w = vld1q_u16(words + i);
+    if (vmaxvq_u16(w) >= 0x80) break;
+    vst1_u8(reinterpret_cast<uint8*>(out), vmovn_u16(w));
+    out += 8;
+    i += 8;
+  }
+#endif
+  for (; i < num_words; ++i) {
+    out = PutUtf8(words[i], out);
+  }
+  DCHECK(out == out_end);
+  return out;
+}
+
+// |Uint16ToUtf8|, without a virtual call per byte.
+inline bool Uint16ToUtf8(uint16 word, BufferedSink* sink) {
+  if (word >= kUtf8EncodableEnd) return false;
+  sink->Commit(PutUtf8(word, sink->Reserve(3)));
+  return true;
+}
+
+// |Uint16ToUtf8| for all of |words|, in one call, written straight
+// into |sink|'s buffer. Returns |false|, writing nothing, if any of
+// |words| can't be encoded.
+bool Uint16ArrayToUtf8(const uint16* words, size_t num_words,
+                       BufferedSink* sink) {
+  size_t length;
+  if (!Utf8Length(words, num_words, &length)) return false;
+  // Pieces small enough not to make |sink| grow much.
+  const size_t kPieceWords = 16384;
+  for (size_t i = 0; i < num_words; i += kPieceWords) {
+    const size_t piece = std::min(kPieceWords, num_words - i);
+    size_t piece_length = length;
+    if (piece != num_words) Utf8Length(words + i, piece, &piece_length);
+    char* const out = sink->Reserve(piece_length);
+    sink->Commit(Uint16ArrayToUtf8Buffer(words + i, piece, out,
+                                         out + piece_length));
+  }
+  return true;
+}
+
+bool Uint16ArrayToUtf8(const uint16* words, size_t num_words,
+                       ByteSinkInterface* sink) {
+  BufferedByteSink buffered(sink);
+  return Uint16ArrayToUtf8(words, num_words, &buffered);
+}
+
+// The inverse of |Uint16ToUtf8|, for a whole buffer. Writes to
+// |out|, which needs room for |length| + 16 words since there is at
+// most one per byte and the vector paths store whole registers.
+// Sets |num_words| to the number written, and returns |false| on
+// malformed input: stray or missing continuation bytes, overlong
+// forms, surrogates, or anything past U+FFFF. Those are never written
+// by |Uint16ToUtf8|, so this accepts exactly its output. Runs of
+// ASCII are widened 16 bytes at a time.
+bool Utf8ToUint16Buffer(const char* utf8, size_t length, uint16* out,
+                        size_t* num_words) {
+  uint16* const out_begin = out;
+  const uint8* in = reinterpret_cast<const uint8*>(utf8);
+  const uint8* const end = in + length;
+  bool ok = true;
+  while (in != end) {
+#if defined(WEBGL_LOADER_SSE2)
+    // Only from an ASCII byte, so that mixed input doesn't pay for a
+    // register per character.
+    if (*in < 0x80 && end - in >= 16) {
+      const __m128i bytes = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(in));
+      const __m128i zero = _mm_setzero_si128();
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out),
+                       _mm_unpacklo_epi8(bytes, zero));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 8),
+                       _mm_unpackhi_epi8(bytes, zero));
+      const uint32 non_ascii = _mm_movemask_epi8(bytes);
+      const size_t ascii = non_ascii ? CountTrailingZeros(non_ascii) : 16;
+      in += ascii;
+      out += ascii;
+      if (ascii == 16) continue;
+    }
+#elif defined(WEBGL_LOADER_NEON) && defined(__aarch64__)
+    if (*in < 0x80 && end - in >= 16) {
+      const uint8x16_t bytes = vld1q_u8(in);
+      if (vmaxvq_u8(bytes) < 0x80) {
+        vst1q_u16(out, vmovl_u8(vget_low_u8(bytes)));
+        vst1q_u16(out + 8, vmovl_u8(vget_high_u8(bytes)));
+        in += 16;
+        out += 16;
+        continue;
+      }
+    }
+#endif
+    const uint8 lead = *in++;
+    uint16 word;
+    if (lead < 0x80) {
+      word = lead;
+    } else if (lead < kUtf8TwoBytePrefix + 2) {
+      // A continuation byte, or the start of an overlong 2 byte form.
+      ok = false;
+      break;
+    } else if (lead < kUtf8ThreeBytePrefix) {
+      if (in == end || (in[0] & 0xC0) != kUtf8MoreBytesPrefix) {
+        ok = false;
+        break;
+      }
+      word = ((lead & 0x1F) << 6) | (*in++ & kUtf8MoreBytesMask);
+    } else if (lead < 0xF0) {
+      if (end - in < 2 || (in[0] & 0xC0) != kUtf8MoreBytesPrefix ||
+          (in[1] & 0xC0) != kUtf8MoreBytesPrefix) {
+        ok = false;
+        break;
+      }
+      word = ((lead & 0x0F) << 12) | ((in[0] & kUtf8MoreBytesMask) << 6) |
+          (in[1] & kUtf8MoreBytesMask);
+      in += 2;
+      if (word < kUtf8TwoByteLimit ||
+          (word >= kUtf8SurrogatePairStart &&
+           word < kUtf8SurrogatePairStart + kUtf8SurrogatePairNum)) {
+        ok = false;
+        break;
+      }
+      if (word >= kUtf8SurrogatePairStart + kUtf8SurrogatePairNum) {
+        // Undo the shift past the surrogate pair range.
+        word -= kUtf8SurrogatePairNum;
+      }
+    } else {
+      ok = false;
+      break;
+    }
+    *out++ = word;
+  }
+  *num_words = out - out_begin;
+  return ok;
+}
+
+// |Utf8ToUint16Buffer|, appending to |words|. On malformed input, the
+// words before it are still appended.
+bool Utf8ToUint16(const char* utf8, size_t length,
+                  std::vector<uint16>* words) {
+  const size_t start = words->size();
+  words->resize(start + length + 16);
+  size_t num_words;
+  const bool ok = Utf8ToUint16Buffer(utf8, length, &(*words)[start],
+                                     &num_words);
+  words->resize(start + num_words);
+  return ok;
+}
+
+// Like |Utf8ToUint16|, but for input that arrives in pieces, such as
+// network reads. A character may be split between calls to |Decode|.
+class Utf8Decoder {
+ public:
+  Utf8Decoder()
+      : num_partial_(0),
+        error_(false) {
+  }
+
+  // Appends the characters completed by |utf8| to |words|. Returns
+  // |false| on malformed input, and keeps failing after that.
+  bool Decode(const char* utf8, size_t length, std::vector<uint16>* words) {
+    if (error_) return false;
+    if (num_partial_ != 0) {
+      // Finish the character left over from the last call.
+      const size_t needed = CharLength(partial_[0]);
+      while (num_partial_ < needed && length != 0) {
+        partial_[num_partial_++] = *utf8++;
+        --length;
+      }
+      if (num_partial_ < needed) return true;
+      num_partial_ = 0;
+      if (!Utf8ToUint16(partial_, needed, words)) return Fail();
+    }
+    // Hold back a trailing incomplete character, which can only be
+    // found in the last 2 bytes.
+    size_t complete = length;
+    for (size_t i = 1; i <= 2 && i <= length; ++i) {
+      const uint8 c = utf8[length - i];
+      if (c < kUtf8MoreBytesPrefix) break;
+      if (c >= kUtf8TwoBytePrefix) {
+        if (CharLength(c) > i) complete = length - i;
+        break;
+      }
+    }
+    if (!Utf8ToUint16(utf8, complete, words)) return Fail();
+    for (size_t i = complete; i < length; ++i) {
+      partial_[num_partial_++] = utf8[i];
+    }
+    return true;
+  }
+
+  // |true| if all the input so far was well formed, and did not end
+  // in the middle of a character.
+  bool at_boundary() const {
+    return !error_ && num_partial_ == 0;
+  }
+
+ private:
+  static size_t CharLength(uint8 lead) {
+    if (lead < kUtf8TwoBytePrefix) return 1;
+    return lead < kUtf8ThreeBytePrefix ? 2 : 3;
+  }
+
+  bool Fail() {
+    error_ = true;
+    return false;
+  }
+
+  char partial_[3];
+  size_t num_partial_;
+  bool error_;
+};
+
+// |Utf8ToUint16| for all of |input|, refilling it as it goes. Returns
+// |false| on malformed input, a read error, or input that ends in the
+// middle of a character.
+bool Utf8ToUint16(BufferedInput* input, std::vector<uint16>* words) {
+  Utf8Decoder decoder;
+  while (input->Refill() == kNoError) {
+    if (!decoder.Decode(input->cursor, input->end() - input->cursor,
+                        words)) {
+      return false;
+    }
+    input->cursor = input->end();
+  }
+  return input->error() == kEndOfFile && decoder.at_boundary();
+}
+
 }  // namespace webgl_loader
 
 #endif  // WEBGL_LOADER_UTF8_H_
@@ -0,0 +1,136 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_WELD_H_
+#define WEBGL_LOADER_WELD_H_
+
+#include <vector>
+
+#include "base.h"
+
+namespace webgl_loader {
+
+// |IndexFlattener| makes a vertex for each distinct triple of OBJ
+// indices, so exporters that repeat positions, texcoords or normals
+// for each face leave many vertices that are the same once quantized.
+// Those cost space on their own, and they also hide shared edges from
+// the connectivity coders. Welding maps each such vertex onto the
+// first one like it, before the vertex optimizer sees the triangles.
+
+// How far apart two vertices' quantized attribs can be, in quanta,
+// and still be welded. All zero welds only identical vertices, which
+// doesn't change what the decoder sees at all.
+struct WeldTolerances {
+  uint16 position;
+  uint16 texcoord;
+  uint16 normal;
+};
+
+// Whether |a| and |b| are within |tolerances| of each other.
+bool WithinWeldTolerances(const uint16* a, const uint16* b,
+                          const WeldTolerances& tolerances) {
+  for (size_t i = 0; i < 8; ++i) {
+    const int tolerance = (i < 3) ? tolerances.position :
+        (i < 5) ? tolerances.texcoord : tolerances.normal;
+    const int difference = static_cast<int>(a[i]) - b[i];
+    if (difference > tolerance || -difference > tolerance) return false;
+  }
+  return true;
+}
+
+// Of a cell of quantized positions.
+size_t CellHash(int x, int y, int z) {
+  return (static_cast<uint32>(x) * 73856093u) ^
+      (static_cast<uint32>(y) * 19349663u) ^
+      (static_cast<uint32>(z) * 83492791u);
+}
+
+// Fills |remap| with the vertex each vertex of |attribs| is welded to,
+// which is itself if it is kept. Returns the number of vertices that
+// are welded away.
+size_t FindWeldedVertices(const QuantizedAttribList& attribs,
+                          const WeldTolerances& tolerances,
+                          std::vector<int>* remap) {
+  const size_t num_verts = attribs.size() / 8;
+  remap->resize(num_verts);
+  // Kept vertices are hashed by a grid of cells one tolerance wide,
+  // so a vertex can only weld to those in the 27 cells around its
+  // own, or just its own cell if the tolerance is zero. Cells that
+  // collide share a chain, which costs only a compare.
+  const int cell_size = tolerances.position + 1;
+  const int reach = tolerances.position > 0 ? 1 : 0;
+  size_t num_buckets = 1;
+  while (num_buckets < 2 * num_verts) num_buckets <<= 1;
+  std::vector<int> heads(num_buckets, -1);
+  std::vector<int> next(num_verts, -1);
+  size_t num_welded = 0;
+  for (size_t v = 0; v < num_verts; ++v) {
+    const uint16* vertex = &attribs[8 * v];
+    int cell[3];
+    for (size_t j = 0; j < 3; ++j) {
+      cell[j] = vertex[j] / cell_size;
+    }
+    int found = -1;
+    for (int dx = -reach; dx <= reach && found < 0; ++dx) {
+      for (int dy = -reach; dy <= reach && found < 0; ++dy) {
+        for (int dz = -reach; dz <= reach && found < 0; ++dz) {
+          const size_t bucket = CellHash(cell[0] + dx, cell[1] + dy,
+                                         cell[2] + dz) & (num_buckets - 1);
+          for (int w = heads[bucket]; w >= 0; w = next[w]) {
+            if (WithinWeldTolerances(vertex, &attribs[8 * w], tolerances)) {
+              found = w;
+              break;
+            }
+          }
+        }
+      }
+    }
+    if (found >= 0) {
+      (*remap)[v] = found;
+      ++num_welded;
+    } else {
+      (*remap)[v] = static_cast<int>(v);
+      const size_t bucket =
+          CellHash(cell[0], cell[1], cell[2]) & (num_buckets - 1);
+      next[v] = heads[bucket];
+      heads[bucket] = static_cast<int>(v);
+    }
+  }
+  return num_welded;
+}
+
+// Appends the triangles |indices|[0, |length|) to |out| through
+// |remap|, except those that are degenerate after welding. Returns
+// the number dropped.
+size_t RemapTriangles(const std::vector<int>& remap, const int* indices,
+                      size_t length, IndexList* out) {
+  size_t num_dropped = 0;
+  for (size_t i = 0; i < length; i += 3) {
+    const int a = remap[indices[i]];
+    const int b = remap[indices[i + 1]];
+    const int c = remap[indices[i + 2]];
+    if (a == b || b == c || c == a) {
+      ++num_dropped;
+      continue;
+    }
+    out->push_back(a);
+    out->push_back(b);
+    out->push_back(c);
+  }
+  return num_dropped;
+}
+
+}  // namespace webgl_loader
+
+#endif  // WEBGL_LOADER_WELD_H_